@@ -181,6 +181,34 @@ stage2_entry:
 .mem_ok:
     mov dword [0x0506], 0xB0071AF0
 
+    ; Полная карта памяти E820 -> 0x0600 (до 32 записей по 24 байта),
+    ; число записей -> 0x050A. Без E820 ядро обходится данными E801.
+    xor ax, ax
+    mov es, ax
+    mov word [0x050A], 0
+    mov di, 0x0600
+    xor ebx, ebx
+.e820_next:
+    mov dword [es:di + 20], 1       ; Для BIOS, отдающих 20 байт: запись действительна
+    mov eax, 0xE820
+    mov ecx, 24
+    mov edx, 0x534D4150             ; 'SMAP'
+    int 0x15
+    jc .e820_done
+    cmp eax, 0x534D4150
+    jne .e820_done
+    jcxz .e820_skip
+    test byte [es:di + 20], 1       ; ACPI 3.0: бит 0 сброшен - запись игнорируется
+    jz .e820_skip
+    add di, 24
+    inc word [0x050A]
+    cmp word [0x050A], 32
+    jae .e820_done
+.e820_skip:
+    test ebx, ebx
+    jnz .e820_next
+.e820_done:
+
     mov ax, [0x0502]
     add ax, 1024
     call print_dec
@@ -24,10 +24,16 @@ x86_64-linux-gnu-g++ $CXXFLAGS -fno-stack-protector -c kernel/src/libc.cpp -o li
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/keyboard.cpp -o keyboard.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/thread.cpp -o thread.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/timer.cpp -o timer.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/lapic.cpp -o lapic.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/smp.cpp -o smp.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/fpu.cpp -o fpu.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/mailbox.cpp -o mailbox.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/sync_ipc.cpp -o sync_ipc.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/task_scheduler.cpp -o task_scheduler.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/event_channel.cpp -o event_channel.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/vmm.cpp -o vmm.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/cow.cpp -o cow.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/vma.cpp -o vma.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/tss.cpp -o tss.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/syscall_gate.cpp -o syscall_gate.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/usermode.cpp -o usermode.o
@@ -49,12 +55,14 @@ x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/bga.cpp -o bga.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/ahci.cpp -o ahci.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/disk.cpp -o disk.o
 x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/page_cache.cpp -o page_cache.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/zero_pool.cpp -o zero_pool.o
+x86_64-linux-gnu-g++ $CXXFLAGS -c kernel/src/memory_map.cpp -o memory_map.o
 
 echo "[4/5] Linking kernel..."
 x86_64-linux-gnu-ld -m elf_i386 -T kernel/linker.ld \
     kernel_entry.o interrupts.o switch_task.o \
     idt.o pic.o pmm.o kmalloc.o libc.o syscalls_posix.o \
-    keyboard.o thread.o timer.o task_scheduler.o event_channel.o vmm.o cow.o tss.o syscall_gate.o usermode.o ata.o vfs.o fat16.o elf_loader.o rtc.o pci.o memory_validator.o mouse.o bga.o ahci.o disk.o page_cache.o \
+    keyboard.o thread.o timer.o lapic.o smp.o fpu.o task_scheduler.o event_channel.o mailbox.o sync_ipc.o vmm.o vma.o cow.o tss.o syscall_gate.o usermode.o ata.o vfs.o fat16.o elf_loader.o rtc.o pci.o memory_validator.o mouse.o bga.o ahci.o disk.o page_cache.o zero_pool.o memory_map.o \
     shell.o shell_history.o shell_autocomplete.o shell_redirect.o vga.o selftest.o \
     kernel_main.o -o kernel.elf
 x86_64-linux-gnu-objcopy -O binary kernel.elf KERNEL.BIN
@@ -154,6 +162,42 @@ x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nos
 x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_forktest.o user_libc.a -o FORKTST.ELF
 mcopy -i data.img FORKTST.ELF ::/FORKTST.ELF
 
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/fault_bench.cpp -o user_fault_bench.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_fault_bench.o user_libc.a -o FAULTBM.ELF
+mcopy -i data.img FAULTBM.ELF ::/FAULTBM.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/touch_bench.cpp -o user_touch_bench.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_touch_bench.o user_libc.a -o TOUCHBM.ELF
+mcopy -i data.img TOUCHBM.ELF ::/TOUCHBM.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/seek_bench.cpp -o user_seek_bench.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_seek_bench.o user_libc.a -o SEEKBM.ELF
+mcopy -i data.img SEEKBM.ELF ::/SEEKBM.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/smp_bench.cpp -o user_smp_bench.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_smp_bench.o user_libc.a -o SMPBENCH.ELF
+mcopy -i data.img SMPBENCH.ELF ::/SMPBENCH.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/str_bench.cpp -o user_str_bench.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_str_bench.o user_libc.a -o STRBENCH.ELF
+mcopy -i data.img STRBENCH.ELF ::/STRBENCH.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/ipc_bench.cpp -o user_ipc_bench.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_ipc_bench.o user_libc.a -o IPCBENCH.ELF
+mcopy -i data.img IPCBENCH.ELF ::/IPCBENCH.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/ipc_sink.cpp -o user_ipc_sink.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_ipc_sink.o user_libc.a -o IPCSINK.ELF
+mcopy -i data.img IPCSINK.ELF ::/IPCSINK.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/ipc_rtt.cpp -o user_ipc_rtt.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_ipc_rtt.o user_libc.a -o IPCRTT.ELF
+mcopy -i data.img IPCRTT.ELF ::/IPCRTT.ELF
+
+x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/vma_bench.cpp -o user_vma_bench.o
+x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_vma_bench.o user_libc.a -o VMABENCH.ELF
+mcopy -i data.img VMABENCH.ELF ::/VMABENCH.ELF
+
 x86_64-linux-gnu-g++ -m32 -ffreestanding -fno-pie -fno-exceptions -fno-rtti -nostdlib -nostdinc -Iuser/libc/include -c user/fileio.cpp -o user_fileio.o
 x86_64-linux-gnu-ld -m elf_i386 -T user/user.ld user_crt0.o user_fileio.o user_libc.a -o FILEIO.ELF
 mcopy -i data.img FILEIO.ELF ::/FILEIO.ELF
@@ -5,9 +5,22 @@
 
 namespace re36 {
 
+struct WaitQueue;
+
 #define HBA_PORT_IPM_ACTIVE 1
 #define HBA_PORT_DET_PRESENT 3
 
+#define HBA_CAP_SNCQ      (1u << 30)  // Контроллер поддерживает NCQ
+#define HBA_GHC_IE        (1u << 1)   // Глобальное разрешение прерываний
+#define HBA_PxIS_DHRS     (1u << 0)   // Пришёл D2H Register FIS (обычная команда)
+#define HBA_PxIS_SDBS     (1u << 3)   // Пришёл Set Device Bits FIS (NCQ)
+#define HBA_PxIS_TFES     (1u << 30)  // Ошибка Task File
+#define HBA_PxIS_FATAL    0x78000000  // TFES, HBFS, HBDS, IFS: очередь остановлена
+
+#define AHCI_PRDT_MAX       24    // Записей PRDT на команду (таблица 512 байт)
+#define AHCI_CMD_TABLE_SIZE 512
+#define AHCI_MAX_SECTORS    128   // Секторов в одной команде (64 КБ)
+
 // Заголовок команды (32 байта)
 struct HBA_CMD_HEADER {
     uint8_t  cfl:5;    // Длина FIS в dwords (обычно 5)
@@ -41,7 +54,7 @@ struct HBA_CMD_TBL {
     uint8_t  cfis[64]; // Command FIS
     uint8_t  acmd[16]; // ATAPI command
     uint8_t  res[48];  // Reserved
-    HBA_PRDT_ENTRY prdt_entry[1]; // PRDT (We can have up to 65535, but we allocate dynamically or fix size)
+    HBA_PRDT_ENTRY prdt_entry[AHCI_PRDT_MAX]; // Scatter-gather: по записи на физически непрерывный кусок
 } __attribute__((packed));
 
 struct HBA_PORT {
@@ -114,18 +127,68 @@ struct FIS_REG_H2D {
 #define AHCI_DEV_PM 4
 #define AHCI_DEV_NULL 0
 
+enum class AhciStatus : uint8_t {
+    Pending,
+    Done,
+    Error
+};
+
+struct AhciRequest;
+// Вызывается из обработчика IRQ (прерывания запрещены) - только короткая работа
+typedef void (*AhciCallback)(AhciRequest* req);
+
+// Асинхронный запрос: заполняется вызывающим, живёт до завершения
+struct AhciRequest {
+    uint8_t  port;
+    bool     write;
+    uint64_t lba;
+    uint32_t count;           // Секторов, не больше AHCI_MAX_SECTORS
+    void*    buffer;          // Виртуальный адрес (должен оставаться отображённым)
+    AhciCallback callback;    // Может быть nullptr
+    void*    context;
+
+    volatile AhciStatus status;   // Заполняет драйвер
+    int      waiter_tid;          // Поток, спящий в wait()
+};
+
+struct AhciPortState {
+    HBA_PORT* regs;
+    bool     ncq;             // READ/WRITE FPDMA QUEUED
+    uint8_t  depth;           // Сколько слотов используем
+    uint32_t active;          // Выданные слоты
+    AhciRequest* reqs[32];
+};
+
+struct AhciStats {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t errors;
+    uint32_t irqs;
+    uint32_t max_inflight;    // Максимум одновременно выданных команд
+};
+
 class AHCIDriver {
 public:
     static void init();
     
-    // Read sectors from a specific port
-    static bool read(uint8_t port, uint64_t lba, uint32_t sector_count, void* buffer_phys);
-    
-    // Write sectors to a specific port
-    static bool write(uint8_t port, uint64_t lba, uint32_t sector_count, void* buffer_phys);
+    // Синхронное чтение/запись: крупные запросы режутся на команды по
+    // AHCI_MAX_SECTORS и выдаются в очередь разом. buffer - виртуальный адрес.
+    static bool read(uint8_t port, uint64_t lba, uint32_t sector_count, void* buffer);
+    static bool write(uint8_t port, uint64_t lba, uint32_t sector_count, void* buffer);
+
+    // Асинхронный API: submit ставит команду в свободный слот (ждёт слот,
+    // если все заняты), wait усыпляет поток до IRQ о завершении.
+    static bool submit(AhciRequest* req);
+    static bool wait(AhciRequest* req);
+
+    // Обработчик IRQ контроллера. true - разбужен хотя бы один поток.
+    static bool handle_interrupt();
+    static int get_irq();
 
     static bool is_present();
     static int get_primary_port();
+    static AhciStats get_stats();
+    static void print_info();
 
 private:
     static PCIDevice* find_ahci_controller();
@@ -133,9 +196,21 @@ private:
     static void port_rebase(HBA_PORT* port, int port_no);
     static void start_cmd(HBA_PORT* port);
     static void stop_cmd(HBA_PORT* port);
-    static int find_cmdslot(HBA_PORT* port);
+    static int find_cmdslot(AhciPortState& ps);
+
+    // IDENTIFY DEVICE опросом (при инициализации порта): NCQ и глубина очереди
+    static void identify(AhciPortState& ps, int port_no);
+    static bool build_command(AhciPortState& ps, int slot, AhciRequest* req);
+    // Завершить выполненные команды порта (из IRQ или опросом)
+    static bool complete_port(int port_no);
+    static bool finish(AhciPortState& ps, int slot, AhciStatus status);
+    static bool transfer(uint8_t port, bool write, uint64_t lba, uint32_t count, uint8_t* buffer);
 
     static HBA_MEM* abarz;
+    static AhciPortState ports_[32];
+    static AhciStats stats_;
+    static int irq_;
+    static WaitQueue slot_waiters_;   // Потоки, ждущие свободный слот
 };
 
 } // namespace re36
@@ -5,8 +5,11 @@
 
 namespace re36 {
 
+struct WaitQueue;
+
 #define ATA_PRIMARY_IO    0x1F0
 #define ATA_PRIMARY_CTRL  0x3F6
+#define ATA_IRQ           14
 
 #define ATA_REG_DATA      0
 #define ATA_REG_ERROR     1
@@ -18,31 +21,120 @@ namespace re36 {
 #define ATA_REG_STATUS    7
 #define ATA_REG_COMMAND   7
 
-#define ATA_CMD_READ_PIO  0x20
-#define ATA_CMD_WRITE_PIO 0x30
-#define ATA_CMD_IDENTIFY  0xEC
+#define ATA_CMD_READ_PIO           0x20
+#define ATA_CMD_READ_PIO_EXT       0x24
+#define ATA_CMD_READ_DMA_EXT       0x25
+#define ATA_CMD_READ_MULTIPLE_EXT  0x29
+#define ATA_CMD_WRITE_PIO          0x30
+#define ATA_CMD_WRITE_PIO_EXT      0x34
+#define ATA_CMD_WRITE_DMA_EXT      0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_READ_MULTIPLE      0xC4
+#define ATA_CMD_WRITE_MULTIPLE     0xC5
+#define ATA_CMD_SET_MULTIPLE       0xC6
+#define ATA_CMD_READ_DMA           0xC8
+#define ATA_CMD_WRITE_DMA          0xCA
+#define ATA_CMD_FLUSH              0xE7
+#define ATA_CMD_FLUSH_EXT          0xEA
+#define ATA_CMD_IDENTIFY           0xEC
 
 #define ATA_SR_BSY        0x80
 #define ATA_SR_DRDY       0x40
+#define ATA_SR_DF         0x20
 #define ATA_SR_DRQ        0x08
 #define ATA_SR_ERR        0x01
 
+#define ATA_CTRL_NIEN     0x02    // Запрет INTRQ устройства (PIO работает опросом)
+
+// Bus master IDE: BAR4 контроллера PCI класса 01:01, первичный канал
+#define ATA_BM_CMD        0
+#define ATA_BM_STATUS     2
+#define ATA_BM_PRDT       4
+#define ATA_BM_CMD_START  0x01
+#define ATA_BM_CMD_READ   0x08    // Направление: устройство -> память
+#define ATA_BM_SR_ERR     0x02
+#define ATA_BM_SR_IRQ     0x04
+
 #define ATA_SECTOR_SIZE   512
+#define ATA_MAX_SECTORS   256     // Секторов в одной команде (128 КБ)
+#define ATA_PRD_MAX       64      // Записей PRD: страницы буфера плюс границы 64 КБ
+#define ATA_PRD_EOT       0x8000
+#define ATA_LBA28_MAX     0x0FFFFFFF
+
+struct ATA_PRD {
+    uint32_t phys;
+    uint16_t bytes;               // 0 = 64 КБ
+    uint16_t flags;               // ATA_PRD_EOT у последней записи
+} __attribute__((packed));
+
+enum class AtaMode : uint8_t {
+    PIO,                          // READ/WRITE SECTORS, DRQ на каждый сектор
+    Multiple,                     // READ/WRITE MULTIPLE, DRQ на блок секторов
+    DMA                           // Bus master DMA, завершение по IRQ14
+};
+
+struct AtaStats {
+    uint32_t commands;
+    uint32_t dma_commands;
+    uint32_t sectors;
+    uint32_t irqs;
+    uint32_t errors;
+    uint32_t flushes;
+};
 
 class ATA {
 public:
+    // IDENTIFY, режим MULTIPLE, поиск bus master на шине PCI
+    // (вызывать после PCI::scan_bus)
     static bool init();
-    
-    static bool read_sectors(uint32_t lba, uint8_t count, void* buffer);
-    
-    static bool write_sectors(uint32_t lba, uint8_t count, const void* buffer);
-    
+
+    // Любое число секторов; команды режутся по ATA_MAX_SECTORS,
+    // за пределами 28 бит LBA используются команды EXT (LBA48)
+    static bool read_sectors(uint64_t lba, uint32_t count, void* buffer);
+
+    // Кэш записи диска не сбрасывается - для этого flush()
+    static bool write_sectors(uint64_t lba, uint32_t count, const void* buffer);
+
+    // Барьер: FLUSH CACHE, данные всех завершённых записей на носителе
+    static bool flush();
+
     static bool is_present();
 
+    // Обработчик IRQ14: завершение DMA, будит ждущий поток
+    static bool handle_interrupt();
+    static int get_irq();
+
+    // Лучший доступный режим выбирается в init(); можно понизить для сравнения
+    static bool set_mode(AtaMode mode);
+    static AtaMode get_mode();
+    static AtaStats get_stats();
+    static void print_info();
+
 private:
     static void wait_bsy();
     static void wait_drq();
+    // Канал выполняет одну команду за раз
+    static void acquire();
+    static void release();
+    static bool setup_command(uint64_t lba, uint32_t count, uint8_t cmd28, uint8_t cmd48);
+    static bool pio_transfer(bool write, uint64_t lba, uint32_t count, uint8_t* buffer);
+    static bool build_prdt(uint8_t* buffer, uint32_t bytes);
+    static bool dma_transfer(bool write, uint64_t lba, uint32_t count, uint8_t* buffer);
+    static bool transfer(bool write, uint64_t lba, uint32_t count, uint8_t* buffer);
+
     static bool present_;
+    static bool lba48_;
+    static uint64_t total_sectors_;
+    static uint16_t multiple_;            // Секторов на DRQ-блок (1 - без MULTIPLE)
+    static uint16_t bm_base_;             // 0 - bus master не найден
+    static ATA_PRD* prdt_;
+    static AtaMode mode_;
+    static volatile bool busy_;
+    static volatile bool irq_done_;
+    static volatile uint8_t bm_status_;
+    static volatile int waiter_tid_;
+    static WaitQueue waiters_;            // Потоки, ждущие канал
+    static AtaStats stats_;
 };
 
 } // namespace re36
@@ -8,11 +8,32 @@ struct BootInfo {
     uint16_t mem_below_16m_kb;
     uint16_t mem_above_16m_64kb;
     uint32_t magic;
+    uint16_t e820_count;         // Записей E820 по BOOT_E820_ADDR, 0 - BIOS не дал карту
 } __attribute__((packed));
 
+// Запись карты памяти INT 15h, EAX=E820h
+struct E820Entry {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi_attr;
+} __attribute__((packed));
+
+#define E820_USABLE      1
+#define E820_RESERVED    2
+#define E820_ACPI        3   // Таблицы ACPI, освобождаются после их разбора
+#define E820_ACPI_NVS    4
+#define E820_BAD         5
+
 #define BOOT_INFO_ADDR   0x0500
 #define BOOT_INFO_MAGIC  0xB0071AF0
+#define BOOT_E820_ADDR   0x0600
+#define BOOT_E820_MAX    32
 
 static inline BootInfo* get_boot_info() {
     return (BootInfo*)BOOT_INFO_ADDR;
 }
+
+static inline E820Entry* get_boot_e820() {
+    return (E820Entry*)BOOT_E820_ADDR;
+}
@@ -4,7 +4,34 @@
 
 namespace re36 {
 
+struct CowStats {
+    uint32_t tables_shared;     // Таблиц страниц, отданных fork без копирования
+    uint32_t tables_copied;     // Отделено при первой записи
+    uint32_t tables_reclaimed;  // Последний владелец забрал таблицу без копии
+};
+
+// Каталог для fork: таблицы пользователя общие с текущим (PDE_SHARED)
 uint32_t* cow_clone_directory();
 bool cow_handle_fault(uint32_t fault_addr, uint32_t error_code);
 
+// Своя копия общей таблицы pd_index в текущем каталоге перед изменением
+// её PTE. false - нет памяти на таблицу.
+bool cow_unshare_table(uint32_t pd_index);
+bool cow_unshare_range(uint32_t virt, uint32_t length);
+CowStats cow_get_stats();
+
+// Передача страниц по IPC (Mailbox), всё - в текущем адресном пространстве
+// Страница отображена и доступна из Ring 3
+bool cow_page_mapped(uint32_t virt);
+// Общий фрейм: у отправителя страница становится PAGE_COW, +1 ссылка
+uint32_t cow_share_page(uint32_t virt);
+// Снять отображение; ссылка на фрейм переходит вызывающему
+uint32_t cow_take_page(uint32_t virt);
+// Отобразить полученный фрейм: записываемым, если он больше ничей, иначе PAGE_COW
+void cow_map_page(uint32_t virt, uint32_t phys);
+
+// mprotect: разрешить или запретить запись в отображённую страницу.
+// Запрет снимает и PAGE_COW, иначе запись прошла бы через копию.
+void cow_protect_page(uint32_t virt, bool writable);
+
 } // namespace re36
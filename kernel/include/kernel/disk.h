@@ -5,11 +5,124 @@
 
 namespace re36 {
 
+// Блочный слой: очередь запросов на каждое устройство. Запросы
+// сортируются по LBA (C-SCAN с дедлайном против голодания), соседние
+// запросы одного направления сливаются в одну команду драйвера.
+#define BLOCK_MERGE_MAX_SECTORS 64     // Секторов в слитой команде (32 КБ)
+#define BLOCK_RUN_MAX           32     // Запросов в одной слитой команде
+#define BLOCK_BATCH             4      // Команд, выдаваемых драйверу разом (AHCI)
+#define BLOCK_DEADLINE_TICKS    50     // Запрос старше 0.5 с обслуживается вне очереди
+#define BLOCK_LATENCY_BUCKETS   8
+#define BLOCK_MAX_QUEUES        2
+
+#define BLOCK_PENDING  0
+#define BLOCK_DONE     1
+#define BLOCK_ERROR    2
+
+enum class BlockDriver : uint8_t {
+    AHCI,
+    ATA
+};
+
+struct BlockRequest {
+    uint64_t lba;
+    uint32_t count;
+    bool     write;
+    uint8_t* buffer;            // Память ядра (identity-mapped)
+
+    volatile uint8_t status;    // Заполняет очередь
+    int      waiter_tid;
+    uint64_t submit_tsc;
+    uint32_t submit_tick;
+    BlockRequest* next;
+};
+
+struct BlockQueueStats {
+    uint32_t requests;          // Принято запросов
+    uint32_t dispatches;        // Команд выдано драйверу
+    uint32_t merged;            // Запросов, слитых с соседним
+    uint32_t bypassed;          // Запросов мимо очереди (буфер вне памяти ядра)
+    uint32_t errors;
+    uint32_t depth;             // Запросов в очереди сейчас
+    uint32_t max_depth;
+    uint32_t sectors;
+    // Задержка от постановки до завершения, кило-тактов TSC:
+    // <16, <64, <256, <1K, <4K, <16K, <64K, больше
+    uint32_t latency[BLOCK_LATENCY_BUCKETS];
+};
+
+class BlockQueue {
+public:
+    void init(const char* name, BlockDriver driver, uint8_t port);
+
+    // Поставить запрос. Если очередь не заткнута и её никто не обслуживает,
+    // вызывающий поток сразу выполняет накопленное.
+    void submit(BlockRequest* req);
+    // Дождаться запроса (выполнить очередь самому или уснуть)
+    bool wait(BlockRequest* req);
+
+    // Синхронное чтение/запись через очередь
+    bool rw(bool write, uint64_t lba, uint32_t count, void* buffer);
+
+    // Пока очередь заткнута, запросы только копятся
+    void plug();
+    void unplug();
+
+    void set_merging(bool enabled) { merging_ = enabled; }
+    BlockQueueStats get_stats();
+    void reset_stats();
+    void print_stats();
+    const char* name() const { return name_; }
+    bool active() const { return active_; }
+
+private:
+    void insert(BlockRequest* req);
+    // Выбрать следующую команду: начало по C-SCAN (или просроченный
+    // запрос) и соседние запросы, слитые в неё. Вызывать под InterruptGuard.
+    BlockRequest* take_run(uint64_t* lba, uint32_t* sectors);
+    void dispatch();
+    bool driver_rw(bool write, uint64_t lba, uint32_t count, uint8_t* buffer);
+    void complete(BlockRequest* run, bool ok);
+
+    char name_[8];
+    bool active_;
+    BlockDriver driver_;
+    uint8_t port_;
+    bool merging_;
+    bool dispatching_;
+    uint32_t plugged_;
+    uint64_t head_lba_;          // Где остановилась головка (для C-SCAN)
+    BlockRequest* queue_;        // Отсортирован по LBA
+    uint8_t* merge_buffer_;      // BLOCK_BATCH буферов по BLOCK_MERGE_MAX_SECTORS
+    BlockQueueStats stats_;
+};
+
 class Disk {
 public:
+    // Очереди для найденных контроллеров (после AHCIDriver::init и ATA::init)
+    static void init();
+
     static bool is_present();
     static bool read_sectors(uint64_t lba, uint32_t count, void* buffer);
     static bool write_sectors(uint64_t lba, uint32_t count, const void* buffer);
+    // Сбросить кэш записи дисков (после sync ФС). Запись кэш не сбрасывает.
+    static bool flush();
+
+    // Очередь основного диска (AHCI, если есть, иначе ATA)
+    static BlockQueue* primary();
+    static BlockQueue* get_queue(int index);
+
+    static void print_stats();
+
+    // Нагрузка из одиночных секторов в перемешанном порядке со слиянием и
+    // без. Запись (теми же данными) - только на основном диске и только если
+    // writable: диапазон lba..lba+sectors должен быть свободен.
+    static void selftest(uint64_t lba, uint32_t sectors, bool writable);
+
+private:
+    static BlockQueue queues_[BLOCK_MAX_QUEUES];
+    static int queue_count_;
+    static BlockQueue* primary_;
 };
 
 } // namespace re36
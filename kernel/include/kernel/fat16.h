@@ -45,10 +45,43 @@ struct __attribute__((packed)) FAT16_DirEntry {
 #define FAT_ATTR_PROTECT_DELETE 0x80 // -gd
 #define FAT16_MAX_FAT_ENTRIES 32768
 #define FAT16_SECTOR_BUF_SIZE 512
+#define FAT16_IO_MAX_SECTORS  64   // Секторов в одной команде диска (32 КБ, кластер максимум)
+#define FAT16_FAT_SECTORS     (FAT16_MAX_FAT_ENTRIES * 2 / 512)
+#define FAT16_SYNC_INTERVAL   1000 // Период отложенного сброса FAT по умолчанию, мс
+#define FAT16_SYNC_PRIORITY   200
+
+// Непрерывный участок цепочки кластеров файла
+struct Fat16Extent {
+    uint32_t file_cluster;   // Номер кластера внутри файла
+    uint16_t disk_cluster;   // Первый кластер участка на диске
+    uint16_t count;          // Длина участка в кластерах
+};
 
 struct Fat16NodeData {
     char name[13];
     uint32_t parent_cluster;
+
+    // Где лежит запись каталога (dir_sector == 0 - ещё не известно)
+    uint32_t dir_sector;
+    int dir_index;
+
+    // Карта экстентов строится при первом чтении и сбрасывается при записи
+    Fat16Extent* extents;
+    uint32_t extent_count;
+
+    // Размер или первый кластер изменились - запись каталога обновится при закрытии
+    bool entry_dirty;
+
+    // Открытые vnode одной записи каталога общие: все дескрипторы файла
+    // видят один размер, первый кластер и конец цепочки
+    vnode* vn;
+    Fat16NodeData* next_open;
+    bool detached;            // Запись удалена или переписана - писать некуда
+};
+
+struct Fat16IoStats {
+    uint32_t sectors_read;      // Секторов прочитано с диска
+    uint32_t sectors_written;   // Секторов записано на диск
 };
 
 class Fat16 {
@@ -72,6 +105,9 @@ public:
     static int fat16_unlink(vnode* dir, const char* name);
     static int fat16_mkdir(vnode* dir, const char* name, int mode);
     static int fat16_rename(vnode* old_dir, const char* old_name, vnode* new_dir, const char* new_name);
+    static int fat16_readpage(vnode* vn, uint32_t index, uint8_t* page);
+    static int fat16_readpages(vnode* vn, uint32_t index, uint32_t count, uint8_t** pages);
+    static int fat16_truncate(vnode* vn, uint32_t size);
 
     // Old API (kept for internal use/transition)
     static int read_file(const char* name, uint8_t* buffer, uint32_t max_size);
@@ -80,10 +116,32 @@ public:
     static bool delete_file(const char* name);
     static void stat_file(const char* name);
     static bool is_mounted();
+
+    // Последовательная запись/чтение файла size байт: по сектору против
+    // цепочек кластеров одной командой (команда shell "fsbench")
+    static void benchmark(uint32_t size);
+    // count дописываний по chunk байт: запись по смещению против перезаписи
+    // файла целиком, объём дискового I/O (команда shell "appendbench")
+    static void bench_append(uint32_t count, uint32_t chunk);
+    // Тест блочной очереди (Disk::selftest) на секторах временного файла
+    // (команда shell "blktest")
+    static void bench_block(uint32_t sectors);
+    static Fat16IoStats get_io_stats() { return io_stats_; }
     static uint32_t root_dir_lba() { return root_dir_lba_; }
     
     static bool change_attributes(vnode* vn, uint8_t flag, bool set);
 
+    // Записать изменённые сектора FAT на диск (команда "sync", SYS_SYNC)
+    static void sync();
+    static int fat16_sync(superblock* sb);
+
+    // Период отложенного сброса FAT в мс; 0 - писать FAT сразу при каждом
+    // изменении. Поток "fatsync" запускается один раз из kernel_main.
+    static void set_sync_interval(uint32_t ms);
+    static uint32_t get_sync_interval() { return sync_interval_; }
+    static void start_sync_thread();
+    static uint32_t dirty_fat_sectors();
+
 
     static int find_dir_entry(uint32_t dir_cluster, const char* name, uint32_t* sector_out, int* index_out, uint32_t* prev_cluster_out = nullptr);
     static int find_free_dir_entry(uint32_t dir_cluster, uint32_t* sector_out, int* index_out, uint32_t* new_cluster_allocated = nullptr);
@@ -100,17 +158,74 @@ private:
     static uint8_t sector_cache_[FAT16_SECTOR_BUF_SIZE];
     static uint32_t cached_sector_;
     static uint8_t* dma_buffer_;
+    static uint8_t* io_buffer_;      // Промежуточный буфер FAT16_IO_MAX_SECTORS секторов
+    static uint32_t alloc_hint_;     // С какого кластера искать свободный
+    static KmemCache* node_cache_;
+    static Fat16NodeData* open_nodes_;
+
+    // Битмап изменённых секторов FAT (пишутся только они)
+    static uint32_t fat_dirty_[FAT16_FAT_SECTORS / 32];
+    static uint32_t sync_interval_;
+    static Fat16IoStats io_stats_;
+
+    // Смонтированный суперблок и vnode устройства для буферного кэша
+    static superblock* sb_;
+    static vnode bdev_vnode_;
     
     static bool read_cached_sector(uint32_t lba);
+
+    // Чтение/запись сектора метаданных через кэш страниц (write-through)
+    static bool read_sector(uint32_t lba, uint8_t* buffer);
+    static bool write_sector(uint32_t lba, const uint8_t* buffer);
+    static int fat16_read_block_page(vnode* vn, uint32_t index, uint8_t* page);
+
+    // Чтение/запись count подряд идущих секторов минимумом команд диска.
+    // Буфер в identity-mapped памяти ядра отдаётся контроллеру напрямую,
+    // остальные (память процесса) идут через io_buffer_.
+    static bool read_run(uint32_t lba, uint32_t count, uint8_t* buffer);
+    static bool write_run(uint32_t lba, uint32_t count, const uint8_t* buffer);
+    // Записать size байт в count кластеров подряд, начиная с cluster
+    static void write_cluster_run(uint16_t cluster, uint32_t count, const uint8_t* data, uint32_t size);
     static uint32_t cluster_to_lba(uint16_t cluster);
     static bool match_filename(const FAT16_DirEntry* entry, const char* name);
     static uint16_t alloc_cluster();
     static void free_chain(uint16_t start_cluster);
     static void flush_fat();
+    // Изменить запись FAT и пометить её сектор
+    static void set_fat(uint32_t cluster, uint16_t value);
+    // FAT изменена: сбросить сразу или оставить потоку "fatsync"
+    static void fat_changed();
+    static void sync_thread();
     static void format_83_name(const char* name, char* out);
+
+    // Найти запись каталога файла (по сохранённому положению, если оно ещё верно)
+    static bool locate_entry(Fat16NodeData* nd, uint32_t* sector_out, int* index_out);
+
+    // Открытый узел записи каталога (sector, index) или nullptr
+    static Fat16NodeData* find_open_node(uint32_t sector, int index);
+    static void unlink_open_node(Fat16NodeData* nd);
+    // Запись удалена: открытые дескрипторы больше не пишут в её кластеры
+    static void detach_open_node(uint32_t sector, int index);
+    // Отложенный размер открытого файла - в запись каталога до её копирования
+    static void flush_open_node(uint32_t sector, int index);
+
+    // Карта экстентов: построить / сбросить / перевести номер кластера файла
+    // в кластер диска за O(log extents). contiguous - сколько кластеров подряд
+    // идут на диске начиная с найденного.
+    static bool build_extents(vnode* vn);
+    static void drop_extents(Fat16NodeData* nd);
+    static uint16_t map_cluster(Fat16NodeData* nd, uint32_t file_cluster, uint32_t* contiguous);
+
+    // Запись по смещению: дорастить цепочку до end байт, записать диапазон
+    // на место (data == nullptr - нули), обновить запись каталога
+    static bool extend_chain(vnode* vn, Fat16NodeData* nd, uint32_t end);
+    static bool write_range(vnode* vn, Fat16NodeData* nd, uint32_t offset, const uint8_t* data, uint32_t size);
+    static bool update_entry(vnode* vn);
+    static bool is_write_protected(Fat16NodeData* nd);
     
     // VFS static operations and structures
     static vnode_operations fat16_vnode_ops;
+    static vnode_operations fat16_bdev_ops;
 };
 
 // Global VFS driver instance for FAT16
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace re36 {
+
+#define FPU_STATE_SIZE  512      // Область FXSAVE (FNSAVE занимает 108 байт)
+#define FPU_NO_CPU      0xFF     // Состояние потока не загружено ни в один FPU
+
+struct FpuStats {
+    uint32_t traps;              // #NM: первое обращение к FPU после переключения
+    uint32_t saves;              // FXSAVE чужого состояния
+    uint32_t restores;           // FXRSTOR состояния потока
+    uint32_t allocs;             // Областей, выделенных при первом использовании
+};
+
+// Ленивое переключение x87/MMX/SSE. switch_task сохраняет только целые
+// регистры; при переключении взводится CR0.TS, и первая инструкция FPU
+// нового потока даёт #NM. Обработчик сохраняет состояние прежнего
+// владельца регистров и загружает своё. Поток, не трогающий FPU, не платит
+// ничего, а вернувшийся на процессор владелец - тоже: TS для него снимается
+// сразу. На SMP поток может уйти на другой процессор, поэтому состояние
+// использовавшего FPU потока сохраняется при уходе с процессора.
+class Fpu {
+public:
+    // CPUID, CR0 (MP, NE, TS) и CR4 (OSFXSR, OSXMMEXCPT), исходный образ
+    // состояния. Вызывать на BSP до первого использования SSE ядром.
+    static void init();
+    // Те же биты CR0/CR4 на AP
+    static void init_ap();
+
+    static bool has_fxsr();
+    static bool has_sse2();
+
+    // Из TaskScheduler::switch_to перед switch_task
+    static void switch_to(int prev_tid, int next_tid);
+    // Исключение #NM (вектор 7)
+    static void handle_trap();
+
+    // Копия состояния родителя для fork. false - нет памяти.
+    static bool fork_state(int parent_tid, int child_tid);
+    // exec и освобождение слота: область возвращается в кэш, следующее
+    // обращение к FPU начнётся с исходного состояния
+    static void release(int tid);
+
+    static FpuStats get_stats();
+    static void print_info();
+
+private:
+    static void setup_cpu();
+    static void save(void* area);
+    static void restore(const void* area);
+    static bool ts_set();
+    static void set_ts();
+    static void clear_ts();
+
+    static bool fxsr_;
+    static bool sse_;
+    static bool sse2_;
+    static FpuStats stats_;
+};
+
+} // namespace re36
@@ -30,5 +30,7 @@ struct Registers {
 // Инициализация IDT
 void init_idt();
 void set_idt_gate(int n, uint32_t handler, uint16_t selector, uint8_t flags);
+// Загрузить заполненную IDT на запущенном AP
+void reload_idt();
 
 } // namespace re36
@@ -5,6 +5,8 @@
 
 namespace re36 {
 
+struct WaitQueue;
+
 // Структура для представления нажатия клавиши
 struct KeyEvent {
     char ascii;          // Раскодированный ASCII символ ('A', '1', ' ' и т.д.)
@@ -16,8 +18,9 @@ class KeyboardDriver {
 public:
     static void init();
 
-    // Вызывается из idt.cpp при каждом прерывании IRQ1 (IRQ 33)
-    static void handle_interrupt();
+    // Вызывается из idt.cpp при каждом прерывании IRQ1 (IRQ 33).
+    // true, если разбужен поток, ждущий символ.
+    static bool handle_interrupt();
 
     // Блокирующее чтение символа из буфера (ждет нажатия)
     static char get_char();
@@ -48,6 +51,7 @@ private:
     static int buffer_head_;
     static int buffer_tail_;
     static bool extended_key_;
+    static WaitQueue readers_;           // Потоки в get_char
 };
 
 } // namespace re36
@@ -5,15 +5,54 @@
 
 namespace re36 {
 
-// Инициализация кучи (heap) ядра.
+// Slab-аллокатор: каждый слаб - один фрейм PMM, в начале которого лежит
+// заголовок Slab, а за ним - объекты одного размера.
+#define KMEM_MAX_CACHES     24
+#define KMEM_NAME_LEN       16
+#define KMEM_MIN_CLASS      8
+#define KMEM_MAX_CLASS      1024   // Больше - выделяется целыми фреймами
+
+struct Slab;
+
+struct KmemCache {
+    char name[KMEM_NAME_LEN];
+    uint32_t obj_size;         // Размер объекта с выравниванием
+    uint32_t objs_per_slab;
+
+    Slab* partial;             // Есть и занятые, и свободные объекты
+    Slab* full;                // Все объекты заняты
+    Slab* empty;               // Все объекты свободны
+    uint32_t empty_count;
+
+    // Статистика
+    uint32_t hits;             // Выделение из уже имеющегося слаба
+    uint32_t misses;           // Пришлось брать новый фрейм у PMM
+    uint32_t frees;
+    uint32_t active_objs;
+    uint32_t slab_count;
+    uint32_t slabs_released;   // Пустые слабы, возвращённые PMM
+};
+
+// Инициализация кучи (heap) ядра: создаёт кэши размеров 8..1024 байт.
 void kmalloc_init();
 
 // Выделить блок памяти заданного размера (в байтах)
 void* kmalloc(size_t size);
 
-// Освободить ранее выделенный блок
+// Освободить ранее выделенный блок (kmalloc или kmem_cache_alloc). O(1)
 void kfree(void* ptr);
 
+// Кэш объектов фиксированного размера (VMA, file, vnode, ...)
+KmemCache* kmem_cache_create(const char* name, size_t obj_size);
+void* kmem_cache_alloc(KmemCache* cache);
+void kmem_cache_free(KmemCache* cache, void* ptr);
+
+// Вернуть все пустые слабы всех кэшей в PMM. Возвращает число фреймов.
+uint32_t kmem_reclaim();
+
+// Печать статистики кэшей (команда shell "slabinfo")
+void kmem_print_stats();
+
 } // namespace re36
 
 // --- Глобальные C++ операторы (требуются для работы классов, vector, string и т.д.) ---
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace re36 {
+
+#define LAPIC_DEFAULT_BASE     0xFEE00000
+
+#define LAPIC_REG_ID           0x020
+#define LAPIC_REG_VERSION      0x030
+#define LAPIC_REG_TPR          0x080
+#define LAPIC_REG_EOI          0x0B0
+#define LAPIC_REG_SVR          0x0F0
+#define LAPIC_REG_ICR_LOW      0x300
+#define LAPIC_REG_ICR_HIGH     0x310
+#define LAPIC_REG_LVT_TIMER    0x320
+#define LAPIC_REG_TIMER_INIT   0x380
+#define LAPIC_REG_TIMER_CUR    0x390
+#define LAPIC_REG_TIMER_DIV    0x3E0
+
+#define LAPIC_SVR_ENABLE       0x100
+#define LAPIC_LVT_MASKED       0x10000
+#define LAPIC_TIMER_ONESHOT    0x00000
+#define LAPIC_TIMER_DEADLINE   0x40000   // Режим TSC-deadline (CPUID.1:ECX[24])
+#define LAPIC_TIMER_DIV_16     0x3
+
+// Межпроцессорные прерывания (ICR)
+#define LAPIC_ICR_INIT         0x00500
+#define LAPIC_ICR_STARTUP      0x00600
+#define LAPIC_ICR_PENDING      0x01000   // Delivery status: ещё не принято
+#define LAPIC_ICR_ASSERT       0x04000
+
+// Векторы IDT вне диапазона PIC (32-47)
+#define LAPIC_TIMER_VECTOR     64
+#define LAPIC_SPURIOUS_VECTOR  255
+
+#define MSR_APIC_BASE          0x1B
+#define MSR_APIC_BASE_ENABLE   0x800
+#define MSR_TSC_DEADLINE       0x6E0
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" :: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// Локальный APIC процессора. Внешние прерывания по-прежнему идут через
+// 8259 PIC (LINT0 в режиме virtual wire) только на BSP, от APIC
+// используются таймер и межпроцессорные прерывания.
+class LocalApic {
+public:
+    // CPUID, отображение регистров (вызывать после VMM::init)
+    static bool init();
+    // Включить APIC запущенного AP (регистры уже отображены BSP)
+    static void init_ap();
+    static bool is_present();
+    static bool has_tsc_deadline();
+
+    static uint32_t read(uint32_t reg);
+    static void write(uint32_t reg, uint32_t value);
+    static void eoi();
+    static uint32_t id();
+    // Послать IPI и дождаться, пока APIC его примет
+    static void send_ipi(uint8_t dest_id, uint32_t icr_low);
+
+private:
+    static void setup();
+
+    static volatile uint32_t* base_;
+    static bool tsc_deadline_;
+};
+
+} // namespace re36
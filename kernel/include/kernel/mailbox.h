@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace re36 {
+
+// Очереди получателя - списки: память берётся из slab-кэшей по мере
+// прихода сообщений, а предел только ограничивает отставшего получателя
+#define IPC_MSG_QUEUE_MAX    64
+#define IPC_GRANT_QUEUE_MAX  64
+#define IPC_GRANT_MAX_PAGES  256      // 1 МБ за одну передачу
+
+// Режим передачи страниц
+#define IPC_GRANT_MOVE  0             // Страницы уходят из адресного пространства отправителя
+#define IPC_GRANT_COW   1             // Общие у обоих до первой записи (PAGE_COW)
+
+// Передача страниц: фреймы со ссылками, которые получатель отобразит к себе
+struct IpcGrant {
+    int sender_tid;
+    uint32_t pages;
+    uint32_t tag;                     // Произвольное слово отправителя
+    uint32_t* frames;                 // kmalloc, pages физических адресов
+    IpcGrant* next;
+};
+
+struct IpcStats {
+    uint32_t msgs;                    // Сообщений с копированием
+    uint32_t msg_bytes;
+    uint32_t grants;
+    uint32_t pages_moved;
+    uint32_t pages_shared;
+    uint32_t queue_full;              // Отказов из-за переполненной очереди
+};
+
+// Почтовый ящик потока для обмена пользовательских драйверов. Короткие
+// сообщения (до IPC_MAX_MSG_SIZE) копируются через буфер ядра; большие
+// данные передаются целыми страницами без копирования: фрейм переходит
+// получателю (MOVE) или отображается у обоих с PAGE_COW, как после fork.
+class Mailbox {
+public:
+    // 0 или -1 (нет получателя, очередь полна, нет памяти)
+    static int send(int target_tid, const void* data, uint32_t size);
+    // Блокирует до сообщения; возвращает число скопированных байт
+    static int recv(int* sender_out, void* buffer, uint32_t max_size);
+
+    // pages страниц текущего адресного пространства с адреса vaddr; все
+    // должны быть отображены. 0 или -1.
+    static int send_grant(int target_tid, uint32_t vaddr, uint32_t pages,
+                          uint32_t mode, uint32_t tag);
+    // Блокирует до передачи и отображает страницы в свободную область
+    // (анонимная VMA, освобождается munmap). Адрес или 0.
+    static uint32_t recv_grant(int* sender_out, uint32_t* tag_out, uint32_t* pages_out);
+
+    // Очереди завершённого потока (thread_cleanup)
+    static void release(int tid);
+
+    static IpcStats get_stats();
+    static void print_info();
+
+private:
+    static void wake(int tid);
+    static void free_grant(IpcGrant* g, bool drop_frames);
+
+    static IpcStats stats_;
+};
+
+} // namespace re36
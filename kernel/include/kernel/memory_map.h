@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace re36 {
+
+#define MEMMAP_MAX_REGIONS 32
+
+struct MemoryRegion {
+    uint64_t base;
+    uint64_t end;
+    uint32_t type;       // E820_*
+};
+
+// Карта физической памяти от загрузчика (E820, без неё - E801).
+// Регионы отсортированы по base. PMM и тождественное отображение ядра
+// охватывают память ниже KERNEL_SPACE_END; RAM выше не используется.
+class MemoryMap {
+public:
+    static void init();
+
+    // Граница памяти под управлением PMM: конец последнего доступного
+    // региона, не выше KERNEL_SPACE_END
+    static uint32_t get_managed_end() { return managed_end_; }
+
+    // Отдать PMM доступные регионы начиная с from (метаданные PMM - ниже)
+    static void release_usable(uint32_t from);
+
+    // Вся доступная RAM и та её часть, что выше KERNEL_SPACE_END (КБ)
+    static uint32_t get_usable_kb() { return usable_kb_; }
+    static uint32_t get_unmanaged_kb() { return unmanaged_kb_; }
+    static bool from_e820() { return from_e820_; }
+
+    static void print();
+
+private:
+    static void add(uint64_t base, uint64_t length, uint32_t type);
+
+    static MemoryRegion regions_[MEMMAP_MAX_REGIONS];
+    static uint32_t count_;
+    static uint32_t managed_end_;
+    static uint32_t usable_kb_;
+    static uint32_t unmanaged_kb_;
+    static bool from_e820_;
+};
+
+} // namespace re36
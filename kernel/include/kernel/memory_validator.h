@@ -13,6 +13,16 @@ public:
     static bool test_pmm();
     static bool test_vmm();
 
+    // Замер задержки alloc_frame/alloc_blocks при разной заполненности памяти
+    static void bench_pmm();
+
+    // Пропускная способность копирования/обнуления страниц (МБ/с)
+    static void bench_memcpy();
+
+    // Обход памяти ядра после каждой перезагрузки CR3: страницы 4 КБ,
+    // 4 МБ и глобальные 4 МБ (тактов на страницу)
+    static void bench_tlb();
+
 private:
     static bool test_heap();
 };
@@ -5,26 +5,110 @@
 namespace re36 {
 
 struct vnode;
+struct superblock;
+struct FileReadahead;
 
-#define PAGE_CACHE_SIZE 256
+// Единый кэш страниц: страницы файлов (ключ - суперблок, inode, номер
+// страницы) и блоки устройства (inode = PAGE_CACHE_BDEV_INODE, номер
+// страницы = LBA / 8). Каждый фрейм кэша держит одну ссылку в PMM;
+// отображённые в процессы страницы держат свои. Вытеснение - по LRU, при
+// превышении лимита или по запросу PMM при нехватке памяти.
+#define PAGE_CACHE_BUCKETS      512
+#define PAGE_CACHE_MIN_PAGES    64
+#define PAGE_CACHE_BDEV_INODE   0xFFFFFFFF
+#define PAGE_CACHE_SECTORS      8    // Секторов по 512 байт в странице
+
+// Упреждающее чтение: окно растёт вдвое при каждом подходе к его концу,
+// пока доступ последовательный; случайный доступ окно сбрасывает
+#define PAGE_CACHE_RA_MIN       4    // Начальное окно, страниц
+#define PAGE_CACHE_RA_MAX       32   // Наибольшее окно (128 КБ)
+#define PAGE_CACHE_FAULT_AROUND 16   // Выровненный блок страниц, отображаемых за один сбой
 
 struct PageCacheEntry {
+    superblock* sb;
     uint32_t inode;
-    uint32_t offset;
+    uint32_t index;          // Номер страницы в файле (или LBA / 8)
     uint32_t phys_frame;
-    bool     valid;
+    bool readahead;          // Прочитана заранее и ещё не запрошена
+
+    PageCacheEntry* hash_next;
+    PageCacheEntry* lru_prev;    // Ближе к голове - недавно использованные
+    PageCacheEntry* lru_next;
+};
+
+struct PageCacheStats {
+    uint32_t pages;          // Страниц в кэше
+    uint32_t max_pages;      // Лимит
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;      // Вытеснено по LRU
+    uint32_t invalidations;  // Сброшено при изменении файла
+    uint32_t readahead;      // Страниц прочитано заранее
+    uint32_t ra_hits;        // Из них понадобилось
+    uint32_t mapped_around;  // Страниц отображено соседними со сбоем (fault-around)
 };
 
 class PageCache {
 public:
+    // Лимит - четверть свободной на момент вызова памяти (нужны PMM и kmalloc)
     static void init();
-    static uint32_t lookup(uint32_t inode, uint32_t offset);
-    static void insert(uint32_t inode, uint32_t offset, uint32_t phys_frame);
-    static void invalidate(uint32_t inode);
+
+    // Страница (sb, inode, index), при промахе читается через
+    // vn->ops->readpage. Возвращает физический адрес фрейма с добавленной
+    // ссылкой для вызывающего (освобождать через PMM::free_frame) или 0.
+    static uint32_t get_page(vnode* vn, uint32_t index);
+
+    // Страница, только если она уже в кэше (без чтения с диска), со ссылкой
+    // для вызывающего; для fault-around
+    static uint32_t lookup(vnode* vn, uint32_t index);
+
+    // Отметить доступ к страницам [index, index + count) и при
+    // последовательном доступе прочитать окно вперёд одной пачкой
+    static void readahead(vnode* vn, FileReadahead* ra, uint32_t index, uint32_t count);
+
+    // Чтение файла через кэш (основа fat16_read и sys_fread). С ra
+    // учитывается последовательный доступ к открытому файлу.
+    static int read(vnode* vn, uint32_t offset, uint8_t* buffer, uint32_t size,
+                    FileReadahead* ra = nullptr);
+
+    // Обновить закэшированную страницу при записи в обход кэша (write-through)
+    static void update(superblock* sb, uint32_t inode, uint32_t index,
+                       uint32_t offset, const uint8_t* data, uint32_t size);
+
+    // Сбросить все страницы файла
+    static void invalidate(superblock* sb, uint32_t inode);
+
+    // Вытеснить до count самых давно использованных страниц. Возвращает,
+    // сколько фреймов реально вернулось в PMM.
+    static uint32_t shrink(uint32_t count);
+
+    static PageCacheStats get_stats();
+
+    static void set_readahead(bool enabled) { readahead_enabled_ = enabled; }
+    static bool readahead_enabled() { return readahead_enabled_; }
+
+    // Холодная загрузка файла так, как её делает подкачка по требованию,
+    // без упреждения и fault-around и с ними (команда shell "rabench")
+    static void bench_readahead(vnode* vn);
 
 private:
-    static PageCacheEntry entries_[PAGE_CACHE_SIZE];
-    static uint32_t hash(uint32_t inode, uint32_t offset);
+    static uint32_t hash(superblock* sb, uint32_t inode, uint32_t index);
+    static PageCacheEntry* find(superblock* sb, uint32_t inode, uint32_t index);
+    static void lru_unlink(PageCacheEntry* e);
+    static void lru_push_front(PageCacheEntry* e);
+    static void remove(PageCacheEntry* e);
+    // Добавить прочитанный фрейм (вызывать под InterruptGuard). Если страницу
+    // уже загрузил другой поток, фрейм освобождается и возвращается имеющаяся.
+    static PageCacheEntry* insert(vnode* vn, uint32_t index, void* frame, bool readahead);
+    // Прочитать отсутствующие в кэше страницы [start, start + count) пачками
+    // подряд идущих; страницы от ahead_from помечаются как упреждающие
+    static void fill(vnode* vn, uint32_t start, uint32_t count, uint32_t ahead_from);
+
+    static PageCacheEntry* buckets_[PAGE_CACHE_BUCKETS];
+    static PageCacheEntry* lru_head_;
+    static PageCacheEntry* lru_tail_;
+    static PageCacheStats stats_;
+    static bool readahead_enabled_;
 };
 
 } // namespace re36
@@ -13,6 +13,12 @@ void pic_remap(int offset1 = 0x20, int offset2 = 0x28);
 // чтобы контроллер знал, что мы обработали прерывание и готов слать новые
 void pic_send_eoi(uint8_t irq);
 
+// Разрешить линию IRQ в маске PIC (для IRQ 8-15 - ещё и каскад IRQ2)
+void pic_unmask(uint8_t irq);
+
+// Запретить линию IRQ в маске PIC
+void pic_mask(uint8_t irq);
+
 // Базовые функции для общения с I/O портами x86
 static inline void outb(uint16_t port, uint8_t val) {
     asm volatile ( "outb %0, %1" : : "a"(val), "Nd"(port) );
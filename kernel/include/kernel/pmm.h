@@ -12,52 +12,155 @@ namespace re36 {
 #define PMM_BITMAP_INDEX(a) (a / 32)
 #define PMM_BITMAP_OFFSET(a) (a % 32)
 
+// Buddy-аллокатор: максимальный порядок блока (2^10 фреймов = 4 МБ)
+#define PMM_MAX_ORDER 10
+#define PMM_NO_FRAME  0xFFFFFFFF
+#define PMM_NO_ORDER  0xFF
+
+// Магазин свободных фреймов перед buddy: пополняется и сбрасывается пачками
+#define PMM_MAGAZINE_BATCH 32
+#define PMM_MAGAZINE_SIZE  (PMM_MAGAZINE_BATCH * 2)
+
+// Page::flags
+#define PG_DIRTY   0x01   // Изменён и ещё не записан на диск
+#define PG_LOCKED  0x02   // Идёт ввод-вывод в фрейм
+#define PG_CACHED  0x04   // Принадлежит кэшу страниц (owner - PageCacheEntry)
+#define PG_ZEROED  0x08   // Обнулён и лежит в ZeroPool
+
+// Дескриптор физического фрейма (аналог struct page). Поля next/prev/order
+// нужны buddy-аллокатору, пока фрейм свободен; остальные - пока он выдан.
+struct Page {
+    uint32_t refcount;   // Ссылок на фрейм; 0 - свободен
+    uint32_t mapcount;   // PTE пользователя на фрейм (общая после fork таблица - одна)
+    uint32_t next;       // Списки свободных блоков
+    uint32_t prev;
+    uint8_t  order;      // Порядок, если фрейм - голова свободного блока, иначе PMM_NO_ORDER
+    uint8_t  flags;      // PG_*
+    uint16_t reserved;
+    void*    owner;      // Для обратного отображения: чей фрейм (при PG_CACHED)
+    uint32_t index;      // Номер страницы у владельца
+};
+
+struct PageStats {
+    uint32_t shared;         // Фреймов больше чем с одной ссылкой
+    uint32_t max_refcount;
+    uint32_t mapped;         // Отображены в процессы
+    uint32_t cached;
+    uint32_t zeroed;
+    uint32_t locked;
+    uint32_t dirty;
+};
+
+struct PmmCacheStats {
+    uint32_t cached;    // Фреймов сейчас в магазине
+    uint32_t hits;      // alloc_frame обслужен без обращения к buddy
+    uint32_t refills;   // Пополнений пачкой из buddy
+    uint32_t drains;    // Сбросов пачкой обратно в buddy
+};
+
+// Освобождает до count фреймов из кэшей (page cache и т.п.), возвращает
+// сколько фреймов реально вернулось в PMM
+typedef uint32_t (*PmmReclaimHook)(uint32_t count);
+
 class PhysicalMemoryManager {
 public:
-    // Инициализация PMM. 
-    // bitmap_addr - физический адрес, где будет лежать сам битмап (массив).
+    // Инициализация PMM.
+    // bitmap_addr - физический адрес, где будут лежать метаданные (битмап,
+    //               счётчики ссылок и списки buddy-аллокатора).
     // memory_size - общий размер доступной ОЗУ в байтах (напр. 32 МБ).
     static void init(uint32_t bitmap_addr, uint32_t memory_size);
 
+    // Сколько байт метаданных PMM занимает для memory_size байт ОЗУ
+    static uint32_t get_metadata_size(uint32_t memory_size);
+
     // Помечает регион памяти (size байт) как занятый или свободный
     static void set_region_free(uint32_t base, uint32_t size);
     static void set_region_used(uint32_t base, uint32_t size);
 
-    // Выделяет первый попавшийся свободный фрейм (4 КБ) и возвращает его физический адрес
+    // Выделяет свободный фрейм (4 КБ) и возвращает его физический адрес. O(log n)
     static void* alloc_frame();
-    
-    // Выделяет непрерывный блок из count фреймов и возвращает физический адрес
+
+    // Выделяет непрерывный блок из count фреймов и возвращает физический адрес. O(log n)
     static void* alloc_blocks(uint32_t count);
-    
-    // Освобождает фрейм по физическому адресу
+
+    // Освобождает фрейм по физическому адресу (со слиянием buddy). O(log n)
     static void free_frame(void* frame_addr);
 
     static void inc_ref(uint32_t phys_addr);
     static void dec_ref(uint32_t phys_addr);
-    static uint8_t get_refcount(uint32_t phys_addr);
+    static uint32_t get_refcount(uint32_t phys_addr);
+
+    // Дескриптор фрейма; nullptr - адрес вне учтённой памяти (MMIO)
+    static Page* get_page(uint32_t phys_addr);
+    // PTE пользователя поставлена на фрейм / снята (VMM, CoW)
+    static void inc_mapcount(uint32_t phys_addr);
+    static void dec_mapcount(uint32_t phys_addr);
+    // Сводка по всем дескрипторам (для meminfo)
+    static PageStats get_page_stats();
 
+    static uint32_t get_memory_size() { return max_frames_ * PMM_FRAME_SIZE; }
     static uint32_t get_free_memory();
     static uint32_t get_used_memory();
 
+    // Количество свободных блоков заданного порядка (для диагностики)
+    static uint32_t get_free_block_count(uint32_t order);
+
+    // Вернуть все фреймы из магазина в buddy (нужно перед выделением
+    // больших непрерывных блоков или резервированием регионов)
+    static void drain_frame_cache();
+    static PmmCacheStats get_cache_stats();
+
+    // Вызывается, когда свободные фреймы закончились (давление на память)
+    static void set_reclaim_hook(PmmReclaimHook hook);
+
 private:
     // Установить / Сбросить бит (занять/освободить фрейм)
     static inline void set_frame(uint32_t frame);
     static inline void clear_frame(uint32_t frame);
-    
+
     // Проверить, занят ли бит
     static inline bool test_frame(uint32_t frame);
 
-    // Найти первый свободный фрейм (index)
-    static uint32_t get_first_free_frame();
-    
-    // Найти последовательность из count свободных фреймов
-    static uint32_t get_free_blocks(uint32_t count);
+    // Списки свободных блоков по порядкам
+    static void list_push(uint32_t frame, uint32_t order);
+    static void list_remove(uint32_t frame, uint32_t order);
+
+    // Выданный фрейм: одна ссылка, без отображений, флагов и владельца
+    static inline void reset_page(uint32_t frame);
+
+    // Выделить блок из 2^order фреймов, вернуть индекс первого фрейма
+    static uint32_t alloc_order(uint32_t order);
+
+    // Вернуть блок 2^order фреймов в списки (со слиянием соседей)
+    static void free_order(uint32_t frame, uint32_t order);
+
+    // Вернуть произвольный диапазон фреймов, разбивая его на выровненные блоки
+    static void free_range(uint32_t frame, uint32_t count);
+
+    // Изъять один свободный фрейм из его buddy-блока
+    static void reserve_frame(uint32_t frame);
+
+    // Пополнить магазин из buddy / сбросить count самых старых фреймов
+    static void magazine_refill();
+    static void magazine_drain(uint32_t count);
+
+    // Попросить кэши вернуть count фреймов. false - ничего не вернулось
+    static bool reclaim(uint32_t count);
 
 private:
     static uint32_t* memory_bitmap_;
     static uint32_t max_frames_;
     static uint32_t used_frames_;
-    static uint8_t* refcounts_;
+    static Page* pages_;              // Дескриптор на каждый фрейм
+    static uint32_t  free_heads_[PMM_MAX_ORDER + 1];
+    static uint32_t  free_counts_[PMM_MAX_ORDER + 1];
+
+    static uint32_t magazine_[PMM_MAGAZINE_SIZE];
+    static uint32_t magazine_count_;
+    static PmmCacheStats cache_stats_;
+
+    static PmmReclaimHook reclaim_hook_;
+    static bool reclaiming_;
 };
 
 } // namespace re36
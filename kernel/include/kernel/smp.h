@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include "kernel/spinlock.h"
+#include "kernel/lapic.h"
+
+namespace re36 {
+
+#define MAX_CPUS 8
+
+// Межпроцессорные прерывания (вне диапазона PIC и таймера LAPIC)
+#define SMP_TLB_VECTOR      65   // Сброс TLB по запросу другого процессора
+#define SMP_RESCHED_VECTOR  66   // В очереди процессора появился поток
+#define SMP_TLB_FLUSH_ALL   0xFFFFFFFF  // tlb_shootdown: перезагрузить CR3 целиком
+
+// Трамплин AP: SIPI стартует процессор в реальном режиме с адреса
+// vector * 0x1000, страница ниже 1 МБ и вне PMM
+#define SMP_TRAMPOLINE_ADDR 0x7000
+
+struct CpuInfo {
+    uint8_t index;               // Номер в cpus (0 - BSP)
+    uint8_t lapic_id;
+    volatile bool online;
+    int running_tid;             // Поток на этом процессоре (current_tid)
+    int idle_tid;                // Поток простоя (0 у BSP до создания idle)
+    uint64_t quantum_end_ns;
+    uint64_t slice_start_ns;
+    uint64_t armed_ns;           // Запрограммированное событие таймера (0 - нет)
+    int fpu_owner;               // Чьё состояние в регистрах FPU (-1 - ничьё)
+
+    uint32_t switches;           // Переключений контекста
+    uint32_t steals;             // Потоков, забранных из чужих очередей
+    uint32_t resched_ipis;       // Принятых SMP_RESCHED_VECTOR
+    uint32_t tlb_ipis;           // Принятых SMP_TLB_VECTOR
+};
+
+extern CpuInfo cpus[MAX_CPUS];
+extern uint8_t lapic_to_cpu[256];
+extern bool smp_active;
+
+// Структура текущего процессора. До Smp::init процессор один.
+static inline CpuInfo* cpu_current() {
+    if (!smp_active) return &cpus[0];
+    return &cpus[lapic_to_cpu[LocalApic::id()]];
+}
+
+// Ядро сериализовано большой блокировкой (BKL): процессор держит её всё
+// время, пока исполняет код ядра, и отпускает при возврате в Ring 3 и в
+// hlt простоя. Внутри ядра InterruptGuard (cli) по-прежнему защищает от
+// прерываний своего процессора, а BKL - от остальных.
+class Smp {
+public:
+    // Разбор таблиц MP, запуск AP (INIT-SIPI-SIPI). Вызывать из
+    // загрузочного потока после TaskScheduler::create_idle(0).
+    static void init();
+    static bool is_active();
+    static int cpu_count();
+    static int online_count();
+
+    // BKL; no-op, пока SMP не включён
+    static void lock_kernel();
+    static void unlock_kernel();
+    static bool holds_kernel();
+    // Вход в ядро из прерывания: true, если BKL пришлось взять (процессор
+    // был в Ring 3 или в hlt простоя)
+    static bool enter_kernel();
+    // Перед iret в Ring 3 вне isr_handler (exec, fork, enter_usermode)
+    static void leave_kernel();
+
+    // sti; hlt с отпущенной BKL: пока процессор спит, ядро доступно другим
+    static void halt();
+
+    static void send_resched(int cpu);
+    // Сбросить запись TLB на процессорах, где она может быть закэширована:
+    // для пользовательских страниц - только там, где исполняется то же
+    // адресное пространство. SMP_TLB_FLUSH_ALL - сбросить весь TLB.
+    static void tlb_shootdown(uint32_t virt, bool user);
+    static void handle_tlb_ipi();
+
+    static void print_info();
+
+private:
+    static bool find_mp_config();
+    static bool start_ap(CpuInfo& cpu);
+    static void ap_main();
+    static void poll_tlb();
+
+    static int cpu_count_;
+    static Spinlock kernel_lock_;
+    static volatile int kernel_owner_;       // Индекс процессора или -1
+    static volatile uint32_t tlb_pending_;   // Маска процессоров, не сбросивших запись
+    static volatile uint32_t tlb_addr_;
+    static uint32_t boot_cr0_;
+    static uint32_t boot_cr4_;
+};
+
+} // namespace re36
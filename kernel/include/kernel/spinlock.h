@@ -26,4 +26,30 @@ struct InterruptGuard {
     }
 };
 
+// Спинлок для данных, общих между процессорами. Прерывания не
+// запрещает: вызывающий сам держит InterruptGuard, если нужно.
+class Spinlock {
+public:
+    bool try_lock() {
+        return !__atomic_test_and_set(&locked_, __ATOMIC_ACQUIRE);
+    }
+
+    void lock() {
+        while (!try_lock()) {
+            while (__atomic_load_n(&locked_, __ATOMIC_RELAXED)) asm volatile("pause");
+        }
+    }
+
+    void unlock() {
+        __atomic_clear(&locked_, __ATOMIC_RELEASE);
+    }
+
+    bool is_locked() const {
+        return __atomic_load_n(&locked_, __ATOMIC_RELAXED);
+    }
+
+private:
+    volatile bool locked_ = false;
+};
+
 } // namespace re36
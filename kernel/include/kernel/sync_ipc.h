@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace re36 {
+
+struct Registers;
+
+// Слова сообщения синхронного вызова: ECX, EDX, ESI, EDI
+#define IPC_CALL_WORDS 4
+
+// Thread::ipc_state
+#define IPC_IDLE         0
+#define IPC_SENDING      1            // Вызов в очереди получателя
+#define IPC_AWAIT_REPLY  2            // Вызов принят, ждёт ответа
+#define IPC_RECEIVING    3            // В reply_wait, ждёт вызова
+
+struct SyncIpcStats {
+    uint32_t calls;
+    uint32_t fast_calls;              // Получатель уже ждал: прямое переключение
+    uint32_t fast_replies;            // Ответ с прямым переключением на вызвавшего
+    uint32_t failed;                  // Получатель завершился, не ответив
+};
+
+// Синхронный вызов в стиле L4: короткое сообщение передаётся в регистрах
+// из кадра прерывания одного потока в кадр другого, а процессор переходит
+// от вызывающего к получателю и обратно напрямую, с остатком кванта, без
+// очереди готовых и без копии через буфер ядра (в отличие от Mailbox).
+class SyncIpc {
+public:
+    // Отправить слова из frame потоку dest и ждать ответа; ответ
+    // оказывается в тех же регистрах frame. 0 или -1.
+    static int call(int dest_tid, Registers* frame);
+    // Ответить reply_tid (-1 - некому) словами из frame и ждать следующего
+    // вызова; его слова - в регистрах frame. Возвращает TID вызвавшего.
+    static int reply_wait(int reply_tid, Registers* frame);
+
+    // Снять поток с очередей и отказать тем, кто ждёт его (thread_cleanup)
+    static void release(int tid);
+
+    static SyncIpcStats get_stats();
+    static void print_info();
+
+private:
+    static void copy_words(Registers* to, const Registers* from);
+    static void enqueue_caller(int dest_tid, int caller_tid);
+    static int dequeue_caller(int dest_tid);
+    static void fail(int tid);
+
+    static SyncIpcStats stats_;
+};
+
+} // namespace re36
@@ -24,6 +24,16 @@ namespace re36 {
 
 #define SYS_GRANT_MMIO 37
 #define SYS_SET_DRIVER 38
+#define SYS_SYNC       39
+#define SYS_USLEEP     40
+#define SYS_CLOCK_NS   41
+#define SYS_CPU_COUNT  42
+#define SYS_SEND_GRANT 43
+#define SYS_RECV_GRANT 44
+#define SYS_IPC_CALL   45
+#define SYS_IPC_REPLY_WAIT 46
+#define SYS_MPROTECT   47
+#define SYS_VFORK      48
 
 struct SyscallRegs {
     uint32_t eax; // Номер syscall
@@ -38,6 +48,9 @@ void syscall_gate_init();
 
 uint32_t handle_syscall(SyscallRegs* regs);
 
+// Свободный диапазон size байт среди VMA текущего потока (0 - нет)
+uint32_t find_free_vaddr(uint32_t size);
+
 } // namespace re36
 
 #include "kernel/idt.h"
@@ -2,33 +2,129 @@
 
 #include <stdint.h>
 #include "kernel/thread.h"
+#include "kernel/smp.h"
 
 namespace re36 {
 
 #define DEFAULT_QUANTUM 5 // 5 тиков = 50 мс при 100 Hz
+#define QUANTUM_NS      (DEFAULT_QUANTUM * 10000000ull)
+
+#define SCHED_LEVELS       256                 // Уровней приоритета (uint8_t)
+#define SCHED_BITMAP_WORDS (SCHED_LEVELS / 32)
+
+// Потоки, ждущие события (освобождения канала диска и т.п.). Пробуждаются
+// все разом, условие перепроверяется после пробуждения.
+struct WaitQueue {
+    Thread* head;
+};
+
+// Очередь готовых процессора: список на каждый уровень приоритета и
+// битмап непустых уровней
+struct RunQueue {
+    Thread* head[SCHED_LEVELS];
+    Thread* tail[SCHED_LEVELS];
+    uint32_t bitmap[SCHED_BITMAP_WORDS];
+    uint32_t nr_ready;
+};
+
+struct SchedStats {
+    uint32_t switches;          // Переключений контекста
+    uint32_t wakeups;           // Пробуждений по таймеру
+    uint32_t reaped;            // Потоков, убранных reaper
+    uint32_t handoffs;          // Прямых передач процессора (синхронный IPC)
+};
 
 class TaskScheduler {
 public:
     static void init();
+    // Поток уборки завершённых потоков и старения приоритетов
+    // (после создания idle, чтобы ему было куда уступать)
+    static void start_reaper();
+    // Поток простоя процессора cpu: не стоит в очереди, берётся, когда
+    // она пуста (и нечего забрать у других)
+    static int create_idle(int cpu);
+    static void idle_loop();
     
     static void schedule();
     
     static void block_current(int channel_id);
     
     static void unblock(int tid);
+
+    // Поставить созданный поток (thread_create, fork) в очередь наименее
+    // загруженного процессора
+    static void make_ready(int tid);
+
+    // Уступить процессор готовому потоку с более высоким приоритетом, не
+    // дожидаясь конца кванта (после пробуждения из обработчика IRQ)
+    static void preempt();
+
+    // Отдать остаток кванта потоку того же или более высокого приоритета
+    static void yield();
     
     static void sleep_current(uint32_t ms);
+    // Точность - до ближайшего события таймера (в периодическом режиме
+    // до тика)
+    static void sleep_ns(uint64_t ns);
     
     static void terminate_current();
+    // Завершить поток; ресурсы освободит reaper
+    static void terminate(int tid);
+
+    // Вызывать под InterruptGuard после проверки условия ожидания
+    static void wait_on(WaitQueue* wq, int channel_id);
+    static void wake_all(WaitQueue* wq);
     
     static int get_current_tid();
+    // Можно ли уснуть: загрузочный поток (tid 0) работает до создания
+    // остальных, переключаться ему не на кого - он опрашивает
+    static bool can_block();
     
     static void print_threads();
     
+    // Снять с очереди готовых следующий поток; если своя очередь пуста -
+    // забрать поток у самого загруженного процессора, иначе текущий (если
+    // он ещё Running) или поток простоя
     static int pick_next_thread();
+    // Переключиться на поток, выбранный pick_next_thread. quantum_end -
+    // конец кванта следующего потока (0 - полный новый квант)
+    static void switch_to(int next_tid, uint64_t quantum_end = 0);
+    // Прямая передача процессора заблокированному потоку (синхронный IPC):
+    // мимо очереди готовых, next дорабатывает квант текущего. Текущий поток
+    // должен быть уже заблокирован.
+    static void handoff(int next_tid);
+    // Уступить процессор новому потоку next, не стоящему в очереди; текущий
+    // встаёт в очередь готовых (fork: потомок первым)
+    static void yield_to(int next_tid);
+
+    static SchedStats get_stats();
+    // Задержка переключения контекста при 8, 64 и 256 потоках
+    static void bench();
 
 private:
+    static void enqueue(Thread& t);
+    static void dequeue(Thread& t);
+    static int highest_ready(const RunQueue& rq);
+    static Thread* steal(int cpu);
+    static int select_cpu();
+    // Разбудить простаивающий процессор, чтобы он забрал поток из очереди
+    // занятого
+    static void kick_idle(int busy_cpu);
+    static void sleep_insert(Thread& t);
+    static void sleep_remove(Thread& t);
+    static void wake_sleepers(uint64_t now);
+    // Запрограммировать таймер процессора на ближайшее событие: конец
+    // кванта (если есть, на кого переключаться) или, на BSP, пробуждение
+    static void rearm();
+    static void age_ready();
+    static void reaper_thread();
+
     static bool scheduling_enabled_;
+    static RunQueue queues_[MAX_CPUS];
+    static Thread* sleep_head_;                        // По возрастанию sleep_until
+    static Thread* reap_head_;
+    static int reaper_tid_;
+    static SchedStats stats_;
 };
 
 } // namespace re36
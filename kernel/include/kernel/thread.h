@@ -3,6 +3,10 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "kernel/vfs.h"
+#include "kernel/kmalloc.h"
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
+#include "kernel/vma.h"
 
 namespace re36 {
 
@@ -18,11 +22,10 @@ struct ForkChildState {
     uint32_t ebp;
 };
 
-#define MAX_THREADS 32
+#define MAX_THREADS 512
 #define THREAD_STACK_SIZE 4096
 
 #define IPC_MAX_MSG_SIZE 512
-#define IPC_MSG_QUEUE_SIZE 4
 
 #define MAX_OPEN_FILES 16
 
@@ -30,6 +33,7 @@ struct IpcMessage {
     int sender_tid;
     uint32_t size;
     uint8_t data[IPC_MAX_MSG_SIZE];
+    IpcMessage* next;
 };
 
 enum class ThreadState : uint8_t {
@@ -44,9 +48,6 @@ enum class ThreadState : uint8_t {
 
 typedef void (*ThreadEntry)();
 
-#define VMA_TYPE_ANON  0
-#define VMA_TYPE_FILE  1
-
 #define MAP_PRIVATE    0x02
 #define MAP_ANONYMOUS  0x20
 #define MAP_FIXED      0x10
@@ -57,17 +58,9 @@ typedef void (*ThreadEntry)();
 #define PROT_EXEC  0x4
 
 struct vnode;
-
-struct VMA {
-    uint32_t start;
-    uint32_t end;
-    uint32_t file_offset;
-    uint32_t file_size;
-    uint32_t flags;
-    uint8_t  type;
-    vnode*   file_vnode;
-    VMA* next;
-};
+struct WaitQueue;
+struct IpcGrant;
+struct Registers;
 
 struct MmioGrant {
     uint32_t phys_start;
@@ -88,41 +81,83 @@ struct Thread {
     uint32_t esp;           // Сохраненный указатель стека
     uint8_t* stack_base;    // Начало выделенного стека
     
-    uint32_t sleep_until;   // Тик пробуждения (если Sleeping)
+    uint64_t sleep_until;   // Время пробуждения, нс (если Sleeping)
     int blocked_channel_id; // ID канала, если заблокирован (-1 = нет)
+
+    // Очередь готовых своего приоритета, список спящих или список на
+    // уборку - поток состоит не более чем в одном из них
+    Thread* run_next;
+    Thread* run_prev;
+    bool on_run_queue;
+    Thread* wait_next;
+    WaitQueue* wait_queue;  // На которой поток заблокирован (nullptr - нет)
+
+    uint8_t cpu;            // Процессор, в чьей очереди стоит / на котором исполняется
+    bool idle;              // Поток простоя процессора: в очередь не ставится
+    bool kill_pending;      // Завершён, пока исполнялся на другом процессоре
+
+    uint8_t* fpu;           // Область FXSAVE из fpu_cache (nullptr - FPU не трогал)
+    uint8_t fpu_cpu;        // Процессор, в чьи регистры загружалось (FPU_NO_CPU)
     
-    uint32_t quantum_remaining; // Остаток кванта
-    uint32_t total_ticks;       // Всего тиков процессорного времени
+    uint64_t cpu_ns;            // Всего процессорного времени
     
     uint32_t* page_directory_phys; // Каталог страниц потока
     uint32_t heap_start;        // Начало кучи (после кода)
     uint32_t heap_end;          // Текущий конец кучи
     bool heap_lock;             // Спинлок для кучи
 
-    VMA* vma_list;              // Динамический список виртуальной памяти (Demand Paging / mmap)
+    VmaTree vmas;               // Области виртуальной памяти (Demand Paging / mmap)
 
-    IpcMessage messages[IPC_MSG_QUEUE_SIZE];
-    int msg_head;
-    int msg_tail;
+    // Почтовый ящик (Mailbox): очереди FIFO из ipc_msg_cache и ipc_grant_cache
+    IpcMessage* msg_head;
+    IpcMessage* msg_tail;
     int msg_count;
-    bool waiting_for_msg;
+    IpcGrant* grant_head;
+    IpcGrant* grant_tail;
+    int grant_count;
+    bool waiting_for_msg;       // Ждёт сообщение или передачу страниц
+
+    // Синхронный вызов (SyncIpc)
+    uint8_t ipc_state;          // IPC_IDLE / IPC_SENDING / IPC_AWAIT_REPLY / IPC_RECEIVING
+    int ipc_partner;            // Кому отправлен вызов
+    int ipc_result;             // Итог для проснувшегося потока
+    Registers* ipc_frame;       // Кадр регистров потока, заблокированного в вызове
+    Thread* ipc_callers;        // Вызывающие, ждущие reply_wait этого потока
+    Thread* ipc_next;
 
     int parent_tid;
     int exit_code;
+    // vfork: потомок исполняется в адресном пространстве родителя, пока
+    // не вызовет exec или не завершится, родитель всё это время ждёт
+    int vfork_parent;           // Чьё адресное пространство занято, или -1
+    int vfork_child;            // Кого ждёт родитель, или -1
 
     file* fd_table[MAX_OPEN_FILES]; // VFS file descriptors for this thread
 
     ForkChildState fork_state;
 };
 
-extern Thread threads[MAX_THREADS];
-extern int current_tid;
+extern Thread* threads;            // MAX_THREADS записей, выделяются в thread_init
+// Поток, исполняемый текущим процессором
+#define current_tid (::re36::cpu_current()->running_tid)
 extern int thread_count;
 
+// Slab-кэши объектов потоков
+extern KmemCache* vma_cache;
+extern KmemCache* ipc_msg_cache;
+extern KmemCache* ipc_grant_cache;
+extern KmemCache* fpu_cache;
+
 void thread_init();
 int thread_create(const char* name, ThreadEntry entry, uint8_t priority);
+// Слот и стек как у thread_create, но без постановки в очередь готовых
+int thread_alloc(const char* name, ThreadEntry entry, uint8_t priority);
 void thread_terminate(int tid);
 void thread_cleanup(int tid);
+// Потомок vfork возвращает адресное пространство родителю (exec, exit)
+void thread_vfork_done(int tid);
+// Вернуть слот (Unused) и освободить стек ядра
+void thread_release(int tid);
 void thread_yield();
 
 extern "C" void switch_task(uint32_t* old_esp, uint32_t new_esp);
@@ -4,19 +4,72 @@
 
 namespace re36 {
 
+#define NS_PER_TICK      10000000u   // Тик совместимости: 10 мс (100 Hz)
+#define TIMER_MIN_DELTA  10000u      // Ближе 10 мкс событие не программируется
+#define TIMER_MAX_DELTA  1000000000u // Дальше 1 с - промежуточное событие
+
+// Источник прерываний таймера
+enum class ClockEventMode : uint8_t {
+    PitPeriodic,                 // PIT IRQ0 с частотой frequency_hz
+    LapicOneShot,                // Таймер LAPIC, одно прерывание на событие
+    TscDeadline                  // Таймер LAPIC в режиме TSC-deadline
+};
+
+struct TimerStats {
+    uint32_t interrupts;         // Прерываний таймера всего
+    uint32_t programmed;         // Перепрограммирований one-shot
+};
+
 class Timer {
 public:
+    // Калибрует TSC (и таймер LAPIC, если LocalApic::init удался) по
+    // каналу 2 PIT. Без LAPIC PIT тикает с частотой frequency_hz.
     static void init(uint32_t frequency_hz);
-    
+    // Таймер LAPIC запущенного AP в режиме и с калибровкой BSP
+    static void init_ap();
+
+    // IRQ0 в периодическом режиме
     static void tick();
-    
+    // Прерывание таймера LAPIC (LAPIC_TIMER_VECTOR)
+    static void handle_event();
+
+    // Тики по 10 мс с загрузки (в режиме one-shot считаются по TSC)
     static uint32_t get_ticks();
-    
+
     static void sleep(uint32_t ms);
 
+    // Счётчик тактов процессора (RDTSC) для микробенчмарков
+    static uint64_t read_tsc();
+
+    // Монотонное время с загрузки, нс (по откалиброванному TSC)
+    static uint64_t now_ns();
+    static uint32_t ns_to_ticks(uint64_t ns);
+
+    // Следующее прерывание текущего процессора в момент deadline_ns (0 -
+    // не нужно). В периодическом режиме ничего не делает: тики идут и так.
+    static void set_next_event(uint64_t deadline_ns);
+    static bool is_tickless();
+
+    static ClockEventMode get_mode();
+    static uint32_t get_tsc_khz();
+    static TimerStats get_stats();
+    static void print_info();
+    // Точность коротких снов и число прерываний за секунду простоя
+    static void bench();
+
 private:
+    // Тактов TSC (и таймера LAPIC) за 10 мс по каналу 2 PIT
+    static void calibrate(uint32_t* tsc_cycles, uint32_t* lapic_counts);
+
     static uint32_t ticks_;
     static uint32_t frequency_;
+    static ClockEventMode mode_;
+    static uint64_t tsc_base_;
+    static uint32_t tsc_per_tick_;       // Тактов TSC за 10 мс
+    static uint32_t ns_mult_;            // нс = (такты * ns_mult_) >> 24
+    static uint32_t tsc_mult_;           // такты = (нс * tsc_mult_) >> 24
+    static uint32_t lapic_mult_;         // счёт LAPIC = (нс * lapic_mult_) >> 24
+    static TimerStats stats_;
 };
 
 } // namespace re36
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include "kernel/smp.h"
 
 namespace re36 {
 
@@ -37,7 +38,7 @@ struct GDTPointer {
     uint32_t base;
 } __attribute__((packed));
 
-#define GDT_ENTRIES 6
+#define GDT_ENTRIES (5 + MAX_CPUS)   // По TSS на процессор
 
 // Селекторы сегментов
 #define KERNEL_CS 0x08
@@ -45,24 +46,28 @@ struct GDTPointer {
 #define USER_CS   0x1B  // 0x18 | 3 (RPL=3)
 #define USER_DS   0x23  // 0x20 | 3 (RPL=3)
 #define TSS_SEG   0x28
+#define TSS_SEG_CPU(i) (TSS_SEG + (i) * 8)
 
 class TSS {
 public:
     static void init(uint32_t kernel_stack);
+    // GDT ядра и TSS процессора cpu на запущенном AP
+    static void init_ap(int cpu);
     
+    // esp0 в TSS текущего процессора
     static void set_kernel_stack(uint32_t stack_top);
     
     static TSSEntry& get_tss();
 
 private:
-    static TSSEntry tss_;
+    static TSSEntry tss_[MAX_CPUS];
     static GDTEntry gdt_[GDT_ENTRIES];
     static GDTPointer gdt_ptr_;
     
     static void set_gdt_entry(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran);
-    static void write_tss(int index, uint32_t ss0, uint32_t esp0);
+    static void write_tss(int index, TSSEntry& tss, uint32_t ss0, uint32_t esp0);
     static void flush_gdt();
-    static void flush_tss();
+    static void flush_tss(uint16_t selector);
 };
 
 } // namespace re36
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "kernel/kmalloc.h"
 
 namespace re36 {
 
@@ -59,6 +60,13 @@ struct vnode_operations {
     int (*rename)(vnode* old_dir, const char* old_name, vnode* new_dir, const char* new_name);
     int (*readdir)(vnode* dir, vfs_dir_entry* entries, int max_entries);
     int (*stat)(vnode* dir, const char* name, vfs_stat_t* out);
+    // Заполнить страницу index (4 КБ) в обход кэша страниц, хвост обнулить
+    int (*readpage)(vnode* vn, uint32_t index, uint8_t* page);
+    // То же для count страниц подряд одной пачкой дисковых запросов
+    // (упреждающее чтение); nullptr - кэш читает по одной странице
+    int (*readpages)(vnode* vn, uint32_t index, uint32_t count, uint8_t** pages);
+    // Обрезать (или оставить) файл до size байт
+    int (*truncate)(vnode* vn, uint32_t size);
 };
 
 // Abstract representation of a file/directory
@@ -80,6 +88,7 @@ struct vfs_filesystem_driver {
     const char* name;
     int (*mount)(block_device* bdev, superblock* sb);
     int (*unmount)(superblock* sb);
+    int (*sync)(superblock* sb);     // Записать отложенные метаданные на диск
 };
 
 // Superblock representing a mounted filesystem
@@ -92,20 +101,33 @@ struct superblock {
 
 
 
+// Состояние упреждающего чтения (на открытый файл и на VMA файла)
+struct FileReadahead {
+    uint32_t next;       // Страница за последним прочитанным участком
+    uint32_t window;     // Окно в страницах, 0 - доступ не последовательный
+    uint32_t ra_end;     // Страницы до ra_end уже прочитаны заранее
+};
+
 // File descriptor object representing an open file per process
 struct file {
     vnode* vn;
     uint32_t offset;
     uint32_t flags;
     uint32_t refcount;
+    FileReadahead ra;
 };
 
+// Slab-кэши объектов VFS (создаются в vfs_init)
+extern KmemCache* vnode_cache;
+extern KmemCache* file_cache;
+
 void vnode_release(vnode* vn);
 void file_release(file* f);
 
 void vfs_init();
 int vfs_register(vfs_filesystem_driver* driver);
 int vfs_mount(const char* fs_type, const char* target_path, block_device* bdev);
+void vfs_sync();
 
 int vfs_open(const char* path, int flags, int mode);
 
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include "kernel/vfs.h"
+
+namespace re36 {
+
+#define VMA_TYPE_ANON  0
+#define VMA_TYPE_FILE  1
+
+// Область адресного пространства потока. Узел AVL-дерева по start;
+// области не пересекаются.
+struct VMA {
+    uint32_t start;
+    uint32_t end;
+    uint32_t file_offset;
+    uint32_t file_size;       // Байт файла от start, дальше - нули
+    uint32_t flags;
+    uint8_t  type;
+    vnode*   file_vnode;      // Своя ссылка у каждой VMA_TYPE_FILE
+    FileReadahead ra;
+
+    VMA* left;
+    VMA* right;
+    uint8_t height;
+    // По поддереву: крайние адреса и наибольший промежуток между областями
+    uint32_t sub_start;
+    uint32_t sub_end;
+    uint32_t max_gap;
+};
+
+struct VmaTree {
+    VMA* root;
+    uint32_t count;
+};
+
+// Область, содержащая addr, или nullptr
+VMA* vma_find(VmaTree& tree, uint32_t addr);
+// Область с наименьшим start, пересекающая [start, end)
+VMA* vma_first_overlap(VmaTree& tree, uint32_t start, uint32_t end);
+
+// Новая область из vma_cache: поля файла и дерева обнулены
+VMA* vma_alloc(uint32_t start, uint32_t end, uint32_t flags, uint8_t type);
+// Вставить v (из vma_alloc); то, что она перекрывает, вырезается.
+// Анонимная v поглощает смежные анонимные области с теми же флагами.
+// false - не хватило памяти (v не вставлена, освобождает вызывающий).
+bool vma_insert(VmaTree& tree, VMA* v);
+// Наименьший адрес в [lo, hi), с которого свободно size байт; 0 - нет
+uint32_t vma_find_free(VmaTree& tree, uint32_t size, uint32_t lo, uint32_t hi);
+
+// Убрать [start, end) из дерева: частично задетые области обрезаются
+// или делятся надвое. Таблицы страниц не трогает. false - не хватило
+// памяти на половину разделённой области (дерево не изменено).
+bool vma_remove_range(VmaTree& tree, uint32_t start, uint32_t end);
+// Сменить флаги страниц [start, end), разделив крайние области. false -
+// в диапазоне есть неотображённые адреса или не хватило памяти (дерево
+// тогда не меняется).
+bool vma_protect(VmaTree& tree, uint32_t start, uint32_t end, uint32_t flags);
+
+// Копия дерева для fork; false - не хватило памяти (dst пусто)
+bool vma_clone(VmaTree& dst, const VmaTree& src);
+// Освободить области (exit, exec, thread_cleanup) или одну, не
+// вставленную в дерево
+void vma_clear(VmaTree& tree);
+void vma_free(VMA* v);
+
+} // namespace re36
@@ -17,12 +17,20 @@ namespace re36 {
 #define PAGE_CACHEDISABLE 0x010
 #define PAGE_ACCESSED   0x020
 #define PAGE_DIRTY      0x040
+#define PAGE_LARGE      0x080   // В PDE: страница 4 МБ (PSE) вместо таблицы
+#define PAGE_GLOBAL     0x100   // Запись TLB переживает перезагрузку CR3 (PGE)
 #define PAGE_COW        0x200
+// В PDE: таблица страниц общая для нескольких каталогов после fork
+// (PDE без PAGE_WRITABLE, ссылки на таблицу - в PMM)
+#define PDE_SHARED      0x200
 
 #define PD_ENTRIES 1024
 #define PT_ENTRIES 1024
+#define LARGE_PAGE_SIZE 0x400000
 
-#define KERNEL_SPACE_END   0x02000000
+// Граница ядра и пользователя: ниже - тождественное отображение RAM
+// (сколько её есть, см. MemoryMap), выше - адреса процессов и MMIO
+#define KERNEL_SPACE_END   0x20000000
 #define RECURSIVE_PD_INDEX 1023
 #define PAGE_TABLES_VADDR  0xFFC00000
 #define PAGE_DIR_VADDR     0xFFFFF000
@@ -31,15 +39,30 @@ class VMM {
 public:
     static void init();
 
+    // Страница 4 МБ в пространстве ядра (без PAGE_USER); virt и phys
+    // выровнены на 4 МБ. PAGE_GLOBAL учитывается, если есть PGE. Пустая
+    // таблица на месте PDE освобождается. false - нет PSE, адрес не
+    // выровнен или в этих 4 МБ уже отображены страницы по 4 КБ.
+    static bool map_large_page(uint32_t virt, uint32_t phys, uint32_t flags);
+    static void unmap_large_page(uint32_t virt);
+    static bool has_large_pages() { return large_pages_; }
+    static bool has_global_pages() { return global_pages_; }
+
+    // Внутри страницы 4 МБ не работает: отображение не меняется
     static void map_page(uint32_t virt, uint32_t phys, uint32_t flags);
 
-    static void unmap_page(uint32_t virt);
+    // false - общую после fork таблицу не удалось отделить (нет памяти),
+    // страница осталась отображённой
+    static bool unmap_page(uint32_t virt);
 
     static uint32_t get_physical(uint32_t virt);
 
     static void invalidate_page(uint32_t virt);
 
     static void flush_tlb();
+    // Сбросить TLB текущего адресного пространства здесь и на процессорах,
+    // где оно исполняется: одна перезагрузка CR3 вместо invlpg на страницу
+    static void flush_address_space();
 
     static uint32_t* create_address_space();
     static void destroy_address_space(uint32_t* page_dir_phys);
@@ -54,7 +77,8 @@ public:
     static uint32_t kernel_directory_phys_;
 
 private:
-    static uint32_t  current_directory_phys_;
+    static bool large_pages_;
+    static bool global_pages_;
 };
 
 } // namespace re36
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace re36 {
+
+// Запас заранее обнулённых фреймов. Фоновый поток "zeroer" с низким
+// приоритетом пополняет его, пока система простаивает, чтобы обработчик
+// page fault не тратил время на обнуление 4 КБ.
+#define ZERO_POOL_SIZE      256
+#define ZERO_POOL_PRIORITY  254
+#define ZERO_POOL_MIN_FREE  (1024 * 1024) // Не копим фреймы, если RAM меньше 1 МБ
+
+struct ZeroPoolStats {
+    uint32_t cached;   // Обнулённых фреймов в запасе
+    uint32_t hits;     // Выдано из запаса
+    uint32_t misses;   // Запас пуст - обнуляли на месте
+    uint32_t zeroed;   // Обнулено фоновым потоком
+};
+
+class ZeroPool {
+public:
+    // Запускает фоновый поток обнуления (нужен работающий планировщик)
+    static void init();
+
+    // Обнулённый фрейм (refcount = 1). Если запас пуст - обнуляет сам.
+    static void* alloc_frame();
+
+    // Вернуть половину запаса в PMM (при нехватке памяти)
+    static void shrink();
+
+    static ZeroPoolStats get_stats();
+
+private:
+    static void worker();
+
+    static uint32_t frames_[ZERO_POOL_SIZE];
+    static uint32_t count_;
+    static ZeroPoolStats stats_;
+};
+
+} // namespace re36
@@ -6,7 +6,14 @@
 extern "C" {
 
 void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
 void* memset(void* s, int c, size_t n);
+
+// Копирование/обнуление выровненной страницы 4 КБ (SSE2, если доступен)
+void mem_init();
+bool mem_has_sse();
+void copy_page(void* dest, const void* src);
+void zero_page(void* dest);
 size_t strlen(const char* s);
 int strcmp(const char* s1, const char* s2);
 
@@ -3,13 +3,30 @@
 #include "kernel/vmm.h"
 #include "kernel/pmm.h"
 #include "kernel/timer.h"
+#include "kernel/pic.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
 #include "libc.h"
 
 namespace re36 {
 
 HBA_MEM* AHCIDriver::abarz = nullptr;
+AhciPortState AHCIDriver::ports_[32];
+AhciStats AHCIDriver::stats_ = { 0, 0, 0, 0, 0 };
+int AHCIDriver::irq_ = -1;
+WaitQueue AHCIDriver::slot_waiters_ = {nullptr};
 static int s_primary_port = -1;
 
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_FPDMA      0x60
+#define ATA_CMD_WRITE_FPDMA     0x61
+#define ATA_CMD_IDENTIFY        0xEC
+
+// Сколько команд синхронный read/write держит в очереди одновременно
+#define AHCI_SYNC_BATCH 8
+
 static inline void mfence() {
     asm volatile("mfence" ::: "memory");
 }
@@ -66,6 +83,8 @@ void AHCIDriver::init() {
     // Global Host Control (AE - AHCI Enable)
     abarz->ghc |= (uint32_t)(1 << 31);
     
+    for (int i = 0; i < 32; i++) ports_[i].regs = nullptr;
+
     // Setup ports
     uint32_t pi = abarz->pi;
     for (int i = 0; i < 32; i++) {
@@ -74,6 +93,20 @@ void AHCIDriver::init() {
         }
         pi >>= 1;
     }
+
+    // Завершение команд - по IRQ; без линии IRQ остаёмся на опросе
+    if (dev->irq != 0 && dev->irq < 16) {
+        irq_ = dev->irq;
+        for (int i = 0; i < 32; i++) {
+            if (!ports_[i].regs) continue;
+            ports_[i].regs->is = (uint32_t)-1;
+            ports_[i].regs->ie = HBA_PxIS_DHRS | HBA_PxIS_SDBS | HBA_PxIS_FATAL;
+        }
+        abarz->is = (uint32_t)-1;
+        abarz->ghc |= HBA_GHC_IE;
+        pic_unmask(irq_);
+        printf("[AHCI] Interrupt-driven completion on IRQ %d\n", irq_);
+    }
 }
 
 void AHCIDriver::check_port(HBA_PORT* port, int port_no) {
@@ -123,10 +156,6 @@ void AHCIDriver::stop_cmd(HBA_PORT* port) {
 }
 
 void AHCIDriver::port_rebase(HBA_PORT* port, int port_no) {
-    if (s_primary_port == -1) {
-        s_primary_port = port_no;
-    }
-
     stop_cmd(port);
 
     // Command list offset: 1K, FIS offset: 256 bytes. Give them 1 frame (4KB) per port.
@@ -137,8 +166,7 @@ void AHCIDriver::port_rebase(HBA_PORT* port, int port_no) {
     }
     
     // Zero memory
-    uint8_t* mem = (uint8_t*)frame;
-    for (int i = 0; i < 4096; i++) mem[i] = 0;
+    zero_page(frame);
 
     port->clb = (uint32_t)frame;
     port->clbu = 0;
@@ -146,189 +174,341 @@ void AHCIDriver::port_rebase(HBA_PORT* port, int port_no) {
     port->fb = (uint32_t)frame + 1024; // FIS base at offset 1024
     port->fbu = 0;
 
-    // Command Tables. We have 32 command headers. 
-    // Each CT takes around 256 bytes for a few PRDT entries. 
-    // 32 CTs * 256 bytes = 8192 bytes = 2 frames.
+    // 32 таблицы команд по AHCI_CMD_TABLE_SIZE (128 байт + PRDT) = 4 фрейма
     HBA_CMD_HEADER* cmdheader = (HBA_CMD_HEADER*)port->clb;
+    uint32_t per_frame = PMM_FRAME_SIZE / AHCI_CMD_TABLE_SIZE;
     uint32_t ct_phys = 0;
 
-    for (int i = 0; i < 32; i++) {
-        cmdheader[i].prdtl = 8;
+    for (uint32_t i = 0; i < 32; i++) {
+        cmdheader[i].prdtl = 0;
 
-        if (i % 16 == 0) {
+        if (i % per_frame == 0) {
             void* f = PhysicalMemoryManager::alloc_frame();
             if (!f) return;
             ct_phys = (uint32_t)f;
-            uint8_t* p = (uint8_t*)f;
-            for (int k = 0; k < 4096; k++) p[k] = 0;
+            zero_page(f);
         }
 
-        uint32_t ct_addr = ct_phys + (i % 16) * 256;
-        cmdheader[i].ctba = ct_addr;
+        cmdheader[i].ctba = ct_phys + (i % per_frame) * AHCI_CMD_TABLE_SIZE;
         cmdheader[i].ctbau = 0;
     }
 
+    port->serr = (uint32_t)-1;
+    port->is = (uint32_t)-1;
     start_cmd(port);
-}
 
-int AHCIDriver::find_cmdslot(HBA_PORT* port) {
-    // If not set in SACT and CI, the slot is free
-    uint32_t slots = port->sact | port->ci;
-    for (int i = 0; i < 32; i++) {
-        if ((slots & 1) == 0)
-            return i;
-        slots >>= 1;
+    AhciPortState& ps = ports_[port_no];
+    ps.regs = port;
+    ps.ncq = false;
+    ps.depth = 1;
+    ps.active = 0;
+    for (int i = 0; i < 32; i++) ps.reqs[i] = nullptr;
+    identify(ps, port_no);
+
+    if (s_primary_port == -1) {
+        s_primary_port = port_no;
     }
-    printf("[AHCI] Cannot find free command list slot\n");
-    return -1;
 }
 
-bool AHCIDriver::read(uint8_t port_no, uint64_t lba, uint32_t sector_count, void* buffer_phys) {
-    if (abarz == nullptr) return false;
-    port_no &= 0x1F;
-    HBA_PORT* port = &abarz->ports[port_no];
-
-    port->is = (uint32_t)-1; // Clear pending interrupts
-
-    int slot = find_cmdslot(port);
-    if (slot == -1) return false;
+void AHCIDriver::identify(AhciPortState& ps, int port_no) {
+    HBA_PORT* port = ps.regs;
+    uint16_t* id = (uint16_t*)PhysicalMemoryManager::alloc_frame();
+    if (!id) return;
 
     HBA_CMD_HEADER* cmdheader = (HBA_CMD_HEADER*)port->clb;
-    cmdheader += slot;
-    
-    cmdheader->cfl = sizeof(FIS_REG_H2D) / sizeof(uint32_t); // 5 dwords
+    cmdheader->cfl = sizeof(FIS_REG_H2D) / sizeof(uint32_t);
     cmdheader->a = 0;
-    cmdheader->w = 0; // Read from device
+    cmdheader->w = 0;
     cmdheader->prdtl = 1;
+    cmdheader->prdbc = 0;
 
     HBA_CMD_TBL* cmdtbl = (HBA_CMD_TBL*)(cmdheader->ctba);
-    uint8_t* cmdbuf = (uint8_t*)cmdtbl;
-    for (int i = 0; i < 256; i++) cmdbuf[i] = 0;
+    memset(cmdtbl, 0, sizeof(HBA_CMD_TBL));
+    cmdtbl->prdt_entry[0].dba = (uint32_t)id;
+    cmdtbl->prdt_entry[0].dbc = 512 - 1;
 
-    // Single PRDT entry
-    cmdtbl->prdt_entry[0].dba = (uint32_t)buffer_phys;
-    cmdtbl->prdt_entry[0].dbau = 0;
-    cmdtbl->prdt_entry[0].dbc = (sector_count * 512) - 1; // bytes - 1
-    cmdtbl->prdt_entry[0].i = 1; // Interrupt when done
-
-    // Setup FIS
-    FIS_REG_H2D *cmdfis = (FIS_REG_H2D*)(&cmdtbl->cfis);
+    FIS_REG_H2D* cmdfis = (FIS_REG_H2D*)(&cmdtbl->cfis);
     cmdfis->fis_type = FIS_TYPE_REG_H2D;
-    cmdfis->c = 1;  // Command
-    cmdfis->command = 0x24; // READ DMA EXT (LBA48)
-    
-    cmdfis->lba0 = (uint8_t)lba;
-    cmdfis->lba1 = (uint8_t)(lba >> 8);
-    cmdfis->lba2 = (uint8_t)(lba >> 16);
-    cmdfis->device = 0x40; // LBA mode
-    
-    cmdfis->lba3 = (uint8_t)(lba >> 24);
-    cmdfis->lba4 = (uint8_t)(lba >> 32);
-    cmdfis->lba5 = (uint8_t)(lba >> 40);
-    
-    cmdfis->countl = sector_count & 0xFF;
-    cmdfis->counth = (sector_count >> 8) & 0xFF;
-
-    // Wait until port is no longer busy
-    int spin = 0;
-    while ((port->tfd & (0x80 | 0x08)) && spin < 1000000) { spin++; }
-    if (spin == 1000000) {
-        printf("[AHCI] Port is hung\n");
-        return false;
-    }
+    cmdfis->c = 1;
+    cmdfis->command = ATA_CMD_IDENTIFY;
 
-    port->ci = 1 << slot; // Issue command
+    port->ci = 1;
     mfence();
-    
-    // Wait for completion
-    while (1) {
-        if ((port->ci & (1 << slot)) == 0) 
-            break;
-        if (port->is & (1 << 30)) { // Task file error
-            printf("[AHCI] Read disk error\n");
-            return false;
-        }
+    bool ok = false;
+    for (int spin = 0; spin < 10000000; spin++) {
+        if (port->is & HBA_PxIS_FATAL) break;
+        if ((port->ci & 1) == 0) { ok = true; break; }
     }
-
-    if (port->tfd & 0x01) { // Error bit
-        printf("[AHCI] Task file read error\n");
-        return false;
+    port->is = (uint32_t)-1;
+
+    // Глубина очереди: не больше слотов контроллера (CAP.NCS) и очереди диска
+    uint32_t slots = ((abarz->cap >> 8) & 0x1F) + 1;
+    if (ok && (abarz->cap & HBA_CAP_SNCQ) && (id[76] & (1 << 8))) {
+        ps.ncq = true;
+        uint32_t qd = (id[75] & 0x1F) + 1;
+        if (qd < slots) slots = qd;
     }
+    ps.depth = (uint8_t)slots;
+    printf("[AHCI] Port %d: %s, queue depth %d\n", port_no,
+           ps.ncq ? "NCQ" : "no NCQ", ps.depth);
 
-    return true;
+    PhysicalMemoryManager::free_frame(id);
 }
 
-bool AHCIDriver::write(uint8_t port_no, uint64_t lba, uint32_t sector_count, void* buffer_phys) {
-    if (abarz == nullptr) return false;
-    port_no &= 0x1F;
-    HBA_PORT* port = &abarz->ports[port_no];
-
-    port->is = (uint32_t)-1; // Clear pending ints
+int AHCIDriver::find_cmdslot(AhciPortState& ps) {
+    // Слот свободен, если мы его не выдали и он не занят в SACT/CI
+    uint32_t slots = ps.active | ps.regs->sact | ps.regs->ci;
+    for (int i = 0; i < ps.depth; i++) {
+        if ((slots & (1u << i)) == 0)
+            return i;
+    }
+    return -1;
+}
 
-    int slot = find_cmdslot(port);
-    if (slot == -1) return false;
+bool AHCIDriver::build_command(AhciPortState& ps, int slot, AhciRequest* req) {
+    HBA_CMD_HEADER* cmdheader = (HBA_CMD_HEADER*)ps.regs->clb + slot;
+    HBA_CMD_TBL* cmdtbl = (HBA_CMD_TBL*)(cmdheader->ctba);
+    memset(cmdtbl, 0, 128);
+
+    // Scatter-gather: буфер режется по страницам, физически соседние
+    // страницы сливаются в одну запись PRDT
+    uint32_t virt = (uint32_t)req->buffer;
+    uint32_t bytes = req->count * 512;
+    int n = 0;
+    while (bytes > 0) {
+        uint32_t phys = virt < KERNEL_SPACE_END ? virt : VMM::get_physical(virt);
+        if (!phys) return false;
+        uint32_t chunk = PMM_FRAME_SIZE - (virt & (PMM_FRAME_SIZE - 1));
+        if (chunk > bytes) chunk = bytes;
+
+        HBA_PRDT_ENTRY* prev = n ? &cmdtbl->prdt_entry[n - 1] : nullptr;
+        if (prev && prev->dba + prev->dbc + 1 == phys) {
+            prev->dbc += chunk;
+        } else {
+            if (n == AHCI_PRDT_MAX) return false;
+            HBA_PRDT_ENTRY* e = &cmdtbl->prdt_entry[n++];
+            e->dba = phys;
+            e->dbau = 0;
+            e->res0 = 0;
+            e->dbc = chunk - 1;
+            e->res1 = 0;
+            e->i = 0;
+        }
+        virt += chunk;
+        bytes -= chunk;
+    }
 
-    HBA_CMD_HEADER* cmdheader = (HBA_CMD_HEADER*)port->clb;
-    cmdheader += slot;
-    
     cmdheader->cfl = sizeof(FIS_REG_H2D) / sizeof(uint32_t);
     cmdheader->a = 0;
-    cmdheader->w = 1; // Write to device
-    cmdheader->prdtl = 1;
+    cmdheader->w = req->write ? 1 : 0;
+    cmdheader->p = 0;
+    cmdheader->c = 0;
+    cmdheader->prdtl = (uint16_t)n;
+    cmdheader->prdbc = 0;
 
-    HBA_CMD_TBL* cmdtbl = (HBA_CMD_TBL*)(cmdheader->ctba);
-    uint8_t* cmdbuf = (uint8_t*)cmdtbl;
-    for (int i = 0; i < 256; i++) cmdbuf[i] = 0;
-
-    cmdtbl->prdt_entry[0].dba = (uint32_t)buffer_phys;
-    cmdtbl->prdt_entry[0].dbau = 0;
-    cmdtbl->prdt_entry[0].dbc = (sector_count * 512) - 1;
-    cmdtbl->prdt_entry[0].i = 1;
-
-    FIS_REG_H2D *cmdfis = (FIS_REG_H2D*)(&cmdtbl->cfis);
+    FIS_REG_H2D* cmdfis = (FIS_REG_H2D*)(&cmdtbl->cfis);
     cmdfis->fis_type = FIS_TYPE_REG_H2D;
     cmdfis->c = 1;
-    cmdfis->command = 0x35; // WRITE DMA EXT
-    
+    cmdfis->device = 0x40; // LBA mode
+
+    uint64_t lba = req->lba;
     cmdfis->lba0 = (uint8_t)lba;
     cmdfis->lba1 = (uint8_t)(lba >> 8);
     cmdfis->lba2 = (uint8_t)(lba >> 16);
-    cmdfis->device = 0x40; // LBA mode
-    
     cmdfis->lba3 = (uint8_t)(lba >> 24);
     cmdfis->lba4 = (uint8_t)(lba >> 32);
     cmdfis->lba5 = (uint8_t)(lba >> 40);
-    
-    cmdfis->countl = sector_count & 0xFF;
-    cmdfis->counth = (sector_count >> 8) & 0xFF;
 
-    int spin = 0;
-    while ((port->tfd & (0x80 | 0x08)) && spin < 1000000) { spin++; }
-    if (spin == 1000000) {
-        printf("[AHCI] Port is hung\n");
+    if (ps.ncq) {
+        // FPDMA QUEUED: число секторов в FEATURE, тег (слот) в COUNT[7:3]
+        cmdfis->command = req->write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+        cmdfis->featurel = req->count & 0xFF;
+        cmdfis->featureh = (req->count >> 8) & 0xFF;
+        cmdfis->countl = (uint8_t)(slot << 3);
+        cmdfis->counth = 0;
+    } else {
+        cmdfis->command = req->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+        cmdfis->countl = req->count & 0xFF;
+        cmdfis->counth = (req->count >> 8) & 0xFF;
+    }
+    return true;
+}
+
+bool AHCIDriver::submit(AhciRequest* req) {
+    if (abarz == nullptr || !req) return false;
+    if (req->port >= 32 || !ports_[req->port].regs) return false;
+    if (req->count == 0 || req->count > AHCI_MAX_SECTORS) return false;
+    if ((uint32_t)req->buffer & 1) return false; // PRDT требует чётный адрес
+
+    AhciPortState& ps = ports_[req->port];
+    req->status = AhciStatus::Pending;
+    req->waiter_tid = -1;
+
+    InterruptGuard guard;
+    int slot;
+    // Без IRQ завершения не придут - опрашиваем порт сами
+    while ((slot = find_cmdslot(ps)) < 0) {
+        if (irq_ < 0 || !TaskScheduler::can_block()) {
+            complete_port(req->port);
+            continue;
+        }
+        TaskScheduler::wait_on(&slot_waiters_, irq_);
+    }
+
+    if (!build_command(ps, slot, req)) {
+        req->status = AhciStatus::Error;
         return false;
     }
 
-    port->ci = 1 << slot;
-    mfence();
-    
-    while (1) {
-        if ((port->ci & (1 << slot)) == 0) 
-            break;
-        if (port->is & (1 << 30)) { 
-            printf("[AHCI] Write disk error\n");
+    // Первая команда ждёт, пока устройство освободится; с очередью
+    // занятость устройства отслеживает контроллер
+    if (ps.active == 0) {
+        int spin = 0;
+        while ((ps.regs->tfd & (0x80 | 0x08)) && spin < 1000000) { spin++; }
+        if (spin == 1000000) {
+            printf("[AHCI] Port is hung\n");
+            req->status = AhciStatus::Error;
             return false;
         }
     }
 
-    if (port->tfd & 0x01) { 
-        printf("[AHCI] Task file write error\n");
-        return false;
+    uint32_t bit = 1u << slot;
+    ps.reqs[slot] = req;
+    ps.active |= bit;
+    mfence();
+    if (ps.ncq) ps.regs->sact = bit;
+    ps.regs->ci = bit;
+    mfence();
+
+    stats_.submitted++;
+    uint32_t inflight = 0;
+    for (uint32_t a = ps.active; a; a &= a - 1) inflight++;
+    if (inflight > stats_.max_inflight) stats_.max_inflight = inflight;
+    return true;
+}
+
+bool AHCIDriver::wait(AhciRequest* req) {
+    InterruptGuard guard;
+    while (req->status == AhciStatus::Pending) {
+        if (irq_ < 0 || !TaskScheduler::can_block()) {
+            complete_port(req->port);
+            continue;
+        }
+        req->waiter_tid = TaskScheduler::get_current_tid();
+        TaskScheduler::block_current(irq_);
     }
+    return req->status == AhciStatus::Done;
+}
 
+bool AHCIDriver::finish(AhciPortState& ps, int slot, AhciStatus status) {
+    AhciRequest* req = ps.reqs[slot];
+    ps.reqs[slot] = nullptr;
+    ps.active &= ~(1u << slot);
+    if (!req) return false;
+
+    if (status == AhciStatus::Done) stats_.completed++;
+    else stats_.errors++;
+
+    req->status = status;
+    if (req->callback) req->callback(req);
+    if (req->waiter_tid < 0) return false;
+    TaskScheduler::unblock(req->waiter_tid);
     return true;
 }
 
+bool AHCIDriver::complete_port(int port_no) {
+    AhciPortState& ps = ports_[port_no];
+    HBA_PORT* port = ps.regs;
+    if (!port) return false;
+
+    uint32_t pis = port->is;
+    port->is = pis;
+    bool woke = false;
+
+    if (pis & HBA_PxIS_FATAL) {
+        // Ошибка останавливает очередь: проваливаем все выданные команды и
+        // перезапускаем порт (сброс ST очищает CI и SACT)
+        printf("[AHCI] Port %d task file error (tfd=0x%x)\n", port_no, port->tfd);
+        stop_cmd(port);
+        port->serr = (uint32_t)-1;
+        port->is = (uint32_t)-1;
+        for (int i = 0; i < 32; i++) {
+            if ((ps.active & (1u << i)) && finish(ps, i, AhciStatus::Error)) woke = true;
+        }
+        start_cmd(port);
+    } else {
+        uint32_t done = ps.active & ~(port->ci | port->sact);
+        for (int i = 0; done; i++, done >>= 1) {
+            if ((done & 1) && finish(ps, i, AhciStatus::Done)) woke = true;
+        }
+    }
+
+    // Освободились слоты - будим ждущих
+    if (slot_waiters_.head && find_cmdslot(ps) >= 0) {
+        TaskScheduler::wake_all(&slot_waiters_);
+        woke = true;
+    }
+    return woke;
+}
+
+bool AHCIDriver::handle_interrupt() {
+    if (abarz == nullptr) return false;
+    uint32_t is = abarz->is;
+    if (is == 0) return false; // Линия IRQ разделяется с другим устройством
+
+    stats_.irqs++;
+    bool woke = false;
+    for (int i = 0; i < 32; i++) {
+        if ((is & (1u << i)) && complete_port(i)) woke = true;
+    }
+    abarz->is = is;
+    return woke;
+}
+
+bool AHCIDriver::transfer(uint8_t port_no, bool write, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    if (abarz == nullptr) return false;
+    port_no &= 0x1F;
+
+    bool ok = true;
+    while (count > 0 && ok) {
+        // Пачка команд выдаётся разом и выполняется диском параллельно
+        AhciRequest reqs[AHCI_SYNC_BATCH];
+        int n = 0;
+        while (count > 0 && n < AHCI_SYNC_BATCH) {
+            uint32_t chunk = count > AHCI_MAX_SECTORS ? AHCI_MAX_SECTORS : count;
+            AhciRequest& r = reqs[n];
+            r.port = port_no;
+            r.write = write;
+            r.lba = lba;
+            r.count = chunk;
+            r.buffer = buffer;
+            r.callback = nullptr;
+            r.context = nullptr;
+            if (!submit(&r)) {
+                ok = false;
+                break;
+            }
+            n++;
+            lba += chunk;
+            buffer += chunk * 512;
+            count -= chunk;
+        }
+        for (int i = 0; i < n; i++) {
+            if (!wait(&reqs[i])) ok = false;
+        }
+    }
+    if (!ok) printf("[AHCI] %s disk error\n", write ? "Write" : "Read");
+    return ok;
+}
+
+bool AHCIDriver::read(uint8_t port_no, uint64_t lba, uint32_t sector_count, void* buffer) {
+    return transfer(port_no, false, lba, sector_count, (uint8_t*)buffer);
+}
+
+bool AHCIDriver::write(uint8_t port_no, uint64_t lba, uint32_t sector_count, void* buffer) {
+    return transfer(port_no, true, lba, sector_count, (uint8_t*)buffer);
+}
+
 bool AHCIDriver::is_present() {
     return s_primary_port != -1;
 }
@@ -337,4 +517,31 @@ int AHCIDriver::get_primary_port() {
     return s_primary_port;
 }
 
+int AHCIDriver::get_irq() {
+    return irq_;
+}
+
+AhciStats AHCIDriver::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void AHCIDriver::print_info() {
+    if (abarz == nullptr) {
+        printf("AHCI controller not present\n");
+        return;
+    }
+    printf("AHCI: %s completion", irq_ >= 0 ? "IRQ" : "polled");
+    if (irq_ >= 0) printf(" (IRQ %d)", irq_);
+    printf("\n");
+    for (int i = 0; i < 32; i++) {
+        if (!ports_[i].regs) continue;
+        printf("  Port %d: %s, queue depth %d, active 0x%x\n", i,
+               ports_[i].ncq ? "NCQ" : "no NCQ", ports_[i].depth, ports_[i].active);
+    }
+    AhciStats st = get_stats();
+    printf("  Commands: %u submitted, %u completed, %u errors\n", st.submitted, st.completed, st.errors);
+    printf("  IRQs: %u, max in flight: %u\n", st.irqs, st.max_inflight);
+}
+
 } // namespace re36
@@ -1,10 +1,40 @@
 #include "kernel/ata.h"
 #include "kernel/pic.h"
+#include "kernel/pci.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
 #include "libc.h"
 
 namespace re36 {
 
 bool ATA::present_ = false;
+bool ATA::lba48_ = false;
+uint64_t ATA::total_sectors_ = 0;
+uint16_t ATA::multiple_ = 1;
+uint16_t ATA::bm_base_ = 0;
+ATA_PRD* ATA::prdt_ = nullptr;
+AtaMode ATA::mode_ = AtaMode::PIO;
+volatile bool ATA::busy_ = false;
+volatile bool ATA::irq_done_ = false;
+volatile uint8_t ATA::bm_status_ = 0;
+volatile int ATA::waiter_tid_ = -1;
+WaitQueue ATA::waiters_ = {nullptr};
+AtaStats ATA::stats_ = {};
+
+static inline void outl(uint16_t port, uint32_t val) {
+    asm volatile("outl %0, %1" :: "a"(val), "Nd"(port));
+}
+
+static inline void insw(uint16_t port, void* buffer, uint32_t words) {
+    asm volatile("rep insw" : "+D"(buffer), "+c"(words) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buffer, uint32_t words) {
+    asm volatile("rep outsw" : "+S"(buffer), "+c"(words) : "d"(port) : "memory");
+}
 
 void ATA::wait_bsy() {
     while (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) & ATA_SR_BSY);
@@ -15,6 +45,7 @@ void ATA::wait_drq() {
 }
 
 bool ATA::init() {
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
     outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xA0);
 
     outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, 0);
@@ -48,79 +79,327 @@ bool ATA::init() {
     }
 
     uint16_t identify_data[256];
-    for (int i = 0; i < 256; i++) {
-        identify_data[i] = inw(ATA_PRIMARY_IO + ATA_REG_DATA);
+    insw(ATA_PRIMARY_IO + ATA_REG_DATA, identify_data, 256);
+
+    // Слово 83 бит 10 - LBA48, число секторов в словах 100-103
+    lba48_ = (identify_data[83] & (1 << 10)) != 0;
+    if (lba48_) {
+        total_sectors_ = identify_data[100] | ((uint32_t)identify_data[101] << 16) |
+                         ((uint64_t)identify_data[102] << 32);
+    } else {
+        total_sectors_ = identify_data[60] | ((uint32_t)identify_data[61] << 16);
     }
 
-    uint32_t total_sectors = identify_data[60] | ((uint32_t)identify_data[61] << 16);
-    (void)total_sectors;
+    // READ/WRITE MULTIPLE: до identify[47] секторов на одно прерывание DRQ
+    multiple_ = 1;
+    uint8_t max_multiple = identify_data[47] & 0xFF;
+    if (max_multiple > 1) {
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0);
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, max_multiple);
+        outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+        wait_bsy();
+        if (!(inb(ATA_PRIMARY_IO + ATA_REG_STATUS) & ATA_SR_ERR)) multiple_ = max_multiple;
+    }
+    mode_ = multiple_ > 1 ? AtaMode::Multiple : AtaMode::PIO;
+
+    // Bus master IDE: контроллер PCI 01:01 с битом 7 prog_if; слово 49 бит 8 -
+    // устройство умеет DMA. Первичный канал всегда на IRQ14 (режим совместимости).
+    PCIDevice* devs = PCI::get_devices();
+    int count = PCI::get_device_count();
+    for (int i = 0; i < count; i++) {
+        PCIDevice* dev = &devs[i];
+        if (dev->class_id != 0x01 || dev->subclass != 0x01 || !(dev->prog_if & 0x80)) continue;
+        if (!(identify_data[49] & (1 << 8))) break;
+
+        uint32_t bar4 = PCI::config_read_dword(dev->bus, dev->slot, dev->func, 0x20);
+        if (!(bar4 & 0x01)) break;
+
+        prdt_ = (ATA_PRD*)PhysicalMemoryManager::alloc_frame();
+        if (!prdt_) break;
+
+        uint16_t cmd = PCI::config_read_word(dev->bus, dev->slot, dev->func, 0x04);
+        PCI::config_write_word(dev->bus, dev->slot, dev->func, 0x04, cmd | 0x04 | 0x01);
+
+        bm_base_ = (uint16_t)(bar4 & 0xFFFC);
+        outb(bm_base_ + ATA_BM_CMD, 0);
+        outb(bm_base_ + ATA_BM_STATUS, ATA_BM_SR_IRQ | ATA_BM_SR_ERR);
+        pic_unmask(ATA_IRQ);
+        mode_ = AtaMode::DMA;
+        break;
+    }
+
+    printf("[ATA] %u sectors, %s, multiple %u, %s\n", (uint32_t)total_sectors_,
+           lba48_ ? "LBA48" : "LBA28", multiple_,
+           bm_base_ ? "bus master DMA on IRQ 14" : "PIO");
 
     present_ = true;
     return true;
 }
 
-bool ATA::read_sectors(uint32_t lba, uint8_t count, void* buffer) {
-    if (!present_) return false;
+void ATA::acquire() {
+    while (true) {
+        // Загрузочный поток не может уснуть и крутится с открытыми
+        // прерываниями, пока владелец канала не доработает
+        InterruptGuard guard;
+        if (!busy_) {
+            busy_ = true;
+            return;
+        }
+        if (TaskScheduler::can_block()) {
+            TaskScheduler::wait_on(&waiters_, ATA_IRQ);
+        }
+    }
+}
 
-    wait_bsy();
+void ATA::release() {
+    InterruptGuard guard;
+    busy_ = false;
+    TaskScheduler::wake_all(&waiters_);
+}
 
-    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, count);
+bool ATA::setup_command(uint64_t lba, uint32_t count, uint8_t cmd28, uint8_t cmd48) {
+    bool ext = lba + count - 1 > ATA_LBA28_MAX;
+    if (ext && !lba48_) return false;
+
+    wait_bsy();
+    if (ext) {
+        // LBA48: сначала старшие байты, затем младшие
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0x40);
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, (uint8_t)(count >> 8));
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA_LO, (uint8_t)(lba >> 24));
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA_MID, (uint8_t)(lba >> 32));
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA_HI, (uint8_t)(lba >> 40));
+    } else {
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+    }
+    // count 256 в LBA28 кодируется нулём
+    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, (uint8_t)count);
     outb(ATA_PRIMARY_IO + ATA_REG_LBA_LO, (uint8_t)(lba & 0xFF));
     outb(ATA_PRIMARY_IO + ATA_REG_LBA_MID, (uint8_t)((lba >> 8) & 0xFF));
     outb(ATA_PRIMARY_IO + ATA_REG_LBA_HI, (uint8_t)((lba >> 16) & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_READ_PIO);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ext ? cmd48 : cmd28);
+    return true;
+}
 
-    uint16_t* buf = (uint16_t*)buffer;
+bool ATA::pio_transfer(bool write, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+
+    uint32_t block = mode_ == AtaMode::PIO ? 1 : multiple_;
+    bool ok;
+    if (block > 1) {
+        ok = write ? setup_command(lba, count, ATA_CMD_WRITE_MULTIPLE, ATA_CMD_WRITE_MULTIPLE_EXT)
+                   : setup_command(lba, count, ATA_CMD_READ_MULTIPLE, ATA_CMD_READ_MULTIPLE_EXT);
+    } else {
+        ok = write ? setup_command(lba, count, ATA_CMD_WRITE_PIO, ATA_CMD_WRITE_PIO_EXT)
+                   : setup_command(lba, count, ATA_CMD_READ_PIO, ATA_CMD_READ_PIO_EXT);
+    }
+    if (!ok) return false;
 
-    for (int s = 0; s < count; s++) {
+    // Один DRQ на блок из block секторов
+    for (uint32_t s = 0; s < count; s += block) {
+        uint32_t n = count - s < block ? count - s : block;
         wait_bsy();
-
         uint8_t status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
-        if (status & ATA_SR_ERR) return false;
-
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) return false;
         wait_drq();
 
-        for (int i = 0; i < 256; i++) {
-            buf[s * 256 + i] = inw(ATA_PRIMARY_IO + ATA_REG_DATA);
-        }
+        if (write) outsw(ATA_PRIMARY_IO + ATA_REG_DATA, buffer + s * ATA_SECTOR_SIZE, n * 256);
+        else insw(ATA_PRIMARY_IO + ATA_REG_DATA, buffer + s * ATA_SECTOR_SIZE, n * 256);
     }
 
+    if (write) {
+        wait_bsy();
+        if (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) & (ATA_SR_ERR | ATA_SR_DF)) return false;
+    }
     return true;
 }
 
-bool ATA::is_present() {
-    return present_;
+bool ATA::build_prdt(uint8_t* buffer, uint32_t bytes) {
+    // Буфер режется по страницам; физически соседние страницы сливаются,
+    // пока запись не пересекает границу 64 КБ
+    uint32_t virt = (uint32_t)buffer;
+    int n = 0;
+    while (bytes > 0) {
+        uint32_t phys = virt < KERNEL_SPACE_END ? virt : VMM::get_physical(virt);
+        if (!phys) return false;
+        uint32_t chunk = PMM_FRAME_SIZE - (virt & (PMM_FRAME_SIZE - 1));
+        if (chunk > bytes) chunk = bytes;
+
+        ATA_PRD* prev = n ? &prdt_[n - 1] : nullptr;
+        uint32_t prev_len = prev ? (prev->bytes ? prev->bytes : 0x10000) : 0;
+        if (prev && prev->phys + prev_len == phys &&
+            (prev->phys >> 16) == ((phys + chunk - 1) >> 16)) {
+            prev->bytes = (uint16_t)(prev_len + chunk);
+        } else {
+            if (n == ATA_PRD_MAX) return false;
+            prdt_[n].phys = phys;
+            prdt_[n].bytes = (uint16_t)chunk;
+            prdt_[n].flags = 0;
+            n++;
+        }
+        virt += chunk;
+        bytes -= chunk;
+    }
+    prdt_[n - 1].flags = ATA_PRD_EOT;
+    return true;
 }
 
-bool ATA::write_sectors(uint32_t lba, uint8_t count, const void* buffer) {
-    if (!present_) return false;
+bool ATA::dma_transfer(bool write, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    if (!build_prdt(buffer, count * ATA_SECTOR_SIZE)) return false;
+
+    uint8_t dir = write ? 0 : ATA_BM_CMD_READ;
+    outb(bm_base_ + ATA_BM_CMD, 0);
+    outl(bm_base_ + ATA_BM_PRDT, (uint32_t)prdt_);
+    outb(bm_base_ + ATA_BM_STATUS, inb(bm_base_ + ATA_BM_STATUS) | ATA_BM_SR_IRQ | ATA_BM_SR_ERR);
+    outb(bm_base_ + ATA_BM_CMD, dir);
+
+    irq_done_ = false;
+    outb(ATA_PRIMARY_CTRL, 0);
+    bool ok = write ? setup_command(lba, count, ATA_CMD_WRITE_DMA, ATA_CMD_WRITE_DMA_EXT)
+                    : setup_command(lba, count, ATA_CMD_READ_DMA, ATA_CMD_READ_DMA_EXT);
+    if (!ok) {
+        outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+        return false;
+    }
+    outb(bm_base_ + ATA_BM_CMD, dir | ATA_BM_CMD_START);
+
+    {
+        // Поток спит до IRQ14; загрузочный поток опрашивает статус сам
+        InterruptGuard guard;
+        while (!irq_done_) {
+            if (TaskScheduler::can_block()) {
+                waiter_tid_ = TaskScheduler::get_current_tid();
+                TaskScheduler::block_current(ATA_IRQ);
+            } else if (inb(bm_base_ + ATA_BM_STATUS) & ATA_BM_SR_IRQ) {
+                handle_interrupt();
+            }
+        }
+        waiter_tid_ = -1;
+    }
 
-    wait_bsy();
+    outb(bm_base_ + ATA_BM_CMD, 0);
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+    uint8_t status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    stats_.dma_commands++;
+    return !(bm_status_ & ATA_BM_SR_ERR) && !(status & (ATA_SR_ERR | ATA_SR_DF));
+}
 
-    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, count);
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA_LO, (uint8_t)(lba & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA_MID, (uint8_t)((lba >> 8) & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_LBA_HI, (uint8_t)((lba >> 16) & 0xFF));
-    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_WRITE_PIO);
+bool ATA::transfer(bool write, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    if (!present_) return false;
 
-    const uint16_t* buf = (const uint16_t*)buffer;
+    acquire();
+    bool ok;
+    // DMA требует чётного адреса; иначе остаётся PIO
+    if (mode_ == AtaMode::DMA && ((uint32_t)buffer & 1) == 0) {
+        ok = dma_transfer(write, lba, count, buffer);
+    } else {
+        ok = pio_transfer(write, lba, count, buffer);
+    }
+    stats_.commands++;
+    stats_.sectors += count;
+    if (!ok) stats_.errors++;
+    release();
+    return ok;
+}
 
-    for (int s = 0; s < count; s++) {
-        wait_bsy();
-        wait_drq();
+bool ATA::read_sectors(uint64_t lba, uint32_t count, void* buffer) {
+    uint8_t* buf = (uint8_t*)buffer;
+    while (count > 0) {
+        uint32_t chunk = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        if (!transfer(false, lba, chunk, buf)) return false;
+        lba += chunk;
+        buf += chunk * ATA_SECTOR_SIZE;
+        count -= chunk;
+    }
+    return true;
+}
 
-        for (int i = 0; i < 256; i++) {
-            outw(ATA_PRIMARY_IO + ATA_REG_DATA, buf[s * 256 + i]);
-        }
+bool ATA::write_sectors(uint64_t lba, uint32_t count, const void* buffer) {
+    uint8_t* buf = (uint8_t*)buffer;
+    while (count > 0) {
+        uint32_t chunk = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        if (!transfer(true, lba, chunk, buf)) return false;
+        lba += chunk;
+        buf += chunk * ATA_SECTOR_SIZE;
+        count -= chunk;
     }
+    return true;
+}
+
+bool ATA::flush() {
+    if (!present_) return false;
 
+    acquire();
     wait_bsy();
-    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, 0xE7);
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, lba48_ ? 0x40 : 0xE0);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, lba48_ ? ATA_CMD_FLUSH_EXT : ATA_CMD_FLUSH);
     wait_bsy();
+    bool ok = !(inb(ATA_PRIMARY_IO + ATA_REG_STATUS) & (ATA_SR_ERR | ATA_SR_DF));
+    stats_.flushes++;
+    if (!ok) stats_.errors++;
+    release();
+    return ok;
+}
+
+bool ATA::is_present() {
+    return present_;
+}
 
+bool ATA::handle_interrupt() {
+    if (!bm_base_) return false;
+    uint8_t bm = inb(bm_base_ + ATA_BM_STATUS);
+    if (!(bm & ATA_BM_SR_IRQ)) return false;
+
+    // Чтение статуса снимает INTRQ устройства, запись 1 - флаги контроллера
+    inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    outb(bm_base_ + ATA_BM_STATUS, bm | ATA_BM_SR_IRQ | ATA_BM_SR_ERR);
+    bm_status_ = bm;
+    stats_.irqs++;
+    irq_done_ = true;
+
+    if (waiter_tid_ < 0) return false;
+    TaskScheduler::unblock(waiter_tid_);
     return true;
 }
 
+int ATA::get_irq() {
+    return bm_base_ ? ATA_IRQ : -1;
+}
+
+bool ATA::set_mode(AtaMode mode) {
+    if (mode == AtaMode::DMA && !bm_base_) return false;
+    if (mode == AtaMode::Multiple && multiple_ <= 1) return false;
+    acquire();
+    mode_ = mode;
+    release();
+    return true;
+}
+
+AtaMode ATA::get_mode() {
+    return mode_;
+}
+
+AtaStats ATA::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void ATA::print_info() {
+    if (!present_) {
+        printf("ATA disk not present\n");
+        return;
+    }
+    static const char* mode_names[] = { "PIO", "PIO multiple", "DMA" };
+    printf("ATA: %u sectors, %s, mode %s\n", (uint32_t)total_sectors_,
+           lba48_ ? "LBA48" : "LBA28", mode_names[(int)mode_]);
+    printf("  Multiple: %u sectors/DRQ, bus master: ", multiple_);
+    if (bm_base_) printf("0x%x (IRQ %d)\n", bm_base_, ATA_IRQ);
+    else printf("none\n");
+    AtaStats st = get_stats();
+    printf("  Commands: %u (%u DMA), %u sectors, %u errors\n",
+           st.commands, st.dma_commands, st.sectors, st.errors);
+    printf("  IRQs: %u, cache flushes: %u\n", st.irqs, st.flushes);
+}
+
 } // namespace re36
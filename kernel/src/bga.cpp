@@ -17,6 +17,7 @@
 #define VBE_DISPI_INDEX_VIRT_HEIGHT  0x7
 #define VBE_DISPI_INDEX_X_OFFSET     0x8
 #define VBE_DISPI_INDEX_Y_OFFSET     0x9
+#define VBE_DISPI_INDEX_VIDEO_MEMORY_64K 0xA
 
 #define VBE_DISPI_DISABLED           0x00
 #define VBE_DISPI_ENABLED            0x01
@@ -32,7 +33,7 @@ uint16_t BgaDriver::bpp_ = 0;
 uint32_t BgaDriver::pitch_ = 0;
 
 uint32_t BgaDriver::framebuffer_phys_ = 0;
-uint32_t BgaDriver::framebuffer_virt_ = 0x00400000; // Directly after the first 4MB of Kernel Space
+uint32_t BgaDriver::framebuffer_virt_ = 0; // = framebuffer_phys_ after init (identity-mapped MMIO)
 uint32_t BgaDriver::framebuffer_size_ = 0;
 
 static const uint8_t font8x8[128][8] = {
@@ -186,11 +187,22 @@ void BgaDriver::init(uint16_t width, uint16_t height, uint16_t bpp) {
     framebuffer_size_ = pitch_ * height_;
 
     // 3. Map the Framebuffer in VMM
-    printf("[BGA] Mapping %d bytes at Phys: 0x%x to Virt: 0x%x\n", 
-           framebuffer_size_, framebuffer_phys_, framebuffer_virt_);
-           
-    for (uint32_t i = 0; i < framebuffer_size_; i += PAGE_SIZE) {
-        VMM::map_page(framebuffer_virt_ + i, framebuffer_phys_ + i, PAGE_PRESENT | PAGE_WRITABLE);
+    // Identity-mapped like the LAPIC and AHCI registers, outside the RAM
+    // identity map. When VRAM covers whole 4 MB pages, the 3 MB frame
+    // takes one PSE page (one TLB entry, no page table) instead of 768 PTEs.
+    framebuffer_virt_ = framebuffer_phys_;
+    uint32_t vram_size = (uint32_t)read_register(VBE_DISPI_INDEX_VIDEO_MEMORY_64K) * 0x10000;
+    uint32_t mapped = 0;
+    while (mapped < framebuffer_size_ && mapped + LARGE_PAGE_SIZE <= vram_size &&
+           VMM::map_large_page(framebuffer_virt_ + mapped, framebuffer_phys_ + mapped,
+                               PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL)) {
+        mapped += LARGE_PAGE_SIZE;
+    }
+    printf("[BGA] Mapping %d bytes at Phys: 0x%x to Virt: 0x%x (%s pages)\n",
+           framebuffer_size_, framebuffer_phys_, framebuffer_virt_, mapped ? "4 MB" : "4 KB");
+
+    for (; mapped < framebuffer_size_; mapped += PAGE_SIZE) {
+        VMM::map_page(framebuffer_virt_ + mapped, framebuffer_phys_ + mapped, PAGE_PRESENT | PAGE_WRITABLE);
     }
 
     // 4. Configure BGA Registers (Crucial steps to avoid artifacting and bugs)
@@ -278,11 +290,8 @@ void BgaDriver::scroll(uint32_t lines, uint32_t bg_color) {
     uint32_t bytes_to_copy = (height_ - pixels_to_scroll) * pitch_;
     uint32_t scroll_offset = pixels_to_scroll * pitch_;
 
-    // Fast memory move to slide everything up
-    // Must handle overlapping memory regions safely, standard memcpy is fine since dest < src
-    for (uint32_t i = 0; i < bytes_to_copy; i++) {
-        fb[i] = fb[i + scroll_offset];
-    }
+    // Slide everything up (regions overlap, dest < src)
+    memmove(fb, fb + scroll_offset, bytes_to_copy);
 
     // Clear the bottom lines
     uint32_t clear_start = bytes_to_copy;
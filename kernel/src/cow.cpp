@@ -8,8 +8,10 @@
 
 namespace re36 {
 
+// Через VMM: на SMP запись сбрасывается и на процессорах того же
+// адресного пространства
 static inline void cow_invlpg(uint32_t addr) {
-    asm volatile("invlpg (%0)" :: "r"(addr) : "memory");
+    VMM::invalidate_page(addr);
 }
 
 static inline uint32_t* cow_get_pde_ptr(uint32_t pd_index) {
@@ -21,15 +23,19 @@ static inline uint32_t* cow_get_pte_ptr(uint32_t virt) {
     return &((uint32_t*)PAGE_TABLES_VADDR)[index];
 }
 
+static CowStats cow_stats = {0, 0, 0};
+
+// Таблицы страниц пользователя не копируются: оба каталога ссылаются на
+// одни таблицы через PDE без PAGE_WRITABLE, и первая запись в любые 4 МБ
+// отделяет свою копию таблицы (cow_unshare_table). fork, за которым
+// сразу следует exec, не трогает ни одного PTE.
 uint32_t* cow_clone_directory() {
     InterruptGuard guard;
 
     uint32_t* new_dir = (uint32_t*)PhysicalMemoryManager::alloc_frame();
     if (!new_dir) return nullptr;
 
-    for (int i = 0; i < PD_ENTRIES; i++) {
-        new_dir[i] = 0;
-    }
+    zero_page(new_dir);
 
     uint32_t* cur_pd = (uint32_t*)PAGE_DIR_VADDR;
 
@@ -37,71 +43,79 @@ uint32_t* cow_clone_directory() {
         if (i == RECURSIVE_PD_INDEX) continue;
         if (!(cur_pd[i] & PAGE_PRESENT)) continue;
 
-        if (!(cur_pd[i] & PAGE_USER)) {
-            new_dir[i] = cur_pd[i];
-            continue;
-        }
-
-        uint32_t* new_pt = (uint32_t*)PhysicalMemoryManager::alloc_frame();
-        if (!new_pt) {
-            for (int k = 0; k < i; k++) {
-                if (k == RECURSIVE_PD_INDEX) continue;
-                if (!(new_dir[k] & PAGE_PRESENT)) continue;
-                if (!(new_dir[k] & PAGE_USER)) continue;
-
-                uint32_t* pt = (uint32_t*)(new_dir[k] & 0xFFFFF000);
-                for (int j = 0; j < PT_ENTRIES; j++) {
-                    if (pt[j] & PAGE_PRESENT) {
-                        uint32_t phys = pt[j] & 0xFFFFF000;
-                        PhysicalMemoryManager::dec_ref(phys);
-
-                        if (pt[j] & PAGE_COW) {
-                            uint32_t* src_pte = cow_get_pte_ptr((k << 22) | (j << 12));
-                            *src_pte = phys | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
-                            *src_pte &= ~PAGE_COW;
-                            cow_invlpg((k << 22) | (j << 12));
-                        }
-                    }
-                }
-                PhysicalMemoryManager::free_frame((void*)pt);
+        if (cur_pd[i] & PAGE_USER) {
+            if (!(cur_pd[i] & PDE_SHARED)) {
+                cur_pd[i] = (cur_pd[i] & ~PAGE_WRITABLE) | PDE_SHARED;
             }
-            PhysicalMemoryManager::free_frame((void*)new_dir);
-            return nullptr;
+            PhysicalMemoryManager::inc_ref(cur_pd[i] & 0xFFFFF000);
+            cow_stats.tables_shared++;
         }
+        new_dir[i] = cur_pd[i];
+    }
 
-        for (int j = 0; j < PT_ENTRIES; j++) {
-            uint32_t* src_pte = cow_get_pte_ptr((i << 22) | (j << 12));
-
-            if (!(*src_pte & PAGE_PRESENT)) {
-                new_pt[j] = 0;
-                continue;
-            }
-
-            uint32_t phys = *src_pte & 0xFFFFF000;
-            uint32_t flags = *src_pte & 0xFFF;
+    new_dir[RECURSIVE_PD_INDEX] = (uint32_t)new_dir | PAGE_PRESENT | PAGE_WRITABLE;
 
-            if (flags & PAGE_WRITABLE) {
-                new_pt[j] = phys | PAGE_PRESENT | PAGE_USER | PAGE_COW;
-                new_pt[j] &= ~PAGE_WRITABLE;
+    // PDE родителя стали только для чтения: один сброс TLB на всё
+    VMM::flush_address_space();
+    return new_dir;
+}
 
-                *src_pte = phys | PAGE_PRESENT | PAGE_USER | PAGE_COW;
-                *src_pte &= ~PAGE_WRITABLE;
-            } else {
-                new_pt[j] = *src_pte;
-            }
+bool cow_unshare_table(uint32_t pd_index) {
+    InterruptGuard guard;
 
-            PhysicalMemoryManager::inc_ref(phys);
+    uint32_t* pde = cow_get_pde_ptr(pd_index);
+    if ((*pde & (PAGE_PRESENT | PDE_SHARED)) != (PAGE_PRESENT | PDE_SHARED)) return true;
+
+    uint32_t old_pt = *pde & 0xFFFFF000;
+    if (PhysicalMemoryManager::get_refcount(old_pt) == 1) {
+        // Остальные владельцы уже отказались от таблицы
+        *pde = (*pde | PAGE_WRITABLE) & ~PDE_SHARED;
+        cow_stats.tables_reclaimed++;
+        VMM::flush_address_space();
+        return true;
+    }
 
-            uint32_t virt_addr = (i << 22) | (j << 12);
-            cow_invlpg(virt_addr);
+    uint32_t* new_pt = (uint32_t*)PhysicalMemoryManager::alloc_frame();
+    if (!new_pt) return false;
+
+    // Страницы теперь в двух таблицах: записываемые становятся CoW в обеих.
+    // Общую таблицу видят через PDE только для чтения, так что устаревших
+    // записываемых записей TLB на неё ни у кого нет.
+    uint32_t* ptes = cow_get_pte_ptr(pd_index << 22);
+    for (int j = 0; j < PT_ENTRIES; j++) {
+        uint32_t e = ptes[j];
+        if (!(e & PAGE_PRESENT)) {
+            new_pt[j] = 0;
+            continue;
         }
-
-        new_dir[i] = (uint32_t)new_pt | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+        if (e & PAGE_WRITABLE) {
+            e = (e & ~PAGE_WRITABLE) | PAGE_COW;
+            ptes[j] = e;
+        }
+        new_pt[j] = e;
+        PhysicalMemoryManager::inc_ref(e & 0xFFFFF000);
+        if (e & PAGE_USER) PhysicalMemoryManager::inc_mapcount(e & 0xFFFFF000);
     }
 
-    new_dir[RECURSIVE_PD_INDEX] = (uint32_t)new_dir | PAGE_PRESENT | PAGE_WRITABLE;
+    *pde = (uint32_t)new_pt | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    PhysicalMemoryManager::dec_ref(old_pt);
+    cow_stats.tables_copied++;
+    VMM::flush_address_space();
+    return true;
+}
 
-    return new_dir;
+bool cow_unshare_range(uint32_t virt, uint32_t length) {
+    if (length == 0) return true;
+    uint32_t last = (virt + length - 1) >> 22;
+    for (uint32_t i = virt >> 22; i <= last; i++) {
+        if (!cow_unshare_table(i)) return false;
+    }
+    return true;
+}
+
+CowStats cow_get_stats() {
+    InterruptGuard guard;
+    return cow_stats;
 }
 
 bool cow_handle_fault(uint32_t fault_addr, uint32_t error_code) {
@@ -114,6 +128,17 @@ bool cow_handle_fault(uint32_t fault_addr, uint32_t error_code) {
     uint32_t* pde = cow_get_pde_ptr(pd_index);
     if (!(*pde & PAGE_PRESENT)) return false;
 
+    // Запись в таблицу, общую после fork: сначала своя копия таблицы,
+    // затем обычный CoW страницы повторным сбоем
+    if (*pde & PDE_SHARED) {
+        if (cow_unshare_table(pd_index)) return true;
+        printf("\n[CoW] OOM copying page table for 0x%x — killing TID %d\n", fault_addr, current_tid);
+        if (current_tid > 0) {
+            thread_terminate(current_tid);
+        }
+        return false;
+    }
+
     uint32_t* pte = cow_get_pte_ptr(fault_addr);
     uint32_t pte_val = *pte;
 
@@ -137,13 +162,11 @@ bool cow_handle_fault(uint32_t fault_addr, uint32_t error_code) {
         return false;
     }
 
-    uint8_t* src = (uint8_t*)(old_phys);
-    uint8_t* dst = (uint8_t*)new_frame;
-    for (int i = 0; i < (int)PAGE_SIZE; i++) {
-        dst[i] = src[i];
-    }
+    copy_page(new_frame, (void*)old_phys);
 
+    PhysicalMemoryManager::dec_mapcount(old_phys);
     PhysicalMemoryManager::dec_ref(old_phys);
+    PhysicalMemoryManager::inc_mapcount((uint32_t)new_frame);
 
     *pte = (uint32_t)new_frame | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
     *pte &= ~PAGE_COW;
@@ -152,4 +175,60 @@ bool cow_handle_fault(uint32_t fault_addr, uint32_t error_code) {
     return true;
 }
 
+bool cow_page_mapped(uint32_t virt) {
+    if (!(*cow_get_pde_ptr(virt >> 22) & PAGE_PRESENT)) return false;
+    uint32_t pte = *cow_get_pte_ptr(virt);
+    return (pte & (PAGE_PRESENT | PAGE_USER)) == (PAGE_PRESENT | PAGE_USER);
+}
+
+uint32_t cow_share_page(uint32_t virt) {
+    InterruptGuard guard;
+    if (!cow_page_mapped(virt)) return 0;
+
+    if (!cow_unshare_table(virt >> 22)) return 0;
+
+    uint32_t* pte = cow_get_pte_ptr(virt);
+    uint32_t phys = *pte & 0xFFFFF000;
+    if (*pte & PAGE_WRITABLE) {
+        *pte = (*pte & ~PAGE_WRITABLE) | PAGE_COW;
+        cow_invlpg(virt);
+    }
+    PhysicalMemoryManager::inc_ref(phys);
+    return phys;
+}
+
+uint32_t cow_take_page(uint32_t virt) {
+    InterruptGuard guard;
+    if (!cow_page_mapped(virt)) return 0;
+
+    uint32_t phys = *cow_get_pte_ptr(virt) & 0xFFFFF000;
+    if (!VMM::unmap_page(virt)) return 0;
+    return phys;
+}
+
+void cow_map_page(uint32_t virt, uint32_t phys) {
+    uint32_t flags = PAGE_PRESENT | PAGE_USER;
+    if (PhysicalMemoryManager::get_refcount(phys) > 1) flags |= PAGE_COW;
+    else flags |= PAGE_WRITABLE;
+    VMM::map_page(virt, phys, flags);
+}
+
+void cow_protect_page(uint32_t virt, bool writable) {
+    InterruptGuard guard;
+    if (!cow_page_mapped(virt)) return;
+    if (!cow_unshare_table(virt >> 22)) return;
+
+    uint32_t* pte = cow_get_pte_ptr(virt);
+    uint32_t val = *pte & ~(PAGE_WRITABLE | PAGE_COW);
+    if (writable) {
+        // Общий фрейм станет записываемым только через копию при записи
+        uint32_t phys = val & 0xFFFFF000;
+        val |= PhysicalMemoryManager::get_refcount(phys) > 1 ? PAGE_COW : PAGE_WRITABLE;
+    }
+    if (val != *pte) {
+        *pte = val;
+        cow_invlpg(virt);
+    }
+}
+
 } // namespace re36
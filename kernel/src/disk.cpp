@@ -1,30 +1,508 @@
 #include "kernel/disk.h"
 #include "kernel/ahci.h"
 #include "kernel/ata.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "kernel/kmalloc.h"
+#include "kernel/timer.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
 #include "libc.h"
 
 namespace re36 {
 
+BlockQueue Disk::queues_[BLOCK_MAX_QUEUES];
+int Disk::queue_count_ = 0;
+BlockQueue* Disk::primary_ = nullptr;
+
+void BlockQueue::init(const char* name, BlockDriver driver, uint8_t port) {
+    int i = 0;
+    while (name[i] && i < 7) {
+        name_[i] = name[i];
+        i++;
+    }
+    name_[i] = '\0';
+
+    driver_ = driver;
+    port_ = port;
+    merging_ = true;
+    dispatching_ = false;
+    plugged_ = 0;
+    head_lba_ = 0;
+    queue_ = nullptr;
+    merge_buffer_ = (uint8_t*)PhysicalMemoryManager::alloc_blocks(
+        BLOCK_BATCH * BLOCK_MERGE_MAX_SECTORS * 512 / PMM_FRAME_SIZE);
+    reset_stats();
+    active_ = true;
+}
+
+bool BlockQueue::driver_rw(bool write, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    if (driver_ == BlockDriver::AHCI) {
+        return write ? AHCIDriver::write(port_, lba, count, buffer)
+                     : AHCIDriver::read(port_, lba, count, buffer);
+    }
+    return write ? ATA::write_sectors(lba, count, buffer)
+                 : ATA::read_sectors(lba, count, buffer);
+}
+
+void BlockQueue::insert(BlockRequest* req) {
+    // Равные LBA остаются в порядке поступления
+    BlockRequest** link = &queue_;
+    while (*link && (*link)->lba <= req->lba) link = &(*link)->next;
+    req->next = *link;
+    *link = req;
+
+    stats_.requests++;
+    stats_.depth++;
+    if (stats_.depth > stats_.max_depth) stats_.max_depth = stats_.depth;
+}
+
+void BlockQueue::submit(BlockRequest* req) {
+    req->status = BLOCK_PENDING;
+    req->waiter_tid = -1;
+    req->next = nullptr;
+    req->submit_tsc = Timer::read_tsc();
+    req->submit_tick = Timer::get_ticks();
+
+    // Буфер процесса виден только из его адресного пространства, а очередь
+    // может обслуживать другой поток - такой запрос выполняется сразу
+    uint32_t end = (uint32_t)req->buffer + req->count * 512;
+    if (end > KERNEL_SPACE_END || req->count > BLOCK_MERGE_MAX_SECTORS) {
+        bool ok = driver_rw(req->write, req->lba, req->count, req->buffer);
+        InterruptGuard guard;
+        stats_.requests++;
+        stats_.bypassed++;
+        stats_.dispatches++;
+        stats_.sectors += req->count;
+        if (!ok) stats_.errors++;
+        req->status = ok ? BLOCK_DONE : BLOCK_ERROR;
+        return;
+    }
+
+    bool run_dispatch = false;
+    {
+        InterruptGuard guard;
+        insert(req);
+        if (plugged_ == 0 && !dispatching_) {
+            dispatching_ = true;
+            run_dispatch = true;
+        }
+    }
+    if (run_dispatch) dispatch();
+}
+
+bool BlockQueue::wait(BlockRequest* req) {
+    while (true) {
+        bool run_dispatch = false;
+        {
+            InterruptGuard guard;
+            if (req->status != BLOCK_PENDING) break;
+            if (!dispatching_) {
+                dispatching_ = true;
+                run_dispatch = true;
+            } else if (TaskScheduler::can_block()) {
+                // Запрос выполнит текущий обработчик очереди и разбудит нас
+                req->waiter_tid = TaskScheduler::get_current_tid();
+                TaskScheduler::block_current(-1);
+                continue;
+            }
+        }
+        if (run_dispatch) dispatch();
+    }
+    return req->status == BLOCK_DONE;
+}
+
+void BlockQueue::plug() {
+    InterruptGuard guard;
+    plugged_++;
+}
+
+void BlockQueue::unplug() {
+    bool run_dispatch = false;
+    {
+        InterruptGuard guard;
+        if (plugged_ > 0) plugged_--;
+        if (plugged_ == 0 && queue_ && !dispatching_) {
+            dispatching_ = true;
+            run_dispatch = true;
+        }
+    }
+    if (run_dispatch) dispatch();
+}
+
+BlockRequest* BlockQueue::take_run(uint64_t* lba, uint32_t* sectors) {
+    if (!queue_) return nullptr;
+
+    // Дедлайн: самый старый запрос, если он ждёт слишком долго
+    uint32_t now = Timer::get_ticks();
+    BlockRequest** start = nullptr;
+    for (BlockRequest** l = &queue_; *l; l = &(*l)->next) {
+        if (now - (*l)->submit_tick >= BLOCK_DEADLINE_TICKS &&
+            (!start || (*l)->submit_tick < (*start)->submit_tick)) {
+            start = l;
+        }
+    }
+
+    // C-SCAN: первый запрос не ниже головки, иначе - с начала диска
+    if (!start) {
+        start = &queue_;
+        for (BlockRequest** l = &queue_; *l; l = &(*l)->next) {
+            if ((*l)->lba >= head_lba_) {
+                start = l;
+                break;
+            }
+        }
+    }
+
+    BlockRequest* first = *start;
+    *start = first->next;
+    first->next = nullptr;
+    stats_.depth--;
+
+    uint64_t end = first->lba + first->count;
+    uint32_t count = first->count;
+    BlockRequest* tail = first;
+    uint32_t n = 1;
+
+    // Следом по списку идут запросы с LBA >= начала: подряд идущие того
+    // же направления добавляются к команде
+    if (merging_) {
+        BlockRequest** l = start;
+        while (*l && n < BLOCK_RUN_MAX && (*l)->lba <= end) {
+            BlockRequest* r = *l;
+            if (r->lba == end && r->write == first->write &&
+                count + r->count <= BLOCK_MERGE_MAX_SECTORS) {
+                *l = r->next;
+                r->next = nullptr;
+                tail->next = r;
+                tail = r;
+                end += r->count;
+                count += r->count;
+                n++;
+                stats_.depth--;
+                stats_.merged++;
+                continue;
+            }
+            l = &r->next;
+        }
+    }
+
+    head_lba_ = end;
+    *lba = first->lba;
+    *sectors = count;
+    return first;
+}
+
+void BlockQueue::complete(BlockRequest* run, bool ok) {
+    uint64_t now = Timer::read_tsc();
+    InterruptGuard guard;
+    while (run) {
+        BlockRequest* next = run->next;
+
+        uint32_t kc = (uint32_t)((now - run->submit_tsc) >> 10);
+        int bucket = 0;
+        while (bucket < BLOCK_LATENCY_BUCKETS - 1 && kc >= (16u << (bucket * 2))) bucket++;
+        stats_.latency[bucket]++;
+        if (!ok) stats_.errors++;
+
+        run->next = nullptr;
+        run->status = ok ? BLOCK_DONE : BLOCK_ERROR;
+        if (run->waiter_tid >= 0) TaskScheduler::unblock(run->waiter_tid);
+        run = next;
+    }
+}
+
+void BlockQueue::dispatch() {
+    // Вызывается с dispatching_ = true; пока мы ждём драйвер, другие потоки
+    // добавляют запросы в очередь, и они сливаются со следующей пачкой
+    while (true) {
+        BlockRequest* runs[BLOCK_BATCH];
+        uint64_t lbas[BLOCK_BATCH];
+        uint32_t counts[BLOCK_BATCH];
+        int n = 0;
+        {
+            InterruptGuard guard;
+            int batch = driver_ == BlockDriver::AHCI ? BLOCK_BATCH : 1;
+            while (n < batch) {
+                runs[n] = take_run(&lbas[n], &counts[n]);
+                if (!runs[n]) break;
+                n++;
+            }
+            if (n == 0) {
+                dispatching_ = false;
+                return;
+            }
+            stats_.dispatches += n;
+        }
+
+        // Одиночный запрос идёт из своего буфера, слитый - через буфер слияния
+        uint8_t* bufs[BLOCK_BATCH];
+        for (int i = 0; i < n; i++) {
+            stats_.sectors += counts[i];
+            if (!runs[i]->next || !merge_buffer_) {
+                bufs[i] = runs[i]->buffer;
+                continue;
+            }
+            bufs[i] = merge_buffer_ + i * BLOCK_MERGE_MAX_SECTORS * 512;
+            if (runs[i]->write) {
+                uint32_t off = 0;
+                for (BlockRequest* r = runs[i]; r; r = r->next) {
+                    memcpy(bufs[i] + off, r->buffer, r->count * 512);
+                    off += r->count * 512;
+                }
+            }
+        }
+
+        bool ok[BLOCK_BATCH];
+        if (driver_ == BlockDriver::AHCI && n > 1) {
+            // Команды пачки стоят в очереди контроллера одновременно
+            AhciRequest reqs[BLOCK_BATCH];
+            for (int i = 0; i < n; i++) {
+                reqs[i].port = port_;
+                reqs[i].write = runs[i]->write;
+                reqs[i].lba = lbas[i];
+                reqs[i].count = counts[i];
+                reqs[i].buffer = bufs[i];
+                reqs[i].callback = nullptr;
+                reqs[i].context = nullptr;
+                ok[i] = AHCIDriver::submit(&reqs[i]);
+            }
+            for (int i = 0; i < n; i++) {
+                if (ok[i]) ok[i] = AHCIDriver::wait(&reqs[i]);
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                if (runs[i]->next && !merge_buffer_) {
+                    ok[i] = false;
+                } else {
+                    ok[i] = driver_rw(runs[i]->write, lbas[i], counts[i], bufs[i]);
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (ok[i] && bufs[i] != runs[i]->buffer && !runs[i]->write) {
+                uint32_t off = 0;
+                for (BlockRequest* r = runs[i]; r; r = r->next) {
+                    memcpy(r->buffer, bufs[i] + off, r->count * 512);
+                    off += r->count * 512;
+                }
+            }
+            complete(runs[i], ok[i]);
+        }
+    }
+}
+
+bool BlockQueue::rw(bool write, uint64_t lba, uint32_t count, void* buffer) {
+    uint8_t* buf = (uint8_t*)buffer;
+
+    // Крупный запрос режется на куски, которые уходят в очередь разом
+    bool ok = true;
+    while (count > 0) {
+        BlockRequest reqs[BLOCK_BATCH];
+        int n = 0;
+        plug();
+        while (count > 0 && n < BLOCK_BATCH) {
+            uint32_t chunk = count > BLOCK_MERGE_MAX_SECTORS ? BLOCK_MERGE_MAX_SECTORS : count;
+            reqs[n].lba = lba;
+            reqs[n].count = chunk;
+            reqs[n].write = write;
+            reqs[n].buffer = buf;
+            submit(&reqs[n]);
+            n++;
+            lba += chunk;
+            buf += chunk * 512;
+            count -= chunk;
+        }
+        unplug();
+        for (int i = 0; i < n; i++) {
+            if (!wait(&reqs[i])) ok = false;
+        }
+    }
+    return ok;
+}
+
+BlockQueueStats BlockQueue::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void BlockQueue::reset_stats() {
+    InterruptGuard guard;
+    uint32_t depth = stats_.depth;
+    memset(&stats_, 0, sizeof(stats_));
+    stats_.depth = active_ ? depth : 0;
+}
+
+void BlockQueue::print_stats() {
+    BlockQueueStats st = get_stats();
+    printf("%s: %u requests, %u commands, %u merged, %u bypassed, %u errors\n",
+           name_, st.requests, st.dispatches, st.merged, st.bypassed, st.errors);
+    uint32_t merge_pct = st.requests ? st.merged * 100 / st.requests : 0;
+    printf("  depth %u (max %u), merge rate %u%%, %u sectors\n",
+           st.depth, st.max_depth, merge_pct, st.sectors);
+    printf("  latency, kcycles: <16:%u <64:%u <256:%u <1K:%u <4K:%u <16K:%u <64K:%u more:%u\n",
+           st.latency[0], st.latency[1], st.latency[2], st.latency[3],
+           st.latency[4], st.latency[5], st.latency[6], st.latency[7]);
+}
+
+void Disk::init() {
+    queue_count_ = 0;
+    primary_ = nullptr;
+
+    if (AHCIDriver::is_present()) {
+        queues_[queue_count_++].init("ahci", BlockDriver::AHCI, (uint8_t)AHCIDriver::get_primary_port());
+    }
+    if (ATA::is_present()) {
+        queues_[queue_count_++].init("ata0", BlockDriver::ATA, 0);
+    }
+    if (queue_count_ > 0) primary_ = &queues_[0];
+}
+
 bool Disk::is_present() {
     return AHCIDriver::is_present() || ATA::is_present();
 }
 
 bool Disk::read_sectors(uint64_t lba, uint32_t count, void* buffer) {
-    if (AHCIDriver::is_present()) {
+    if (primary_) {
+        return primary_->rw(false, lba, count, buffer);
+    } else if (AHCIDriver::is_present()) {
         return AHCIDriver::read((uint8_t)AHCIDriver::get_primary_port(), lba, count, buffer);
     } else if (ATA::is_present()) {
-        return ATA::read_sectors((uint32_t)lba, count, buffer);
+        return ATA::read_sectors(lba, count, buffer);
     }
     return false;
 }
 
 bool Disk::write_sectors(uint64_t lba, uint32_t count, const void* buffer) {
-    if (AHCIDriver::is_present()) {
+    if (primary_) {
+        return primary_->rw(true, lba, count, (void*)buffer);
+    } else if (AHCIDriver::is_present()) {
         return AHCIDriver::write((uint8_t)AHCIDriver::get_primary_port(), lba, count, (void*)buffer);
     } else if (ATA::is_present()) {
-        return ATA::write_sectors((uint32_t)lba, count, buffer);
+        return ATA::write_sectors(lba, count, buffer);
     }
     return false;
 }
 
+bool Disk::flush() {
+    // AHCI-драйвер пока не выдаёт FLUSH CACHE - сбрасывается только IDE
+    return ATA::is_present() ? ATA::flush() : true;
+}
+
+BlockQueue* Disk::primary() {
+    return primary_;
+}
+
+BlockQueue* Disk::get_queue(int index) {
+    if (index < 0 || index >= queue_count_) return nullptr;
+    return &queues_[index];
+}
+
+void Disk::print_stats() {
+    if (queue_count_ == 0) {
+        printf("No block devices\n");
+        return;
+    }
+    for (int i = 0; i < queue_count_; i++) {
+        queues_[i].print_stats();
+    }
+}
+
+static uint32_t gcd32(uint32_t a, uint32_t b) {
+    while (b) { uint32_t t = a % b; a = b; b = t; }
+    return a;
+}
+
+// Выдать sectors одиночных запросов в перемешанном порядке одной пачкой,
+// вернуть затраченные такты TSC
+static uint64_t selftest_pass(BlockQueue* q, BlockRequest* reqs, uint8_t* buf,
+                              uint64_t lba, uint32_t sectors, bool write, bool* ok) {
+    uint64_t t0 = Timer::read_tsc();
+    q->plug();
+    // Шаг взаимно прост с числом секторов - обходим каждый ровно раз
+    uint32_t step = 7;
+    while (gcd32(step, sectors) != 1) step++;
+    for (uint32_t i = 0, s = 0; i < sectors; i++, s = (s + step) % sectors) {
+        reqs[i].lba = lba + s;
+        reqs[i].count = 1;
+        reqs[i].write = write;
+        reqs[i].buffer = buf + s * 512;
+        q->submit(&reqs[i]);
+    }
+    q->unplug();
+    for (uint32_t i = 0; i < sectors; i++) {
+        if (!q->wait(&reqs[i])) *ok = false;
+    }
+    return Timer::read_tsc() - t0;
+}
+
+static uint32_t selftest_kb_per_sec(uint32_t sectors, uint64_t cycles, uint32_t tsc_mhz) {
+    uint32_t us = (uint32_t)(cycles >> 6) / tsc_mhz * 64;
+    if (us == 0) us = 1;
+    return sectors / 2 * 1000000 / us;
+}
+
+void Disk::selftest(uint64_t lba, uint32_t sectors, bool writable) {
+    if (queue_count_ == 0) {
+        printf("No block devices\n");
+        return;
+    }
+    sectors &= ~1u;
+    if (sectors < 2 || sectors > 256) {
+        printf("Selftest range must be 2..256 sectors\n");
+        return;
+    }
+
+    uint32_t frames = sectors * 512 / PMM_FRAME_SIZE + 1;
+    uint8_t* buf = (uint8_t*)PhysicalMemoryManager::alloc_blocks(frames);
+    BlockRequest* reqs = (BlockRequest*)kmalloc(sectors * sizeof(BlockRequest));
+    if (!buf || !reqs) {
+        printf("Out of memory for selftest\n");
+        if (buf) {
+            for (uint32_t i = 0; i < frames; i++) PhysicalMemoryManager::free_frame(buf + i * PMM_FRAME_SIZE);
+        }
+        if (reqs) kfree(reqs);
+        return;
+    }
+
+    uint32_t tsc_mhz = Timer::get_tsc_khz() / 1000;
+    if (tsc_mhz == 0) tsc_mhz = 1;
+
+    printf("[Blocktest] %u single-sector requests in shuffled order at LBA %u\n",
+           sectors, (uint32_t)lba);
+
+    for (int qi = 0; qi < queue_count_; qi++) {
+        BlockQueue* q = &queues_[qi];
+        bool can_write = writable && q == primary_;
+        bool ok = true;
+
+        for (int pass = 0; pass < (can_write ? 2 : 1); pass++) {
+            bool write = pass == 1;
+            // Запись - теми же данными, что только что прочитаны
+            if (write && !q->rw(false, lba, sectors, buf)) ok = false;
+
+            uint32_t kbs[2];
+            uint32_t cmds[2];
+            for (int merge = 0; merge < 2; merge++) {
+                q->set_merging(merge == 1);
+                uint32_t d0 = q->get_stats().dispatches;
+                uint64_t cycles = selftest_pass(q, reqs, buf, lba, sectors, write, &ok);
+                cmds[merge] = q->get_stats().dispatches - d0;
+                kbs[merge] = selftest_kb_per_sec(sectors, cycles, tsc_mhz);
+            }
+            q->set_merging(true);
+
+            printf("  %s %s: unmerged %u KB/s (%u cmds), merged %u KB/s (%u cmds)%s\n",
+                   q->name(), write ? "write" : "read ", kbs[0], cmds[0], kbs[1], cmds[1],
+                   ok ? "" : " [I/O ERROR]");
+        }
+        if (!can_write) printf("  %s write skipped (not the scratch device)\n", q->name());
+    }
+
+    kfree(reqs);
+    for (uint32_t i = 0; i < frames; i++) PhysicalMemoryManager::free_frame(buf + i * PMM_FRAME_SIZE);
+}
+
 } // namespace re36
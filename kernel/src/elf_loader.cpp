@@ -3,8 +3,10 @@
 #include "kernel/vfs.h"
 #include "kernel/vmm.h"
 #include "kernel/pmm.h"
+#include "kernel/zero_pool.h"
 #include "kernel/tss.h"
 #include "kernel/thread.h"
+#include "kernel/smp.h"
 #include "libc.h"
 
 #include "kernel/kmalloc.h"
@@ -120,27 +122,22 @@ static void apply_relocations(vnode* vn, Elf32_Phdr* phdrs, int phnum,
 
                 uint32_t phys = VMM::get_physical(page_addr);
                 if (!phys) {
-                    void* frame = PhysicalMemoryManager::alloc_frame();
+                    void* frame = ZeroPool::alloc_frame();
                     if (!frame) continue;
 
                     uint8_t* fp = (uint8_t*)frame;
-                    for (int b = 0; b < 4096; b++) fp[b] = 0;
-
-                    VMA* v = threads[current_tid].vma_list;
-                    while (v) {
-                        if (page_addr >= v->start && page_addr < v->end) {
-                            uint32_t off_in_vma = page_addr - v->start;
-                            uint32_t foff = v->file_offset + off_in_vma;
-                            uint32_t fdata_end = v->file_size;
-                            if (off_in_vma < fdata_end) {
-                                uint32_t rsz = 4096;
-                                if (off_in_vma + 4096 > fdata_end) rsz = fdata_end - off_in_vma;
-                                if (vn->ops && vn->ops->read)
-                                    vn->ops->read(vn, foff, fp, rsz);
-                            }
-                            break;
+
+                    VMA* v = vma_find(threads[current_tid].vmas, page_addr);
+                    if (v) {
+                        uint32_t off_in_vma = page_addr - v->start;
+                        uint32_t foff = v->file_offset + off_in_vma;
+                        uint32_t fdata_end = v->file_size;
+                        if (off_in_vma < fdata_end) {
+                            uint32_t rsz = 4096;
+                            if (off_in_vma + 4096 > fdata_end) rsz = fdata_end - off_in_vma;
+                            if (vn->ops && vn->ops->read)
+                                vn->ops->read(vn, foff, fp, rsz);
                         }
-                        v = v->next;
                     }
 
                     VMM::map_page(page_addr, (uint32_t)frame,
@@ -201,24 +198,27 @@ static bool load_elf_segments(vnode* vn, uint8_t* header_buf, int header_size,
         uint32_t flags = PAGE_PRESENT | PAGE_USER;
         if (phdrs[i].p_flags & PF_W) flags |= PAGE_WRITABLE;
 
-        VMA* new_vma = (VMA*)kmalloc(sizeof(VMA));
+        VMA* new_vma = vma_alloc(vaddr_start, vaddr_end, flags, VMA_TYPE_FILE);
         if (!new_vma) {
             printf("[ELF] Out of memory for VMA structure\n");
             return false;
         }
 
-        new_vma->start = vaddr_start;
-        new_vma->end = vaddr_end;
-
         uint32_t align_diff = biased_vaddr - vaddr_start;
         new_vma->file_offset = phdrs[i].p_offset - align_diff;
         new_vma->file_size = phdrs[i].p_filesz + align_diff;
-        new_vma->flags = flags;
-        new_vma->type = VMA_TYPE_FILE;
+        // У каждой области своя ссылка на файл (снимается vma_free)
         new_vma->file_vnode = vn;
+        __atomic_add_fetch(&vn->refcount, 1, __ATOMIC_SEQ_CST);
 
-        new_vma->next = threads[current_tid].vma_list;
-        threads[current_tid].vma_list = new_vma;
+        // Сегменты, делящие страницу на стыке, перекрываются: общая
+        // страница достаётся следующему (данным), как раньше при поиске
+        // по списку с головы
+        if (!vma_insert(threads[current_tid].vmas, new_vma)) {
+            vma_free(new_vma);
+            printf("[ELF] Out of memory for VMA structure\n");
+            return false;
+        }
     }
 
     if (out->phdr_vaddr == 0) {
@@ -293,13 +293,7 @@ static void elf_thread_entry() {
     threads[current_tid].page_directory_phys = new_dir;
     VMM::switch_address_space(new_dir);
 
-    VMA* curr = threads[current_tid].vma_list;
-    while (curr) {
-        VMA* next = curr->next;
-        kfree(curr);
-        curr = next;
-    }
-    threads[current_tid].vma_list = nullptr;
+    vma_clear(threads[current_tid].vmas);
 
     Elf32_Phdr* phdrs = (Elf32_Phdr*)(header_buf + ehdr->e_phoff);
 
@@ -394,15 +388,13 @@ static void elf_thread_entry() {
     threads[current_tid].heap_lock = false;
 
     for (uint32_t p = 0; p < USER_STACK_PAGES; p++) {
-        void* frame = PhysicalMemoryManager::alloc_frame();
+        void* frame = ZeroPool::alloc_frame();
         if (!frame) {
             printf("[ELF] Out of memory for stack\n");
             return;
         }
         uint32_t vaddr = USER_STACK_TOP - (USER_STACK_PAGES - p) * 4096;
         VMM::map_page(vaddr, (uint32_t)frame, PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER);
-        uint8_t* page_ptr = (uint8_t*)vaddr;
-        for (int b = 0; b < 4096; b++) page_ptr[b] = 0;
     }
 
     uint32_t user_esp = USER_STACK_TOP;
@@ -434,6 +426,10 @@ static void elf_thread_entry() {
     asm volatile("pushf; pop %0" : "=r"(eflags));
     eflags |= 0x200;
 
+    // В Ring 3 процессор уходит без BKL
+    asm volatile("cli");
+    Smp::leave_kernel();
+
     asm volatile(
         "cli\n\t"
         "mov $0x23, %%ax\n\t"
@@ -1,8 +1,14 @@
 #include "kernel/fat16.h"
 #include "kernel/disk.h"
 #include "kernel/rtc.h"
+#include "kernel/timer.h"
 #include "kernel/pmm.h"
+#include "kernel/vmm.h"
 #include "kernel/kmalloc.h"
+#include "kernel/page_cache.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
 #include "libc.h"
 
 namespace re36 {
@@ -17,6 +23,15 @@ bool Fat16::mounted_ = false;
 uint8_t Fat16::sector_cache_[FAT16_SECTOR_BUF_SIZE] __attribute__((aligned(4096)));
 uint32_t Fat16::cached_sector_ = 0xFFFFFFFF;
 uint8_t* Fat16::dma_buffer_ = nullptr;
+uint8_t* Fat16::io_buffer_ = nullptr;
+uint32_t Fat16::alloc_hint_ = 2;
+KmemCache* Fat16::node_cache_ = nullptr;
+Fat16NodeData* Fat16::open_nodes_ = nullptr;
+uint32_t Fat16::fat_dirty_[FAT16_FAT_SECTORS / 32];
+uint32_t Fat16::sync_interval_ = FAT16_SYNC_INTERVAL;
+Fat16IoStats Fat16::io_stats_ = { 0, 0 };
+superblock* Fat16::sb_ = nullptr;
+vnode Fat16::bdev_vnode_;
 
 bool Fat16::read_cached_sector(uint32_t lba) {
     if (lba == cached_sector_) return true;
@@ -74,16 +89,16 @@ bool Fat16::init() {
     }
 
     if (!dma_buffer_) dma_buffer_ = (uint8_t*)PhysicalMemoryManager::alloc_frame();
-    if (!dma_buffer_) return false;
+    if (!io_buffer_) io_buffer_ = (uint8_t*)PhysicalMemoryManager::alloc_blocks(FAT16_IO_MAX_SECTORS * 512 / PMM_FRAME_SIZE);
+    if (!node_cache_) node_cache_ = kmem_cache_create("fat16_node", sizeof(Fat16NodeData));
+    if (!dma_buffer_ || !io_buffer_) return false;
 
     if (!Disk::read_sectors(0, 1, dma_buffer_)) {
         printf("[FAT16] Failed to read boot sector\n");
         return false;
     }
 
-    for (uint32_t i = 0; i < sizeof(FAT16_BPB); i++) {
-        ((uint8_t*)&bpb_)[i] = dma_buffer_[i];
-    }
+    memcpy(&bpb_, dma_buffer_, sizeof(FAT16_BPB));
 
     if (bpb_.bytes_per_sector != 512) {
         printf("[FAT16] Unsupported sector size: %d\n", bpb_.bytes_per_sector);
@@ -99,16 +114,14 @@ bool Fat16::init() {
     uint32_t fat_entries = (fat_sectors * 512) / 2;
     if (fat_entries > FAT16_MAX_FAT_ENTRIES) fat_entries = FAT16_MAX_FAT_ENTRIES;
 
-    uint32_t entry_idx = 0;
-    for (uint32_t s = 0; s < fat_sectors && entry_idx < fat_entries; s++) {
-        if (!Disk::read_sectors(fat_start_lba_ + s, 1, dma_buffer_)) {
-            printf("[FAT16] Failed to read FAT sector %d\n", s);
-            return false;
-        }
-        for (uint32_t i = 0; i < 256 && entry_idx < fat_entries; i++) {
-            fat_table_[entry_idx++] = ((uint16_t*)dma_buffer_)[i];
-        }
+    // Таблица FAT читается сразу в fat_table_ (статический массив ядра)
+    uint32_t fat_read_sectors = (fat_entries * 2 + 511) / 512;
+    if (!read_run(fat_start_lba_, fat_read_sectors, (uint8_t*)fat_table_)) {
+        printf("[FAT16] Failed to read FAT\n");
+        return false;
     }
+    alloc_hint_ = 2;
+    for (uint32_t i = 0; i < FAT16_FAT_SECTORS / 32; i++) fat_dirty_[i] = 0;
 
     uint32_t total_sectors = bpb_.total_sectors_16 ? bpb_.total_sectors_16 : bpb_.total_sectors_32;
     uint32_t data_sectors = total_sectors - data_start_lba_;
@@ -138,7 +151,7 @@ void Fat16::list_root() {
     int file_count = 0;
 
     for (uint32_t s = 0; s < root_dir_sectors_; s++) {
-        if (!Disk::read_sectors(root_dir_lba_ + s, 1, dma_buffer_)) continue;
+        if (!read_sector(root_dir_lba_ + s, dma_buffer_)) continue;
 
         FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
         int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
@@ -177,7 +190,7 @@ int Fat16::read_file(const char* name, uint8_t* buffer, uint32_t max_size) {
     bool found = false;
 
     for (uint32_t s = 0; s < root_dir_sectors_; s++) {
-        if (!Disk::read_sectors(root_dir_lba_ + s, 1, dma_buffer_)) continue;
+        if (!read_sector(root_dir_lba_ + s, dma_buffer_)) continue;
 
         FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
         int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
@@ -219,9 +232,7 @@ read_data:
             if (bytes_read + to_copy > max_size)
                 to_copy = max_size - bytes_read;
 
-            for (uint32_t b = 0; b < to_copy; b++) {
-                buffer[bytes_read + b] = dma_buffer_[b];
-            }
+            memcpy(buffer + bytes_read, dma_buffer_, to_copy);
             bytes_read += to_copy;
         }
 
@@ -238,7 +249,7 @@ int Fat16::read_file_offset(const char* name, uint32_t offset, uint8_t* buffer,
     int index;
     if (find_dir_entry(0, name, &sector, &index) != 0) return -1;
 
-    Disk::read_sectors(sector, 1, dma_buffer_);
+    read_sector(sector, dma_buffer_);
     FAT16_DirEntry* entry = &((FAT16_DirEntry*)dma_buffer_)[index];
 
     if (offset >= entry->file_size) return 0; // чтение за пределами файла
@@ -276,9 +287,7 @@ int Fat16::read_file_offset(const char* name, uint32_t offset, uint8_t* buffer,
                 to_copy = size - bytes_read;
             }
 
-            for (uint32_t b = 0; b < to_copy; b++) {
-                buffer[bytes_read + b] = dma_buffer_[offset_in_sector + b];
-            }
+            memcpy(buffer + bytes_read, dma_buffer_ + offset_in_sector, to_copy);
 
             bytes_read += to_copy;
             offset_in_sector = 0; // Смещение применяется только к первому прочитанному сектору
@@ -325,7 +334,7 @@ int Fat16::find_dir_entry(uint32_t dir_cluster, const char* name, uint32_t* sect
 
     if (dir_cluster == 0) {
         for (uint32_t s = 0; s < root_dir_sectors_; s++) {
-            if (!Disk::read_sectors(root_dir_lba_ + s, 1, dma_buffer_)) continue;
+            if (!read_sector(root_dir_lba_ + s, dma_buffer_)) continue;
             
             FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
             int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
@@ -352,7 +361,7 @@ int Fat16::find_dir_entry(uint32_t dir_cluster, const char* name, uint32_t* sect
     while (cluster >= 2 && cluster < 0xFFF8) {
         uint32_t lba = cluster_to_lba(cluster);
         for (uint8_t s = 0; s < bpb_.sectors_per_cluster; s++) {
-            if (!Disk::read_sectors(lba + s, 1, dma_buffer_)) continue;
+            if (!read_sector(lba + s, dma_buffer_)) continue;
             
             FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
             int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
@@ -383,7 +392,7 @@ int Fat16::find_free_dir_entry(uint32_t dir_cluster, uint32_t* sector_out, int*
 
     if (dir_cluster == 0) {
         for (uint32_t s = 0; s < root_dir_sectors_; s++) {
-            if (!Disk::read_sectors(root_dir_lba_ + s, 1, dma_buffer_)) continue;
+            if (!read_sector(root_dir_lba_ + s, dma_buffer_)) continue;
             FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
             int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
             for (int i = 0; i < entries_per_sector; i++) {
@@ -403,7 +412,7 @@ int Fat16::find_free_dir_entry(uint32_t dir_cluster, uint32_t* sector_out, int*
     while (cluster >= 2 && cluster < 0xFFF8) {
         uint32_t lba = cluster_to_lba(cluster);
         for (uint8_t s = 0; s < bpb_.sectors_per_cluster; s++) {
-            if (!Disk::read_sectors(lba + s, 1, dma_buffer_)) continue;
+            if (!read_sector(lba + s, dma_buffer_)) continue;
             FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
             int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
             for (int i = 0; i < entries_per_sector; i++) {
@@ -422,14 +431,14 @@ int Fat16::find_free_dir_entry(uint32_t dir_cluster, uint32_t* sector_out, int*
     uint16_t new_cluster = alloc_cluster();
     if (new_cluster == 0) return -1; // Disk full
 
-    fat_table_[prev_cluster] = new_cluster;
-    flush_fat();
+    set_fat(prev_cluster, new_cluster);
+    fat_changed();
     
     // Clear and return the first entry of the new cluster
     uint32_t new_lba = cluster_to_lba(new_cluster);
-    for (int b = 0; b < 512; b++) dma_buffer_[b] = 0;
+    memset(dma_buffer_, 0, 512);
     for (uint8_t s = 0; s < bpb_.sectors_per_cluster; s++) {
-        Disk::write_sectors(new_lba + s, 1, dma_buffer_);
+        write_sector(new_lba + s, dma_buffer_);
     }
 
     if (sector_out) *sector_out = new_lba;
@@ -442,9 +451,13 @@ uint16_t Fat16::alloc_cluster() {
     uint32_t total = (bpb_.fat_size_16 * 512) / 2;
     if (total > FAT16_MAX_FAT_ENTRIES) total = FAT16_MAX_FAT_ENTRIES;
     
-    for (uint32_t i = 2; i < total; i++) {
+    // Поиск с места последнего выделения: новые кластеры файла идут подряд
+    if (alloc_hint_ < 2 || alloc_hint_ >= total) alloc_hint_ = 2;
+    for (uint32_t n = 2; n < total; n++) {
+        uint32_t i = alloc_hint_;
+        if (++alloc_hint_ >= total) alloc_hint_ = 2;
         if (fat_table_[i] == 0x0000) {
-            fat_table_[i] = 0xFFFF;
+            set_fat(i, 0xFFFF);
             return (uint16_t)i;
         }
     }
@@ -452,38 +465,112 @@ uint16_t Fat16::alloc_cluster() {
 }
 
 void Fat16::free_chain(uint16_t start_cluster) {
+    // Кластеры уйдут другим файлам - страницы этого файла больше не верны
+    if (sb_) PageCache::invalidate(sb_, start_cluster);
+
     uint16_t cluster = start_cluster;
     while (cluster >= 2 && cluster < 0xFFF8) {
         uint16_t next = fat_table_[cluster];
-        fat_table_[cluster] = 0x0000;
+        set_fat(cluster, 0x0000);
         cluster = next;
     }
 }
 
+void Fat16::set_fat(uint32_t cluster, uint16_t value) {
+    fat_table_[cluster] = value;
+    uint32_t sector = cluster / 256;
+    fat_dirty_[sector / 32] |= 1u << (sector % 32);
+}
+
 void Fat16::flush_fat() {
     uint32_t fat_sectors = bpb_.fat_size_16;
-    
-    for (uint32_t s = 0; s < fat_sectors; s++) {
-        uint16_t* entries = (uint16_t*)dma_buffer_;
-        for (int i = 0; i < 256; i++) {
-            uint32_t idx = s * 256 + i;
-            entries[i] = (idx < FAT16_MAX_FAT_ENTRIES) ? fat_table_[idx] : 0;
+    if (fat_sectors > FAT16_FAT_SECTORS) fat_sectors = FAT16_FAT_SECTORS;
+
+    // Снимок битмапа: сектор, изменённый во время записи, снова станет
+    // грязным и уйдёт следующим сбросом
+    uint32_t dirty[FAT16_FAT_SECTORS / 32];
+    {
+        InterruptGuard guard;
+        for (uint32_t i = 0; i < FAT16_FAT_SECTORS / 32; i++) {
+            dirty[i] = fat_dirty_[i];
+            fat_dirty_[i] = 0;
         }
-        
+    }
+
+    // Подряд идущие грязные сектора пишутся в каждую копию FAT одной командой
+    // прямо из fat_table_ (identity-mapped память ядра)
+    uint32_t s = 0;
+    while (s < fat_sectors) {
+        if (!(dirty[s / 32] & (1u << (s % 32)))) {
+            s++;
+            continue;
+        }
+        uint32_t count = 1;
+        while (s + count < fat_sectors && count < FAT16_IO_MAX_SECTORS &&
+               (dirty[(s + count) / 32] & (1u << ((s + count) % 32)))) {
+            count++;
+        }
+
+        const uint8_t* data = (const uint8_t*)fat_table_ + s * 512;
         for (uint8_t f = 0; f < bpb_.num_fats; f++) {
-            Disk::write_sectors(fat_start_lba_ + f * bpb_.fat_size_16 + s, 1, dma_buffer_);
+            write_run(fat_start_lba_ + f * bpb_.fat_size_16 + s, count, data);
         }
+        s += count;
     }
     cached_sector_ = 0xFFFFFFFF;
 }
 
+void Fat16::fat_changed() {
+    if (sync_interval_ == 0) flush_fat();
+}
+
+void Fat16::sync() {
+    if (!mounted_) return;
+    flush_fat();
+    // Барьер: FAT и записанные ранее данные уходят из кэша диска на носитель
+    Disk::flush();
+}
+
+int Fat16::fat16_sync(superblock* sb) {
+    (void)sb;
+    sync();
+    return 0;
+}
+
+uint32_t Fat16::dirty_fat_sectors() {
+    InterruptGuard guard;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < FAT16_FAT_SECTORS / 32; i++) {
+        for (uint32_t bits = fat_dirty_[i]; bits; bits &= bits - 1) n++;
+    }
+    return n;
+}
+
+void Fat16::set_sync_interval(uint32_t ms) {
+    sync_interval_ = ms;
+    // При переходе в write-through накопленное уходит сразу
+    if (ms == 0) sync();
+}
+
+void Fat16::sync_thread() {
+    while (true) {
+        uint32_t interval = sync_interval_;
+        TaskScheduler::sleep_current(interval ? interval : FAT16_SYNC_INTERVAL);
+        if (sync_interval_ != 0) sync();
+    }
+}
+
+void Fat16::start_sync_thread() {
+    thread_create("fatsync", sync_thread, FAT16_SYNC_PRIORITY);
+}
+
 bool Fat16::write_file_in_dir(uint32_t dir_cluster, const char* name, const uint8_t* data, uint32_t size) {
     if (!mounted_) return false;
     
     uint32_t old_sector;
     int old_index;
     if (find_dir_entry(dir_cluster, name, &old_sector, &old_index) == 0) {
-        Disk::read_sectors(old_sector, 1, dma_buffer_);
+        read_sector(old_sector, dma_buffer_);
         FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
         
         if (entries[old_index].attributes & FAT_ATTR_PROTECT_MODIFY) {
@@ -491,49 +578,54 @@ bool Fat16::write_file_in_dir(uint32_t dir_cluster, const char* name, const uint
             return false;
         }
         
-        if (entries[old_index].first_cluster >= 2) {
-            free_chain(entries[old_index].first_cluster);
-        }
+        // Открытый файл мог нарастить цепочку, ещё не записав её начало
+        Fat16NodeData* open = find_open_node(old_sector, old_index);
+        uint16_t old_cluster = open ? (uint16_t)open->vn->inode_num : entries[old_index].first_cluster;
+        detach_open_node(old_sector, old_index);
+
         entries[old_index].name[0] = 0xE5;
-        Disk::write_sectors(old_sector, 1, dma_buffer_);
+        write_sector(old_sector, dma_buffer_);
+        if (old_cluster >= 2) {
+            free_chain(old_cluster);
+        }
     }
     
     uint16_t first_cluster = 0;
     uint16_t prev_cluster = 0;
-    uint32_t bytes_written = 0;
-    
-    while (bytes_written < size) {
+    uint32_t cluster_bytes = bpb_.sectors_per_cluster * 512;
+    uint32_t clusters_needed = (size + cluster_bytes - 1) / cluster_bytes;
+
+    // Подряд идущие кластеры копятся в участок и пишутся одной командой
+    uint16_t run_start = 0;
+    uint32_t run_len = 0;
+    uint32_t run_offset = 0;
+
+    for (uint32_t c = 0; c < clusters_needed; c++) {
         uint16_t cluster = alloc_cluster();
         if (cluster == 0) {
             if (first_cluster) free_chain(first_cluster);
             printf("[FAT16] Disk full!\n");
-            flush_fat();
+            fat_changed();
             return false;
         }
         
         if (first_cluster == 0) first_cluster = cluster;
-        if (prev_cluster != 0) fat_table_[prev_cluster] = cluster;
-        
-        uint32_t lba = cluster_to_lba(cluster);
-        
-        for (uint8_t s = 0; s < bpb_.sectors_per_cluster && bytes_written < size; s++) {
-            for (int b = 0; b < 512; b++) dma_buffer_[b] = 0;
-            
-            uint32_t to_copy = 512;
-            if (bytes_written + to_copy > size) to_copy = size - bytes_written;
-            
-            for (uint32_t b = 0; b < to_copy; b++) {
-                dma_buffer_[b] = data[bytes_written + b];
-            }
-            
-            Disk::write_sectors(lba + s, 1, dma_buffer_);
-            bytes_written += to_copy;
+        if (prev_cluster != 0) set_fat(prev_cluster, cluster);
+
+        if (run_len > 0 && cluster == run_start + run_len) {
+            run_len++;
+        } else {
+            if (run_len > 0) write_cluster_run(run_start, run_len, data + run_offset, size - run_offset);
+            run_start = cluster;
+            run_len = 1;
+            run_offset = c * cluster_bytes;
         }
         
         prev_cluster = cluster;
     }
+    if (run_len > 0) write_cluster_run(run_start, run_len, data + run_offset, size - run_offset);
     
-    flush_fat();
+    fat_changed();
     
     uint32_t free_sec;
     int free_idx;
@@ -542,7 +634,7 @@ bool Fat16::write_file_in_dir(uint32_t dir_cluster, const char* name, const uint
         return false;
     }
     
-    Disk::read_sectors(free_sec, 1, dma_buffer_);
+    read_sector(free_sec, dma_buffer_);
     FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
     
     format_83_name(name, entries[free_idx].name);
@@ -553,7 +645,7 @@ bool Fat16::write_file_in_dir(uint32_t dir_cluster, const char* name, const uint
     entries[free_idx].first_cluster = first_cluster;
     entries[free_idx].file_size = size;
     
-    Disk::write_sectors(free_sec, 1, dma_buffer_);
+    write_sector(free_sec, dma_buffer_);
     return true;
 }
 
@@ -567,7 +659,7 @@ bool Fat16::delete_file(const char* name) {
         return false;
     }
     
-    Disk::read_sectors(sector, 1, dma_buffer_);
+    read_sector(sector, dma_buffer_);
     FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
     
     if (entries[index].attributes & FAT_ATTR_PROTECT_DELETE) {
@@ -575,14 +667,17 @@ bool Fat16::delete_file(const char* name) {
         return false;
     }
     
-    uint16_t first_cluster = entries[index].first_cluster;
-    
+    // Открытый файл мог нарастить цепочку, ещё не записав её начало
+    Fat16NodeData* open = find_open_node(sector, index);
+    uint16_t first_cluster = open ? (uint16_t)open->vn->inode_num : entries[index].first_cluster;
+    detach_open_node(sector, index);
+
     entries[index].name[0] = 0xE5;
-    Disk::write_sectors(sector, 1, dma_buffer_);
+    write_sector(sector, dma_buffer_);
     
     if (first_cluster >= 2) {
         free_chain(first_cluster);
-        flush_fat();
+        fat_changed();
     }
     
     return true;
@@ -601,7 +696,7 @@ void Fat16::stat_file(const char* name) {
         return;
     }
     
-    Disk::read_sectors(sector, 1, dma_buffer_);
+    read_sector(sector, dma_buffer_);
     FAT16_DirEntry* entry = &((FAT16_DirEntry*)dma_buffer_)[index];
     
     char fname[13];
@@ -647,11 +742,10 @@ bool Fat16::change_attributes(vnode* vn, uint8_t flag, bool set) {
     Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
     uint32_t sector;
     int index;
-    if (find_dir_entry(nd->parent_cluster, nd->name, &sector, &index) != 0) {
+    if (!locate_entry(nd, &sector, &index)) {
         return false;
     }
     
-    Disk::read_sectors(sector, 1, dma_buffer_);
     FAT16_DirEntry* entry = &((FAT16_DirEntry*)dma_buffer_)[index];
     
     if (set) {
@@ -660,80 +754,541 @@ bool Fat16::change_attributes(vnode* vn, uint8_t flag, bool set) {
         entry->attributes &= ~flag;
     }
     
-    Disk::write_sectors(sector, 1, dma_buffer_);
+    write_sector(sector, dma_buffer_);
     return true;
 }
 
 int Fat16::fat16_read(vnode* vn, uint32_t offset, uint8_t* buffer, uint32_t size) {
     if (!mounted_) return -1;
     if (vn->type != VnodeType::File) return -1;
+    if (!vn->fs_data) return -1;
+    return PageCache::read(vn, offset, buffer, size);
+}
+
+// Заполнить страницу index файла прямо с диска (вызывается кэшем страниц
+// при промахе). Хвост за концом файла обнуляется.
+int Fat16::fat16_readpage(vnode* vn, uint32_t index, uint8_t* page) {
+    if (!mounted_ || vn->type != VnodeType::File) return -1;
+
+    uint32_t offset = index * PMM_FRAME_SIZE;
+    uint32_t bytes_to_read = 0;
+    if (offset < vn->size) {
+        bytes_to_read = vn->size - offset;
+        if (bytes_to_read > PMM_FRAME_SIZE) bytes_to_read = PMM_FRAME_SIZE;
+    }
+    if (bytes_to_read == 0) {
+        zero_page(page);
+        return 0;
+    }
 
     Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
-    if (!nd) return -1;
-    
+    if (!nd || (!nd->extents && !build_extents(vn))) return -1;
+
+    // Страница 4 КБ и кластер выровнены по секторам - читаем прямо во фрейм
+    uint32_t cluster_size = bpb_.sectors_per_cluster * 512;
+    uint32_t file_cluster = offset / cluster_size;
+    uint32_t sector_in_cluster = (offset % cluster_size) / 512;
+    uint32_t bytes_read = 0;
+    while (bytes_read < bytes_to_read) {
+        uint32_t contiguous = 0;
+        uint16_t cluster = map_cluster(nd, file_cluster, &contiguous);
+        if (cluster == 0) return -1;
+
+        // Весь непрерывный участок, попадающий в страницу, - одной командой
+        uint32_t sectors = contiguous * bpb_.sectors_per_cluster - sector_in_cluster;
+        uint32_t wanted = (bytes_to_read - bytes_read + 511) / 512;
+        if (sectors > wanted) sectors = wanted;
+
+        if (!read_run(cluster_to_lba(cluster) + sector_in_cluster, sectors, page + bytes_read)) return -1;
+        bytes_read += sectors * 512;
+
+        uint32_t consumed = sector_in_cluster + sectors;
+        file_cluster += consumed / bpb_.sectors_per_cluster;
+        sector_in_cluster = consumed % bpb_.sectors_per_cluster;
+    }
+
+    // Сектор за концом файла мог занести мусор в хвост страницы
+    if (bytes_to_read < PMM_FRAME_SIZE) {
+        memset(page + bytes_to_read, 0, PMM_FRAME_SIZE - bytes_to_read);
+    }
+    return (int)bytes_to_read;
+}
+
+// count страниц подряд для упреждающего чтения: запросы всех страниц
+// уходят в блочную очередь разом, и соседние на диске сливаются в одну команду
+int Fat16::fat16_readpages(vnode* vn, uint32_t index, uint32_t count, uint8_t** pages) {
+    if (!mounted_ || vn->type != VnodeType::File) return -1;
+
+    Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
+    if (!nd || (!nd->extents && !build_extents(vn))) return -1;
+
+    // Страница 4 КБ выровнена по кластеру или лежит внутри одного
+    uint32_t spc = bpb_.sectors_per_cluster;
+    uint32_t runs_per_page = spc >= PAGE_CACHE_SECTORS ? 1 : PAGE_CACHE_SECTORS / spc;
+    BlockQueue* q = Disk::primary();
+    BlockRequest* reqs = q ? (BlockRequest*)kmalloc(count * runs_per_page * sizeof(BlockRequest)) : nullptr;
+    if (!reqs) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (fat16_readpage(vn, index + i, pages[i]) < 0) return -1;
+        }
+        return 0;
+    }
+
+    uint32_t cluster_size = spc * 512;
+    uint32_t n = 0;
+    bool ok = true;
+    q->plug();
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint32_t offset = (index + i) * PMM_FRAME_SIZE;
+        uint32_t bytes_to_read = offset < vn->size ? vn->size - offset : 0;
+        if (bytes_to_read > PMM_FRAME_SIZE) bytes_to_read = PMM_FRAME_SIZE;
+
+        uint32_t file_cluster = offset / cluster_size;
+        uint32_t sector_in_cluster = (offset % cluster_size) / 512;
+        uint32_t bytes_read = 0;
+        while (bytes_read < bytes_to_read) {
+            uint32_t contiguous = 0;
+            uint16_t cluster = map_cluster(nd, file_cluster, &contiguous);
+            if (cluster == 0) {
+                ok = false;
+                break;
+            }
+            uint32_t sectors = contiguous * spc - sector_in_cluster;
+            uint32_t wanted = (bytes_to_read - bytes_read + 511) / 512;
+            if (sectors > wanted) sectors = wanted;
+
+            BlockRequest* r = &reqs[n++];
+            r->lba = cluster_to_lba(cluster) + sector_in_cluster;
+            r->count = sectors;
+            r->write = false;
+            r->buffer = pages[i] + bytes_read;
+            q->submit(r);
+            io_stats_.sectors_read += sectors;
+            bytes_read += sectors * 512;
+
+            uint32_t consumed = sector_in_cluster + sectors;
+            file_cluster += consumed / spc;
+            sector_in_cluster = consumed % spc;
+        }
+    }
+    q->unplug();
+    for (uint32_t i = 0; i < n; i++) {
+        if (!q->wait(&reqs[i])) ok = false;
+    }
+    kfree(reqs);
+    if (!ok) return -1;
+
+    // Хвост за концом файла обнуляется после чтения последнего сектора
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t offset = (index + i) * PMM_FRAME_SIZE;
+        uint32_t bytes = offset < vn->size ? vn->size - offset : 0;
+        if (bytes < PMM_FRAME_SIZE) memset(pages[i] + bytes, 0, PMM_FRAME_SIZE - bytes);
+    }
+    return 0;
+}
+
+// Страница из 8 секторов блочного устройства (буферный кэш метаданных)
+int Fat16::fat16_read_block_page(vnode* vn, uint32_t index, uint8_t* page) {
+    (void)vn;
+    io_stats_.sectors_read += PAGE_CACHE_SECTORS;
+    return Disk::read_sectors(index * PAGE_CACHE_SECTORS, PAGE_CACHE_SECTORS, page) ? PMM_FRAME_SIZE : -1;
+}
+
+bool Fat16::read_sector(uint32_t lba, uint8_t* buffer) {
+    if (sb_) {
+        uint32_t frame = PageCache::get_page(&bdev_vnode_, lba / PAGE_CACHE_SECTORS);
+        if (frame) {
+            memcpy(buffer, (uint8_t*)frame + (lba % PAGE_CACHE_SECTORS) * 512, 512);
+            PhysicalMemoryManager::free_frame((void*)frame);
+            return true;
+        }
+    }
+    io_stats_.sectors_read++;
+    return Disk::read_sectors(lba, 1, buffer);
+}
+
+bool Fat16::write_sector(uint32_t lba, const uint8_t* buffer) {
+    if (sb_) {
+        PageCache::update(sb_, PAGE_CACHE_BDEV_INODE, lba / PAGE_CACHE_SECTORS,
+                          (lba % PAGE_CACHE_SECTORS) * 512, buffer, 512);
+    }
+    io_stats_.sectors_written++;
+    return Disk::write_sectors(lba, 1, buffer);
+}
+
+// Контроллер пишет по физическому адресу: напрямую можно только в
+// identity-mapped память ядра, AHCI к тому же требует чётный адрес
+static bool dma_capable(const uint8_t* buffer, uint32_t size) {
+    uint32_t addr = (uint32_t)buffer;
+    return (addr & 1) == 0 && addr + size <= KERNEL_SPACE_END;
+}
+
+bool Fat16::read_run(uint32_t lba, uint32_t count, uint8_t* buffer) {
+    while (count > 0) {
+        uint32_t chunk = count > FAT16_IO_MAX_SECTORS ? FAT16_IO_MAX_SECTORS : count;
+        io_stats_.sectors_read += chunk;
+        if (dma_capable(buffer, chunk * 512)) {
+            if (!Disk::read_sectors(lba, chunk, buffer)) return false;
+        } else {
+            if (!Disk::read_sectors(lba, chunk, io_buffer_)) return false;
+            memcpy(buffer, io_buffer_, chunk * 512);
+        }
+        lba += chunk;
+        buffer += chunk * 512;
+        count -= chunk;
+    }
+    return true;
+}
+
+bool Fat16::write_run(uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    while (count > 0) {
+        uint32_t chunk = count > FAT16_IO_MAX_SECTORS ? FAT16_IO_MAX_SECTORS : count;
+        io_stats_.sectors_written += chunk;
+
+        // Буферный кэш должен видеть то же, что и диск
+        if (sb_) {
+            for (uint32_t s = 0; s < chunk; s++) {
+                uint32_t sec = lba + s;
+                PageCache::update(sb_, PAGE_CACHE_BDEV_INODE, sec / PAGE_CACHE_SECTORS,
+                                  (sec % PAGE_CACHE_SECTORS) * 512, buffer + s * 512, 512);
+            }
+        }
+
+        if (dma_capable(buffer, chunk * 512)) {
+            if (!Disk::write_sectors(lba, chunk, buffer)) return false;
+        } else {
+            if (buffer != io_buffer_) memcpy(io_buffer_, buffer, chunk * 512);
+            if (!Disk::write_sectors(lba, chunk, io_buffer_)) return false;
+        }
+        lba += chunk;
+        buffer += chunk * 512;
+        count -= chunk;
+    }
+    return true;
+}
+
+void Fat16::write_cluster_run(uint16_t cluster, uint32_t count, const uint8_t* data, uint32_t size) {
+    uint32_t bytes = count * bpb_.sectors_per_cluster * 512;
+    if (bytes > size) bytes = size;
+
+    uint32_t lba = cluster_to_lba(cluster);
+    uint32_t full_sectors = bytes / 512;
+    if (full_sectors > 0) write_run(lba, full_sectors, data);
+
+    // Неполный последний сектор дополняем нулями
+    uint32_t tail = bytes % 512;
+    if (tail) {
+        memset(dma_buffer_, 0, 512);
+        memcpy(dma_buffer_, data + full_sectors * 512, tail);
+        write_sector(lba + full_sectors, dma_buffer_);
+    }
+}
+
+Fat16NodeData* Fat16::find_open_node(uint32_t sector, int index) {
+    for (Fat16NodeData* nd = open_nodes_; nd; nd = nd->next_open) {
+        if (nd->dir_sector == sector && nd->dir_index == index && nd->vn->refcount > 0) return nd;
+    }
+    return nullptr;
+}
+
+void Fat16::unlink_open_node(Fat16NodeData* nd) {
+    for (Fat16NodeData** p = &open_nodes_; *p; p = &(*p)->next_open) {
+        if (*p == nd) {
+            *p = nd->next_open;
+            break;
+        }
+    }
+    nd->next_open = nullptr;
+}
+
+void Fat16::detach_open_node(uint32_t sector, int index) {
+    Fat16NodeData* nd = find_open_node(sector, index);
+    if (!nd) return;
+    unlink_open_node(nd);
+    nd->detached = true;
+    nd->entry_dirty = false;
+    nd->dir_sector = 0;
+    drop_extents(nd);
+}
+
+void Fat16::flush_open_node(uint32_t sector, int index) {
+    Fat16NodeData* nd = find_open_node(sector, index);
+    if (nd && nd->entry_dirty) update_entry(nd->vn);
+}
+
+bool Fat16::locate_entry(Fat16NodeData* nd, uint32_t* sector_out, int* index_out) {
+    if (nd->detached) return false;
+    // Записи каталога FAT не перемещаются, пока файл не переименован или
+    // не переписан - проверяем сохранённое положение по имени
+    if (nd->dir_sector && read_sector(nd->dir_sector, dma_buffer_) &&
+        match_filename(&((FAT16_DirEntry*)dma_buffer_)[nd->dir_index], nd->name)) {
+        *sector_out = nd->dir_sector;
+        *index_out = nd->dir_index;
+        return true;
+    }
+
     uint32_t sector;
     int index;
-    if (find_dir_entry(nd->parent_cluster, nd->name, &sector, &index) != 0) return -1;
-    
-    Disk::read_sectors(sector, 1, dma_buffer_);
-    FAT16_DirEntry* entry = &((FAT16_DirEntry*)dma_buffer_)[index];
-    
-    // Check bounds
-    if (offset >= entry->file_size) return 0;
-    uint32_t bytes_to_read = size;
-    if (offset + bytes_to_read > entry->file_size) {
-        bytes_to_read = entry->file_size - offset;
+    if (find_dir_entry(nd->parent_cluster, nd->name, &sector, &index) != 0) return false;
+    if (!read_sector(sector, dma_buffer_)) return false;
+    nd->dir_sector = sector;
+    nd->dir_index = index;
+    *sector_out = sector;
+    *index_out = index;
+    return true;
+}
+
+bool Fat16::build_extents(vnode* vn) {
+    Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
+
+    // vnode может читаться из нескольких потоков (fork) - строим один раз
+    InterruptGuard guard;
+    if (nd->extents) return true;
+    if (nd->detached) return false;   // Цепочка освобождена вместе с записью
+
+    // Первый проход - сколько участков, второй - заполнение
+    uint32_t count = 0;
+    uint16_t cluster = (uint16_t)vn->inode_num;
+    uint16_t prev = 0;
+    while (cluster >= 2 && cluster < 0xFFF8) {
+        if (prev == 0 || cluster != prev + 1) count++;
+        prev = cluster;
+        cluster = fat_table_[cluster];
     }
-    
-    // Quick seek and read...
-    uint16_t cluster = entry->first_cluster;
-    uint32_t current_offset = 0;
-    while (cluster >= 2 && cluster < 0xFFF8 && current_offset + (bpb_.sectors_per_cluster * 512) <= offset) {
+    if (count == 0) return false;
+
+    Fat16Extent* extents = (Fat16Extent*)kmalloc(count * sizeof(Fat16Extent));
+    if (!extents) return false;
+
+    uint32_t n = 0;
+    uint32_t file_cluster = 0;
+    cluster = (uint16_t)vn->inode_num;
+    prev = 0;
+    while (cluster >= 2 && cluster < 0xFFF8) {
+        if (prev != 0 && cluster == prev + 1 && extents[n - 1].count < 0xFFFF) {
+            extents[n - 1].count++;
+        } else {
+            if (n == count) break; // Цепочку успели изменить между проходами
+            extents[n].file_cluster = file_cluster;
+            extents[n].disk_cluster = cluster;
+            extents[n].count = 1;
+            n++;
+        }
+        prev = cluster;
         cluster = fat_table_[cluster];
-        current_offset += bpb_.sectors_per_cluster * 512;
+        file_cluster++;
     }
-    
-    if (cluster < 2 || cluster >= 0xFFF8) return 0;
-    
-    uint32_t bytes_read = 0;
-    while (bytes_read < bytes_to_read && cluster >= 2 && cluster < 0xFFF8) {
-        uint32_t lba = cluster_to_lba(cluster);
-        for (uint8_t s = 0; s < bpb_.sectors_per_cluster && bytes_read < bytes_to_read; s++) {
-            if (!Disk::read_sectors(lba + s, 1, dma_buffer_)) return -1;
-            
-            uint32_t sec_offset = current_offset;
-            uint32_t copy_start = 0;
-            if (offset > sec_offset) {
-                if (offset - sec_offset >= 512) {
-                    current_offset += 512;
-                    continue;
-                }
-                copy_start = offset - sec_offset;
-            }
-            
-            uint32_t to_copy = 512 - copy_start;
-            if (bytes_read + to_copy > bytes_to_read) to_copy = bytes_to_read - bytes_read;
-            
-            for (uint32_t b = 0; b < to_copy; b++) {
-                buffer[bytes_read + b] = dma_buffer_[copy_start + b];
+
+    nd->extents = extents;
+    nd->extent_count = n;
+    return true;
+}
+
+void Fat16::drop_extents(Fat16NodeData* nd) {
+    if (nd->extents) kfree(nd->extents);
+    nd->extents = nullptr;
+    nd->extent_count = 0;
+}
+
+uint16_t Fat16::map_cluster(Fat16NodeData* nd, uint32_t file_cluster, uint32_t* contiguous) {
+    if (nd->extent_count == 0) return 0;
+
+    // Бинарный поиск последнего участка с file_cluster <= искомого
+    uint32_t lo = 0, hi = nd->extent_count;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (nd->extents[mid].file_cluster <= file_cluster) lo = mid;
+        else hi = mid;
+    }
+
+    const Fat16Extent& e = nd->extents[lo];
+    uint32_t delta = file_cluster - e.file_cluster;
+    if (file_cluster < e.file_cluster || delta >= e.count) return 0;
+    if (contiguous) *contiguous = e.count - delta;
+    return (uint16_t)(e.disk_cluster + delta);
+}
+
+bool Fat16::is_write_protected(Fat16NodeData* nd) {
+    uint32_t sector;
+    int index;
+    if (!locate_entry(nd, &sector, &index)) return true;
+    if (((FAT16_DirEntry*)dma_buffer_)[index].attributes & FAT_ATTR_PROTECT_MODIFY) {
+        printf("Permission denied: File is protected from modification (-gc)\n");
+        return true;
+    }
+    return false;
+}
+
+bool Fat16::update_entry(vnode* vn) {
+    Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
+    uint32_t sector;
+    int index;
+    if (!locate_entry(nd, &sector, &index)) return false;
+
+    FAT16_DirEntry* entry = &((FAT16_DirEntry*)dma_buffer_)[index];
+    entry->first_cluster = (uint16_t)vn->inode_num;
+    entry->file_size = vn->size;
+    entry->time = RTC::fat_time();
+    entry->date = RTC::fat_date();
+    entry->attributes |= FAT_ATTR_ARCHIVE;
+    if (!write_sector(sector, dma_buffer_)) return false;
+    nd->entry_dirty = false;
+    return true;
+}
+
+bool Fat16::extend_chain(vnode* vn, Fat16NodeData* nd, uint32_t end) {
+    uint32_t cluster_size = bpb_.sectors_per_cluster * 512;
+    uint32_t needed = (end + cluster_size - 1) / cluster_size;
+
+    if (vn->inode_num >= 2 && !nd->extents && !build_extents(vn)) return false;
+    uint32_t have = 0;
+    uint16_t last = 0;
+    if (nd->extent_count > 0) {
+        const Fat16Extent& e = nd->extents[nd->extent_count - 1];
+        have = e.file_cluster + e.count;
+        last = (uint16_t)(e.disk_cluster + e.count - 1);
+    }
+    if (have >= needed) return true;
+
+    // Новые кластеры ищем сразу за последним - файл растёт одним участком
+    if (last) alloc_hint_ = last + 1;
+    bool ok = true;
+    for (uint32_t i = have; i < needed; i++) {
+        uint16_t cluster = alloc_cluster();
+        if (cluster == 0) {
+            printf("[FAT16] Disk full!\n");
+            ok = false;
+            break;
+        }
+        if (last) {
+            set_fat(last, cluster);
+        } else {
+            vn->inode_num = cluster;
+            nd->entry_dirty = true;
+        }
+        last = cluster;
+    }
+    fat_changed();
+
+    drop_extents(nd);
+    return build_extents(vn) && ok;
+}
+
+bool Fat16::write_range(vnode* vn, Fat16NodeData* nd, uint32_t offset, const uint8_t* data, uint32_t size) {
+    uint32_t cluster_size = bpb_.sectors_per_cluster * 512;
+    uint32_t old_size = vn->size;
+
+    // Нули берутся из io_buffer_: write_run не копирует буфер сам в себя
+    const uint8_t* zeros = nullptr;
+    if (!data) {
+        memset(io_buffer_, 0, FAT16_IO_MAX_SECTORS * 512);
+        zeros = io_buffer_;
+    }
+
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t in_cluster = pos % cluster_size;
+        uint32_t contiguous = 0;
+        uint16_t cluster = map_cluster(nd, pos / cluster_size, &contiguous);
+        if (cluster == 0) return false;
+
+        uint32_t lba = cluster_to_lba(cluster) + in_cluster / 512;
+        uint32_t in_sector = pos % 512;
+        uint32_t n = contiguous * cluster_size - in_cluster;
+        if (n > size - done) n = size - done;
+        if (zeros && n > FAT16_IO_MAX_SECTORS * 512) n = FAT16_IO_MAX_SECTORS * 512;
+        const uint8_t* src = zeros ? zeros : data + done;
+
+        if (in_sector != 0 || n < 512) {
+            // Неполный сектор: читаем (если в нём есть данные файла) и дописываем
+            if (n > 512 - in_sector) n = 512 - in_sector;
+            if (pos - in_sector < old_size) {
+                if (!read_sector(lba, dma_buffer_)) return false;
+            } else {
+                memset(dma_buffer_, 0, 512);
             }
-            
-            bytes_read += to_copy;
-            current_offset += 512;
+            memcpy(dma_buffer_ + in_sector, src, n);
+            if (!write_sector(lba, dma_buffer_)) return false;
+        } else {
+            // Целые сектора подряд - одной командой
+            n -= n % 512;
+            if (!write_run(lba, n / 512, src)) return false;
         }
-        cluster = fat_table_[cluster];
+
+        // Закэшированные страницы файла должны видеть новые данные
+        for (uint32_t p = 0; p < n; ) {
+            uint32_t page_off = (pos + p) % PMM_FRAME_SIZE;
+            uint32_t chunk = PMM_FRAME_SIZE - page_off;
+            if (chunk > n - p) chunk = n - p;
+            PageCache::update(sb_, vn->inode_num, (pos + p) / PMM_FRAME_SIZE, page_off, src + p, chunk);
+            p += chunk;
+        }
+        done += n;
     }
-    
-    return bytes_read;
+    return true;
 }
 
 int Fat16::fat16_write(vnode* vn, uint32_t offset, const uint8_t* buffer, uint32_t size) {
-    (void)offset;
-    if (!mounted_ || !vn) return -1;
+    if (!mounted_ || !vn || vn->type != VnodeType::File) return -1;
     Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
     if (!nd) return -1;
-    if (write_file_in_dir(nd->parent_cluster, nd->name, buffer, size)) return (int)size;
-    return -1;
+    if (size == 0) return 0;
+    if (offset + size < offset) return -1;
+    if (is_write_protected(nd)) return -1;
+
+    uint32_t end = offset + size;
+    if (!extend_chain(vn, nd, end)) return -1;
+
+    // Дыра между концом файла и offset заполняется нулями
+    if (offset > vn->size) {
+        if (!write_range(vn, nd, vn->size, nullptr, offset - vn->size)) return -1;
+        vn->size = offset;
+        nd->entry_dirty = true;
+    }
+    if (!write_range(vn, nd, offset, buffer, size)) return -1;
+
+    // Размер в записи каталога обновится при закрытии файла
+    if (end > vn->size) {
+        vn->size = end;
+        nd->entry_dirty = true;
+    }
+    return (int)size;
+}
+
+int Fat16::fat16_truncate(vnode* vn, uint32_t size) {
+    if (!mounted_ || !vn || vn->type != VnodeType::File) return -1;
+    Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
+    if (!nd) return -1;
+    if (size >= vn->size) return 0;
+    if (is_write_protected(nd)) return -1;
+
+    // Хвост последней страницы в кэше больше не верен - сбрасываем файл целиком
+    if (sb_) PageCache::invalidate(sb_, vn->inode_num);
+    drop_extents(nd);
+
+    uint32_t cluster_size = bpb_.sectors_per_cluster * 512;
+    uint32_t keep = (size + cluster_size - 1) / cluster_size;
+    uint16_t first = (uint16_t)vn->inode_num;
+    if (keep == 0) {
+        if (first >= 2) free_chain(first);
+        vn->inode_num = 0;
+    } else {
+        uint16_t cluster = first;
+        for (uint32_t i = 1; i < keep && cluster >= 2 && cluster < 0xFFF8; i++) {
+            cluster = fat_table_[cluster];
+        }
+        if (cluster >= 2 && cluster < 0xFFF8) {
+            uint16_t next = fat_table_[cluster];
+            set_fat(cluster, 0xFFFF);
+            if (next >= 2 && next < 0xFFF8) free_chain(next);
+        }
+    }
+    fat_changed();
+
+    vn->size = size;
+    nd->entry_dirty = true;
+    return update_entry(vn) ? 0 : -1;
 }
 
 int Fat16::fat16_open(vnode* vn) {
@@ -742,8 +1297,14 @@ int Fat16::fat16_open(vnode* vn) {
     return 0; // Success
 }
 
+// Последняя ссылка на vnode (vnode_release)
 int Fat16::fat16_close(vnode* vn) {
-    (void)vn;
+    if (vn && vn->fs_data) {
+        Fat16NodeData* nd = (Fat16NodeData*)vn->fs_data;
+        if (nd->entry_dirty) update_entry(vn);
+        drop_extents(nd);
+        if (!nd->detached) unlink_open_node(nd);
+    }
     return 0;
 }
 
@@ -755,22 +1316,35 @@ int Fat16::fat16_lookup(vnode* dir, const char* name, vnode** out) {
     int index;
     if (find_dir_entry(dir_cluster, name, &sector, &index) != 0) return -1;
 
+    // Запись уже открыта - тот же vnode, иначе дескрипторы разойдутся
+    // в размере и конце цепочки
+    Fat16NodeData* open = find_open_node(sector, index);
+    if (open) {
+        __atomic_add_fetch(&open->vn->refcount, 1, __ATOMIC_SEQ_CST);
+        *out = open->vn;
+        return 0;
+    }
+
     // Read the entry to get details
-    Disk::read_sectors(sector, 1, dma_buffer_);
+    read_sector(sector, dma_buffer_);
     FAT16_DirEntry* entry = &((FAT16_DirEntry*)dma_buffer_)[index];
 
-    vnode* vn = (vnode*)kmalloc(sizeof(vnode));
+    vnode* vn = (vnode*)kmem_cache_alloc(vnode_cache);
     if (!vn) return -1;
 
     vn->type = (entry->attributes & FAT_ATTR_DIRECTORY) ? VnodeType::Directory : VnodeType::File;
     vn->size = entry->file_size;
     vn->inode_num = entry->first_cluster;
     vn->refcount = 1;
-    vn->sb = nullptr; // filled by mount
+    vn->sb = dir->sb;
     vn->ops = &fat16_vnode_ops;
     vn->mount_target = nullptr;
     
-    Fat16NodeData* nd = (Fat16NodeData*)kmalloc(sizeof(Fat16NodeData));
+    Fat16NodeData* nd = (Fat16NodeData*)kmem_cache_alloc(node_cache_);
+    if (!nd) {
+        kmem_cache_free(vnode_cache, vn);
+        return -1;
+    }
     int nlen = 0;
     while (name[nlen] && nlen < 12) {
         nd->name[nlen] = name[nlen];
@@ -778,6 +1352,15 @@ int Fat16::fat16_lookup(vnode* dir, const char* name, vnode** out) {
     }
     nd->name[nlen] = '\0';
     nd->parent_cluster = dir_cluster;
+    nd->dir_sector = sector;
+    nd->dir_index = index;
+    nd->extents = nullptr;
+    nd->extent_count = 0;
+    nd->entry_dirty = false;
+    nd->vn = vn;
+    nd->detached = false;
+    nd->next_open = open_nodes_;
+    open_nodes_ = nd;
     vn->fs_data = nd;
 
     *out = vn;
@@ -798,7 +1381,7 @@ int Fat16::fat16_mount(block_device* bdev, superblock* sb) {
     (void)bdev;
     if (!init()) return -1; // Fallback to our hardcoded ATA/Disk init for now
 
-    vnode* root = (vnode*)kmalloc(sizeof(vnode));
+    vnode* root = (vnode*)kmem_cache_alloc(vnode_cache);
     if (!root) return -1;
 
     root->type = VnodeType::Directory;
@@ -811,6 +1394,17 @@ int Fat16::fat16_mount(block_device* bdev, superblock* sb) {
     root->fs_data = nullptr;
 
     sb->root_vnode = root;
+
+    // Псевдо-vnode устройства: через него метаданные (каталоги) идут в кэш страниц
+    bdev_vnode_.type = VnodeType::Device;
+    bdev_vnode_.size = 0;
+    bdev_vnode_.inode_num = PAGE_CACHE_BDEV_INODE;
+    bdev_vnode_.refcount = 1;
+    bdev_vnode_.sb = sb;
+    bdev_vnode_.ops = &fat16_bdev_ops;
+    bdev_vnode_.mount_target = nullptr;
+    bdev_vnode_.fs_data = nullptr;
+    sb_ = sb;
     return 0;
 }
 
@@ -822,7 +1416,7 @@ int Fat16::fat16_readdir(vnode* dir, vfs_dir_entry* entries, int max_entries) {
 
     if (dir_cluster == 0) {
         for (uint32_t s = 0; s < root_dir_sectors_ && count < max_entries; s++) {
-            if (!Disk::read_sectors(root_dir_lba_ + s, 1, dma_buffer_)) continue;
+            if (!read_sector(root_dir_lba_ + s, dma_buffer_)) continue;
 
             FAT16_DirEntry* dir_entries = (FAT16_DirEntry*)dma_buffer_;
             int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
@@ -853,7 +1447,7 @@ int Fat16::fat16_readdir(vnode* dir, vfs_dir_entry* entries, int max_entries) {
         while (cluster >= 2 && cluster < 0xFFF8 && count < max_entries) {
             uint32_t lba = cluster_to_lba(cluster);
             for (uint8_t s = 0; s < bpb_.sectors_per_cluster && count < max_entries; s++) {
-                if (!Disk::read_sectors(lba + s, 1, dma_buffer_)) continue;
+                if (!read_sector(lba + s, dma_buffer_)) continue;
 
                 FAT16_DirEntry* dir_entries = (FAT16_DirEntry*)dma_buffer_;
                 int entries_per_sector = 512 / sizeof(FAT16_DirEntry);
@@ -893,8 +1487,9 @@ int Fat16::fat16_stat(vnode* dir, const char* name, vfs_stat_t* out) {
     uint32_t sector;
     int index;
     if (find_dir_entry(dir_cluster, name, &sector, &index) != 0) return -1;
+    flush_open_node(sector, index);
 
-    Disk::read_sectors(sector, 1, dma_buffer_);
+    read_sector(sector, dma_buffer_);
     FAT16_DirEntry* entry = &((FAT16_DirEntry*)dma_buffer_)[index];
 
     out->size = entry->file_size;
@@ -915,7 +1510,7 @@ int Fat16::fat16_unlink(vnode* dir, const char* name) {
     int index;
     if (find_dir_entry(dir->inode_num, name, &sector, &index) != 0) return -1;
     
-    Disk::read_sectors(sector, 1, dma_buffer_);
+    read_sector(sector, dma_buffer_);
     FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
 
     if (entries[index].attributes & FAT_ATTR_PROTECT_DELETE) {
@@ -923,14 +1518,17 @@ int Fat16::fat16_unlink(vnode* dir, const char* name) {
         return -1;
     }
     
-    uint16_t first_cluster = entries[index].first_cluster;
-    
+    // Открытый файл мог нарастить цепочку, ещё не записав её начало
+    Fat16NodeData* open = find_open_node(sector, index);
+    uint16_t first_cluster = open ? (uint16_t)open->vn->inode_num : entries[index].first_cluster;
+    detach_open_node(sector, index);
+
     entries[index].name[0] = 0xE5;
-    Disk::write_sectors(sector, 1, dma_buffer_);
+    write_sector(sector, dma_buffer_);
 
     if (first_cluster >= 2) {
         free_chain(first_cluster);
-        flush_fat();
+        fat_changed();
     }
     
     return 0;
@@ -953,7 +1551,7 @@ int Fat16::fat16_mkdir(vnode* dir, const char* name, int mode) {
     uint16_t cluster = alloc_cluster();
     if (cluster == 0) return -1; // Disk full
 
-    Disk::read_sectors(sector, 1, dma_buffer_);
+    read_sector(sector, dma_buffer_);
     FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
     
     format_83_name(name, entries[index].name);
@@ -964,12 +1562,12 @@ int Fat16::fat16_mkdir(vnode* dir, const char* name, int mode) {
     entries[index].first_cluster = cluster;
     entries[index].file_size = 0;
     
-    Disk::write_sectors(sector, 1, dma_buffer_);
-    flush_fat();
+    write_sector(sector, dma_buffer_);
+    fat_changed();
 
     // Init the directory '.' and '..'
     uint32_t new_dir_lba = cluster_to_lba(cluster);
-    for (int b = 0; b < 512; b++) dma_buffer_[b] = 0;
+    memset(dma_buffer_, 0, 512);
     
     FAT16_DirEntry* new_entries = (FAT16_DirEntry*)dma_buffer_;
     // '.'
@@ -984,12 +1582,12 @@ int Fat16::fat16_mkdir(vnode* dir, const char* name, int mode) {
     new_entries[1].attributes = FAT_ATTR_DIRECTORY;
     new_entries[1].first_cluster = (uint16_t)parent_cluster;
     
-    Disk::write_sectors(new_dir_lba, 1, dma_buffer_);
+    write_sector(new_dir_lba, dma_buffer_);
     
     // Fill the rest of the cluster with 0
-    for (int b = 0; b < 512; b++) dma_buffer_[b] = 0;
+    memset(dma_buffer_, 0, 512);
     for (uint8_t s = 1; s < bpb_.sectors_per_cluster; s++) {
-        Disk::write_sectors(new_dir_lba + s, 1, dma_buffer_);
+        write_sector(new_dir_lba + s, dma_buffer_);
     }
 
     return 0;
@@ -1022,9 +1620,11 @@ int Fat16::fat16_rename(vnode* old_dir, const char* old_name, vnode* new_dir, co
         return -1; // Disk full / Directory full
     }
 
-    // 4. Read the old entry and save it
+    // 4. Read the old entry and save it (with the size of an open file)
+    flush_open_node(old_sector, old_index);
+    Fat16NodeData* open = find_open_node(old_sector, old_index);
     FAT16_DirEntry old_entry_copy;
-    Disk::read_sectors(old_sector, 1, dma_buffer_);
+    read_sector(old_sector, dma_buffer_);
     FAT16_DirEntry* old_entries = (FAT16_DirEntry*)dma_buffer_;
     old_entry_copy = old_entries[old_index];
     
@@ -1036,29 +1636,300 @@ int Fat16::fat16_rename(vnode* old_dir, const char* old_name, vnode* new_dir, co
     // or we can just do it in one pass if they are the same sector.
     if (old_sector == new_sector) {
         // Read sector once, apply both modifications, write once
-        Disk::read_sectors(new_sector, 1, dma_buffer_);
+        read_sector(new_sector, dma_buffer_);
         FAT16_DirEntry* entries = (FAT16_DirEntry*)dma_buffer_;
         entries[old_index].name[0] = 0xE5; // Delete old
         entries[new_index] = old_entry_copy; // Add new
-        Disk::write_sectors(new_sector, 1, dma_buffer_);
+        write_sector(new_sector, dma_buffer_);
     } else {
         // 5a. Delete old entry
-        Disk::read_sectors(old_sector, 1, dma_buffer_);
+        read_sector(old_sector, dma_buffer_);
         FAT16_DirEntry* old_entries_del = (FAT16_DirEntry*)dma_buffer_;
         old_entries_del[old_index].name[0] = 0xE5;
-        Disk::write_sectors(old_sector, 1, dma_buffer_);
+        write_sector(old_sector, dma_buffer_);
         
         // 5b. Write to new location
-        Disk::read_sectors(new_sector, 1, dma_buffer_);
+        read_sector(new_sector, dma_buffer_);
         FAT16_DirEntry* new_entries = (FAT16_DirEntry*)dma_buffer_;
         new_entries[new_index] = old_entry_copy;
-        Disk::write_sectors(new_sector, 1, dma_buffer_);
+        write_sector(new_sector, dma_buffer_);
+    }
+
+    // Open handles follow the entry to its new place
+    if (open) {
+        int nlen = 0;
+        while (new_name[nlen] && nlen < 12) {
+            open->name[nlen] = new_name[nlen];
+            nlen++;
+        }
+        open->name[nlen] = '\0';
+        open->parent_cluster = new_cluster;
+        open->dir_sector = new_sector;
+        open->dir_index = new_index;
     }
     
-    flush_fat();
+    fat_changed();
     return 0;
 }
 
+#define FSBENCH_FILE "FSBENCH.DAT"
+#define FSBENCH_SMALL_FILES 32
+
+static uint32_t bench_kb_per_sec(uint32_t size, uint32_t ticks) {
+    if (ticks == 0) ticks = 1;
+    return (size / 1024) * 100 / ticks;   // PIT 100 Гц
+}
+
+// Буфер из alloc_blocks освобождается покадрово
+static void free_bench_buffer(uint8_t* buf, uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        PhysicalMemoryManager::free_frame(buf + i * PMM_FRAME_SIZE);
+    }
+}
+
+void Fat16::benchmark(uint32_t size) {
+    if (!mounted_) {
+        printf("FAT16 not mounted\n");
+        return;
+    }
+
+    uint32_t frames = (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint8_t* buf = (uint8_t*)PhysicalMemoryManager::alloc_blocks(frames);
+    if (!buf) {
+        printf("Out of memory for bench\n");
+        return;
+    }
+    for (uint32_t i = 0; i < size; i++) buf[i] = (uint8_t)(i / 512 + i);
+
+    printf("[Bench] FAT16 sequential I/O, %u KB file, %u sectors/cluster\n",
+           size / 1024, bpb_.sectors_per_cluster);
+
+    // Запись: цепочки кластеров одной командой
+    uint32_t t0 = Timer::get_ticks();
+    if (!write_file_in_dir(0, FSBENCH_FILE, buf, size)) {
+        printf("  write failed\n");
+        free_bench_buffer(buf, frames);
+        return;
+    }
+    uint32_t t1 = Timer::get_ticks();
+
+    uint32_t sector;
+    int index;
+    if (find_dir_entry(0, FSBENCH_FILE, &sector, &index) != 0 || !read_sector(sector, dma_buffer_)) {
+        printf("  file not found after write\n");
+        free_bench_buffer(buf, frames);
+        return;
+    }
+    uint16_t first = ((FAT16_DirEntry*)dma_buffer_)[index].first_cluster;
+    uint32_t sectors = (size + 511) / 512;
+
+    // Запись по одному сектору через dma_buffer_ (как было раньше)
+    uint32_t t2 = Timer::get_ticks();
+    uint32_t done = 0;
+    for (uint16_t c = first; c >= 2 && c < 0xFFF8 && done < sectors; c = fat_table_[c]) {
+        uint32_t lba = cluster_to_lba(c);
+        for (uint32_t s = 0; s < bpb_.sectors_per_cluster && done < sectors; s++, done++) {
+            memcpy(dma_buffer_, buf + done * 512, 512);
+            Disk::write_sectors(lba + s, 1, dma_buffer_);
+        }
+    }
+    uint32_t t3 = Timer::get_ticks();
+
+    // Чтение по одному сектору
+    memset(buf, 0, size);
+    done = 0;
+    for (uint16_t c = first; c >= 2 && c < 0xFFF8 && done < sectors; c = fat_table_[c]) {
+        uint32_t lba = cluster_to_lba(c);
+        for (uint32_t s = 0; s < bpb_.sectors_per_cluster && done < sectors; s++, done++) {
+            Disk::read_sectors(lba + s, 1, dma_buffer_);
+            memcpy(buf + done * 512, dma_buffer_, 512);
+        }
+    }
+    uint32_t t4 = Timer::get_ticks();
+
+    // Чтение участками подряд идущих кластеров прямо в буфер
+    memset(buf, 0, size);
+    done = 0;
+    uint16_t c = first;
+    while (c >= 2 && c < 0xFFF8 && done < sectors) {
+        uint16_t run = 1;
+        while (fat_table_[c + run - 1] == c + run) run++;
+        uint32_t count = run * bpb_.sectors_per_cluster;
+        if (count > sectors - done) count = sectors - done;
+        read_run(cluster_to_lba(c), count, buf + done * 512);
+        done += count;
+        c = fat_table_[c + run - 1];
+    }
+    uint32_t t5 = Timer::get_ticks();
+
+    bool ok = true;
+    for (uint32_t i = 0; i < size; i++) {
+        if (buf[i] != (uint8_t)(i / 512 + i)) { ok = false; break; }
+    }
+
+    printf("  write, per sector:   %u KB/s\n", bench_kb_per_sec(size, t3 - t2));
+    printf("  write, per run:      %u KB/s\n", bench_kb_per_sec(size, t1 - t0));
+    printf("  read,  per sector:   %u KB/s\n", bench_kb_per_sec(size, t4 - t3));
+    printf("  read,  per run:      %u KB/s %s\n", bench_kb_per_sec(size, t5 - t4), ok ? "" : "[DATA MISMATCH]");
+
+    delete_file(FSBENCH_FILE);
+
+    // Серия мелких файлов: FAT после каждого против одного отложенного сброса
+    uint32_t saved_interval = sync_interval_;
+    uint32_t burst_ticks[2];
+    for (int mode = 0; mode < 2; mode++) {
+        sync_interval_ = mode == 0 ? 0 : FAT16_SYNC_INTERVAL;
+        uint32_t b0 = Timer::get_ticks();
+        char name[13] = "FSB_00.DAT";
+        for (int i = 0; i < FSBENCH_SMALL_FILES; i++) {
+            name[4] = '0' + i / 10;
+            name[5] = '0' + i % 10;
+            write_file_in_dir(0, name, buf, 512);
+        }
+        for (int i = 0; i < FSBENCH_SMALL_FILES; i++) {
+            name[4] = '0' + i / 10;
+            name[5] = '0' + i % 10;
+            delete_file(name);
+        }
+        sync();
+        burst_ticks[mode] = Timer::get_ticks() - b0;
+    }
+    sync_interval_ = saved_interval;
+
+    printf("  %d small files, FAT write-through: %u ticks\n", FSBENCH_SMALL_FILES, burst_ticks[0]);
+    printf("  %d small files, FAT deferred:      %u ticks\n", FSBENCH_SMALL_FILES, burst_ticks[1]);
+
+    free_bench_buffer(buf, frames);
+}
+
+#define APPENDBENCH_FILE "APPBENCH.LOG"
+
+void Fat16::bench_append(uint32_t count, uint32_t chunk) {
+    if (!mounted_ || !sb_) {
+        printf("FAT16 not mounted\n");
+        return;
+    }
+
+    uint32_t size = count * chunk;
+    uint32_t frames = (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    if (count == 0 || chunk == 0 || frames > 256) {
+        printf("Bad bench size (max 1 MB total)\n");
+        return;
+    }
+    uint8_t* buf = (uint8_t*)PhysicalMemoryManager::alloc_blocks(frames);
+    if (!buf) {
+        printf("Out of memory for bench\n");
+        return;
+    }
+    for (uint32_t i = 0; i < size; i++) buf[i] = (uint8_t)(i * 7 + i / chunk);
+
+    printf("[Bench] FAT16 append: %u x %u bytes\n", count, chunk);
+
+    // Объём I/O после четверти, половины и всех дописываний: при перезаписи
+    // целиком растёт квадратично, при записи по смещению - линейно
+    uint32_t marks[3] = { count / 4, count / 2, count };
+    uint32_t written[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+    uint32_t ticks[2] = { 0, 0 };
+
+    for (int mode = 0; mode < 2; mode++) {
+        uint32_t sector;
+        int index;
+        if (find_dir_entry(0, APPENDBENCH_FILE, &sector, &index) == 0) delete_file(APPENDBENCH_FILE);
+        uint8_t dummy = 0;
+        vnode* vn = nullptr;
+        if (!write_file_in_dir(0, APPENDBENCH_FILE, &dummy, 0) ||
+            fat16_lookup(sb_->root_vnode, APPENDBENCH_FILE, &vn) != 0) {
+            printf("  cannot create %s\n", APPENDBENCH_FILE);
+            break;
+        }
+
+        uint32_t w0 = io_stats_.sectors_written;
+        uint32_t t0 = Timer::get_ticks();
+        int m = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (mode == 0) {
+                // Как раньше: каждая запись пересоздаёт файл целиком
+                write_file_in_dir(0, APPENDBENCH_FILE, buf, (i + 1) * chunk);
+            } else {
+                fat16_write(vn, i * chunk, buf + i * chunk, chunk);
+            }
+            while (m < 3 && i + 1 == marks[m]) written[mode][m++] = io_stats_.sectors_written - w0;
+        }
+        vnode_release(vn);
+        sync();
+        ticks[mode] = Timer::get_ticks() - t0;
+    }
+
+    // Проверка содержимого после дописываний по смещению
+    bool ok = false;
+    vnode* vn = nullptr;
+    if (fat16_lookup(sb_->root_vnode, APPENDBENCH_FILE, &vn) == 0) {
+        ok = vn->size == size;
+        uint8_t* check = (uint8_t*)PhysicalMemoryManager::alloc_frame();
+        for (uint32_t off = 0; ok && check && off < size; off += PMM_FRAME_SIZE) {
+            uint32_t n = size - off < PMM_FRAME_SIZE ? size - off : PMM_FRAME_SIZE;
+            ok = fat16_read(vn, off, check, n) == (int)n;
+            for (uint32_t i = 0; ok && i < n; i++) ok = check[i] == buf[off + i];
+        }
+        if (check) PhysicalMemoryManager::free_frame(check);
+        vnode_release(vn);
+    }
+
+    printf("  sectors written after %u / %u / %u appends:\n", marks[0], marks[1], marks[2]);
+    printf("  rewrite whole file:  %u / %u / %u, %u ticks\n", written[0][0], written[0][1], written[0][2], ticks[0]);
+    printf("  write at offset:     %u / %u / %u, %u ticks %s\n", written[1][0], written[1][1], written[1][2],
+           ticks[1], ok ? "" : "[DATA MISMATCH]");
+
+    delete_file(APPENDBENCH_FILE);
+    for (uint32_t i = 0; i < frames; i++) {
+        PhysicalMemoryManager::free_frame(buf + i * PMM_FRAME_SIZE);
+    }
+}
+
+#define BLOCKTEST_FILE "BLKTEST.TMP"
+
+void Fat16::bench_block(uint32_t sectors) {
+    if (!mounted_ || !sb_) {
+        printf("FAT16 not mounted\n");
+        return;
+    }
+    uint32_t size = sectors * 512;
+    uint32_t frames = (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint8_t* buf = (uint8_t*)PhysicalMemoryManager::alloc_blocks(frames);
+    if (!buf) {
+        printf("Out of memory for bench\n");
+        return;
+    }
+    memset(buf, 0, size);
+
+    // Временный файл даёт диапазон секторов, который можно перезаписывать
+    uint32_t sector;
+    int index;
+    if (find_dir_entry(0, BLOCKTEST_FILE, &sector, &index) == 0) delete_file(BLOCKTEST_FILE);
+    vnode* vn = nullptr;
+    if (!write_file_in_dir(0, BLOCKTEST_FILE, buf, size) ||
+        fat16_lookup(sb_->root_vnode, BLOCKTEST_FILE, &vn) != 0) {
+        printf("  cannot create %s\n", BLOCKTEST_FILE);
+    } else {
+        uint32_t contiguous = 0;
+        uint16_t cluster = map_cluster((Fat16NodeData*)vn->fs_data, 0, &contiguous);
+        uint32_t run = contiguous * bpb_.sectors_per_cluster;
+        vnode_release(vn);
+        sync();
+        if (cluster < 2 || run == 0) {
+            printf("  %s has no clusters\n", BLOCKTEST_FILE);
+        } else {
+            // Без записи, если файл лёг не одним куском
+            Disk::selftest(cluster_to_lba(cluster), run < sectors ? run : sectors, run >= sectors);
+        }
+    }
+
+    delete_file(BLOCKTEST_FILE);
+    for (uint32_t i = 0; i < frames; i++) {
+        PhysicalMemoryManager::free_frame(buf + i * PMM_FRAME_SIZE);
+    }
+}
+
 vnode_operations Fat16::fat16_vnode_ops = {
     Fat16::fat16_open,
     Fat16::fat16_close,
@@ -1071,12 +1942,24 @@ vnode_operations Fat16::fat16_vnode_ops = {
     Fat16::fat16_rename,
     Fat16::fat16_readdir,
     Fat16::fat16_stat,
+    Fat16::fat16_readpage,
+    Fat16::fat16_readpages,
+    Fat16::fat16_truncate,
+};
+
+vnode_operations Fat16::fat16_bdev_ops = {
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr,
+    Fat16::fat16_read_block_page,
+    nullptr,
+    nullptr,
 };
 
 vfs_filesystem_driver fat16_driver = {
     "fat16",
     Fat16::fat16_mount,
-    nullptr
+    nullptr,
+    Fat16::fat16_sync
 };
 
 } // namespace re36
@@ -0,0 +1,212 @@
+#include "kernel/fpu.h"
+#include "kernel/thread.h"
+#include "kernel/smp.h"
+#include "kernel/spinlock.h"
+#include "kernel/task_scheduler.h"
+#include "libc.h"
+
+namespace re36 {
+
+#define CR0_MP (1u << 1)
+#define CR0_EM (1u << 2)
+#define CR0_TS (1u << 3)
+#define CR0_NE (1u << 5)
+#define CR4_OSFXSR     (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+
+#define MXCSR_DEFAULT 0x1F80     // Все исключения SSE замаскированы
+
+bool Fpu::fxsr_ = false;
+bool Fpu::sse_ = false;
+bool Fpu::sse2_ = false;
+FpuStats Fpu::stats_ = {0, 0, 0, 0};
+
+// Состояние после FNINIT (и LDMXCSR по умолчанию): с него начинает поток
+static uint8_t init_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+
+void Fpu::setup_cpu() {
+    uint32_t cr0, cr4;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~CR0_EM;                    // FPU не эмулируется
+    cr0 |= CR0_MP | CR0_NE;            // WAIT учитывает TS, ошибки x87 - через #MF
+    asm volatile("mov %0, %%cr0" :: "r"(cr0));
+
+    if (!fxsr_) return;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR;
+    if (sse_) cr4 |= CR4_OSXMMEXCPT;
+    asm volatile("mov %0, %%cr4" :: "r"(cr4));
+}
+
+void Fpu::init() {
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    fxsr_ = edx & (1 << 24);
+    sse_ = fxsr_ && (edx & (1 << 25));
+    sse2_ = sse_ && (edx & (1 << 26));
+
+    for (int i = 0; i < MAX_CPUS; i++) cpus[i].fpu_owner = -1;
+
+    setup_cpu();
+    asm volatile("clts; fninit");
+    if (sse_) {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+        asm volatile("ldmxcsr %0" :: "m"(mxcsr));
+    }
+    save(init_state);
+    set_ts();
+}
+
+void Fpu::init_ap() {
+    setup_cpu();
+    clear_ts();
+    restore(init_state);
+    set_ts();
+}
+
+bool Fpu::has_fxsr() {
+    return fxsr_;
+}
+
+bool Fpu::has_sse2() {
+    return sse2_;
+}
+
+void Fpu::save(void* area) {
+    if (fxsr_) {
+        asm volatile("fxsave (%0)" :: "r"(area) : "memory");
+    } else {
+        // FNSAVE сбрасывает FPU - регистры владельца возвращаются назад
+        asm volatile("fnsave (%0); frstor (%0)" :: "r"(area) : "memory");
+    }
+}
+
+void Fpu::restore(const void* area) {
+    if (fxsr_) asm volatile("fxrstor (%0)" :: "r"(area) : "memory");
+    else asm volatile("frstor (%0)" :: "r"(area) : "memory");
+}
+
+bool Fpu::ts_set() {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0 & CR0_TS;
+}
+
+void Fpu::set_ts() {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    if (!(cr0 & CR0_TS)) asm volatile("mov %0, %%cr0" :: "r"(cr0 | CR0_TS));
+}
+
+void Fpu::clear_ts() {
+    asm volatile("clts");
+}
+
+void Fpu::switch_to(int prev_tid, int next_tid) {
+    CpuInfo* cpu = cpu_current();
+
+    // TS снят - уходящий поток владеет регистрами. На SMP он может
+    // продолжить на другом процессоре, где до этих регистров не добраться.
+    if (!ts_set() && smp_active && cpu->fpu_owner == prev_tid) {
+        save(threads[prev_tid].fpu);
+        stats_.saves++;
+    }
+
+    Thread& next = threads[next_tid];
+    if (cpu->fpu_owner == next_tid && next.fpu_cpu == cpu->index) clear_ts();
+    else set_ts();
+}
+
+void Fpu::handle_trap() {
+    CpuInfo* cpu = cpu_current();
+    int tid = cpu->running_tid;
+    Thread& t = threads[tid];
+
+    clear_ts();
+    stats_.traps++;
+    // Регистры ещё хранят состояние потока: после release или с другого
+    // процессора сюда не попасть
+    if (cpu->fpu_owner == tid && t.fpu_cpu == cpu->index) return;
+
+    if (!t.fpu) {
+        t.fpu = (uint8_t*)kmem_cache_alloc(fpu_cache);
+        if (!t.fpu) {
+            set_ts();
+            printf("\n[FPU] Thread %d: no memory for FPU state\n", tid);
+            TaskScheduler::terminate_current();
+            return;
+        }
+        memcpy(t.fpu, init_state, FPU_STATE_SIZE);
+        stats_.allocs++;
+    }
+
+    // Без SMP состояние прежнего владельца есть только в регистрах; с SMP
+    // оно сохранено в switch_to и могло с тех пор измениться на другом
+    // процессоре
+    int owner = cpu->fpu_owner;
+    if (!smp_active && owner >= 0 && owner != tid) {
+        save(threads[owner].fpu);
+        stats_.saves++;
+    }
+
+    restore(t.fpu);
+    stats_.restores++;
+    cpu->fpu_owner = tid;
+    t.fpu_cpu = cpu->index;
+}
+
+bool Fpu::fork_state(int parent_tid, int child_tid) {
+    InterruptGuard guard;
+    Thread& parent = threads[parent_tid];
+    Thread& child = threads[child_tid];
+    child.fpu = nullptr;
+    child.fpu_cpu = FPU_NO_CPU;
+    if (!parent.fpu) return true;
+
+    child.fpu = (uint8_t*)kmem_cache_alloc(fpu_cache);
+    if (!child.fpu) return false;
+    stats_.allocs++;
+
+    CpuInfo* cpu = cpu_current();
+    if (cpu->fpu_owner == parent_tid && parent.fpu_cpu == cpu->index && !ts_set()) {
+        save(parent.fpu);
+        stats_.saves++;
+    }
+    memcpy(child.fpu, parent.fpu, FPU_STATE_SIZE);
+    return true;
+}
+
+void Fpu::release(int tid) {
+    InterruptGuard guard;
+    Thread& t = threads[tid];
+
+    for (int i = 0; i < MAX_CPUS; i++) {
+        if (cpus[i].fpu_owner == tid) cpus[i].fpu_owner = -1;
+    }
+    // exec: следующая инструкция FPU должна дать #NM
+    if (cpu_current()->running_tid == tid) set_ts();
+
+    if (t.fpu) kmem_cache_free(fpu_cache, t.fpu);
+    t.fpu = nullptr;
+    t.fpu_cpu = FPU_NO_CPU;
+}
+
+FpuStats Fpu::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void Fpu::print_info() {
+    FpuStats st = get_stats();
+    printf("FPU: %s%s%s, lazy switching (CR0.TS + #NM)\n",
+           fxsr_ ? "FXSAVE" : "FNSAVE", sse_ ? ", SSE" : "", sse2_ ? ", SSE2" : "");
+    printf("Traps: %u, saves: %u, restores: %u, state areas: %u allocated\n",
+           st.traps, st.saves, st.restores, st.allocs);
+    printf(" CPU | Owner\n");
+    for (int i = 0; i < MAX_CPUS; i++) {
+        if (!cpus[i].online && i != 0) continue;
+        printf(" %d   | %d\n", i, cpus[i].fpu_owner);
+    }
+}
+
+} // namespace re36
@@ -11,6 +11,11 @@
 #include "kernel/bga.h"
 #include "kernel/vga.h"
 #include "kernel/event_channel.h"
+#include "kernel/ahci.h"
+#include "kernel/ata.h"
+#include "kernel/lapic.h"
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
 #include "libc.h"
 
 namespace re36 {
@@ -71,6 +76,12 @@ extern "C" {
     void irq14();
     void irq15();
 
+    // Локальный APIC: таймер, IPI и ложное прерывание
+    void isr64();
+    void isr65();
+    void isr66();
+    void isr255();
+
     void load_idt(uint32_t idt_ptr);
 }
 
@@ -136,12 +147,33 @@ void init_idt() {
     set_idt_gate(46, (uint32_t)irq14, 0x08, 0x8E);
     set_idt_gate(47, (uint32_t)irq15, 0x08, 0x8E);
 
+    set_idt_gate(LAPIC_TIMER_VECTOR, (uint32_t)isr64, 0x08, 0x8E);
+    set_idt_gate(SMP_TLB_VECTOR, (uint32_t)isr65, 0x08, 0x8E);
+    set_idt_gate(SMP_RESCHED_VECTOR, (uint32_t)isr66, 0x08, 0x8E);
+    set_idt_gate(LAPIC_SPURIOUS_VECTOR, (uint32_t)isr255, 0x08, 0x8E);
+
+    load_idt((uint32_t)&idt_ptr);
+}
+
+void reload_idt() {
     load_idt((uint32_t)&idt_ptr);
 }
 
 } 
 
-extern "C" void isr_handler(re36::Registers* regs) {
+static void dispatch_interrupt(re36::Registers* regs) {
+    if (regs->int_no == LAPIC_TIMER_VECTOR) {
+        re36::Timer::handle_event();
+        return;
+    }
+
+    if (regs->int_no == SMP_RESCHED_VECTOR) {
+        re36::cpu_current()->resched_ipis++;
+        re36::LocalApic::eoi();
+        re36::TaskScheduler::schedule();
+        return;
+    }
+
     if (regs->int_no >= 32 && regs->int_no <= 47) {
 
         if (regs->int_no == 32) {
@@ -152,19 +184,36 @@ extern "C" void isr_handler(re36::Registers* regs) {
             return;
         }
 
+        // Нажатие клавиши и завершение команд AHCI и DMA IDE будят ждущие
+        // потоки
+        bool woke = false;
         if (regs->int_no == 33) {
-            re36::KeyboardDriver::handle_interrupt();
+            woke = re36::KeyboardDriver::handle_interrupt();
         }
 
         if (regs->int_no == 44) {
             re36::MouseDriver::handle_interrupt();
         }
 
+        if ((int)regs->int_no - 32 == re36::AHCIDriver::get_irq()) {
+            woke |= re36::AHCIDriver::handle_interrupt();
+        }
+        if ((int)regs->int_no - 32 == re36::ATA::get_irq()) {
+            woke |= re36::ATA::handle_interrupt();
+        }
+
         // Notify user-space drivers waiting via sys_wait_irq
         re36::EventSystem::push(regs->int_no - 32, 1);
 
         re36::pic_send_eoi(regs->int_no - 32);
 
+        if (woke) re36::TaskScheduler::preempt();
+        return;
+    }
+
+    // Первое обращение к FPU после переключения (CR0.TS)
+    if (regs->int_no == 7) {
+        re36::Fpu::handle_trap();
         return;
     }
 
@@ -316,3 +365,24 @@ extern "C" void isr_handler(re36::Registers* regs) {
         asm volatile("cli; hlt");
     }
 }
+
+extern "C" void isr_handler(re36::Registers* regs) {
+    // Сброс TLB не берёт BKL: её владелец ждёт подтверждения
+    if (regs->int_no == SMP_TLB_VECTOR) {
+        re36::Smp::handle_tlb_ipi();
+        return;
+    }
+
+    // Ложное прерывание APIC: EOI не посылается
+    if (regs->int_no == LAPIC_SPURIOUS_VECTOR) return;
+
+    // Из Ring 3 и из hlt простоя процессор приходит без BKL. Если здесь
+    // произошло переключение, отпускает её тот, кто вернётся в этот кадр.
+    bool took = re36::Smp::enter_kernel();
+    dispatch_interrupt(regs);
+
+    if ((regs->cs & 3) == 3 && re36::threads[re36::TaskScheduler::get_current_tid()].kill_pending) {
+        re36::TaskScheduler::terminate_current();
+    }
+    if (took) re36::Smp::leave_kernel();
+}
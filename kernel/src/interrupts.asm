@@ -91,6 +91,36 @@ IRQ_STUB 13, 45
 IRQ_STUB 14, 46
 IRQ_STUB 15, 47
 
+; Локальный APIC: таймер (one-shot / TSC-deadline), IPI и ложное прерывание
+global isr64
+isr64:
+    cli
+    push byte 0         ; Фейковый код ошибки
+    push dword 64       ; Номер прерывания
+    jmp isr_common_stub
+
+; IPI: сброс TLB и перепланирование
+global isr65
+isr65:
+    cli
+    push byte 0         ; Фейковый код ошибки
+    push dword 65       ; Номер прерывания
+    jmp isr_common_stub
+
+global isr66
+isr66:
+    cli
+    push byte 0         ; Фейковый код ошибки
+    push dword 66       ; Номер прерывания
+    jmp isr_common_stub
+
+global isr255
+isr255:
+    cli
+    push byte 0         ; Фейковый код ошибки
+    push dword 255      ; Номер прерывания
+    jmp isr_common_stub
+
 ; Syscall Gate (int 0x80 = ISR 128)
 global isr128
 isr128:
@@ -102,6 +132,7 @@ isr128:
 ; Общий кусок кода для всех прерываний
 isr_common_stub:
     pusha               ; Сохраняет EDI, ESI, EBP, ESP, EBX, EDX, ECX, EAX
+    cld                 ; Прерванный код мог быть внутри std (memmove) - iret вернёт его DF
 
     mov ax, ds          ; Сохраняем Data Segment
     push eax            ; И кладем его на стек тоже (структура Registers)
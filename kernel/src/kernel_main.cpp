@@ -2,12 +2,16 @@
 #include <stddef.h>
 #include "kernel/idt.h"
 #include "kernel/pmm.h"
+#include "kernel/memory_map.h"
 #include "kernel/pic.h"
 #include "kernel/kmalloc.h"
 #include "kernel/vector.h"
 #include "kernel/string.h"
 #include "kernel/keyboard.h"
 #include "kernel/timer.h"
+#include "kernel/lapic.h"
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
 #include "kernel/task_scheduler.h"
 #include "kernel/event_channel.h"
 #include "kernel/vmm.h"
@@ -30,16 +34,11 @@
 #include "kernel/fat16.h"
 #include "kernel/vfs.h"
 #include "kernel/page_cache.h"
+#include "kernel/zero_pool.h"
 #include "libc.h"
 
 static volatile uint16_t* vga_buffer = (volatile uint16_t*)0xB8000;
 
-void idle_thread() {
-    while (true) {
-        asm volatile("hlt");
-    }
-}
-
 void user_thread_entry() {
     re36::enter_usermode();
 }
@@ -50,6 +49,8 @@ void shell_thread() {
 
 extern "C" void kernel_main() {
     serial_init();
+    re36::Fpu::init();
+    mem_init();
     volatile uint16_t* dbg = (volatile uint16_t*)0xB8000;
     dbg[0] = 0x4F31;
 
@@ -59,11 +60,25 @@ extern "C" void kernel_main() {
     re36::pic_remap(0x20, 0x28);
     dbg[2] = 0x4F33; // '3' — PMM
 
-    uint32_t pmm_bitmap_addr = ((uint32_t)&_kernel_end + 0xFFF) & ~0xFFF;
-    re36::PhysicalMemoryManager::init(pmm_bitmap_addr, 32 * 1024 * 1024);
-    re36::PhysicalMemoryManager::set_region_free(0x100000, 31 * 1024 * 1024);
+    // Размер PMM - по карте памяти загрузчика. Метаданные PMM (битмап,
+    // дескрипторы фреймов) не помещаются между концом ядра и стеком на
+    // 0x90000, поэтому кладём их с 1 МБ
+    re36::MemoryMap::init();
+    uint32_t pmm_memory_size = re36::MemoryMap::get_managed_end();
+    uint32_t pmm_bitmap_addr = 0x100000;
+    re36::PhysicalMemoryManager::init(pmm_bitmap_addr, pmm_memory_size);
+    uint32_t pmm_free_base = (pmm_bitmap_addr + re36::PhysicalMemoryManager::get_metadata_size(pmm_memory_size) + 0xFFF) & ~0xFFF;
+    re36::MemoryMap::release_usable(pmm_free_base);
+    printf("[PMM] %u MB managed, %u MB free\n", pmm_memory_size >> 20,
+           re36::PhysicalMemoryManager::get_free_memory() >> 20);
+    if (re36::MemoryMap::get_unmanaged_kb()) {
+        printf("[PMM] %u MB of RAM above %u MB is not used\n",
+               re36::MemoryMap::get_unmanaged_kb() / 1024, KERNEL_SPACE_END >> 20);
+    }
     dbg[3] = 0x4F34; // '4' — kmalloc
 
+    re36::kmalloc_init();
+
     re36::EventSystem::init();
     dbg[4] = 0x4F35; // '5' — Keyboard
 
@@ -84,6 +99,7 @@ extern "C" void kernel_main() {
     dbg[7] = 0x4F38; // '8' — Timer
     dbg[8] = 0x4F39; // '9' — Timer
 
+    re36::LocalApic::init();
     re36::Timer::init(100);
     dbg[9] = 0x4F41; // 'A' — TSS
 
@@ -110,18 +126,24 @@ extern "C" void kernel_main() {
     printf("==========================================\n\n");
 
     set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
-    printf("-> PMM Initialized (32 MB RAM)\n");
+    printf("-> PMM Initialized (%u MB RAM)\n", pmm_memory_size >> 20);
     printf("-> Heap Initialized\n");
+    printf("-> Page copy: %s\n", mem_has_sse() ? "SSE2" : "rep movsd");
     printf("-> Keyboard Driver (Ring 0) Loaded via IRQ1\n");
     printf("-> PS/2 Mouse Driver (Ring 0) Loaded via IRQ12\n");
-    printf("-> PIT Timer Initialized (100 Hz)\n");
+    if (re36::Timer::is_tickless()) {
+        printf("-> LAPIC One-Shot Timer (tickless, TSC %u kHz)\n", re36::Timer::get_tsc_khz());
+    } else {
+        printf("-> PIT Timer Initialized (100 Hz)\n");
+    }
     printf("-> Task Scheduler Initialized (Priority RR)\n");
     printf("-> Event Channel System Ready\n");
     printf("-> ATA Disk Controller Ready\n");
     
-    re36::ATA::init();
     re36::PCI::scan_bus();
+    re36::ATA::init();
     re36::AHCIDriver::init();
+    re36::Disk::init();
     
     // Initialize Video Mode (1024x768x32)
     re36::BgaDriver::init(1024, 768, 32);
@@ -153,18 +175,28 @@ extern "C" void kernel_main() {
     
     set_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
 
-    re36::thread_create("idle", idle_thread, 255);
+    re36::TaskScheduler::create_idle(0);
+    re36::TaskScheduler::start_reaper();
+    re36::Smp::init();
+    if (re36::Smp::online_count() > 1) {
+        printf("-> SMP: %d CPUs online (MP table, big kernel lock)\n", re36::Smp::online_count());
+    }
     int shell_tid = re36::thread_create("shell", shell_thread, 1);
     if (shell_tid >= 0) {
         re36::threads[shell_tid].is_driver = true;
     }
+    re36::ZeroPool::init();
+    re36::Fat16::start_sync_thread();
 
     set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-    printf("Spawned threads: idle (pri=255), shell (pri=1)\n");
+    printf("Spawned threads: idle (pri=255), reaper (pri=100), shell (pri=1), zeroer (pri=254), fatsync (pri=200)\n");
     printf("Switching to shell thread...\n\n");
     set_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
 
+    // Загрузочному потоку больше нечего делать: простой - забота idle, а в
+    // очереди готовых он заставлял бы таймер делить процессор между двумя
+    // простаивающими потоками
     while (true) {
-        asm volatile("sti; hlt");
+        re36::TaskScheduler::block_current(-1);
     }
 }
@@ -1,6 +1,8 @@
 #include "kernel/keyboard.h"
 #include "kernel/pic.h" // Для inb
 #include "kernel/event_channel.h"
+#include "kernel/task_scheduler.h"
+#include "kernel/spinlock.h"
 #include "libc.h"       // Для printf/putchar
 
 namespace re36 {
@@ -17,6 +19,7 @@ char KeyboardDriver::char_buffer_[256];
 int KeyboardDriver::buffer_head_ = 0;
 int KeyboardDriver::buffer_tail_ = 0;
 bool KeyboardDriver::extended_key_ = false;
+WaitQueue KeyboardDriver::readers_ = {nullptr};
 
 // Американская раскладка QWERTY (Scancode Set 1) - Нажатия 
 static const char kbd_us_qwerty[128] = {
@@ -101,9 +104,13 @@ void KeyboardDriver::init() {
     kbd_channel_id_ = EventSystem::create_channel("kbd");
 }
 
-void KeyboardDriver::handle_interrupt() {
+bool KeyboardDriver::handle_interrupt() {
     uint8_t scancode = inb(0x60);
     process_scancode(scancode);
+
+    if (!readers_.head || buffer_head_ == buffer_tail_) return false;
+    TaskScheduler::wake_all(&readers_);
+    return true;
 }
 
 void KeyboardDriver::process_scancode(uint8_t scancode) {
@@ -215,11 +222,17 @@ char KeyboardDriver::get_char_nonblocking() {
 }
 
 char KeyboardDriver::get_char() {
+    InterruptGuard guard;
     char c = 0;
     while ((c = get_char_nonblocking()) == 0) {
-        asm volatile("sti; hlt; cli");
+        // IRQ1 приходит только на BSP: поток, исполняемый на AP, не
+        // дождался бы его в hlt. Загрузочный поток уснуть не может.
+        if (TaskScheduler::get_current_tid() != 0) {
+            TaskScheduler::wait_on(&readers_, -1);
+        } else {
+            Smp::halt();
+        }
     }
-    asm volatile("sti");
     return c;
 }
 
@@ -1,101 +1,261 @@
 #include "kernel/kmalloc.h"
 #include "kernel/pmm.h"
+#include "kernel/spinlock.h"
+#include "libc.h"
 
 namespace re36 {
 
-// Максимально примитивный аллокатор кучи (Heap) на базе связного списка.
-// В реальности аллокаторы сложнее, но для вызова new и размещения пары классов этого хватит.
+// Slab-аллокатор кучи ядра. Мелкие объекты живут в слабах по одному фрейму:
+// заголовок Slab в начале фрейма позволяет kfree найти кэш за O(1) по адресу.
+// Крупные блоки (> KMEM_MAX_CLASS) выделяются целыми фреймами у PMM.
 
-struct MemoryBlock {
-    size_t size;           // Размер вместе со структурой (MemoryBlock)
-    bool is_free;          // Свободен ли блок
-    MemoryBlock* next;     // Следующий блок в MemoryBlockList
+#define SLAB_MAGIC  0x51AB51AB
+#define LARGE_MAGIC 0x1A26E000
+
+struct Slab {
+    uint32_t magic;
+    KmemCache* cache;
+    Slab* prev;
+    Slab* next;
+    void* free_list;       // Односвязный список свободных объектов
+    uint32_t inuse;
 };
 
-static MemoryBlock* heap_start = nullptr;
+struct LargeHeader {
+    uint32_t magic;
+    uint32_t pages;
+    uint32_t reserved[2];  // Выравнивание полезных данных на 16 байт
+};
 
-void kmalloc_init() {
-    // Выделяем первый физический фрейм (4 КБ) в качестве основы для кучи
-    heap_start = (MemoryBlock*)PhysicalMemoryManager::alloc_frame();
-    if (!heap_start) return; // Упс, память кончилась на самом старте.
+#define SLAB_DATA_OFFSET ((sizeof(Slab) + 15) & ~15u)
+
+static KmemCache caches[KMEM_MAX_CACHES];
+static uint32_t cache_count = 0;
+static KmemCache* size_classes[8]; // 8, 16, ..., 1024
+static bool heap_ready = false;
+
+static void slab_list_remove(Slab** head, Slab* slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else *head = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->prev = slab->next = nullptr;
+}
 
-    // Инициализируем первый блок
-    heap_start->size = PMM_FRAME_SIZE;
-    heap_start->is_free = true;
-    heap_start->next = nullptr;
+static void slab_list_push(Slab** head, Slab* slab) {
+    slab->prev = nullptr;
+    slab->next = *head;
+    if (*head) (*head)->prev = slab;
+    *head = slab;
 }
 
-// Простая функция разделения блока (если он сильно больше, чем просили)
-static void split_block(MemoryBlock* block, size_t size) {
-    if (block->size <= size + sizeof(MemoryBlock) + 32) {
-        return; // Блок слишком маленький, чтобы его дробить
+static Slab* slab_create(KmemCache* cache) {
+    Slab* slab = (Slab*)PhysicalMemoryManager::alloc_frame();
+    if (!slab) return nullptr;
+
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->prev = slab->next = nullptr;
+    slab->inuse = 0;
+    slab->free_list = nullptr;
+
+    // Нарезаем фрейм на объекты, список строим с конца, чтобы выдавать по возрастанию
+    uint8_t* base = (uint8_t*)slab + SLAB_DATA_OFFSET;
+    for (int i = (int)cache->objs_per_slab - 1; i >= 0; i--) {
+        void** obj = (void**)(base + i * cache->obj_size);
+        *obj = slab->free_list;
+        slab->free_list = obj;
     }
 
-    // Создаем новый блок после запрашиваемого размера
-    MemoryBlock* new_block = (MemoryBlock*)((uint8_t*)block + size);
-    new_block->size = block->size - size;
-    new_block->is_free = true;
-    new_block->next = block->next;
+    cache->slab_count++;
+    return slab;
+}
 
-    block->size = size;
-    block->next = new_block;
+static void slab_destroy(KmemCache* cache, Slab* slab) {
+    slab->magic = 0;
+    cache->slab_count--;
+    cache->slabs_released++;
+    PhysicalMemoryManager::free_frame(slab);
 }
 
-void* kmalloc(size_t size) {
-    if (size == 0) return nullptr;
+KmemCache* kmem_cache_create(const char* name, size_t obj_size) {
+    InterruptGuard guard;
+    if (cache_count >= KMEM_MAX_CACHES) return nullptr;
+
+    size_t size = (obj_size + 7) & ~(size_t)7;
+    if (size < sizeof(void*)) size = sizeof(void*);
+    if (size > PMM_FRAME_SIZE - SLAB_DATA_OFFSET) return nullptr;
+
+    KmemCache* cache = &caches[cache_count++];
+    int i = 0;
+    while (name[i] && i < KMEM_NAME_LEN - 1) {
+        cache->name[i] = name[i];
+        i++;
+    }
+    cache->name[i] = '\0';
+
+    cache->obj_size = size;
+    cache->objs_per_slab = (PMM_FRAME_SIZE - SLAB_DATA_OFFSET) / size;
+    cache->partial = cache->full = cache->empty = nullptr;
+    cache->empty_count = 0;
+    cache->hits = cache->misses = cache->frees = 0;
+    cache->active_objs = cache->slab_count = cache->slabs_released = 0;
+    return cache;
+}
+
+void* kmem_cache_alloc(KmemCache* cache) {
+    if (!cache) return nullptr;
+    InterruptGuard guard;
+
+    Slab* slab = cache->partial;
+    if (slab) {
+        cache->hits++;
+    } else if (cache->empty) {
+        slab = cache->empty;
+        slab_list_remove(&cache->empty, slab);
+        cache->empty_count--;
+        slab_list_push(&cache->partial, slab);
+        cache->hits++;
+    } else {
+        slab = slab_create(cache);
+        if (!slab) return nullptr;
+        slab_list_push(&cache->partial, slab);
+        cache->misses++;
+    }
+
+    void** obj = (void**)slab->free_list;
+    slab->free_list = *obj;
+    slab->inuse++;
+    cache->active_objs++;
+
+    if (slab->inuse == cache->objs_per_slab) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+    return obj;
+}
+
+static void slab_free_object(Slab* slab, void* ptr) {
+    KmemCache* cache = slab->cache;
 
-    // Выравниваем размер до 8 байт + добавляем заголовок
-    size_t total_size = size + sizeof(MemoryBlock);
-    if (total_size % 8 != 0) {
-        total_size += 8 - (total_size % 8);
+    if (slab->inuse == cache->objs_per_slab) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
     }
 
-    MemoryBlock* current = heap_start;
-    MemoryBlock* last = nullptr;
+    *(void**)ptr = slab->free_list;
+    slab->free_list = ptr;
+    slab->inuse--;
+    cache->active_objs--;
+    cache->frees++;
 
-    // Ищем свободный блок подходящего размера
-    while (current) {
-        if (current->is_free && current->size >= total_size) {
-            current->is_free = false;
-            split_block(current, total_size);
-            return (void*)((uint8_t*)current + sizeof(MemoryBlock));
+    if (slab->inuse == 0) {
+        slab_list_remove(&cache->partial, slab);
+        // Один пустой слаб держим про запас, остальные сразу отдаём PMM
+        if (cache->empty_count >= 1) {
+            slab_destroy(cache, slab);
+        } else {
+            slab_list_push(&cache->empty, slab);
+            cache->empty_count++;
         }
-        last = current;
-        current = current->next;
     }
+}
+
+void kmem_cache_free(KmemCache* cache, void* ptr) {
+    if (!ptr) return;
+    InterruptGuard guard;
+
+    Slab* slab = (Slab*)((uint32_t)ptr & ~(PMM_FRAME_SIZE - 1));
+    if (slab->magic != SLAB_MAGIC || slab->cache != cache) return;
+    slab_free_object(slab, ptr);
+}
+
+uint32_t kmem_reclaim() {
+    InterruptGuard guard;
+    uint32_t released = 0;
+    for (uint32_t i = 0; i < cache_count; i++) {
+        KmemCache* cache = &caches[i];
+        while (cache->empty) {
+            Slab* slab = cache->empty;
+            slab_list_remove(&cache->empty, slab);
+            cache->empty_count--;
+            slab_destroy(cache, slab);
+            released++;
+        }
+    }
+    return released;
+}
+
+void kmalloc_init() {
+    if (heap_ready) return;
+
+    static const char* class_names[8] = {
+        "kmalloc-8", "kmalloc-16", "kmalloc-32", "kmalloc-64",
+        "kmalloc-128", "kmalloc-256", "kmalloc-512", "kmalloc-1024"
+    };
+    for (int i = 0; i < 8; i++) {
+        size_classes[i] = kmem_cache_create(class_names[i], KMEM_MIN_CLASS << i);
+    }
+    heap_ready = true;
+}
 
-    // Если не нашли свободного места, мы должны попросить у PMM еще памяти.
-    // Просим нужное количество фреймов и линкуем к куче
-    size_t pages_needed = total_size / PMM_FRAME_SIZE;
-    if (total_size % PMM_FRAME_SIZE != 0) pages_needed++;
+void* kmalloc(size_t size) {
+    if (size == 0) return nullptr;
+    if (!heap_ready) kmalloc_init();
 
-    MemoryBlock* new_area = (MemoryBlock*)PhysicalMemoryManager::alloc_blocks(pages_needed);
-    
-    // В полноценной ОС здесь надо просить VMM замаппить вирт в физическую 
-    // последовательно, а пока мы работаем с физической, и мы просим смежные фреймы у PMM.
-    if (!new_area) return nullptr;
+    if (size <= KMEM_MAX_CLASS) {
+        int idx = 0;
+        while ((size_t)(KMEM_MIN_CLASS << idx) < size) idx++;
+        return kmem_cache_alloc(size_classes[idx]);
+    }
 
-    new_area->size = pages_needed * PMM_FRAME_SIZE;
-    new_area->is_free = false; // Сразу забираем под нашу аллокацию
-    new_area->next = nullptr;
-    
-    if (last) last->next = new_area;
+    // Крупный блок: непрерывные фреймы с заголовком в начале
+    size_t total_size = size + sizeof(LargeHeader);
+    uint32_t pages = (total_size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
 
-    split_block(new_area, total_size);
+    LargeHeader* hdr = (LargeHeader*)PhysicalMemoryManager::alloc_blocks(pages);
+    if (!hdr) {
+        // Под давлением памяти пробуем отдать пустые слабы и повторить
+        if (kmem_reclaim() == 0) return nullptr;
+        hdr = (LargeHeader*)PhysicalMemoryManager::alloc_blocks(pages);
+        if (!hdr) return nullptr;
+    }
 
-    return (void*)((uint8_t*)new_area + sizeof(MemoryBlock));
+    hdr->magic = LARGE_MAGIC;
+    hdr->pages = pages;
+    return (void*)((uint8_t*)hdr + sizeof(LargeHeader));
 }
 
 void kfree(void* ptr) {
     if (!ptr) return;
+    InterruptGuard guard;
 
-    MemoryBlock* block = (MemoryBlock*)((uint8_t*)ptr - sizeof(MemoryBlock));
-    block->is_free = true;
+    uint32_t page = (uint32_t)ptr & ~(PMM_FRAME_SIZE - 1);
+    if (*(uint32_t*)page == SLAB_MAGIC) {
+        slab_free_object((Slab*)page, ptr);
+        return;
+    }
+
+    LargeHeader* hdr = (LargeHeader*)page;
+    if (hdr->magic != LARGE_MAGIC || (uint8_t*)ptr != (uint8_t*)hdr + sizeof(LargeHeader)) {
+        return; // Чужой указатель - игнорируем
+    }
+
+    uint32_t pages = hdr->pages;
+    hdr->magic = 0;
+    for (uint32_t i = 0; i < pages; i++) {
+        PhysicalMemoryManager::free_frame((void*)(page + i * PMM_FRAME_SIZE));
+    }
+}
 
-    // Простейшая дефрагментация: сливаем этот кусок со следующим, если он свободен
-    if (block->next && block->next->is_free) {
-        block->size += block->next->size;
-        block->next = block->next->next;
+void kmem_print_stats() {
+    printf("Cache          Size Per  Slabs Active    Hits  Misses  Frag Freed\n");
+    for (uint32_t i = 0; i < cache_count; i++) {
+        KmemCache* c = &caches[i];
+        uint32_t capacity = c->slab_count * c->objs_per_slab;
+        uint32_t frag = capacity ? 100 - (c->active_objs * 100) / capacity : 0;
+        printf("%-14s %4u %3u %6u %6u %7u %7u %4u%% %5u\n",
+               c->name, c->obj_size, c->objs_per_slab, c->slab_count, c->active_objs,
+               c->hits, c->misses, frag, c->slabs_released);
     }
 }
 
@@ -0,0 +1,76 @@
+#include "kernel/lapic.h"
+#include "kernel/vmm.h"
+#include "kernel/spinlock.h"
+#include "libc.h"
+
+namespace re36 {
+
+volatile uint32_t* LocalApic::base_ = nullptr;
+bool LocalApic::tsc_deadline_ = false;
+
+bool LocalApic::init() {
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if (!(edx & (1 << 9))) return false;       // Нет APIC
+    if (!(edx & (1 << 5))) return false;       // Нет MSR
+    tsc_deadline_ = (ecx & (1 << 24)) != 0;
+
+    uint64_t msr = rdmsr(MSR_APIC_BASE);
+    uint32_t phys = (uint32_t)msr & 0xFFFFF000;
+    if (!phys) phys = LAPIC_DEFAULT_BASE;
+    if (!(msr & MSR_APIC_BASE_ENABLE)) {
+        wrmsr(MSR_APIC_BASE, msr | MSR_APIC_BASE_ENABLE);
+    }
+
+    // Регистры отображаются 1:1 некэшируемыми, как ABAR у AHCI; таблица
+    // страниц ядра копируется в адресные пространства процессов
+    VMM::map_page(phys, phys, PAGE_PRESENT | PAGE_WRITABLE | PAGE_CACHEDISABLE);
+    base_ = (volatile uint32_t*)phys;
+
+    setup();
+    return true;
+}
+
+void LocalApic::init_ap() {
+    if (base_) setup();
+}
+
+void LocalApic::setup() {
+    write(LAPIC_REG_TPR, 0);
+    write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+    write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+bool LocalApic::is_present() {
+    return base_ != nullptr;
+}
+
+bool LocalApic::has_tsc_deadline() {
+    return tsc_deadline_;
+}
+
+uint32_t LocalApic::read(uint32_t reg) {
+    return base_[reg / 4];
+}
+
+void LocalApic::write(uint32_t reg, uint32_t value) {
+    base_[reg / 4] = value;
+}
+
+void LocalApic::eoi() {
+    if (base_) write(LAPIC_REG_EOI, 0);
+}
+
+uint32_t LocalApic::id() {
+    return base_ ? read(LAPIC_REG_ID) >> 24 : 0;
+}
+
+void LocalApic::send_ipi(uint8_t dest_id, uint32_t icr_low) {
+    if (!base_) return;
+    InterruptGuard guard;
+    write(LAPIC_REG_ICR_HIGH, (uint32_t)dest_id << 24);
+    write(LAPIC_REG_ICR_LOW, icr_low);
+    while (read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) asm volatile("pause");
+}
+
+} // namespace re36
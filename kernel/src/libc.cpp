@@ -3,6 +3,7 @@
 #include "kernel/pic.h"
 #include "kernel/vga.h"
 #include "kernel/bga.h"
+#include "kernel/fpu.h"
 #include <stdint.h>
 #include <stdarg.h>
 
@@ -12,23 +13,143 @@ char getchar() {
     return re36::KeyboardDriver::get_char();
 }
 
+// Копирование/заполнение двойными словами (rep movsd / rep stosd) с
+// добиванием хвоста байтами. Флаг DF по ABI сброшен - копируем вперёд.
 void* memcpy(void* dest, const void* src, size_t n) {
+    void* d = dest;
+    size_t dwords = n >> 2;
+    size_t tail = n & 3;
+    asm volatile("rep movsl" : "+D"(d), "+S"(src), "+c"(dwords) : : "memory");
+    asm volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(tail) : : "memory");
+    return dest;
+}
+
+void* memmove(void* dest, const void* src, size_t n) {
     uint8_t* d = (uint8_t*)dest;
     const uint8_t* s = (const uint8_t*)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
     }
+
+    // Перекрытие с dest > src - копируем с конца (DF=1)
+    const uint8_t* s_end = s + n - 1;
+    uint8_t* d_end = d + n - 1;
+    asm volatile("std\n\t"
+                 "rep movsb\n\t"
+                 "cld"
+                 : "+D"(d_end), "+S"(s_end), "+c"(n) : : "memory");
     return dest;
 }
 
 void* memset(void* s, int c, size_t n) {
-    uint8_t* p = (uint8_t*)s;
-    for (size_t i = 0; i < n; i++) {
-        p[i] = (uint8_t)c;
-    }
+    void* d = s;
+    uint32_t fill = (uint8_t)c * 0x01010101u;
+    size_t dwords = n >> 2;
+    size_t tail = n & 3;
+    asm volatile("rep stosl" : "+D"(d), "+c"(dwords) : "a"(fill) : "memory");
+    asm volatile("rep stosb" : "+D"(d), "+c"(tail) : "a"(fill) : "memory");
     return s;
 }
 
+// --- Страничные примитивы ---
+// Ядро собрано с -mno-sse, поэтому компилятор не трогает XMM-регистры.
+// В регистрах может лежать состояние потока - владельца FPU (не обязательно
+// текущего), поэтому SSE-путь с запрещёнными прерываниями снимает CR0.TS,
+// сохраняет используемые XMM0-XMM3 и возвращает всё как было.
+
+static bool sse_enabled = false;
+
+// Вызывается после re36::Fpu::init, который включает OSFXSR
+void mem_init() {
+    sse_enabled = re36::Fpu::has_sse2();
+}
+
+bool mem_has_sse() {
+    return sse_enabled;
+}
+
+void copy_page(void* dest, const void* src) {
+    if (!sse_enabled) {
+        memcpy(dest, src, 4096);
+        return;
+    }
+
+    uint32_t blocks = 4096 / 64;
+    uint32_t cr0;
+    asm volatile(
+        "pushfl\n\t"
+        "cli\n\t"
+        "mov %%cr0, %3\n\t"
+        "clts\n\t"
+        "sub $64, %%esp\n\t"
+        "movdqu %%xmm0, 0(%%esp)\n\t"
+        "movdqu %%xmm1, 16(%%esp)\n\t"
+        "movdqu %%xmm2, 32(%%esp)\n\t"
+        "movdqu %%xmm3, 48(%%esp)\n\t"
+        "1:\n\t"
+        "movdqa 0(%1), %%xmm0\n\t"
+        "movdqa 16(%1), %%xmm1\n\t"
+        "movdqa 32(%1), %%xmm2\n\t"
+        "movdqa 48(%1), %%xmm3\n\t"
+        "movdqa %%xmm0, 0(%0)\n\t"
+        "movdqa %%xmm1, 16(%0)\n\t"
+        "movdqa %%xmm2, 32(%0)\n\t"
+        "movdqa %%xmm3, 48(%0)\n\t"
+        "add $64, %1\n\t"
+        "add $64, %0\n\t"
+        "dec %2\n\t"
+        "jnz 1b\n\t"
+        "movdqu 0(%%esp), %%xmm0\n\t"
+        "movdqu 16(%%esp), %%xmm1\n\t"
+        "movdqu 32(%%esp), %%xmm2\n\t"
+        "movdqu 48(%%esp), %%xmm3\n\t"
+        "add $64, %%esp\n\t"
+        "test $8, %3\n\t"
+        "jz 2f\n\t"
+        "mov %3, %%cr0\n\t"
+        "2:\n\t"
+        "popfl"
+        : "+r"(dest), "+r"(src), "+r"(blocks), "=&r"(cr0)
+        :
+        : "memory", "cc");
+}
+
+void zero_page(void* dest) {
+    if (!sse_enabled) {
+        memset(dest, 0, 4096);
+        return;
+    }
+
+    uint32_t blocks = 4096 / 64;
+    uint32_t cr0;
+    asm volatile(
+        "pushfl\n\t"
+        "cli\n\t"
+        "mov %%cr0, %2\n\t"
+        "clts\n\t"
+        "sub $16, %%esp\n\t"
+        "movdqu %%xmm0, (%%esp)\n\t"
+        "pxor %%xmm0, %%xmm0\n\t"
+        "1:\n\t"
+        "movdqa %%xmm0, 0(%0)\n\t"
+        "movdqa %%xmm0, 16(%0)\n\t"
+        "movdqa %%xmm0, 32(%0)\n\t"
+        "movdqa %%xmm0, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "dec %1\n\t"
+        "jnz 1b\n\t"
+        "movdqu (%%esp), %%xmm0\n\t"
+        "add $16, %%esp\n\t"
+        "test $8, %2\n\t"
+        "jz 2f\n\t"
+        "mov %2, %%cr0\n\t"
+        "2:\n\t"
+        "popfl"
+        : "+r"(dest), "+r"(blocks), "=&r"(cr0)
+        :
+        : "memory", "cc");
+}
+
 size_t strlen(const char* s) {
     size_t len = 0;
     while (s[len]) {
@@ -0,0 +1,221 @@
+#include "kernel/mailbox.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
+#include "kernel/syscall_gate.h"
+#include "kernel/spinlock.h"
+#include "kernel/cow.h"
+#include "kernel/vmm.h"
+#include "kernel/pmm.h"
+#include "kernel/kmalloc.h"
+#include "libc.h"
+
+namespace re36 {
+
+IpcStats Mailbox::stats_ = {0, 0, 0, 0, 0, 0};
+
+static bool alive(int tid) {
+    if (tid < 0 || tid >= MAX_THREADS) return false;
+    ThreadState st = threads[tid].state;
+    return st != ThreadState::Unused && st != ThreadState::Terminated &&
+           st != ThreadState::Zombie;
+}
+
+void Mailbox::wake(int tid) {
+    Thread& t = threads[tid];
+    if (t.waiting_for_msg) {
+        t.waiting_for_msg = false;
+        TaskScheduler::unblock(tid);
+    }
+}
+
+int Mailbox::send(int target_tid, const void* data, uint32_t size) {
+    if (size > IPC_MAX_MSG_SIZE) return -1;
+
+    InterruptGuard guard;
+    if (!alive(target_tid)) return -1;
+    Thread& target = threads[target_tid];
+    if (target.msg_count >= IPC_MSG_QUEUE_MAX) {
+        stats_.queue_full++;
+        return -1;
+    }
+
+    IpcMessage* msg = (IpcMessage*)kmem_cache_alloc(ipc_msg_cache);
+    if (!msg) return -1;
+    msg->sender_tid = current_tid;
+    msg->size = size;
+    msg->next = nullptr;
+    memcpy(msg->data, data, size);
+
+    if (target.msg_tail) target.msg_tail->next = msg;
+    else target.msg_head = msg;
+    target.msg_tail = msg;
+    target.msg_count++;
+
+    stats_.msgs++;
+    stats_.msg_bytes += size;
+    wake(target_tid);
+    return 0;
+}
+
+int Mailbox::recv(int* sender_out, void* buffer, uint32_t max_size) {
+    // Ожидание под той же блокировкой прерываний, что и проверка очереди:
+    // иначе сообщение, пришедшее между ними, не разбудит поток
+    InterruptGuard guard;
+    Thread& cur = threads[current_tid];
+    while (!cur.msg_head) {
+        cur.waiting_for_msg = true;
+        TaskScheduler::block_current(-1);
+    }
+
+    IpcMessage* msg = cur.msg_head;
+    cur.msg_head = msg->next;
+    if (!cur.msg_head) cur.msg_tail = nullptr;
+    cur.msg_count--;
+
+    if (sender_out) *sender_out = msg->sender_tid;
+    uint32_t copy_sz = msg->size < max_size ? msg->size : max_size;
+    memcpy(buffer, msg->data, copy_sz);
+    kmem_cache_free(ipc_msg_cache, msg);
+    return (int)copy_sz;
+}
+
+int Mailbox::send_grant(int target_tid, uint32_t vaddr, uint32_t pages,
+                        uint32_t mode, uint32_t tag) {
+    if (pages == 0 || pages > IPC_GRANT_MAX_PAGES) return -1;
+    if (mode != IPC_GRANT_MOVE && mode != IPC_GRANT_COW) return -1;
+    if ((vaddr & 0xFFF) || vaddr < KERNEL_SPACE_END) return -1;
+    if (vaddr + pages * 4096 < vaddr) return -1;
+
+    InterruptGuard guard;
+    if (!alive(target_tid) || target_tid == current_tid) return -1;
+    Thread& target = threads[target_tid];
+    if (target.grant_count >= IPC_GRANT_QUEUE_MAX) {
+        stats_.queue_full++;
+        return -1;
+    }
+
+    // Сначала проверка всего диапазона: передача либо целиком, либо никак
+    for (uint32_t i = 0; i < pages; i++) {
+        if (!cow_page_mapped(vaddr + i * 4096)) return -1;
+    }
+    // Общие после fork таблицы страниц отделяются заранее: дальше
+    // снятие и CoW страниц памяти не требуют
+    if (!cow_unshare_range(vaddr, pages * 4096)) return -1;
+
+    IpcGrant* g = (IpcGrant*)kmem_cache_alloc(ipc_grant_cache);
+    if (!g) return -1;
+    g->frames = (uint32_t*)kmalloc(pages * sizeof(uint32_t));
+    if (!g->frames) {
+        kmem_cache_free(ipc_grant_cache, g);
+        return -1;
+    }
+    g->sender_tid = current_tid;
+    g->pages = pages;
+    g->tag = tag;
+    g->next = nullptr;
+
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t v = vaddr + i * 4096;
+        g->frames[i] = mode == IPC_GRANT_MOVE ? cow_take_page(v) : cow_share_page(v);
+    }
+    if (mode == IPC_GRANT_MOVE) stats_.pages_moved += pages;
+    else stats_.pages_shared += pages;
+    stats_.grants++;
+
+    if (target.grant_tail) target.grant_tail->next = g;
+    else target.grant_head = g;
+    target.grant_tail = g;
+    target.grant_count++;
+
+    wake(target_tid);
+    return 0;
+}
+
+uint32_t Mailbox::recv_grant(int* sender_out, uint32_t* tag_out, uint32_t* pages_out) {
+    InterruptGuard guard;
+    Thread& cur = threads[current_tid];
+    while (!cur.grant_head) {
+        cur.waiting_for_msg = true;
+        TaskScheduler::block_current(-1);
+    }
+
+    IpcGrant* g = cur.grant_head;
+    cur.grant_head = g->next;
+    if (!cur.grant_head) cur.grant_tail = nullptr;
+    cur.grant_count--;
+
+    uint32_t length = g->pages * 4096;
+    uint32_t vaddr = find_free_vaddr(length);
+    VMA* vma = vaddr ? vma_alloc(vaddr, vaddr + length,
+                                 PAGE_PRESENT | PAGE_USER | PAGE_WRITABLE, VMA_TYPE_ANON)
+                     : nullptr;
+    if (!vma || !cow_unshare_range(vaddr, length) || !vma_insert(cur.vmas, vma)) {
+        if (vma) vma_free(vma);
+        free_grant(g, true);
+        return 0;
+    }
+
+    // Ссылки на фреймы переходят в таблицу страниц получателя
+    for (uint32_t i = 0; i < g->pages; i++) {
+        cow_map_page(vaddr + i * 4096, g->frames[i]);
+    }
+
+    if (sender_out) *sender_out = g->sender_tid;
+    if (tag_out) *tag_out = g->tag;
+    if (pages_out) *pages_out = g->pages;
+    free_grant(g, false);
+    return vaddr;
+}
+
+void Mailbox::free_grant(IpcGrant* g, bool drop_frames) {
+    if (drop_frames) {
+        for (uint32_t i = 0; i < g->pages; i++) PhysicalMemoryManager::dec_ref(g->frames[i]);
+    }
+    kfree(g->frames);
+    kmem_cache_free(ipc_grant_cache, g);
+}
+
+void Mailbox::release(int tid) {
+    InterruptGuard guard;
+    Thread& t = threads[tid];
+
+    while (t.msg_head) {
+        IpcMessage* next = t.msg_head->next;
+        kmem_cache_free(ipc_msg_cache, t.msg_head);
+        t.msg_head = next;
+    }
+    t.msg_tail = nullptr;
+    t.msg_count = 0;
+
+    while (t.grant_head) {
+        IpcGrant* next = t.grant_head->next;
+        free_grant(t.grant_head, true);
+        t.grant_head = next;
+    }
+    t.grant_tail = nullptr;
+    t.grant_count = 0;
+}
+
+IpcStats Mailbox::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void Mailbox::print_info() {
+    IpcStats st = get_stats();
+    printf("Messages: %u (%u KB copied)\n", st.msgs, st.msg_bytes / 1024);
+    printf("Page grants: %u, pages moved: %u, shared (CoW): %u\n",
+           st.grants, st.pages_moved, st.pages_shared);
+    printf("Rejected (queue full): %u\n", st.queue_full);
+
+    InterruptGuard guard;
+    for (int i = 0; i < MAX_THREADS; i++) {
+        Thread& t = threads[i];
+        if (t.state == ThreadState::Unused) continue;
+        if (!t.msg_count && !t.grant_count) continue;
+        printf("  TID %d (%s): %d messages, %d grants queued\n",
+               i, t.name, t.msg_count, t.grant_count);
+    }
+}
+
+} // namespace re36
@@ -0,0 +1,107 @@
+#include "kernel/memory_map.h"
+#include "kernel/boot_info.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "libc.h"
+
+namespace re36 {
+
+MemoryRegion MemoryMap::regions_[MEMMAP_MAX_REGIONS];
+uint32_t MemoryMap::count_ = 0;
+uint32_t MemoryMap::managed_end_ = 0;
+uint32_t MemoryMap::usable_kb_ = 0;
+uint32_t MemoryMap::unmanaged_kb_ = 0;
+bool MemoryMap::from_e820_ = false;
+
+// Вставка с сохранением порядка по base
+void MemoryMap::add(uint64_t base, uint64_t length, uint32_t type) {
+    if (length == 0 || count_ >= MEMMAP_MAX_REGIONS) return;
+    uint32_t i = count_++;
+    while (i > 0 && regions_[i - 1].base > base) {
+        regions_[i] = regions_[i - 1];
+        i--;
+    }
+    regions_[i].base = base;
+    regions_[i].end = base + length;
+    regions_[i].type = type;
+}
+
+static const char* type_name(uint32_t type) {
+    switch (type) {
+        case E820_USABLE:   return "usable";
+        case E820_RESERVED: return "reserved";
+        case E820_ACPI:     return "ACPI tables";
+        case E820_ACPI_NVS: return "ACPI NVS";
+        case E820_BAD:      return "bad";
+        default:            return "unknown";
+    }
+}
+
+void MemoryMap::init() {
+    BootInfo* bi = get_boot_info();
+    count_ = 0;
+
+    if (bi->magic == BOOT_INFO_MAGIC && bi->e820_count > 0 && bi->e820_count <= BOOT_E820_MAX) {
+        E820Entry* e = get_boot_e820();
+        for (uint32_t i = 0; i < bi->e820_count; i++) add(e[i].base, e[i].length, e[i].type);
+        from_e820_ = true;
+    } else if (bi->magic == BOOT_INFO_MAGIC) {
+        // E801: RAM до 640 КБ, от 1 МБ до 16 МБ и выше 16 МБ
+        add(0, 0xA0000, E820_USABLE);
+        add(0x100000, (uint64_t)bi->mem_below_16m_kb * 1024, E820_USABLE);
+        add(0x1000000, (uint64_t)bi->mem_above_16m_64kb * 0x10000, E820_USABLE);
+    } else {
+        // Загрузчик без BootInfo - прежний минимум в 32 МБ
+        add(0, 0xA0000, E820_USABLE);
+        add(0x100000, 31 * 1024 * 1024, E820_USABLE);
+    }
+
+    managed_end_ = 0;
+    usable_kb_ = 0;
+    unmanaged_kb_ = 0;
+    for (uint32_t i = 0; i < count_; i++) {
+        MemoryRegion& r = regions_[i];
+        if (r.type != E820_USABLE) continue;
+        usable_kb_ += (uint32_t)((r.end - r.base) >> 10);
+        if (r.end > KERNEL_SPACE_END) {
+            uint64_t from = r.base > KERNEL_SPACE_END ? r.base : KERNEL_SPACE_END;
+            unmanaged_kb_ += (uint32_t)((r.end - from) >> 10);
+        }
+        uint32_t end = r.end > KERNEL_SPACE_END ? KERNEL_SPACE_END : (uint32_t)r.end;
+        if (r.base < KERNEL_SPACE_END && end > managed_end_) managed_end_ = end;
+    }
+    managed_end_ &= ~(PMM_FRAME_SIZE - 1);
+}
+
+void MemoryMap::release_usable(uint32_t from) {
+    for (uint32_t i = 0; i < count_; i++) {
+        const MemoryRegion& r = regions_[i];
+        if (r.type != E820_USABLE || r.end <= from || r.base >= managed_end_) continue;
+        // Неполные фреймы по краям региона не отдаём
+        uint32_t base = r.base > from ? ((uint32_t)r.base + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1) : from;
+        uint32_t end = r.end < managed_end_ ? (uint32_t)r.end & ~(PMM_FRAME_SIZE - 1) : managed_end_;
+        if (end > base) PhysicalMemoryManager::set_region_free(base, end - base);
+    }
+
+    // BIOS может вернуть пересекающиеся регионы: занятые важнее
+    for (uint32_t i = 0; i < count_; i++) {
+        const MemoryRegion& r = regions_[i];
+        if (r.type == E820_USABLE || r.base >= managed_end_) continue;
+        uint32_t base = (uint32_t)r.base & ~(PMM_FRAME_SIZE - 1);
+        uint32_t end = r.end < managed_end_ ? ((uint32_t)r.end + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1) : managed_end_;
+        if (end > base) PhysicalMemoryManager::set_region_used(base, end - base);
+    }
+}
+
+void MemoryMap::print() {
+    printf("Memory map (%s):\n", from_e820_ ? "E820" : "E801");
+    for (uint32_t i = 0; i < count_; i++) {
+        const MemoryRegion& r = regions_[i];
+        printf("  %u KB - %u KB: %s\n", (uint32_t)(r.base >> 10), (uint32_t)(r.end >> 10), type_name(r.type));
+    }
+    printf("Usable: %u MB, managed by PMM up to %u MB", usable_kb_ / 1024, managed_end_ >> 20);
+    if (unmanaged_kb_) printf(", %u MB above it unused", unmanaged_kb_ / 1024);
+    printf("\n");
+}
+
+} // namespace re36
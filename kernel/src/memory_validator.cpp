@@ -2,6 +2,7 @@
 #include "kernel/pmm.h"
 #include "kernel/vmm.h"
 #include "kernel/kmalloc.h"
+#include "kernel/timer.h"
 #include "libc.h"
 
 namespace re36 {
@@ -60,9 +61,202 @@ bool MemoryValidator::test_pmm() {
 
     PhysicalMemoryManager::free_frame(new_frame);
 
+    // Buddy: непрерывный блок, хвост сверх запроса возвращается, после
+    // освобождения соседи сливаются и свободная память восстанавливается
+    uint32_t free_before = PhysicalMemoryManager::get_free_memory();
+    void* block = PhysicalMemoryManager::alloc_blocks(5);
+    if (!block) return false;
+    if ((uint32_t)block % (8 * PMM_FRAME_SIZE) != 0) return false;
+    if (PhysicalMemoryManager::get_free_memory() != free_before - 5 * PMM_FRAME_SIZE) return false;
+    for (uint32_t i = 0; i < 5; i++) {
+        if (PhysicalMemoryManager::get_refcount((uint32_t)block + i * PMM_FRAME_SIZE) != 1) return false;
+    }
+    for (uint32_t i = 0; i < 5; i++) {
+        PhysicalMemoryManager::free_frame((void*)((uint32_t)block + i * PMM_FRAME_SIZE));
+    }
+    if (PhysicalMemoryManager::get_free_memory() != free_before) return false;
+
     return true;
 }
 
+static const uint32_t PMM_BENCH_ROUNDS = 256;
+
+static void bench_pmm_level(uint32_t fill_percent, void** held, uint32_t& held_count, uint32_t total_frames) {
+    uint32_t target = total_frames * fill_percent / 100;
+    while (held_count < target) {
+        void* f = PhysicalMemoryManager::alloc_frame();
+        if (!f) break;
+        held[held_count++] = f;
+    }
+
+    uint64_t t0 = Timer::read_tsc();
+    for (uint32_t i = 0; i < PMM_BENCH_ROUNDS; i++) {
+        void* f = PhysicalMemoryManager::alloc_frame();
+        PhysicalMemoryManager::free_frame(f);
+    }
+    uint64_t t1 = Timer::read_tsc();
+    for (uint32_t i = 0; i < PMM_BENCH_ROUNDS; i++) {
+        void* b = PhysicalMemoryManager::alloc_blocks(8);
+        if (!b) break;
+        for (uint32_t k = 0; k < 8; k++) {
+            PhysicalMemoryManager::free_frame((void*)((uint32_t)b + k * PMM_FRAME_SIZE));
+        }
+    }
+    uint64_t t2 = Timer::read_tsc();
+
+    printf("  fill %u%%: alloc+free frame %u cycles, alloc_blocks(8)+free %u cycles\n",
+           fill_percent,
+           (uint32_t)(t1 - t0) / PMM_BENCH_ROUNDS,
+           (uint32_t)(t2 - t1) / PMM_BENCH_ROUNDS);
+}
+
+void MemoryValidator::bench_pmm() {
+    printf("[Bench] PMM allocation latency by fill level\n");
+
+    uint32_t total_frames = PhysicalMemoryManager::get_free_memory() / PMM_FRAME_SIZE;
+    void** held = (void**)kmalloc(total_frames * sizeof(void*));
+    if (!held) {
+        printf("  Out of memory for bench\n");
+        return;
+    }
+    uint32_t held_count = 0;
+
+    static const uint32_t levels[] = { 0, 25, 50, 75, 90 };
+    for (uint32_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        bench_pmm_level(levels[i], held, held_count, total_frames);
+    }
+
+    for (uint32_t i = 0; i < held_count; i++) {
+        PhysicalMemoryManager::free_frame(held[i]);
+    }
+    kfree(held);
+}
+
+#define COPY_BENCH_ROUNDS 1024
+
+// МБ/с для COPY_BENCH_ROUNDS страниц (4 МБ) за cycles тактов.
+// Считаем в 32 битах: libgcc с 64-битным делением ядро не линкует.
+static uint32_t bench_mb_per_sec(uint64_t cycles, uint32_t tsc_khz) {
+    uint32_t cycles_per_kb = (uint32_t)cycles / (COPY_BENCH_ROUNDS * PMM_FRAME_SIZE / 1024);
+    if (cycles_per_kb == 0) cycles_per_kb = 1;
+    return tsc_khz / cycles_per_kb * 1000 / 1024;
+}
+
+void MemoryValidator::bench_memcpy() {
+    printf("[Bench] Page copy throughput (%s)\n", mem_has_sse() ? "SSE2 available" : "no SSE2");
+
+    uint8_t* src = (uint8_t*)PhysicalMemoryManager::alloc_frame();
+    uint8_t* dst = (uint8_t*)PhysicalMemoryManager::alloc_frame();
+    if (!src || !dst) {
+        printf("  Out of memory for bench\n");
+        if (src) PhysicalMemoryManager::free_frame(src);
+        return;
+    }
+    for (uint32_t i = 0; i < PMM_FRAME_SIZE; i++) src[i] = (uint8_t)i;
+
+    uint32_t tsc_khz = Timer::get_tsc_khz();
+
+    volatile uint8_t* vdst = dst;
+    uint64_t t0 = Timer::read_tsc();
+    for (uint32_t r = 0; r < COPY_BENCH_ROUNDS; r++) {
+        for (uint32_t i = 0; i < PMM_FRAME_SIZE; i++) vdst[i] = src[i];
+    }
+    uint64_t t1 = Timer::read_tsc();
+    for (uint32_t r = 0; r < COPY_BENCH_ROUNDS; r++) memcpy(dst, src, PMM_FRAME_SIZE);
+    uint64_t t2 = Timer::read_tsc();
+    for (uint32_t r = 0; r < COPY_BENCH_ROUNDS; r++) copy_page(dst, src);
+    uint64_t t3 = Timer::read_tsc();
+    bool copy_ok = true;
+    for (uint32_t i = 0; i < PMM_FRAME_SIZE; i++) {
+        if (dst[i] != (uint8_t)i) copy_ok = false;
+    }
+    for (uint32_t r = 0; r < COPY_BENCH_ROUNDS; r++) memset(dst, 0, PMM_FRAME_SIZE);
+    uint64_t t4 = Timer::read_tsc();
+    for (uint32_t r = 0; r < COPY_BENCH_ROUNDS; r++) zero_page(dst);
+    uint64_t t5 = Timer::read_tsc();
+    bool zero_ok = true;
+    for (uint32_t i = 0; i < PMM_FRAME_SIZE; i++) {
+        if (dst[i] != 0) zero_ok = false;
+    }
+
+    printf("  byte loop copy:     %u MB/s\n", bench_mb_per_sec(t1 - t0, tsc_khz));
+    printf("  memcpy (rep movsd): %u MB/s\n", bench_mb_per_sec(t2 - t1, tsc_khz));
+    printf("  copy_page:          %u MB/s %s\n", bench_mb_per_sec(t3 - t2, tsc_khz), copy_ok ? "" : "[DATA MISMATCH]");
+    printf("  memset (rep stosd): %u MB/s\n", bench_mb_per_sec(t4 - t3, tsc_khz));
+    printf("  zero_page:          %u MB/s %s\n", bench_mb_per_sec(t5 - t4, tsc_khz), zero_ok ? "" : "[DATA MISMATCH]");
+
+    PhysicalMemoryManager::free_frame(src);
+    PhysicalMemoryManager::free_frame(dst);
+}
+
+#define TLB_BENCH_PHYS    0x00800000    // 16 МБ внутри тождественного отображения
+#define TLB_BENCH_SIZE    0x01000000
+#define TLB_BENCH_WINDOW  0xD0000000    // Выше стека пользователя, ниже MMIO
+#define TLB_BENCH_ROUNDS  64
+
+// Читает по слову из каждой страницы окна после сброса TLB - как
+// системный вызов, проходящий по данным ядра после переключения процесса.
+// Смещение в странице сдвигается, чтобы строки кэша попадали в разные наборы.
+static uint32_t bench_tlb_walk(uint32_t base) {
+    uint64_t cycles = 0;
+    uint32_t sum = 0;
+    for (uint32_t r = 0; r < TLB_BENCH_ROUNDS; r++) {
+        VMM::flush_tlb();
+        uint64_t t0 = Timer::read_tsc();
+        for (uint32_t off = 0; off < TLB_BENCH_SIZE; off += PAGE_SIZE) {
+            sum += *(volatile uint32_t*)(base + off + ((off >> 6) & 0xFC0));
+        }
+        cycles += Timer::read_tsc() - t0;
+    }
+    (void)sum;
+    return (uint32_t)cycles / (TLB_BENCH_ROUNDS * (TLB_BENCH_SIZE / PAGE_SIZE));
+}
+
+void MemoryValidator::bench_tlb() {
+    printf("[Bench] Kernel memory walk after CR3 reload, %u pages of 4 KB\n",
+           TLB_BENCH_SIZE / PAGE_SIZE);
+    if (PhysicalMemoryManager::get_memory_size() < TLB_BENCH_PHYS + TLB_BENCH_SIZE) {
+        printf("  Needs %u MB of RAM\n", (TLB_BENCH_PHYS + TLB_BENCH_SIZE) >> 20);
+        return;
+    }
+    if (!VMM::has_large_pages()) {
+        printf("  CPU has no PSE: kernel uses 4 KB pages only\n");
+    }
+
+    // Те же физические страницы через окно со страницами по 4 КБ ...
+    for (uint32_t off = 0; off < TLB_BENCH_SIZE; off += PAGE_SIZE) {
+        VMM::map_page(TLB_BENCH_WINDOW + off, TLB_BENCH_PHYS + off, PAGE_PRESENT | PAGE_WRITABLE);
+    }
+    if (VMM::get_physical(TLB_BENCH_WINDOW + TLB_BENCH_SIZE - PAGE_SIZE) !=
+        TLB_BENCH_PHYS + TLB_BENCH_SIZE - PAGE_SIZE) {
+        printf("  Out of memory for bench\n");
+    } else {
+        printf("  4 KB pages:         %u cycles per page\n", bench_tlb_walk(TLB_BENCH_WINDOW));
+    }
+    for (uint32_t off = 0; off < TLB_BENCH_SIZE; off += PAGE_SIZE) {
+        VMM::unmap_page(TLB_BENCH_WINDOW + off);
+    }
+
+    // ... через страницы по 4 МБ без PAGE_GLOBAL (их таблицы освобождаются) ...
+    if (VMM::has_large_pages()) {
+        bool mapped = true;
+        for (uint32_t off = 0; off < TLB_BENCH_SIZE; off += LARGE_PAGE_SIZE) {
+            if (!VMM::map_large_page(TLB_BENCH_WINDOW + off, TLB_BENCH_PHYS + off,
+                                     PAGE_PRESENT | PAGE_WRITABLE)) mapped = false;
+        }
+        if (mapped) {
+            printf("  4 MB pages:         %u cycles per page\n", bench_tlb_walk(TLB_BENCH_WINDOW));
+        }
+        for (uint32_t off = 0; off < TLB_BENCH_SIZE; off += LARGE_PAGE_SIZE) {
+            VMM::unmap_large_page(TLB_BENCH_WINDOW + off);
+        }
+    }
+
+    // ... и через тождественное отображение ядра
+    printf("  kernel identity map: %u cycles per page (%s)\n", bench_tlb_walk(TLB_BENCH_PHYS),
+           VMM::has_global_pages() ? "4 MB, global" : VMM::has_large_pages() ? "4 MB" : "4 KB");
+}
+
 bool MemoryValidator::test_vmm() {
     // Pick an address that is likely unused right now
     uint32_t test_virt_addr = 0xE0000000;
@@ -138,6 +332,22 @@ bool MemoryValidator::test_heap() {
     kfree(ptr2);
     kfree(ptr3);
 
+    // Слабы: объекты одного класса не пересекаются, освобождённый слот переиспользуется
+    void* objs[64];
+    for (int i = 0; i < 64; i++) {
+        objs[i] = kmalloc(100);
+        if (!objs[i]) return false;
+        for (int j = 0; j < i; j++) {
+            uint32_t a = (uint32_t)objs[i], b = (uint32_t)objs[j];
+            if (a < b + 128 && b < a + 128) return false;
+        }
+    }
+    void* reused = objs[10];
+    kfree(reused);
+    objs[10] = kmalloc(128);
+    if (objs[10] != reused) return false;
+    for (int i = 0; i < 64; i++) kfree(objs[i]);
+
     return true;
 }
 
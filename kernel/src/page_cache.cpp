@@ -1,64 +1,386 @@
 #include "kernel/page_cache.h"
 #include "kernel/pmm.h"
+#include "kernel/vfs.h"
+#include "kernel/kmalloc.h"
+#include "kernel/spinlock.h"
+#include "kernel/disk.h"
+#include "kernel/timer.h"
+#include "libc.h"
 
 namespace re36 {
 
-PageCacheEntry PageCache::entries_[PAGE_CACHE_SIZE];
+PageCacheEntry* PageCache::buckets_[PAGE_CACHE_BUCKETS];
+PageCacheEntry* PageCache::lru_head_ = nullptr;
+PageCacheEntry* PageCache::lru_tail_ = nullptr;
+PageCacheStats PageCache::stats_ = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+bool PageCache::readahead_enabled_ = true;
+
+static KmemCache* entry_cache = nullptr;
+
+// Вызывается PMM, когда свободные фреймы закончились
+static uint32_t page_cache_reclaim(uint32_t count) {
+    return PageCache::shrink(count);
+}
 
 void PageCache::init() {
-    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
-        entries_[i].valid = false;
+    for (int i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+        buckets_[i] = nullptr;
+    }
+    lru_head_ = lru_tail_ = nullptr;
+
+    if (!entry_cache) entry_cache = kmem_cache_create("page_cache", sizeof(PageCacheEntry));
+
+    uint32_t max_pages = PhysicalMemoryManager::get_free_memory() / PMM_FRAME_SIZE / 4;
+    if (max_pages < PAGE_CACHE_MIN_PAGES) max_pages = PAGE_CACHE_MIN_PAGES;
+    stats_.max_pages = max_pages;
+
+    PhysicalMemoryManager::set_reclaim_hook(page_cache_reclaim);
+}
+
+uint32_t PageCache::hash(superblock* sb, uint32_t inode, uint32_t index) {
+    return ((uint32_t)sb * 31 + inode * 2654435761u + index) % PAGE_CACHE_BUCKETS;
+}
+
+PageCacheEntry* PageCache::find(superblock* sb, uint32_t inode, uint32_t index) {
+    PageCacheEntry* e = buckets_[hash(sb, inode, index)];
+    while (e) {
+        if (e->sb == sb && e->inode == inode && e->index == index) return e;
+        e = e->hash_next;
     }
+    return nullptr;
 }
 
-uint32_t PageCache::hash(uint32_t inode, uint32_t offset) {
-    return (inode * 2654435761u + offset / 4096) % PAGE_CACHE_SIZE;
+void PageCache::lru_unlink(PageCacheEntry* e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else lru_head_ = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else lru_tail_ = e->lru_prev;
+    e->lru_prev = e->lru_next = nullptr;
+}
+
+void PageCache::lru_push_front(PageCacheEntry* e) {
+    e->lru_prev = nullptr;
+    e->lru_next = lru_head_;
+    if (lru_head_) lru_head_->lru_prev = e;
+    lru_head_ = e;
+    if (!lru_tail_) lru_tail_ = e;
+}
+
+// Убрать запись из хеша и LRU и отпустить ссылку кэша на фрейм
+void PageCache::remove(PageCacheEntry* e) {
+    PageCacheEntry** link = &buckets_[hash(e->sb, e->inode, e->index)];
+    while (*link && *link != e) link = &(*link)->hash_next;
+    if (*link) *link = e->hash_next;
+
+    lru_unlink(e);
+    stats_.pages--;
+
+    // Отображённый в процессы фрейм переживёт кэш, но уже не его
+    Page* pg = PhysicalMemoryManager::get_page(e->phys_frame);
+    if (pg) {
+        pg->flags &= ~PG_CACHED;
+        pg->owner = nullptr;
+    }
+    PhysicalMemoryManager::free_frame((void*)e->phys_frame);
+    kmem_cache_free(entry_cache, e);
 }
 
-uint32_t PageCache::lookup(uint32_t inode, uint32_t offset) {
-    uint32_t h = hash(inode, offset);
-    for (uint32_t i = 0; i < 4; i++) {
-        uint32_t idx = (h + i) % PAGE_CACHE_SIZE;
-        if (entries_[idx].valid &&
-            entries_[idx].inode == inode &&
-            entries_[idx].offset == offset) {
-            return entries_[idx].phys_frame;
+PageCacheEntry* PageCache::insert(vnode* vn, uint32_t index, void* frame, bool readahead) {
+    // Пока читали, страницу мог загрузить другой поток
+    PageCacheEntry* other = find(vn->sb, vn->inode_num, index);
+    if (other) {
+        PhysicalMemoryManager::free_frame(frame);
+        return other;
+    }
+
+    PageCacheEntry* e = (PageCacheEntry*)kmem_cache_alloc(entry_cache);
+    if (!e) {
+        PhysicalMemoryManager::free_frame(frame);
+        return nullptr;
+    }
+    e->sb = vn->sb;
+    e->inode = vn->inode_num;
+    e->index = index;
+    e->phys_frame = (uint32_t)frame;
+    e->readahead = readahead;
+
+    Page* pg = PhysicalMemoryManager::get_page(e->phys_frame);
+    if (pg) {
+        pg->flags = (pg->flags & ~PG_LOCKED) | PG_CACHED;
+        pg->owner = e;
+        pg->index = index;
+    }
+
+    uint32_t h = hash(e->sb, e->inode, e->index);
+    e->hash_next = buckets_[h];
+    buckets_[h] = e;
+    lru_push_front(e);
+    stats_.pages++;
+    if (readahead) stats_.readahead++;
+    return e;
+}
+
+uint32_t PageCache::get_page(vnode* vn, uint32_t index) {
+    if (!vn || !vn->ops || !vn->ops->readpage) return 0;
+
+    {
+        InterruptGuard guard;
+        PageCacheEntry* e = find(vn->sb, vn->inode_num, index);
+        if (e) {
+            stats_.hits++;
+            if (e->readahead) {
+                e->readahead = false;
+                stats_.ra_hits++;
+            }
+            lru_unlink(e);
+            lru_push_front(e);
+            PhysicalMemoryManager::inc_ref(e->phys_frame);
+            return e->phys_frame;
         }
+        stats_.misses++;
+    }
+
+    if (stats_.pages >= stats_.max_pages) shrink(1);
+
+    // Выделяем и читаем без блокировки: allocator может сам вызвать shrink(),
+    // а чтение с диска долгое
+    void* frame = PhysicalMemoryManager::alloc_frame();
+    if (!frame) return 0;
+    PhysicalMemoryManager::get_page((uint32_t)frame)->flags |= PG_LOCKED;
+    if (vn->ops->readpage(vn, index, (uint8_t*)frame) < 0) {
+        PhysicalMemoryManager::free_frame(frame);
+        return 0;
+    }
+
+    InterruptGuard guard;
+    PageCacheEntry* e = insert(vn, index, frame, false);
+    if (!e) return 0;
+    lru_unlink(e);
+    lru_push_front(e);
+
+    // Одна ссылка остаётся у кэша, вторая - вызывающему
+    PhysicalMemoryManager::inc_ref(e->phys_frame);
+    return e->phys_frame;
+}
+
+uint32_t PageCache::lookup(vnode* vn, uint32_t index) {
+    if (!vn) return 0;
+    InterruptGuard guard;
+    PageCacheEntry* e = find(vn->sb, vn->inode_num, index);
+    if (!e) return 0;
+    if (e->readahead) {
+        e->readahead = false;
+        stats_.ra_hits++;
     }
-    return 0;
+    stats_.mapped_around++;
+    lru_unlink(e);
+    lru_push_front(e);
+    PhysicalMemoryManager::inc_ref(e->phys_frame);
+    return e->phys_frame;
 }
 
-void PageCache::insert(uint32_t inode, uint32_t offset, uint32_t phys_frame) {
-    uint32_t h = hash(inode, offset);
+void PageCache::fill(vnode* vn, uint32_t start, uint32_t count, uint32_t ahead_from) {
+    if (!vn || !vn->ops || !vn->ops->readpage) return;
 
-    for (uint32_t i = 0; i < 4; i++) {
-        uint32_t idx = (h + i) % PAGE_CACHE_SIZE;
-        if (!entries_[idx].valid) {
-            entries_[idx].inode = inode;
-            entries_[idx].offset = offset;
-            entries_[idx].phys_frame = phys_frame;
-            entries_[idx].valid = true;
-            return;
+    uint8_t* frames[PAGE_CACHE_RA_MAX];
+    uint32_t i = 0;
+    while (i < count) {
+        // Подряд идущие отсутствующие страницы - одним вызовом readpages
+        uint32_t run = 0;
+        while (i + run < count && run < PAGE_CACHE_RA_MAX) {
+            {
+                InterruptGuard guard;
+                if (find(vn->sb, vn->inode_num, start + i + run)) break;
+            }
+            if (stats_.pages + run >= stats_.max_pages) shrink(1);
+            void* frame = PhysicalMemoryManager::alloc_frame();
+            if (!frame) break;
+            PhysicalMemoryManager::get_page((uint32_t)frame)->flags |= PG_LOCKED;
+            frames[run++] = (uint8_t*)frame;
         }
-        if (entries_[idx].inode == inode && entries_[idx].offset == offset) {
-            entries_[idx].phys_frame = phys_frame;
-            return;
+        if (run == 0) {
+            // Страница уже в кэше (или память кончилась) - дальше
+            InterruptGuard guard;
+            if (!find(vn->sb, vn->inode_num, start + i)) return;
+            i++;
+            continue;
         }
+
+        bool ok = true;
+        if (vn->ops->readpages) {
+            ok = vn->ops->readpages(vn, start + i, run, frames) >= 0;
+        } else {
+            for (uint32_t k = 0; ok && k < run; k++) {
+                ok = vn->ops->readpage(vn, start + i + k, frames[k]) >= 0;
+            }
+        }
+
+        InterruptGuard guard;
+        for (uint32_t k = 0; k < run; k++) {
+            if (ok) insert(vn, start + i + k, frames[k], start + i + k >= ahead_from);
+            else PhysicalMemoryManager::free_frame(frames[k]);
+        }
+        if (!ok) return;
+        i += run;
+    }
+}
+
+void PageCache::readahead(vnode* vn, FileReadahead* ra, uint32_t index, uint32_t count) {
+    if (!readahead_enabled_ || !vn || !ra || count == 0) return;
+    uint32_t end = index + count;
+    uint32_t file_pages = (vn->size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+
+    // Последовательно: продолжение прошлого участка (или дочитывание его
+    // последней страницы мелкими порциями) либо первое чтение с начала
+    bool sequential = index == ra->next || index + 1 == ra->next ||
+                      (index == 0 && ra->next == 0);
+    ra->next = end;
+    if (!sequential) {
+        ra->window = 0;
+        ra->ra_end = 0;
+        // Запрошенное всё равно читаем одной пачкой
+        if (count > 1) fill(vn, index, count, end);
+        return;
+    }
+
+    // Впереди ещё больше половины окна - читать рано
+    if (ra->ra_end < index) ra->ra_end = index;
+    if (ra->ra_end > end && ra->ra_end - end > ra->window / 2) return;
+
+    ra->window = ra->window ? ra->window * 2 : PAGE_CACHE_RA_MIN;
+    if (ra->window > PAGE_CACHE_RA_MAX) ra->window = PAGE_CACHE_RA_MAX;
+    uint32_t stop = end + ra->window;
+    if (stop > file_pages) stop = file_pages;
+    if (stop > ra->ra_end) {
+        fill(vn, ra->ra_end, stop - ra->ra_end, end);
+        ra->ra_end = stop;
     }
+}
+
+int PageCache::read(vnode* vn, uint32_t offset, uint8_t* buffer, uint32_t size, FileReadahead* ra) {
+    if (!vn) return -1;
+    if (offset >= vn->size) return 0;
+    if (size > vn->size - offset) size = vn->size - offset;
+    if (size == 0) return 0;
+
+    uint32_t first = offset / PMM_FRAME_SIZE;
+    uint32_t pages = (offset + size - 1) / PMM_FRAME_SIZE - first + 1;
+    if (ra) readahead(vn, ra, first, pages);
+    else if (readahead_enabled_ && pages > 1) fill(vn, first, pages, first + pages);
 
-    uint32_t idx = h % PAGE_CACHE_SIZE;
-    entries_[idx].inode = inode;
-    entries_[idx].offset = offset;
-    entries_[idx].phys_frame = phys_frame;
-    entries_[idx].valid = true;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t in_page = pos % PMM_FRAME_SIZE;
+        uint32_t chunk = PMM_FRAME_SIZE - in_page;
+        if (chunk > size - done) chunk = size - done;
+
+        uint32_t frame = get_page(vn, pos / PMM_FRAME_SIZE);
+        if (!frame) return done ? (int)done : -1;
+
+        memcpy(buffer + done, (uint8_t*)frame + in_page, chunk);
+        PhysicalMemoryManager::free_frame((void*)frame);
+        done += chunk;
+    }
+    return (int)done;
 }
 
-void PageCache::invalidate(uint32_t inode) {
-    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
-        if (entries_[i].valid && entries_[i].inode == inode) {
-            entries_[i].valid = false;
+void PageCache::update(superblock* sb, uint32_t inode, uint32_t index,
+                       uint32_t offset, const uint8_t* data, uint32_t size) {
+    InterruptGuard guard;
+    PageCacheEntry* e = find(sb, inode, index);
+    if (!e) return;
+    if (offset >= PMM_FRAME_SIZE) return;
+    if (size > PMM_FRAME_SIZE - offset) size = PMM_FRAME_SIZE - offset;
+    memcpy((uint8_t*)e->phys_frame + offset, data, size);
+}
+
+void PageCache::invalidate(superblock* sb, uint32_t inode) {
+    InterruptGuard guard;
+    PageCacheEntry* e = lru_head_;
+    while (e) {
+        PageCacheEntry* next = e->lru_next;
+        if (e->sb == sb && e->inode == inode) {
+            remove(e);
+            stats_.invalidations++;
         }
+        e = next;
+    }
+}
+
+uint32_t PageCache::shrink(uint32_t count) {
+    InterruptGuard guard;
+    uint32_t released = 0;
+    while (count > 0 && lru_tail_) {
+        PageCacheEntry* e = lru_tail_;
+        // Фрейм вернётся в PMM, только если его больше никто не отображает
+        if (PhysicalMemoryManager::get_refcount(e->phys_frame) == 1) released++;
+        remove(e);
+        stats_.evictions++;
+        count--;
+    }
+    return released;
+}
+
+PageCacheStats PageCache::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void PageCache::bench_readahead(vnode* vn) {
+    uint32_t pages = (vn->size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    if (pages == 0) {
+        printf("  empty file\n");
+        return;
+    }
+    uint8_t* mapped = (uint8_t*)kmalloc(pages);
+    if (!mapped) {
+        printf("  Out of memory for bench\n");
+        return;
+    }
+
+    uint32_t tsc_mhz = Timer::get_tsc_khz() / 1000;
+    if (tsc_mhz == 0) tsc_mhz = 1;
+
+    bool saved = readahead_enabled_;
+    BlockQueue* q = Disk::primary();
+    for (int mode = 0; mode < 2; mode++) {
+        invalidate(vn->sb, vn->inode_num);
+        readahead_enabled_ = mode == 1;
+        memset(mapped, 0, pages);
+        FileReadahead ra = {};
+
+        uint32_t d0 = q ? q->get_stats().dispatches : 0;
+        uint32_t faults = 0;
+        uint64_t t0 = Timer::read_tsc();
+        // Сбои по порядку страниц, как при старте программы
+        for (uint32_t i = 0; i < pages; i++) {
+            if (mapped[i]) continue;
+            faults++;
+            readahead(vn, &ra, i, 1);
+            uint32_t frame = get_page(vn, i);
+            if (frame) PhysicalMemoryManager::free_frame((void*)frame);
+            mapped[i] = 1;
+            if (!readahead_enabled_) continue;
+
+            uint32_t from = i & ~(PAGE_CACHE_FAULT_AROUND - 1);
+            for (uint32_t j = from; j < from + PAGE_CACHE_FAULT_AROUND && j < pages; j++) {
+                if (mapped[j]) continue;
+                uint32_t near = lookup(vn, j);
+                if (!near) continue;
+                PhysicalMemoryManager::free_frame((void*)near);
+                mapped[j] = 1;
+            }
+        }
+        uint32_t us = (uint32_t)((Timer::read_tsc() - t0) >> 6) / tsc_mhz * 64;
+        uint32_t cmds = q ? q->get_stats().dispatches - d0 : 0;
+
+        printf("  %s: %u faults, %u disk commands, %u us\n",
+               mode ? "read-ahead + fault-around" : "one page per fault       ",
+               faults, cmds, us);
     }
+    readahead_enabled_ = saved;
+    kfree(mapped);
 }
 
 } // namespace re36
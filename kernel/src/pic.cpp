@@ -18,6 +18,22 @@ void pic_send_eoi(uint8_t irq) {
     outb(PIC1_COMMAND, 0x20); // EOI для Master PIC
 }
 
+void pic_unmask(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+        irq = 2;
+    }
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+}
+
+void pic_mask(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_DATA, inb(PIC2_DATA) | (1 << (irq - 8)));
+    } else {
+        outb(PIC1_DATA, inb(PIC1_DATA) | (1 << irq));
+    }
+}
+
 void pic_remap(int offset1, int offset2) {
     uint8_t a1, a2;
     
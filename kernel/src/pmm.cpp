@@ -1,11 +1,20 @@
 #include "kernel/pmm.h"
+#include "kernel/spinlock.h"
 
 namespace re36 {
 
 uint32_t* PhysicalMemoryManager::memory_bitmap_ = nullptr;
 uint32_t  PhysicalMemoryManager::max_frames_ = 0;
 uint32_t  PhysicalMemoryManager::used_frames_ = 0;
-uint8_t*  PhysicalMemoryManager::refcounts_ = nullptr;
+Page*     PhysicalMemoryManager::pages_ = nullptr;
+uint32_t  PhysicalMemoryManager::free_heads_[PMM_MAX_ORDER + 1];
+uint32_t  PhysicalMemoryManager::free_counts_[PMM_MAX_ORDER + 1];
+
+uint32_t PhysicalMemoryManager::magazine_[PMM_MAGAZINE_SIZE];
+uint32_t PhysicalMemoryManager::magazine_count_ = 0;
+PmmCacheStats PhysicalMemoryManager::cache_stats_ = { 0, 0, 0, 0 };
+PmmReclaimHook PhysicalMemoryManager::reclaim_hook_ = nullptr;
+bool PhysicalMemoryManager::reclaiming_ = false;
 
 inline void PhysicalMemoryManager::set_frame(uint32_t frame) {
     memory_bitmap_[PMM_BITMAP_INDEX(frame)] |= (1 << PMM_BITMAP_OFFSET(frame));
@@ -19,102 +28,297 @@ inline bool PhysicalMemoryManager::test_frame(uint32_t frame) {
     return memory_bitmap_[PMM_BITMAP_INDEX(frame)] & (1 << PMM_BITMAP_OFFSET(frame));
 }
 
+// Раскладка метаданных: [bitmap][Page на каждый фрейм]
+static uint32_t bitmap_bytes_for(uint32_t frames) {
+    return (frames + 31) / 32 * 4;
+}
+
+uint32_t PhysicalMemoryManager::get_metadata_size(uint32_t memory_size) {
+    uint32_t frames = memory_size / PMM_FRAME_SIZE;
+    return bitmap_bytes_for(frames) + frames * sizeof(Page);
+}
+
 void PhysicalMemoryManager::init(uint32_t bitmap_addr, uint32_t memory_size) {
     memory_bitmap_ = (uint32_t*)bitmap_addr;
     max_frames_ = memory_size / PMM_FRAME_SIZE;
-    
+
+    // Изначально вся память занята - свободные регионы отдаются через set_region_free
     used_frames_ = max_frames_;
-    uint32_t bitmap_size = max_frames_ / 32;
-    
-    for (uint32_t i = 0; i < bitmap_size; i++) {
+    uint32_t bitmap_bytes = bitmap_bytes_for(max_frames_);
+
+    for (uint32_t i = 0; i < bitmap_bytes / 4; i++) {
         memory_bitmap_[i] = 0xFFFFFFFF;
     }
 
-    uint32_t bitmap_bytes = (max_frames_ + 31) / 32 * 4;
-    refcounts_ = (uint8_t*)(bitmap_addr + bitmap_bytes);
+    pages_ = (Page*)(bitmap_addr + bitmap_bytes);
     for (uint32_t i = 0; i < max_frames_; i++) {
-        refcounts_[i] = 0;
+        Page& pg = pages_[i];
+        pg.refcount = 0;
+        pg.mapcount = 0;
+        pg.next = PMM_NO_FRAME;
+        pg.prev = PMM_NO_FRAME;
+        pg.order = PMM_NO_ORDER;
+        pg.flags = 0;
+        pg.reserved = 0;
+        pg.owner = nullptr;
+        pg.index = 0;
+    }
+
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; o++) {
+        free_heads_[o] = PMM_NO_FRAME;
+        free_counts_[o] = 0;
     }
 }
 
-void PhysicalMemoryManager::set_region_free(uint32_t base, uint32_t size) {
-    uint32_t align = base / PMM_FRAME_SIZE;
-    uint32_t frames = size / PMM_FRAME_SIZE;
+inline void PhysicalMemoryManager::reset_page(uint32_t frame) {
+    Page& pg = pages_[frame];
+    pg.refcount = 1;
+    pg.mapcount = 0;
+    pg.flags = 0;
+    pg.owner = nullptr;
+    pg.index = 0;
+}
 
-    for (; frames > 0; frames--, align++) {
-        clear_frame(align);
-        used_frames_--;
+void PhysicalMemoryManager::list_push(uint32_t frame, uint32_t order) {
+    pages_[frame].order = (uint8_t)order;
+    pages_[frame].prev = PMM_NO_FRAME;
+    pages_[frame].next = free_heads_[order];
+    if (free_heads_[order] != PMM_NO_FRAME) pages_[free_heads_[order]].prev = frame;
+    free_heads_[order] = frame;
+    free_counts_[order]++;
+}
+
+void PhysicalMemoryManager::list_remove(uint32_t frame, uint32_t order) {
+    uint32_t prev = pages_[frame].prev;
+    uint32_t next = pages_[frame].next;
+    if (prev == PMM_NO_FRAME) free_heads_[order] = next;
+    else pages_[prev].next = next;
+    if (next != PMM_NO_FRAME) pages_[next].prev = prev;
+    pages_[frame].order = PMM_NO_ORDER;
+    free_counts_[order]--;
+}
+
+uint32_t PhysicalMemoryManager::alloc_order(uint32_t order) {
+    uint32_t o = order;
+    while (o <= PMM_MAX_ORDER && free_heads_[o] == PMM_NO_FRAME) o++;
+    if (o > PMM_MAX_ORDER) return PMM_NO_FRAME; // Нет блока нужного размера
+
+    uint32_t frame = free_heads_[o];
+    list_remove(frame, o);
+
+    // Делим блок пополам, возвращая верхние половины в списки
+    while (o > order) {
+        o--;
+        list_push(frame + (1u << o), o);
     }
+
+    uint32_t count = 1u << order;
+    for (uint32_t i = 0; i < count; i++) set_frame(frame + i);
+    used_frames_ += count;
+    return frame;
 }
 
-void PhysicalMemoryManager::set_region_used(uint32_t base, uint32_t size) {
-    uint32_t align = base / PMM_FRAME_SIZE;
-    uint32_t frames = size / PMM_FRAME_SIZE;
+void PhysicalMemoryManager::free_order(uint32_t frame, uint32_t order) {
+    uint32_t count = 1u << order;
+    for (uint32_t i = 0; i < count; i++) clear_frame(frame + i);
+    used_frames_ -= count;
 
-    for (; frames > 0; frames--, align++) {
-        set_frame(align);
-        used_frames_++;
+    // Сливаем с buddy, пока он свободен и того же порядка
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = frame ^ (1u << order);
+        if (buddy + (1u << order) > max_frames_) break;
+        if (pages_[buddy].order != order) break;
+        list_remove(buddy, order);
+        frame &= ~(1u << order);
+        order++;
     }
+    list_push(frame, order);
 }
 
-uint32_t PhysicalMemoryManager::get_first_free_frame() {
-    for (uint32_t i = 0; i < PMM_BITMAP_INDEX(max_frames_); i++) {
-        // Если блок (32 фрейма) не полностью занят
-        if (memory_bitmap_[i] != 0xFFFFFFFF) {
-            for (int j = 0; j < 32; j++) {
-                uint32_t bit = 1 << j;
-                if (!(memory_bitmap_[i] & bit)) { // Если бит = 0 (свободен)
-                    return i * 32 + j; // Возвращаем индекс фрейма
-                }
-            }
+void PhysicalMemoryManager::free_range(uint32_t frame, uint32_t count) {
+    while (count > 0) {
+        uint32_t order = 0;
+        while (order < PMM_MAX_ORDER &&
+               (frame & ((2u << order) - 1)) == 0 &&
+               (2u << order) <= count) {
+            order++;
         }
+        free_order(frame, order);
+        frame += 1u << order;
+        count -= 1u << order;
     }
-    return 0xFFFFFFFF; // Нет памяти
 }
 
-void* PhysicalMemoryManager::alloc_frame() {
-    if (get_free_memory() == 0) return nullptr;
+void PhysicalMemoryManager::reserve_frame(uint32_t frame) {
+    // Ищем свободный блок, в который входит фрейм
+    uint32_t head = frame;
+    uint32_t o = 0;
+    for (; o <= PMM_MAX_ORDER; o++) {
+        head = frame & ~((1u << o) - 1);
+        if (pages_[head].order == o) break;
+    }
+    if (o > PMM_MAX_ORDER) return; // Фрейм уже занят
 
-    uint32_t frame = get_first_free_frame();
-    if (frame == 0xFFFFFFFF) return nullptr;
+    list_remove(head, o);
+    while (o > 0) {
+        o--;
+        uint32_t half = 1u << o;
+        if (frame >= head + half) {
+            list_push(head, o);
+            head += half;
+        } else {
+            list_push(head + half, o);
+        }
+    }
 
     set_frame(frame);
     used_frames_++;
-    refcounts_[frame] = 1;
-    
-    return (void*)(frame * PMM_FRAME_SIZE);
 }
 
-uint32_t PhysicalMemoryManager::get_free_blocks(uint32_t count) {
-    if (count == 0) return 0xFFFFFFFF;
-    if (count == 1) return get_first_free_frame();
+void PhysicalMemoryManager::magazine_refill() {
+    while (magazine_count_ < PMM_MAGAZINE_BATCH) {
+        uint32_t frame = alloc_order(0);
+        if (frame == PMM_NO_FRAME) break;
+        magazine_[magazine_count_++] = frame;
+    }
+    cache_stats_.refills++;
+}
 
-    uint32_t current_count = 0;
-    uint32_t start_frame = 0xFFFFFFFF;
+void PhysicalMemoryManager::magazine_drain(uint32_t count) {
+    if (count > magazine_count_) count = magazine_count_;
 
-    for (uint32_t i = 0; i < max_frames_; i++) {
-        if (!test_frame(i)) {
-            if (current_count == 0) start_frame = i;
-            current_count++;
-            if (current_count == count) return start_frame;
-        } else {
-            current_count = 0;
+    // Внизу магазина лежат самые давно освобождённые (холодные) фреймы
+    for (uint32_t i = 0; i < count; i++) {
+        free_order(magazine_[i], 0);
+    }
+    for (uint32_t i = count; i < magazine_count_; i++) {
+        magazine_[i - count] = magazine_[i];
+    }
+    magazine_count_ -= count;
+    cache_stats_.drains++;
+}
+
+void PhysicalMemoryManager::drain_frame_cache() {
+    InterruptGuard guard;
+    if (magazine_count_ > 0) magazine_drain(magazine_count_);
+}
+
+PmmCacheStats PhysicalMemoryManager::get_cache_stats() {
+    PmmCacheStats stats = cache_stats_;
+    stats.cached = magazine_count_;
+    return stats;
+}
+
+void PhysicalMemoryManager::set_reclaim_hook(PmmReclaimHook hook) {
+    InterruptGuard guard;
+    reclaim_hook_ = hook;
+}
+
+bool PhysicalMemoryManager::reclaim(uint32_t count) {
+    // Хук сам освобождает фреймы через free_frame - не входим в него повторно
+    if (!reclaim_hook_ || reclaiming_) return false;
+    reclaiming_ = true;
+    uint32_t released = reclaim_hook_(count);
+    reclaiming_ = false;
+    return released > 0;
+}
+
+void PhysicalMemoryManager::set_region_free(uint32_t base, uint32_t size) {
+    InterruptGuard guard;
+
+    uint32_t frame = base / PMM_FRAME_SIZE;
+    uint32_t end = frame + size / PMM_FRAME_SIZE;
+    if (end > max_frames_) end = max_frames_;
+
+    // Фреймы из магазина тоже помечены занятыми - не отдаём их дважды
+    if (magazine_count_ > 0) magazine_drain(magazine_count_);
+
+    // Отдаём непрерывные занятые участки целыми выровненными блоками
+    while (frame < end) {
+        if (!test_frame(frame)) {
+            frame++;
+            continue;
         }
+        uint32_t run = frame;
+        while (run < end && test_frame(run)) {
+            pages_[run].refcount = 0;
+            run++;
+        }
+        free_range(frame, run - frame);
+        frame = run;
+    }
+}
+
+void PhysicalMemoryManager::set_region_used(uint32_t base, uint32_t size) {
+    InterruptGuard guard;
+
+    uint32_t frame = base / PMM_FRAME_SIZE;
+    uint32_t end = frame + size / PMM_FRAME_SIZE;
+    if (end > max_frames_) end = max_frames_;
+
+    // Фреймы из магазина числятся занятыми в buddy - сначала вернём их
+    if (magazine_count_ > 0) magazine_drain(magazine_count_);
+
+    for (; frame < end; frame++) {
+        if (!test_frame(frame)) reserve_frame(frame);
     }
-    return 0xFFFFFFFF; // Нет подходящего блока
+}
+
+void* PhysicalMemoryManager::alloc_frame() {
+    InterruptGuard guard;
+
+    if (magazine_count_ == 0) {
+        magazine_refill();
+        if (magazine_count_ == 0 && reclaim(PMM_MAGAZINE_BATCH)) magazine_refill();
+        if (magazine_count_ == 0) return nullptr;
+    } else {
+        cache_stats_.hits++;
+    }
+
+    uint32_t frame = magazine_[--magazine_count_];
+    reset_page(frame);
+    return (void*)(frame * PMM_FRAME_SIZE);
 }
 
 void* PhysicalMemoryManager::alloc_blocks(uint32_t count) {
-    if (get_free_memory() < count * PMM_FRAME_SIZE) return nullptr;
+    if (count == 0) return nullptr;
+
+    InterruptGuard guard;
+    uint32_t available = max_frames_ - used_frames_ + magazine_count_;
+    if (available < count) reclaim(count - available);
+    if (max_frames_ - used_frames_ + magazine_count_ < count) return nullptr;
+    if (max_frames_ - used_frames_ < count) magazine_drain(magazine_count_);
 
-    uint32_t start_frame = get_free_blocks(count);
-    if (start_frame == 0xFFFFFFFF) return nullptr;
+    uint32_t order = 0;
+    while ((1u << order) < count) order++;
+
+    uint32_t start_frame = PMM_NO_FRAME;
+    if (order <= PMM_MAX_ORDER) {
+        start_frame = alloc_order(order);
+        if (start_frame == PMM_NO_FRAME && magazine_count_ > 0) {
+            // Магазин мог раздробить нужный блок - вернём фреймы и повторим
+            magazine_drain(magazine_count_);
+            start_frame = alloc_order(order);
+        }
+        if (start_frame == PMM_NO_FRAME) return nullptr;
+        // Хвост сверх count возвращаем обратно
+        free_range(start_frame + count, (1u << order) - count);
+    } else {
+        // Больше максимального блока: линейный поиск непрерывного участка
+        magazine_drain(magazine_count_);
+        uint32_t run = 0;
+        for (uint32_t i = 0; i < max_frames_; i++) {
+            if (test_frame(i)) { run = 0; continue; }
+            if (++run == count) { start_frame = i + 1 - count; break; }
+        }
+        if (start_frame == PMM_NO_FRAME) return nullptr;
+        for (uint32_t i = 0; i < count; i++) reserve_frame(start_frame + i);
+    }
 
     for (uint32_t i = 0; i < count; i++) {
-        set_frame(start_frame + i);
-        used_frames_++;
+        reset_page(start_frame + i);
     }
-    
+
     return (void*)(start_frame * PMM_FRAME_SIZE);
 }
 
@@ -123,21 +327,24 @@ void PhysicalMemoryManager::free_frame(void* frame_addr) {
     uint32_t frame = addr / PMM_FRAME_SIZE;
     if (frame >= max_frames_) return;
 
-    if (refcounts_[frame] > 1) {
-        refcounts_[frame]--;
+    InterruptGuard guard;
+
+    if (pages_[frame].refcount > 1) {
+        pages_[frame].refcount--;
         return;
     }
 
-    refcounts_[frame] = 0;
-    clear_frame(frame);
-    used_frames_--;
+    // refcount 0: фрейм уже свободен (или в магазине) либо никогда не выдавался
+    if (pages_[frame].refcount == 0) return;
+
+    pages_[frame].refcount = 0;
+    if (magazine_count_ == PMM_MAGAZINE_SIZE) magazine_drain(PMM_MAGAZINE_BATCH);
+    magazine_[magazine_count_++] = frame;
 }
 
 void PhysicalMemoryManager::inc_ref(uint32_t phys_addr) {
     uint32_t frame = phys_addr / PMM_FRAME_SIZE;
-    if (frame < max_frames_ && refcounts_[frame] < 255) {
-        refcounts_[frame]++;
-    }
+    if (frame < max_frames_) pages_[frame].refcount++;
 }
 
 void PhysicalMemoryManager::dec_ref(uint32_t phys_addr) {
@@ -146,18 +353,55 @@ void PhysicalMemoryManager::dec_ref(uint32_t phys_addr) {
     free_frame((void*)phys_addr);
 }
 
-uint8_t PhysicalMemoryManager::get_refcount(uint32_t phys_addr) {
+uint32_t PhysicalMemoryManager::get_refcount(uint32_t phys_addr) {
     uint32_t frame = phys_addr / PMM_FRAME_SIZE;
     if (frame >= max_frames_) return 0;
-    return refcounts_[frame];
+    return pages_[frame].refcount;
+}
+
+Page* PhysicalMemoryManager::get_page(uint32_t phys_addr) {
+    uint32_t frame = phys_addr / PMM_FRAME_SIZE;
+    return frame < max_frames_ ? &pages_[frame] : nullptr;
+}
+
+void PhysicalMemoryManager::inc_mapcount(uint32_t phys_addr) {
+    uint32_t frame = phys_addr / PMM_FRAME_SIZE;
+    if (frame < max_frames_) pages_[frame].mapcount++;
+}
+
+void PhysicalMemoryManager::dec_mapcount(uint32_t phys_addr) {
+    uint32_t frame = phys_addr / PMM_FRAME_SIZE;
+    if (frame < max_frames_ && pages_[frame].mapcount > 0) pages_[frame].mapcount--;
+}
+
+PageStats PhysicalMemoryManager::get_page_stats() {
+    InterruptGuard guard;
+    PageStats st = {0, 0, 0, 0, 0, 0, 0};
+    for (uint32_t i = 0; i < max_frames_; i++) {
+        const Page& pg = pages_[i];
+        if (pg.refcount == 0) continue;
+        if (pg.refcount > 1) st.shared++;
+        if (pg.refcount > st.max_refcount) st.max_refcount = pg.refcount;
+        if (pg.mapcount) st.mapped++;
+        if (pg.flags & PG_CACHED) st.cached++;
+        if (pg.flags & PG_ZEROED) st.zeroed++;
+        if (pg.flags & PG_LOCKED) st.locked++;
+        if (pg.flags & PG_DIRTY) st.dirty++;
+    }
+    return st;
 }
 
 uint32_t PhysicalMemoryManager::get_free_memory() {
-    return (max_frames_ - used_frames_) * PMM_FRAME_SIZE;
+    return (max_frames_ - used_frames_ + magazine_count_) * PMM_FRAME_SIZE;
 }
 
 uint32_t PhysicalMemoryManager::get_used_memory() {
-    return used_frames_ * PMM_FRAME_SIZE;
+    return (used_frames_ - magazine_count_) * PMM_FRAME_SIZE;
+}
+
+uint32_t PhysicalMemoryManager::get_free_block_count(uint32_t order) {
+    if (order > PMM_MAX_ORDER) return 0;
+    return free_counts_[order];
 }
 
 } // namespace re36
@@ -14,14 +14,23 @@
 #include "kernel/elf_loader.h"
 #include "kernel/usermode.h"
 #include "kernel/boot_info.h"
+#include "kernel/memory_map.h"
 #include "kernel/pci.h"
 #include "kernel/ahci.h"
+#include "kernel/disk.h"
 #include "kernel/vga.h"
 #include "kernel/bga.h"
 #include "kernel/pic.h"
 #include "kernel/memory_validator.h"
 #include "kernel/kmalloc.h"
 #include "kernel/fat16.h"
+#include "kernel/zero_pool.h"
+#include "kernel/page_cache.h"
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
+#include "kernel/mailbox.h"
+#include "kernel/sync_ipc.h"
+#include "kernel/cow.h"
 #include "libc.h"
 
 namespace re36 {
@@ -182,6 +191,7 @@ static void exec_command(const char* cmd) {
         printf("Uptime: %u:%u:%u (%u ticks)\n", hours, minutes % 60, seconds % 60, ticks);
     } else if (str_eq(cmd, "reboot")) {
         printf("Rebooting system...\n");
+        vfs_sync();
         // Using 8042 keyboard controller to pulse the reset line
         uint8_t good = 0x02;
         while (good & 0x02) {
@@ -217,6 +227,48 @@ static void exec_command(const char* cmd) {
         MemoryValidator::run_all_tests();
     } else if (str_eq(cmd, "pmmtest")) {
         MemoryValidator::test_pmm();
+    } else if (str_eq(cmd, "pmmbench")) {
+        MemoryValidator::bench_pmm();
+    } else if (str_eq(cmd, "copybench")) {
+        MemoryValidator::bench_memcpy();
+    } else if (str_eq(cmd, "tlbbench")) {
+        MemoryValidator::bench_tlb();
+    } else if (str_eq(cmd, "sync")) {
+        uint32_t dirty = Fat16::dirty_fat_sectors();
+        vfs_sync();
+        printf("Synced %u FAT sectors\n", dirty);
+    } else if (str_starts(cmd, "syncint ", 8)) {
+        Fat16::set_sync_interval((uint32_t)atoi(str_after(cmd, 8)));
+        printf("FAT sync interval: %u ms%s\n", Fat16::get_sync_interval(),
+               Fat16::get_sync_interval() ? "" : " (write-through)");
+    } else if (str_eq(cmd, "fsbench")) {
+        Fat16::benchmark(1024 * 1024);
+    } else if (str_eq(cmd, "appendbench")) {
+        Fat16::bench_append(1000, 128);
+    } else if (str_eq(cmd, "rabench") || str_starts(cmd, "rabench ", 8)) {
+        const char* files[2] = { "/ANIM.ELF", "/DYNTEST.ELF" };
+        int nfiles = 2;
+        if (str_starts(cmd, "rabench ", 8)) {
+            files[0] = str_after(cmd, 8);
+            nfiles = 1;
+        }
+        for (int i = 0; i < nfiles; i++) {
+            vnode* vn = nullptr;
+            if (vfs_resolve_path(files[i], &vn) != 0 || !vn) {
+                printf("File not found: %s\n", files[i]);
+                continue;
+            }
+            printf("[Bench] Cold page-in of %s (%u bytes)\n", files[i], vn->size);
+            PageCache::bench_readahead(vn);
+            vnode_release(vn);
+        }
+    } else if (str_starts(cmd, "readahead ", 10)) {
+        PageCache::set_readahead(str_eq(str_after(cmd, 10), "on"));
+        printf("Read-ahead and fault-around: %s\n", PageCache::readahead_enabled() ? "on" : "off");
+    } else if (str_eq(cmd, "blktest")) {
+        Fat16::bench_block(256);
+    } else if (str_eq(cmd, "blkstat")) {
+        Disk::print_stats();
     } else if (str_eq(cmd, "vmmtest")) {
         MemoryValidator::test_vmm();
     } else if (str_eq(cmd, "syscall")) {
@@ -224,6 +276,19 @@ static void exec_command(const char* cmd) {
         uint32_t tid;
         asm volatile("mov $5, %%eax; int $0x80; mov %%eax, %0" : "=r"(tid) :: "eax");
         printf("Syscall returned TID = %d\n", tid);
+    } else if (str_eq(cmd, "atainfo")) {
+        ATA::print_info();
+    } else if (str_starts(cmd, "atamode ", 8)) {
+        const char* arg = str_after(cmd, 8);
+        AtaMode mode = str_eq(arg, "dma") ? AtaMode::DMA :
+                       str_eq(arg, "multi") ? AtaMode::Multiple : AtaMode::PIO;
+        if (!ATA::is_present() || !ATA::set_mode(mode)) {
+            printf("Mode not supported by the device\n");
+        } else {
+            printf("ATA mode: %s\n", arg);
+        }
+    } else if (str_eq(cmd, "ahciinfo")) {
+        AHCIDriver::print_info();
     } else if (str_starts(cmd, "ahcitest ", 9)) {
         int port = atoi(str_after(cmd, 9));
         printf("Testing AHCI Port %d...\n", port);
@@ -260,10 +325,10 @@ static void exec_command(const char* cmd) {
         }
     } else if (str_eq(cmd, "help")) {
         printf("File: ls <path>, mkdir <path>, cat, less, more, write, rm, mv, stat, hexdump, exec, mknod, link\n");
-        printf("System: ps (threads), kill, killall, ticks, uptime, date, whoiam, fork\n");
-        printf("        meminfo (mems), pci, bootinfo, syscall, ring3, clear\n");
-        printf("        reboot, kernelpanic, echo, sleep, yield, help\n");
-        printf("Tests:  memtest, pmmtest, vmmtest, ahcitest <port>\n");
+        printf("System: ps (threads), kill, killall, ticks, uptime, timerinfo, smpinfo, fpuinfo, ipcinfo, date, whoiam, fork\n");
+        printf("        meminfo (mems), slabinfo, slabreclaim, pci, bootinfo, syscall, ring3, clear\n");
+        printf("        reboot, sync, syncint <ms>, readahead <on|off>, kernelpanic, echo, sleep, yield, help\n");
+        printf("Tests:  memtest, pmmtest, pmmbench, copybench, tlbbench, fsbench, appendbench, rabench [file], schedbench, timerbench, blktest, blkstat, vmmtest, ahcitest <port>, ahciinfo, atainfo, atamode <pio|multi|dma>\n");
         printf("Display: mode text, mode gfx, gfx, bga\n");
         printf("Shell: Tab=autocomplete, Up/Down=history, >=redirect, |=pipe\n");
     } else if (str_eq(cmd, "gfx")) {
@@ -278,11 +343,52 @@ static void exec_command(const char* cmd) {
         }
     } else if (str_eq(cmd, "ps") || str_eq(cmd, "threads")) {
         TaskScheduler::print_threads();
+        SchedStats ss = TaskScheduler::get_stats();
+        printf("%d threads, %u switches, %u timer wakeups, %u reaped\n",
+               thread_count, ss.switches, ss.wakeups, ss.reaped);
+    } else if (str_eq(cmd, "schedbench")) {
+        TaskScheduler::bench();
+    } else if (str_eq(cmd, "timerinfo")) {
+        Timer::print_info();
+    } else if (str_eq(cmd, "smpinfo")) {
+        Smp::print_info();
+    } else if (str_eq(cmd, "fpuinfo")) {
+        Fpu::print_info();
+    } else if (str_eq(cmd, "ipcinfo")) {
+        Mailbox::print_info();
+        SyncIpc::print_info();
+    } else if (str_eq(cmd, "timerbench")) {
+        Timer::bench();
     } else if (str_eq(cmd, "meminfo") || str_eq(cmd, "mems")) {
+        printf("RAM: %u KB managed", PhysicalMemoryManager::get_memory_size() / 1024);
+        if (MemoryMap::get_unmanaged_kb()) printf(", %u KB above direct map unused", MemoryMap::get_unmanaged_kb());
+        printf("\n");
         printf("Free RAM: %u KB\n", PhysicalMemoryManager::get_free_memory() / 1024);
         printf("Used RAM: %u KB\n", PhysicalMemoryManager::get_used_memory() / 1024);
+        PmmCacheStats pcs = PhysicalMemoryManager::get_cache_stats();
+        printf("Frame cache: %u cached, %u hits, %u refills, %u drains\n",
+               pcs.cached, pcs.hits, pcs.refills, pcs.drains);
+        PageCacheStats pgs = PageCache::get_stats();
+        printf("Page cache: %u/%u pages, %u hits, %u misses, %u evicted, %u invalidated\n",
+               pgs.pages, pgs.max_pages, pgs.hits, pgs.misses, pgs.evictions, pgs.invalidations);
+        printf("Read-ahead: %s, %u pages read ahead, %u used, %u mapped by fault-around\n",
+               PageCache::readahead_enabled() ? "on" : "off", pgs.readahead, pgs.ra_hits, pgs.mapped_around);
+        ZeroPoolStats zps = ZeroPool::get_stats();
+        uint32_t zp_total = zps.hits + zps.misses;
+        printf("Zero pool: %u cached, %u hits, %u misses (%u%% hit), %u zeroed in background\n",
+               zps.cached, zps.hits, zps.misses, zp_total ? zps.hits * 100 / zp_total : 0, zps.zeroed);
+        CowStats cs = cow_get_stats();
+        printf("Fork page tables: %u shared, %u copied on write, %u taken back without copy\n",
+               cs.tables_shared, cs.tables_copied, cs.tables_reclaimed);
+        PageStats ps = PhysicalMemoryManager::get_page_stats();
+        printf("Page frames: %u shared (max %u refs), %u mapped by users, %u cached, %u zeroed, %u locked\n",
+               ps.shared, ps.max_refcount, ps.mapped, ps.cached, ps.zeroed, ps.locked);
         uint32_t cr3_val; asm volatile("mov %%cr3, %0" : "=r"(cr3_val));
         printf("Paging: Enabled (CR3 = 0x%x)\n", cr3_val);
+    } else if (str_eq(cmd, "slabinfo")) {
+        kmem_print_stats();
+    } else if (str_eq(cmd, "slabreclaim")) {
+        printf("Released %u empty slabs\n", kmem_reclaim());
     } else if (str_eq(cmd, "mode text")) {
         VGA::init_text_mode();
         set_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
@@ -297,11 +403,12 @@ static void exec_command(const char* cmd) {
             printf("Boot drive: 0x%x\n", bi->boot_drive);
             printf("Video mode: 0x%x\n", bi->video_mode);
             uint32_t total_kb = 1024 + bi->mem_below_16m_kb + (uint32_t)bi->mem_above_16m_64kb * 64;
-            printf("Memory: %u KB (%u MB)\n", total_kb, total_kb / 1024);
+            printf("Memory (E801): %u KB (%u MB)\n", total_kb, total_kb / 1024);
             printf("Boot magic: 0x%x (OK)\n", bi->magic);
         } else {
             printf("Boot info not available (magic: 0x%x)\n", bi->magic);
         }
+        MemoryMap::print();
     } else if (str_eq(cmd, "ring3")) {
         printf("Launching Ring 3 user process...\n");
         void (*entry)() = []() { enter_usermode(); };
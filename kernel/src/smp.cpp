@@ -0,0 +1,389 @@
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
+#include "kernel/lapic.h"
+#include "kernel/timer.h"
+#include "kernel/tss.h"
+#include "kernel/idt.h"
+#include "kernel/vmm.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
+#include "libc.h"
+
+// Данные трамплина в конце его страницы: временная GDT, стек и точка
+// входа AP (заполняет BSP перед каждым SIPI)
+#define TRAMP_GDT    (SMP_TRAMPOLINE_ADDR + 0xFC0)
+#define TRAMP_GDTR   (SMP_TRAMPOLINE_ADDR + 0xFE0)
+#define TRAMP_STACK  (SMP_TRAMPOLINE_ADDR + 0xFF0)
+#define TRAMP_ENTRY  (SMP_TRAMPOLINE_ADDR + 0xFF4)
+
+#define SMP_STR_(x) #x
+#define SMP_STR(x) SMP_STR_(x)
+
+// AP просыпается в реальном режиме на SMP_TRAMPOLINE_ADDR: плоская GDT,
+// защищённый режим без страниц, стек потока простоя и переход в ap_main
+extern "C" uint8_t ap_trampoline_start[];
+extern "C" uint8_t ap_trampoline_end[];
+
+asm(
+    ".section .rodata\n"
+    ".global ap_trampoline_start\n"
+    ".global ap_trampoline_end\n"
+    ".code16\n"
+    "ap_trampoline_start:\n"
+    "    cli\n"
+    "    xorw %ax, %ax\n"
+    "    movw %ax, %ds\n"
+    "    lgdtl " SMP_STR(TRAMP_GDTR) "\n"
+    "    movl %cr0, %eax\n"
+    "    orl $1, %eax\n"
+    "    movl %eax, %cr0\n"
+    "    ljmpl $0x08, $(" SMP_STR(SMP_TRAMPOLINE_ADDR) " + ap_trampoline_pm - ap_trampoline_start)\n"
+    ".code32\n"
+    "ap_trampoline_pm:\n"
+    "    movw $0x10, %ax\n"
+    "    movw %ax, %ds\n"
+    "    movw %ax, %es\n"
+    "    movw %ax, %fs\n"
+    "    movw %ax, %gs\n"
+    "    movw %ax, %ss\n"
+    "    movl " SMP_STR(TRAMP_STACK) ", %esp\n"
+    "    call *" SMP_STR(TRAMP_ENTRY) "\n"
+    "1:  hlt\n"
+    "    jmp 1b\n"
+    "ap_trampoline_end:\n"
+    ".previous\n"
+);
+
+namespace re36 {
+
+CpuInfo cpus[MAX_CPUS];
+uint8_t lapic_to_cpu[256];
+bool smp_active = false;
+
+int Smp::cpu_count_ = 1;
+Spinlock Smp::kernel_lock_;
+volatile int Smp::kernel_owner_ = -1;
+volatile uint32_t Smp::tlb_pending_ = 0;
+volatile uint32_t Smp::tlb_addr_ = 0;
+uint32_t Smp::boot_cr0_ = 0;
+uint32_t Smp::boot_cr4_ = 0;
+
+// ================= Таблицы MP (Intel MultiProcessor Spec 1.4) =================
+
+struct MpFloating {
+    char signature[4];           // "_MP_"
+    uint32_t config;             // Физический адрес таблицы конфигурации
+    uint8_t length;              // В 16-байтных блоках
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t features[5];
+} __attribute__((packed));
+
+struct MpConfig {
+    char signature[4];           // "PCMP"
+    uint16_t length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem[8];
+    char product[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_addr;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__((packed));
+
+struct MpProcessor {
+    uint8_t type;                // 0
+    uint8_t lapic_id;
+    uint8_t lapic_version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed));
+
+#define MP_ENTRY_PROCESSOR 0
+#define MP_CPU_ENABLED     0x01
+
+static bool mp_checksum(const uint8_t* p, uint32_t len) {
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += p[i];
+    return sum == 0;
+}
+
+static MpFloating* mp_scan(uint32_t base, uint32_t len) {
+    for (uint32_t addr = base; addr + sizeof(MpFloating) <= base + len; addr += 16) {
+        MpFloating* mpf = (MpFloating*)addr;
+        if (mpf->signature[0] == '_' && mpf->signature[1] == 'M' &&
+            mpf->signature[2] == 'P' && mpf->signature[3] == '_' &&
+            mp_checksum((const uint8_t*)mpf, mpf->length * 16)) {
+            return mpf;
+        }
+    }
+    return nullptr;
+}
+
+// Плавающий указатель ищется в первом КБ EBDA, в последнем КБ базовой
+// памяти и в ПЗУ BIOS. Таблицы по умолчанию (config == 0) не поддержаны.
+bool Smp::find_mp_config() {
+    MpFloating* mpf = nullptr;
+    uint32_t ebda = (uint32_t)(*(volatile uint16_t*)0x40E) << 4;
+    if (ebda) mpf = mp_scan(ebda, 1024);
+    if (!mpf) mpf = mp_scan(0x9FC00, 1024);
+    if (!mpf) mpf = mp_scan(0xF0000, 0x10000);
+    if (!mpf || !mpf->config || mpf->config >= KERNEL_SPACE_END) return false;
+
+    MpConfig* cfg = (MpConfig*)mpf->config;
+    if (cfg->signature[0] != 'P' || cfg->signature[1] != 'C' ||
+        cfg->signature[2] != 'M' || cfg->signature[3] != 'P') return false;
+    if (!mp_checksum((const uint8_t*)cfg, cfg->length)) return false;
+
+    uint8_t bsp_id = cpus[0].lapic_id;
+    uint8_t* entry = (uint8_t*)(cfg + 1);
+    for (uint16_t i = 0; i < cfg->entry_count; i++) {
+        if (*entry != MP_ENTRY_PROCESSOR) {
+            entry += 8;
+            continue;
+        }
+        MpProcessor* p = (MpProcessor*)entry;
+        entry += sizeof(MpProcessor);
+        if (!(p->flags & MP_CPU_ENABLED) || p->lapic_id == bsp_id) continue;
+        if (cpu_count_ >= MAX_CPUS) continue;
+
+        CpuInfo& c = cpus[cpu_count_];
+        c.index = (uint8_t)cpu_count_;
+        c.lapic_id = p->lapic_id;
+        cpu_count_++;
+    }
+    return true;
+}
+
+// ================= Запуск AP =================
+
+static void delay_ns(uint64_t ns) {
+    uint64_t end = Timer::now_ns() + ns;
+    while (Timer::now_ns() < end) asm volatile("pause");
+}
+
+static bool wait_online(CpuInfo& cpu, uint64_t ns) {
+    uint64_t end = Timer::now_ns() + ns;
+    while (!__atomic_load_n(&cpu.online, __ATOMIC_ACQUIRE)) {
+        if (Timer::now_ns() >= end) return false;
+        asm volatile("pause");
+    }
+    return true;
+}
+
+bool Smp::start_ap(CpuInfo& cpu) {
+    Thread& idle = threads[cpu.idle_tid];
+    *(volatile uint32_t*)TRAMP_STACK = (uint32_t)(idle.stack_base + THREAD_STACK_SIZE);
+    *(volatile uint32_t*)TRAMP_ENTRY = (uint32_t)ap_main;
+
+    // INIT, 10 мс, затем SIPI (второй - если первый не разбудил)
+    LocalApic::send_ipi(cpu.lapic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    delay_ns(10000000);
+
+    uint32_t sipi = LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT | (SMP_TRAMPOLINE_ADDR >> 12);
+    LocalApic::send_ipi(cpu.lapic_id, sipi);
+    if (wait_online(cpu, 200000)) return true;
+    LocalApic::send_ipi(cpu.lapic_id, sipi);
+    return wait_online(cpu, 100000000);
+}
+
+void Smp::ap_main() {
+    // Страничная адресация и флаги FPU - как у BSP
+    asm volatile("mov %0, %%cr4" :: "r"(boot_cr4_));
+    asm volatile("mov %0, %%cr3" :: "r"(VMM::kernel_directory_phys_) : "memory");
+    asm volatile("mov %0, %%cr0" :: "r"(boot_cr0_) : "memory");
+
+    reload_idt();
+    CpuInfo* cpu = cpu_current();
+    TSS::init_ap(cpu->index);
+    Fpu::init_ap();
+    LocalApic::init_ap();
+    Timer::init_ap();
+
+    // BSP ждёт online с BKL в руках, поэтому свои поля AP заполняет до
+    // захвата блокировки: кроме него их сейчас никто не трогает
+    Thread& idle = threads[cpu->idle_tid];
+    idle.state = ThreadState::Running;
+    idle.cpu = cpu->index;
+    cpu->running_tid = cpu->idle_tid;
+    cpu->slice_start_ns = Timer::now_ns();
+    __atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+
+    lock_kernel();
+    TaskScheduler::idle_loop();
+}
+
+void Smp::init() {
+    cpus[0].index = 0;
+    cpus[0].lapic_id = (uint8_t)LocalApic::id();
+    cpus[0].online = true;
+
+    // Таймеры AP калибруются по BSP: нужен режим one-shot LAPIC
+    if (!LocalApic::is_present() || !Timer::is_tickless()) return;
+    if (!find_mp_config() || cpu_count_ < 2) return;
+
+    asm volatile("mov %%cr0, %0" : "=r"(boot_cr0_));
+    asm volatile("mov %%cr4, %0" : "=r"(boot_cr4_));
+
+    uint32_t tramp_size = (uint32_t)(ap_trampoline_end - ap_trampoline_start);
+    memcpy((void*)SMP_TRAMPOLINE_ADDR, ap_trampoline_start, tramp_size);
+
+    uint64_t* gdt = (uint64_t*)TRAMP_GDT;
+    gdt[0] = 0;
+    gdt[1] = 0x00CF9A000000FFFFull;  // Код ядра, 0x08
+    gdt[2] = 0x00CF92000000FFFFull;  // Данные ядра, 0x10
+    *(volatile uint16_t*)TRAMP_GDTR = 3 * 8 - 1;
+    *(volatile uint32_t*)(TRAMP_GDTR + 2) = TRAMP_GDT;
+
+    {
+        InterruptGuard guard;
+        for (int i = 0; i < cpu_count_; i++) lapic_to_cpu[cpus[i].lapic_id] = (uint8_t)i;
+        kernel_lock_.lock();
+        kernel_owner_ = 0;
+        smp_active = true;
+    }
+
+    for (int i = 1; i < cpu_count_; i++) {
+        if (TaskScheduler::create_idle(i) < 0) break;
+        if (!start_ap(cpus[i])) {
+            printf("[SMP] CPU %d (APIC %d) did not start\n", i, cpus[i].lapic_id);
+        }
+    }
+}
+
+bool Smp::is_active() {
+    return smp_active;
+}
+
+int Smp::cpu_count() {
+    return cpu_count_;
+}
+
+int Smp::online_count() {
+    int n = 0;
+    for (int i = 0; i < cpu_count_; i++) {
+        if (cpus[i].online) n++;
+    }
+    return n;
+}
+
+// ================= Большая блокировка ядра =================
+
+void Smp::lock_kernel() {
+    if (!smp_active) return;
+    int me = cpu_current()->index;
+    // Прерывания запрещены: запрос сброса TLB от владельца BKL
+    // обслуживается прямо в цикле ожидания
+    while (!kernel_lock_.try_lock()) {
+        while (kernel_lock_.is_locked()) {
+            poll_tlb();
+            asm volatile("pause");
+        }
+    }
+    kernel_owner_ = me;
+}
+
+void Smp::unlock_kernel() {
+    if (!smp_active) return;
+    kernel_owner_ = -1;
+    kernel_lock_.unlock();
+}
+
+bool Smp::holds_kernel() {
+    return smp_active && kernel_owner_ == cpu_current()->index;
+}
+
+bool Smp::enter_kernel() {
+    if (!smp_active || holds_kernel()) return false;
+    lock_kernel();
+    return true;
+}
+
+void Smp::leave_kernel() {
+    if (holds_kernel()) unlock_kernel();
+}
+
+void Smp::halt() {
+    uint32_t flags = cli_save();
+    bool held = holds_kernel();
+    if (held) unlock_kernel();
+    asm volatile("sti; hlt; cli");
+    if (held) lock_kernel();
+    sti_restore(flags);
+}
+
+// ================= IPI =================
+
+void Smp::send_resched(int cpu) {
+    if (!smp_active || cpu == cpu_current()->index || !cpus[cpu].online) return;
+    LocalApic::send_ipi(cpus[cpu].lapic_id, LAPIC_ICR_ASSERT | SMP_RESCHED_VECTOR);
+}
+
+void Smp::tlb_shootdown(uint32_t virt, bool user) {
+    if (!smp_active) return;
+
+    int me = cpu_current()->index;
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+
+    uint32_t mask = 0;
+    for (int i = 0; i < cpu_count_; i++) {
+        if (i == me || !cpus[i].online) continue;
+        if (user && (uint32_t)threads[cpus[i].running_tid].page_directory_phys != cr3) continue;
+        mask |= 1u << i;
+    }
+    if (!mask) return;
+
+    // Вызывающий держит BKL: одновременно идёт не больше одного запроса
+    tlb_addr_ = virt;
+    __atomic_store_n(&tlb_pending_, mask, __ATOMIC_RELEASE);
+    for (int i = 0; i < cpu_count_; i++) {
+        if (mask & (1u << i)) {
+            LocalApic::send_ipi(cpus[i].lapic_id, LAPIC_ICR_ASSERT | SMP_TLB_VECTOR);
+        }
+    }
+    while (__atomic_load_n(&tlb_pending_, __ATOMIC_ACQUIRE)) asm volatile("pause");
+}
+
+void Smp::poll_tlb() {
+    CpuInfo* cpu = cpu_current();
+    uint32_t bit = 1u << cpu->index;
+    if (!(__atomic_load_n(&tlb_pending_, __ATOMIC_ACQUIRE) & bit)) return;
+    if (tlb_addr_ == SMP_TLB_FLUSH_ALL) {
+        uint32_t cr3;
+        asm volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) :: "memory");
+    } else {
+        asm volatile("invlpg (%0)" :: "r"(tlb_addr_) : "memory");
+    }
+    cpu->tlb_ipis++;
+    __atomic_and_fetch(&tlb_pending_, ~bit, __ATOMIC_RELEASE);
+}
+
+void Smp::handle_tlb_ipi() {
+    poll_tlb();
+    LocalApic::eoi();
+}
+
+void Smp::print_info() {
+    printf("CPUs: %d found, %d online%s\n", cpu_count_, online_count(),
+           smp_active ? "" : " (SMP off: no MP table or no LAPIC timer)");
+    printf(" CPU | APIC | Thread | Switches | Steals | Resched IPI | TLB IPI\n");
+    for (int i = 0; i < cpu_count_; i++) {
+        CpuInfo& c = cpus[i];
+        if (!c.online) {
+            printf(" %d   | %d    | offline\n", i, c.lapic_id);
+            continue;
+        }
+        printf(" %d   | %d    | %d\t| %u\t   | %u\t    | %u\t  | %u\n",
+               i, c.lapic_id, c.running_tid, c.switches, c.steals,
+               c.resched_ipis, c.tlb_ipis);
+    }
+}
+
+} // namespace re36
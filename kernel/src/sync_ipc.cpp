@@ -0,0 +1,171 @@
+#include "kernel/sync_ipc.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
+#include "kernel/spinlock.h"
+#include "kernel/idt.h"
+#include "libc.h"
+
+namespace re36 {
+
+SyncIpcStats SyncIpc::stats_ = {0, 0, 0, 0};
+
+void SyncIpc::copy_words(Registers* to, const Registers* from) {
+    to->ecx = from->ecx;
+    to->edx = from->edx;
+    to->esi = from->esi;
+    to->edi = from->edi;
+}
+
+void SyncIpc::enqueue_caller(int dest_tid, int caller_tid) {
+    Thread** pp = &threads[dest_tid].ipc_callers;
+    while (*pp) pp = &(*pp)->ipc_next;
+    threads[caller_tid].ipc_next = nullptr;
+    *pp = &threads[caller_tid];
+}
+
+// Первый вызывающий, который ещё ждёт; завершённых, но не убранных
+// reaper, пропускает
+int SyncIpc::dequeue_caller(int dest_tid) {
+    Thread& dest = threads[dest_tid];
+    while (dest.ipc_callers) {
+        Thread* t = dest.ipc_callers;
+        dest.ipc_callers = t->ipc_next;
+        t->ipc_next = nullptr;
+        if (t->state == ThreadState::Blocked && t->ipc_state == IPC_SENDING) return t->tid;
+    }
+    return -1;
+}
+
+void SyncIpc::fail(int tid) {
+    Thread& t = threads[tid];
+    t.ipc_state = IPC_IDLE;
+    t.ipc_result = -1;
+    t.ipc_next = nullptr;
+    stats_.failed++;
+    TaskScheduler::unblock(tid);
+}
+
+int SyncIpc::call(int dest_tid, Registers* frame) {
+    InterruptGuard guard;
+    int self = current_tid;
+    if (dest_tid < 0 || dest_tid >= MAX_THREADS || dest_tid == self) return -1;
+    Thread& dest = threads[dest_tid];
+    if (dest.state == ThreadState::Unused || dest.state == ThreadState::Terminated ||
+        dest.state == ThreadState::Zombie || dest.idle) {
+        return -1;
+    }
+
+    Thread& cur = threads[self];
+    cur.ipc_frame = frame;
+    cur.ipc_partner = dest_tid;
+    cur.ipc_result = -1;
+    stats_.calls++;
+
+    if (dest.state == ThreadState::Blocked && dest.ipc_state == IPC_RECEIVING) {
+        // Быстрый путь: получатель ждёт в reply_wait - слова сразу в его
+        // регистры, процессор ему без выбора следующего потока
+        copy_words(dest.ipc_frame, frame);
+        dest.ipc_result = self;
+        dest.ipc_state = IPC_IDLE;
+        cur.ipc_state = IPC_AWAIT_REPLY;
+        cur.state = ThreadState::Blocked;
+        cur.blocked_channel_id = -1;
+        stats_.fast_calls++;
+        TaskScheduler::handoff(dest_tid);
+    } else {
+        cur.ipc_state = IPC_SENDING;
+        enqueue_caller(dest_tid, self);
+    }
+
+    // Ответ (или отказ) снимает IPC_AWAIT_REPLY; чужой unblock - нет
+    while (cur.ipc_state != IPC_IDLE) TaskScheduler::block_current(-1);
+    return cur.ipc_result;
+}
+
+int SyncIpc::reply_wait(int reply_tid, Registers* frame) {
+    InterruptGuard guard;
+    int self = current_tid;
+    Thread& cur = threads[self];
+
+    int replied = -1;
+    if (reply_tid >= 0 && reply_tid < MAX_THREADS) {
+        Thread& caller = threads[reply_tid];
+        // Вызывающий мог завершиться, пока ждал: ответ тогда теряется
+        if (caller.state == ThreadState::Blocked && caller.ipc_state == IPC_AWAIT_REPLY &&
+            caller.ipc_partner == self) {
+            copy_words(caller.ipc_frame, frame);
+            caller.ipc_result = 0;
+            caller.ipc_state = IPC_IDLE;
+            replied = reply_tid;
+        }
+    }
+
+    int sender = dequeue_caller(self);
+    if (sender >= 0) {
+        // Вызов уже ждёт: принимаем его, ответивший - обычным порядком
+        // в очередь готовых
+        Thread& s = threads[sender];
+        copy_words(frame, s.ipc_frame);
+        s.ipc_state = IPC_AWAIT_REPLY;
+        if (replied >= 0) TaskScheduler::unblock(replied);
+        return sender;
+    }
+
+    cur.ipc_frame = frame;
+    cur.ipc_state = IPC_RECEIVING;
+    if (replied >= 0) {
+        // Быстрый путь ответа: процессор сразу вызвавшему
+        cur.state = ThreadState::Blocked;
+        cur.blocked_channel_id = -1;
+        stats_.fast_replies++;
+        TaskScheduler::handoff(replied);
+    }
+    while (cur.ipc_state == IPC_RECEIVING) TaskScheduler::block_current(-1);
+    return cur.ipc_result;
+}
+
+void SyncIpc::release(int tid) {
+    InterruptGuard guard;
+    Thread& t = threads[tid];
+
+    // Снять себя с очереди получателя
+    if (t.ipc_state == IPC_SENDING) {
+        Thread** pp = &threads[t.ipc_partner].ipc_callers;
+        while (*pp && *pp != &t) pp = &(*pp)->ipc_next;
+        if (*pp) *pp = t.ipc_next;
+    }
+
+    // Ждущие ответа от завершённого потока уже не дождутся
+    while (t.ipc_callers) {
+        Thread* c = t.ipc_callers;
+        t.ipc_callers = c->ipc_next;
+        if (c->state == ThreadState::Blocked && c->ipc_state == IPC_SENDING) fail(c->tid);
+    }
+    for (int i = 0; i < MAX_THREADS; i++) {
+        Thread& c = threads[i];
+        if (c.state == ThreadState::Blocked && c.ipc_state == IPC_AWAIT_REPLY &&
+            c.ipc_partner == tid) {
+            fail(i);
+        }
+    }
+
+    t.ipc_state = IPC_IDLE;
+    t.ipc_partner = -1;
+    t.ipc_frame = nullptr;
+    t.ipc_next = nullptr;
+}
+
+SyncIpcStats SyncIpc::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void SyncIpc::print_info() {
+    SyncIpcStats st = get_stats();
+    SchedStats ss = TaskScheduler::get_stats();
+    printf("Sync calls: %u (%u direct to waiting receiver), direct replies: %u\n",
+           st.calls, st.fast_calls, st.fast_replies);
+    printf("Failed (receiver exited): %u, scheduler handoffs: %u\n", st.failed, ss.handoffs);
+}
+
+} // namespace re36
@@ -10,10 +10,17 @@
 #include "kernel/ata.h"
 #include "kernel/spinlock.h"
 #include "kernel/pmm.h"
+#include "kernel/zero_pool.h"
 #include "kernel/elf.h"
 #include "kernel/elf_loader.h"
 #include "kernel/tss.h"
 #include "kernel/kmalloc.h"
+#include "kernel/page_cache.h"
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
+#include "kernel/mailbox.h"
+#include "kernel/sync_ipc.h"
+#include "kernel/cow.h"
 #include "libc.h"
 
 namespace re36 {
@@ -34,15 +41,14 @@ static uint32_t sys_exit(SyscallRegs* regs) {
     Thread& cur = threads[current_tid];
     cur.exit_code = exit_code;
 
+    thread_vfork_done(current_tid);
     if (cur.page_directory_phys != (uint32_t*)VMM::kernel_directory_phys_ &&
         cur.page_directory_phys != nullptr) {
         VMM::destroy_address_space(cur.page_directory_phys);
         cur.page_directory_phys = (uint32_t*)VMM::kernel_directory_phys_;
     }
 
-    VMA* v = cur.vma_list;
-    while (v) { VMA* n = v->next; kfree(v); v = n; }
-    cur.vma_list = nullptr;
+    vma_clear(cur.vmas);
 
     for (int f = 0; f < MAX_OPEN_FILES; f++) {
         if (cur.fd_table[f]) {
@@ -50,6 +56,9 @@ static uint32_t sys_exit(SyscallRegs* regs) {
             cur.fd_table[f] = nullptr;
         }
     }
+    // Зомби ждёт wait() родителя, а thread_cleanup до него не дойдёт
+    Mailbox::release(current_tid);
+    SyncIpc::release(current_tid);
 
     if (cur.parent_tid >= 0 && cur.parent_tid < MAX_THREADS &&
         threads[cur.parent_tid].state != ThreadState::Unused) {
@@ -64,19 +73,8 @@ static uint32_t sys_exit(SyscallRegs* regs) {
             }
         }
 
-        int next_tid = TaskScheduler::pick_next_thread();
-        if (next_tid != current_tid) {
-            InterruptGuard guard;
-            int old_tid = current_tid;
-            current_tid = next_tid;
-            threads[next_tid].state = ThreadState::Running;
-            threads[next_tid].quantum_remaining = 5;
-            if (threads[next_tid].page_directory_phys != threads[old_tid].page_directory_phys) {
-                VMM::switch_address_space(threads[next_tid].page_directory_phys);
-            }
-            TSS::set_kernel_stack((uint32_t)(threads[next_tid].stack_base + THREAD_STACK_SIZE));
-            switch_task(&threads[old_tid].esp, threads[next_tid].esp);
-        }
+        InterruptGuard guard;
+        TaskScheduler::switch_to(TaskScheduler::pick_next_thread());
         return 0;
     }
 
@@ -123,6 +121,26 @@ static uint32_t sys_time(SyscallRegs* regs) {
     return Timer::get_ticks();
 }
 
+static uint32_t sys_usleep(SyscallRegs* regs) {
+    uint32_t us = regs->ebx;
+    TaskScheduler::sleep_ns((uint64_t)us * 1000);
+    return 0;
+}
+
+// Монотонное время с загрузки в нс: 64 бита не помещаются в EAX
+static uint32_t sys_clock_ns(SyscallRegs* regs) {
+    uint64_t* out = (uint64_t*)regs->ebx;
+    if (!out) return (uint32_t)-1;
+    *out = Timer::now_ns();
+    return 0;
+}
+
+// Процессоров в работе (для выбора числа рабочих процессов)
+static uint32_t sys_cpu_count(SyscallRegs* regs) {
+    (void)regs;
+    return (uint32_t)Smp::online_count();
+}
+
 static uint32_t sys_send(SyscallRegs* regs) {
     int channel_id = (int)regs->ebx;
     uint32_t data = regs->ecx;
@@ -139,25 +157,19 @@ static uint32_t sys_recv(SyscallRegs* regs) {
     return EventSystem::pop(channel_id);
 }
 
-static uint32_t find_free_vaddr(uint32_t size) {
-    uint32_t candidate = 0x20000000;
-    uint32_t end_limit = 0xB0000000;
-    Thread& cur = threads[current_tid];
+uint32_t find_free_vaddr(uint32_t size) {
+    return vma_find_free(threads[current_tid].vmas, size, 0x20000000, 0xB0000000);
+}
 
-    while (candidate + size <= end_limit) {
-        bool conflict = false;
-        VMA* v = cur.vma_list;
-        while (v) {
-            if (candidate < v->end && (candidate + size) > v->start) {
-                candidate = (v->end + 0xFFF) & ~0xFFF;
-                conflict = true;
-                break;
-            }
-            v = v->next;
+// Снять отображения диапазона и отдать фреймы (ссылки) в PMM
+static void unmap_pages(uint32_t addr, uint32_t length) {
+    for (uint32_t off = 0; off < length; off += 4096) {
+        uint32_t v = addr + off;
+        uint32_t phys = VMM::get_physical(v);
+        if (phys && VMM::unmap_page(v)) {
+            PhysicalMemoryManager::free_frame((void*)phys);
         }
-        if (!conflict) return candidate;
     }
-    return 0;
 }
 
 static uint32_t sys_mmap(SyscallRegs* regs) {
@@ -178,6 +190,7 @@ static uint32_t sys_mmap(SyscallRegs* regs) {
     if (addr && (flags & MAP_FIXED)) {
         if (addr < KERNEL_SPACE_END) return (uint32_t)-1;
         vaddr = addr & ~0xFFF;
+        if (vaddr + length < vaddr) return (uint32_t)-1;
     } else {
         vaddr = find_free_vaddr(length);
         if (vaddr == 0) return (uint32_t)-1;
@@ -185,56 +198,41 @@ static uint32_t sys_mmap(SyscallRegs* regs) {
 
     Thread& cur = threads[current_tid];
 
-    VMA* vma = (VMA*)kmalloc(sizeof(VMA));
-    if (!vma) return (uint32_t)-1;
+    file* f = nullptr;
+    if (!(flags & MAP_ANONYMOUS)) {
+        if (fd < 0 || fd >= MAX_OPEN_FILES || !cur.fd_table[fd]) return (uint32_t)-1;
+        f = cur.fd_table[fd];
+        if (!f->vn) return (uint32_t)-1;
+    }
 
-    vma->start = vaddr;
-    vma->end = vaddr + length;
-    vma->flags = page_flags;
+    VMA* vma = vma_alloc(vaddr, vaddr + length, page_flags,
+                         f ? VMA_TYPE_FILE : VMA_TYPE_ANON);
+    if (!vma) return (uint32_t)-1;
 
-    if (flags & MAP_ANONYMOUS) {
-        vma->type = VMA_TYPE_ANON;
-        vma->file_vnode = nullptr;
-        vma->file_offset = 0;
-        vma->file_size = 0;
+    // MAP_FIXED заменяет то, что было отображено в диапазоне
+    if (flags & MAP_FIXED) unmap_pages(vaddr, length);
 
+    if (!f) {
         for (uint32_t off = 0; off < length; off += 4096) {
-            void* frame = PhysicalMemoryManager::alloc_frame();
+            void* frame = ZeroPool::alloc_frame();
             if (!frame) {
-                for (uint32_t undo = 0; undo < off; undo += 4096) {
-                    uint32_t phys = VMM::get_physical(vaddr + undo);
-                    if (phys) {
-                        VMM::unmap_page(vaddr + undo);
-                        PhysicalMemoryManager::free_frame((void*)phys);
-                    }
-                }
-                kfree(vma);
+                unmap_pages(vaddr, off);
+                vma_free(vma);
                 return (uint32_t)-1;
             }
             VMM::map_page(vaddr + off, (uint32_t)frame, page_flags);
-            uint8_t* p = (uint8_t*)(vaddr + off);
-            for (int b = 0; b < 4096; b++) p[b] = 0;
         }
     } else {
-        if (fd < 0 || fd >= MAX_OPEN_FILES || !cur.fd_table[fd]) {
-            kfree(vma);
-            return (uint32_t)-1;
-        }
-        file* f = cur.fd_table[fd];
-        if (!f->vn) {
-            kfree(vma);
-            return (uint32_t)-1;
-        }
-        vma->type = VMA_TYPE_FILE;
         vma->file_vnode = f->vn;
         __atomic_add_fetch(&f->vn->refcount, 1, __ATOMIC_SEQ_CST);
-        vma->file_offset = 0;
         vma->file_size = length;
     }
 
-    vma->next = cur.vma_list;
-    cur.vma_list = vma;
-
+    if (!vma_insert(cur.vmas, vma)) {
+        if (!f) unmap_pages(vaddr, length);
+        vma_free(vma);
+        return (uint32_t)-1;
+    }
     return vaddr;
 }
 
@@ -245,32 +243,34 @@ static uint32_t sys_munmap(SyscallRegs* regs) {
     if (addr == 0 || length == 0) return (uint32_t)-1;
     addr &= ~0xFFF;
     length = (length + 0xFFF) & ~0xFFF;
+    if (addr + length < addr) return (uint32_t)-1;
 
-    Thread& cur = threads[current_tid];
+    // Области, задетые частично, обрезаются или делятся надвое
+    if (!vma_remove_range(threads[current_tid].vmas, addr, addr + length)) return (uint32_t)-1;
+    unmap_pages(addr, length);
+    return 0;
+}
 
-    for (uint32_t off = 0; off < length; off += 4096) {
-        uint32_t v = addr + off;
-        uint32_t phys = VMM::get_physical(v);
-        if (phys) {
-            VMM::unmap_page(v);
-            PhysicalMemoryManager::free_frame((void*)phys);
-        }
-    }
+static uint32_t sys_mprotect(SyscallRegs* regs) {
+    uint32_t addr   = regs->ebx;
+    uint32_t length = regs->ecx;
+    uint32_t prot   = regs->edx;
 
-    VMA** prev = &cur.vma_list;
-    while (*prev) {
-        VMA* v = *prev;
-        if (v->start >= addr && v->end <= addr + length) {
-            *prev = v->next;
-            if (v->type == VMA_TYPE_FILE && v->file_vnode) {
-                vnode_release(v->file_vnode);
-            }
-            kfree(v);
-        } else {
-            prev = &v->next;
-        }
-    }
+    if ((addr & 0xFFF) || length == 0) return (uint32_t)-1;
+    length = (length + 0xFFF) & ~0xFFF;
+    if (addr + length < addr) return (uint32_t)-1;
+
+    uint32_t page_flags = PAGE_PRESENT | PAGE_USER;
+    if (prot & PROT_WRITE) page_flags |= PAGE_WRITABLE;
 
+    // Крайние области делятся, внутренние сливаются с соседями по флагам;
+    // ещё не загруженные страницы получат флаги области при первом обращении
+    if (!vma_protect(threads[current_tid].vmas, addr, addr + length, page_flags)) {
+        return (uint32_t)-1;
+    }
+    for (uint32_t off = 0; off < length; off += 4096) {
+        cow_protect_page(addr + off, (prot & PROT_WRITE) != 0);
+    }
     return 0;
 }
 
@@ -352,66 +352,39 @@ static uint32_t sys_wait_irq(SyscallRegs* regs) {
 }
 
 static uint32_t sys_send_msg(SyscallRegs* regs) {
-    int target_tid = (int)regs->ebx;
-    const uint8_t* data = (const uint8_t*)regs->ecx;
-    uint32_t size = regs->edx;
-
-    if (target_tid < 0 || target_tid >= MAX_THREADS || size > IPC_MAX_MSG_SIZE) return (uint32_t)-1;
-    
-    InterruptGuard guard;
-    Thread& target = threads[target_tid];
-    if (target.state == ThreadState::Unused || target.state == ThreadState::Terminated) return (uint32_t)-1;
-
-    if (target.msg_count >= IPC_MSG_QUEUE_SIZE) return (uint32_t)-1; // Queue full
-
-    IpcMessage& msg = target.messages[target.msg_tail];
-    msg.sender_tid = current_tid;
-    msg.size = size;
-    for (uint32_t i = 0; i < size; i++) {
-        msg.data[i] = data[i];
-    }
-
-    target.msg_tail = (target.msg_tail + 1) % IPC_MSG_QUEUE_SIZE;
-    target.msg_count++;
-
-    if (target.waiting_for_msg) {
-        target.waiting_for_msg = false;
-        TaskScheduler::unblock(target_tid);
-    }
-
-    return 0;
+    return (uint32_t)Mailbox::send((int)regs->ebx, (const void*)regs->ecx, regs->edx);
 }
 
 static uint32_t sys_recv_msg(SyscallRegs* regs) {
-    int* sender_tid_out = (int*)regs->ebx;
-    uint8_t* buffer = (uint8_t*)regs->ecx;
-    uint32_t max_size = regs->edx;
-
-    while (true) {
-        {
-            InterruptGuard guard;
-            Thread& cur = threads[current_tid];
-
-            if (cur.msg_count > 0) {
-                IpcMessage& msg = cur.messages[cur.msg_head];
-                if (sender_tid_out) *sender_tid_out = msg.sender_tid;
-
-                uint32_t copy_sz = msg.size < max_size ? msg.size : max_size;
-                for (uint32_t i = 0; i < copy_sz; i++) {
-                    buffer[i] = msg.data[i];
-                }
+    return (uint32_t)Mailbox::recv((int*)regs->ebx, (void*)regs->ecx, regs->edx);
+}
 
-                cur.msg_head = (cur.msg_head + 1) % IPC_MSG_QUEUE_SIZE;
-                cur.msg_count--;
+// Передача страниц без копирования: ebx - получатель, ecx - адрес, edx -
+// число страниц, esi - IPC_GRANT_MOVE / IPC_GRANT_COW, edi - метка
+static uint32_t sys_send_grant(SyscallRegs* regs) {
+    return (uint32_t)Mailbox::send_grant((int)regs->ebx, regs->ecx, regs->edx,
+                                         regs->esi, regs->edi);
+}
 
-                return copy_sz;
-            }
+// Возвращает адрес отображённых страниц или -1
+static uint32_t sys_recv_grant(SyscallRegs* regs) {
+    uint32_t vaddr = Mailbox::recv_grant((int*)regs->ebx, (uint32_t*)regs->ecx,
+                                         (uint32_t*)regs->edx);
+    return vaddr ? vaddr : (uint32_t)-1;
+}
 
-            cur.waiting_for_msg = true;
-        }
+// Синхронный вызов: ebx - получатель, ECX/EDX/ESI/EDI - слова сообщения,
+// в них же приходит ответ. 0 или -1.
+static uint32_t sys_ipc_call(SyscallRegs* regs) {
+    if (!g_current_isr_regs) return (uint32_t)-1;
+    return (uint32_t)SyncIpc::call((int)regs->ebx, g_current_isr_regs);
+}
 
-        TaskScheduler::block_current(-1);
-    }
+// ebx - кому ответить (-1 - некому), ECX/EDX/ESI/EDI - ответ; возвращает
+// TID следующего вызвавшего, его слова - в ECX/EDX/ESI/EDI
+static uint32_t sys_ipc_reply_wait(SyscallRegs* regs) {
+    if (!g_current_isr_regs) return (uint32_t)-1;
+    return (uint32_t)SyncIpc::reply_wait((int)regs->ebx, g_current_isr_regs);
 }
 
 static uint32_t sys_find_thread(SyscallRegs* regs) {
@@ -493,9 +466,8 @@ static uint32_t sys_sbrk(SyscallRegs* regs) {
 
         for (uint32_t p = new_page_end; p < old_page_end; p += 4096) {
             uint32_t phys = VMM::get_physical(p);
-            if (phys) {
+            if (phys && VMM::unmap_page(p)) {
                 PhysicalMemoryManager::free_frame((void*)phys);
-                VMM::unmap_page(p);
             }
         }
     }
@@ -522,6 +494,7 @@ static int find_free_fd(Thread& cur) {
 static int map_flags(int api_mode) {
     if (api_mode == 1) return O_RDONLY;      // FMODE_READ
     if (api_mode == 2) return O_WRONLY | O_CREAT | O_TRUNC; // FMODE_WRITE
+    if (api_mode == 3) return O_WRONLY | O_CREAT | O_APPEND; // FMODE_APPEND
     return O_RDONLY;
 }
 
@@ -540,7 +513,7 @@ static uint32_t sys_fopen(SyscallRegs* regs) {
     
     vnode* vn = (vnode*)vn_ptr;
 
-    file* f = (file*)kmalloc(sizeof(file));
+    file* f = (file*)kmem_cache_alloc(file_cache);
     if (!f) {
         if (vn->ops && vn->ops->close) vn->ops->close(vn);
         return (uint32_t)-1;
@@ -550,6 +523,7 @@ static uint32_t sys_fopen(SyscallRegs* regs) {
     f->offset = 0;
     f->flags = (uint32_t)vfs_flags;
     f->refcount = 1;
+    f->ra = {};
     
     cur.fd_table[fd_idx] = f;
 
@@ -571,7 +545,10 @@ static uint32_t sys_fread(SyscallRegs* regs) {
     if ((f->flags & O_WRONLY) && !(f->flags & O_RDWR)) return 0;
 
     int read_bytes = -1;
-    if (f->vn->ops && f->vn->ops->read) {
+    if (f->vn->type == VnodeType::File && f->vn->ops && f->vn->ops->readpage) {
+        // Через кэш страниц с учётом последовательного доступа к файлу
+        read_bytes = PageCache::read(f->vn, f->offset, buffer, size, &f->ra);
+    } else if (f->vn->ops && f->vn->ops->read) {
         read_bytes = f->vn->ops->read(f->vn, f->offset, buffer, size);
     }
 
@@ -594,6 +571,8 @@ static uint32_t sys_fwrite(SyscallRegs* regs) {
     file* f = cur.fd_table[fd];
     if (!f || !f->vn) return 0;
 
+    if (f->flags & O_APPEND) f->offset = f->vn->size;
+
     int written = -1;
     if (f->vn->ops && f->vn->ops->write) {
         written = f->vn->ops->write(f->vn, f->offset, data, size);
@@ -636,6 +615,10 @@ static void fork_child_entry() {
 
     ForkChildState* r = &threads[current_tid].fork_state;
 
+    // В Ring 3 процессор уходит без BKL
+    asm volatile("cli");
+    Smp::leave_kernel();
+
     asm volatile(
         "cli\n\t"
         "mov $0x23, %%cx\n\t"
@@ -661,8 +644,8 @@ static void fork_child_entry() {
     );
 }
 
-static uint32_t sys_fork(SyscallRegs* regs) {
-    (void)regs;
+// share_space - vfork: потомок исполняется в каталоге и областях родителя
+static uint32_t fork_process(bool share_space) {
     InterruptGuard guard;
 
     if (!g_current_isr_regs) return (uint32_t)-1;
@@ -679,6 +662,16 @@ static uint32_t sys_fork(SyscallRegs* regs) {
     Thread& parent = threads[current_tid];
     Thread& child = threads[child_tid];
 
+    child.stack_base = (uint8_t*)PhysicalMemoryManager::alloc_frame();
+    if (!child.stack_base) return (uint32_t)-1;
+
+    // Регистры FPU/SSE наследуются вместе с целыми
+    if (!Fpu::fork_state(current_tid, child_tid)) {
+        PhysicalMemoryManager::free_frame(child.stack_base);
+        child.stack_base = nullptr;
+        return (uint32_t)-1;
+    }
+
     for (int j = 0; j < 32; j++) child.name[j] = parent.name[j];
 
     child.fork_state.eip = g_current_isr_regs->eip;
@@ -692,16 +685,31 @@ static uint32_t sys_fork(SyscallRegs* regs) {
     child.fork_state.ebp = g_current_isr_regs->ebp;
 
     child.tid = child_tid;
-    child.state = ThreadState::Ready;
     child.priority = parent.priority;
     child.sleep_until = 0;
     child.blocked_channel_id = -1;
-    child.quantum_remaining = 5;
-    child.total_ticks = 0;
-    child.msg_head = 0;
-    child.msg_tail = 0;
+    child.run_next = nullptr;
+    child.run_prev = nullptr;
+    child.on_run_queue = false;
+    child.wait_next = nullptr;
+    child.wait_queue = nullptr;
+    child.cpu = 0;
+    child.idle = false;
+    child.kill_pending = false;
+    child.cpu_ns = 0;
+    child.msg_head = nullptr;
+    child.msg_tail = nullptr;
     child.msg_count = 0;
+    child.grant_head = nullptr;
+    child.grant_tail = nullptr;
+    child.grant_count = 0;
     child.waiting_for_msg = false;
+    child.ipc_state = IPC_IDLE;
+    child.ipc_partner = -1;
+    child.ipc_result = 0;
+    child.ipc_frame = nullptr;
+    child.ipc_callers = nullptr;
+    child.ipc_next = nullptr;
     child.parent_tid = current_tid;
     child.exit_code = 0;
     child.heap_start = parent.heap_start;
@@ -709,22 +717,18 @@ static uint32_t sys_fork(SyscallRegs* regs) {
     child.heap_lock = false;
     child.is_driver = false;
     child.num_mmio_grants = 0;
-
-    child.vma_list = nullptr;
-    VMA* src_vma = parent.vma_list;
-    VMA** dst_ptr = &child.vma_list;
-    while (src_vma) {
-        VMA* copy = (VMA*)kmalloc(sizeof(VMA));
-        if (!copy) break;
-        copy->start = src_vma->start;
-        copy->end = src_vma->end;
-        copy->file_offset = src_vma->file_offset;
-        copy->file_size = src_vma->file_size;
-        copy->flags = src_vma->flags;
-        copy->next = nullptr;
-        *dst_ptr = copy;
-        dst_ptr = &copy->next;
-        src_vma = src_vma->next;
+    child.vfork_parent = -1;
+    child.vfork_child = -1;
+
+    // Копия дерева VMA: у файловых областей - свои ссылки на vnode.
+    // Потомку vfork сбои страниц разрешает дерево родителя.
+    child.vmas = {nullptr, 0};
+    if (!share_space && !vma_clone(child.vmas, parent.vmas)) {
+        Fpu::release(child_tid);
+        PhysicalMemoryManager::free_frame(child.stack_base);
+        child.stack_base = nullptr;
+        child.parent_tid = -1;
+        return (uint32_t)-1;
     }
     
     // Inherit file descriptors
@@ -740,7 +744,7 @@ static uint32_t sys_fork(SyscallRegs* regs) {
         }
     }
 
-    uint32_t* new_dir = VMM::clone_directory();
+    uint32_t* new_dir = share_space ? parent.page_directory_phys : VMM::clone_directory();
     if (!new_dir) {
         for (int f = 0; f < MAX_OPEN_FILES; f++) {
             if (child.fd_table[f]) {
@@ -748,10 +752,11 @@ static uint32_t sys_fork(SyscallRegs* regs) {
                 child.fd_table[f] = nullptr;
             }
         }
-        VMA* rv = child.vma_list;
-        while (rv) { VMA* rn = rv->next; kfree(rv); rv = rn; }
-        child.vma_list = nullptr;
-        child.state = ThreadState::Unused;
+        vma_clear(child.vmas);
+        Fpu::release(child_tid);
+        PhysicalMemoryManager::free_frame(child.stack_base);
+        child.stack_base = nullptr;
+        child.parent_tid = -1;
         return (uint32_t)-1;
     }
     child.page_directory_phys = new_dir;
@@ -769,9 +774,33 @@ static uint32_t sys_fork(SyscallRegs* regs) {
     child.esp = (uint32_t)stack_top;
 
     thread_count++;
+    if (!share_space) {
+        // Потомок первым: если он сразу вызовет exec или exit, родитель
+        // заберёт общие таблицы страниц обратно без копирования
+        TaskScheduler::yield_to(child_tid);
+        return (uint32_t)child_tid;
+    }
+
+    // Процессор сразу потомку; родитель ждёт его exec или завершения
+    child.vfork_parent = current_tid;
+    parent.vfork_child = child_tid;
+    parent.state = ThreadState::Blocked;
+    parent.blocked_channel_id = -1;
+    TaskScheduler::handoff(child_tid);
+    while (parent.vfork_child == child_tid) TaskScheduler::block_current(-1);
     return (uint32_t)child_tid;
 }
 
+static uint32_t sys_fork(SyscallRegs* regs) {
+    (void)regs;
+    return fork_process(false);
+}
+
+static uint32_t sys_vfork(SyscallRegs* regs) {
+    (void)regs;
+    return fork_process(true);
+}
+
 static uint32_t sys_exec(SyscallRegs* regs) {
     const char* filename = (const char*)regs->ebx;
     char* const* argv = (char* const*)regs->ecx;
@@ -850,24 +879,16 @@ static uint32_t sys_exec(SyscallRegs* regs) {
         uint32_t offset = 0;
         if (argv) {
             for (int i = 0; i < argc; i++) {
-                const char* arg = argv[i];
-                int len = 0;
-                while (arg[len]) {
-                    string_buf[offset++] = arg[len];
-                    len++;
-                }
-                string_buf[offset++] = '\0';
+                uint32_t len = strlen(argv[i]) + 1;
+                memcpy(string_buf + offset, argv[i], len);
+                offset += len;
             }
         }
         if (envp) {
             for (int i = 0; i < envc; i++) {
-                const char* env = envp[i];
-                int len = 0;
-                while (env[len]) {
-                    string_buf[offset++] = env[len];
-                    len++;
-                }
-                string_buf[offset++] = '\0';
+                uint32_t len = strlen(envp[i]) + 1;
+                memcpy(string_buf + offset, envp[i], len);
+                offset += len;
             }
         }
     }
@@ -880,17 +901,14 @@ static uint32_t sys_exec(SyscallRegs* regs) {
         }
     }
 
+    // Строки уже в ядре: адресное пространство родителя vfork больше не нужно
+    thread_vfork_done(current_tid);
     if (cur.page_directory_phys != (uint32_t*)VMM::kernel_directory_phys_) {
         VMM::destroy_address_space(cur.page_directory_phys);
     }
+    Fpu::release(current_tid);
 
-    VMA* v = cur.vma_list;
-    while (v) {
-        VMA* next = v->next;
-        kfree(v);
-        v = next;
-    }
-    cur.vma_list = nullptr;
+    vma_clear(cur.vmas);
 
     uint32_t* new_dir = VMM::create_address_space();
     if (!new_dir) {
@@ -914,16 +932,16 @@ static uint32_t sys_exec(SyscallRegs* regs) {
         uint32_t flags = PAGE_PRESENT | PAGE_USER;
         if (phdrs[i].p_flags & PF_W) flags |= PAGE_WRITABLE;
 
-        VMA* new_vma = (VMA*)kmalloc(sizeof(VMA));
+        // Без vnode: страницы дочитываются по имени потока (VMM::handle_page_fault)
+        VMA* new_vma = vma_alloc(vaddr_start, vaddr_end, flags, VMA_TYPE_ANON);
         if (!new_vma) break;
-        new_vma->start = vaddr_start;
-        new_vma->end = vaddr_end;
         uint32_t align_diff = phdrs[i].p_vaddr - vaddr_start;
         new_vma->file_offset = phdrs[i].p_offset - align_diff;
         new_vma->file_size = phdrs[i].p_filesz + align_diff;
-        new_vma->flags = flags;
-        new_vma->next = cur.vma_list;
-        cur.vma_list = new_vma;
+        if (!vma_insert(cur.vmas, new_vma)) {
+            vma_free(new_vma);
+            break;
+        }
     }
 
     uint32_t entry = ehdr->e_entry;
@@ -936,12 +954,10 @@ static uint32_t sys_exec(SyscallRegs* regs) {
     cur.heap_lock = false;
 
     for (uint32_t p = 0; p < USER_STACK_PAGES; p++) {
-        void* frame = PhysicalMemoryManager::alloc_frame();
+        void* frame = ZeroPool::alloc_frame();
         if (!frame) return (uint32_t)-1; // TODO: handle rollback correctly
         uint32_t vaddr = USER_STACK_TOP - (USER_STACK_PAGES - p) * 4096;
         VMM::map_page(vaddr, (uint32_t)frame, PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER);
-        uint8_t* pp = (uint8_t*)vaddr;
-        for (int b = 0; b < 4096; b++) pp[b] = 0;
     }
 
     uint32_t user_esp = USER_STACK_TOP;
@@ -959,9 +975,7 @@ static uint32_t sys_exec(SyscallRegs* regs) {
         user_esp &= ~3; // Выравнивание по 4 байта
 
         uint8_t* stack_strings = (uint8_t*)user_esp;
-        for (uint32_t k = 0; k < total_string_size; k++) {
-            stack_strings[k] = string_buf[k];
-        }
+        memcpy(stack_strings, string_buf, total_string_size);
 
         kfree(string_buf);
         
@@ -1008,6 +1022,10 @@ static uint32_t sys_exec(SyscallRegs* regs) {
     asm volatile("pushf; pop %0" : "=r"(eflags));
     eflags |= 0x200;
 
+    // В Ring 3 процессор уходит без BKL
+    asm volatile("cli");
+    Smp::leave_kernel();
+
     asm volatile(
         "cli\n\t"
         "mov $0x23, %%ax\n\t"
@@ -1042,8 +1060,7 @@ static uint32_t sys_wait(SyscallRegs* regs) {
                     if (threads[i].state == ThreadState::Zombie) {
                         int child_tid = i;
                         if (status_ptr) *status_ptr = threads[i].exit_code;
-                        threads[i].state = ThreadState::Unused;
-                        thread_count--;
+                        thread_release(i);
                         return (uint32_t)child_tid;
                     }
                 }
@@ -1091,6 +1108,13 @@ static uint32_t sys_set_driver(SyscallRegs* regs) {
     return 0;
 }
 
+// Записать отложенные метаданные всех ФС (FAT) на диск
+static uint32_t sys_sync(SyscallRegs* regs) {
+    (void)regs;
+    vfs_sync();
+    return 0;
+}
+
 typedef uint32_t (*SyscallHandler)(SyscallRegs*);
 
 static SyscallHandler syscall_table[] = {
@@ -1133,6 +1157,16 @@ static SyscallHandler syscall_table[] = {
     sys_wait,        // 36
     sys_grant_mmio,  // 37
     sys_set_driver,  // 38
+    sys_sync,        // 39
+    sys_usleep,      // 40
+    sys_clock_ns,    // 41
+    sys_cpu_count,   // 42
+    sys_send_grant,  // 43
+    sys_recv_grant,  // 44
+    sys_ipc_call,    // 45
+    sys_ipc_reply_wait, // 46
+    sys_mprotect,    // 47
+    sys_vfork,       // 48
 };
 
 #define SYSCALL_COUNT (sizeof(syscall_table) / sizeof(syscall_table[0]))
@@ -3,130 +3,288 @@
 #include "kernel/spinlock.h"
 #include "kernel/tss.h"
 #include "kernel/vmm.h"
+#include "kernel/fpu.h"
 #include "libc.h"
 
 namespace re36 {
 
 bool TaskScheduler::scheduling_enabled_ = false;
+RunQueue TaskScheduler::queues_[MAX_CPUS];
+Thread* TaskScheduler::sleep_head_ = nullptr;
+Thread* TaskScheduler::reap_head_ = nullptr;
+int TaskScheduler::reaper_tid_ = -1;
+SchedStats TaskScheduler::stats_ = {0, 0, 0, 0};
 
 #define AGING_INTERVAL 50
 #define AGING_BOOST 1
 
+#define REAPER_PRIORITY 100
+
 void TaskScheduler::init() {
     thread_init();
     scheduling_enabled_ = true;
 }
 
-int TaskScheduler::pick_next_thread() {
-    int best_tid = 0;
-    uint8_t best_priority = 255;
+// ================= Очереди готовых =================
 
-    uint32_t now = Timer::get_ticks();
+void TaskScheduler::enqueue(Thread& t) {
+    // Поток простоя не стоит в очереди: его берут, когда она пуста
+    if (t.on_run_queue || t.idle) return;
+    RunQueue& rq = queues_[t.cpu];
+    bool was_empty = rq.nr_ready == 0;
+    uint8_t p = t.priority;
+    t.run_next = nullptr;
+    t.run_prev = rq.tail[p];
+    if (rq.tail[p]) rq.tail[p]->run_next = &t;
+    else rq.head[p] = &t;
+    rq.tail[p] = &t;
+    rq.bitmap[p >> 5] |= 1u << (p & 31);
+    rq.nr_ready++;
+    t.on_run_queue = true;
 
-    for (int i = 0; i < MAX_THREADS; i++) {
-        if (threads[i].state == ThreadState::Terminated && i != current_tid) {
-            thread_cleanup(i);
+    Thread& running = threads[cpus[t.cpu].running_tid];
+    if (t.cpu != cpu_current()->index) {
+        // Чужой процессор может спать в hlt без запрограммированного таймера
+        if (was_empty || running.idle || t.priority < running.priority) {
+            Smp::send_resched(t.cpu);
         }
-        
-        if (threads[i].state == ThreadState::Sleeping) {
-            if (now >= threads[i].sleep_until) {
-                threads[i].state = ThreadState::Ready;
-                threads[i].blocked_channel_id = -1;
-            }
+    } else if (was_empty) {
+        // Появилось, на кого переключаться: нужен конец кванта текущего
+        rearm();
+    }
+    if (!running.idle) kick_idle(t.cpu);
+}
+
+void TaskScheduler::dequeue(Thread& t) {
+    if (!t.on_run_queue) return;
+    RunQueue& rq = queues_[t.cpu];
+    uint8_t p = t.priority;
+    if (t.run_prev) t.run_prev->run_next = t.run_next;
+    else rq.head[p] = t.run_next;
+    if (t.run_next) t.run_next->run_prev = t.run_prev;
+    else rq.tail[p] = t.run_prev;
+    if (!rq.head[p]) rq.bitmap[p >> 5] &= ~(1u << (p & 31));
+    rq.nr_ready--;
+    t.run_next = nullptr;
+    t.run_prev = nullptr;
+    t.on_run_queue = false;
+}
+
+// Наивысший (с наименьшим номером) непустой уровень, -1 - готовых нет
+int TaskScheduler::highest_ready(const RunQueue& rq) {
+    for (int w = 0; w < SCHED_BITMAP_WORDS; w++) {
+        if (rq.bitmap[w]) return w * 32 + __builtin_ctz(rq.bitmap[w]);
+    }
+    return -1;
+}
+
+// Work stealing: лучший поток из самой длинной чужой очереди переходит
+// на процессор cpu
+Thread* TaskScheduler::steal(int cpu) {
+    int victim = -1;
+    uint32_t most = 0;
+    for (int i = 0; i < Smp::cpu_count(); i++) {
+        if (i == cpu || !cpus[i].online) continue;
+        if (queues_[i].nr_ready > most) {
+            most = queues_[i].nr_ready;
+            victim = i;
         }
     }
+    if (victim < 0) return nullptr;
 
-    for (int i = 0; i < MAX_THREADS; i++) {
-        if (i == current_tid) continue;
-        if (threads[i].state == ThreadState::Ready) {
-            if (threads[i].priority < best_priority) {
-                best_priority = threads[i].priority;
-                best_tid = i;
-            }
+    RunQueue& rq = queues_[victim];
+    Thread* t = rq.head[highest_ready(rq)];
+    dequeue(*t);
+    t->cpu = (uint8_t)cpu;
+    cpus[cpu].steals++;
+    return t;
+}
+
+// Процессор с наименьшей нагрузкой: готовые плюс исполняемый не-idle
+int TaskScheduler::select_cpu() {
+    int best = cpu_current()->index;
+    uint32_t best_load = 0xFFFFFFFF;
+    for (int i = 0; i < Smp::cpu_count(); i++) {
+        if (!cpus[i].online) continue;
+        uint32_t load = queues_[i].nr_ready + (threads[cpus[i].running_tid].idle ? 0 : 1);
+        if (load < best_load) {
+            best_load = load;
+            best = i;
         }
     }
+    return best;
+}
+
+void TaskScheduler::kick_idle(int busy_cpu) {
+    int me = cpu_current()->index;
+    for (int i = 0; i < Smp::cpu_count(); i++) {
+        if (i == busy_cpu || i == me || !cpus[i].online) continue;
+        if (threads[cpus[i].running_tid].idle && queues_[i].nr_ready == 0) {
+            Smp::send_resched(i);
+            return;
+        }
+    }
+}
+
+int TaskScheduler::pick_next_thread() {
+    CpuInfo* cpu = cpu_current();
+    RunQueue& rq = queues_[cpu->index];
+    int p = highest_ready(rq);
+    if (p < 0) {
+        Thread* stolen = steal(cpu->index);
+        if (stolen) return stolen->tid;
+        if (threads[current_tid].state == ThreadState::Running) return current_tid;
+        return cpu->idle_tid;
+    }
+    Thread* t = rq.head[p];
+    dequeue(*t);
+    return t->tid;
+}
+
+void TaskScheduler::switch_to(int next_tid, uint64_t quantum_end) {
+    CpuInfo* cpu = cpu_current();
+    uint64_t now = Timer::now_ns();
+    Thread& next = threads[next_tid];
+    next.state = ThreadState::Running;
+    next.cpu = cpu->index;
+    cpu->quantum_end_ns = quantum_end ? quantum_end : now + QUANTUM_NS;
+    if (next_tid == cpu->running_tid) {
+        rearm();
+        return;
+    }
+
+    int old_tid = cpu->running_tid;
+    threads[old_tid].cpu_ns += now - cpu->slice_start_ns;
+    cpu->slice_start_ns = now;
+    cpu->running_tid = next_tid;
+    cpu->switches++;
+    stats_.switches++;
+    rearm();
+
+    if (next.page_directory_phys != threads[old_tid].page_directory_phys) {
+        VMM::switch_address_space(next.page_directory_phys);
+    }
+
+    TSS::set_kernel_stack((uint32_t)(next.stack_base + THREAD_STACK_SIZE));
+    Fpu::switch_to(old_tid, next_tid);
+    switch_task(&threads[old_tid].esp, next.esp);
+}
+
+void TaskScheduler::handoff(int next_tid) {
+    InterruptGuard guard;
+    stats_.handoffs++;
+    switch_to(next_tid, cpu_current()->quantum_end_ns);
+}
+
+void TaskScheduler::yield_to(int next_tid) {
+    InterruptGuard guard;
+    Thread& cur = threads[current_tid];
+    cur.state = ThreadState::Ready;
+    enqueue(cur);
+    switch_to(next_tid);
+}
+
+void TaskScheduler::rearm() {
+    if (!Timer::is_tickless()) return;
+
+    CpuInfo* cpu = cpu_current();
+    uint64_t next = 0;
+    if (queues_[cpu->index].nr_ready) next = cpu->quantum_end_ns ? cpu->quantum_end_ns : 1;
+    // Спящих будит таймер BSP: иначе каждое пробуждение будило бы все
+    // процессоры
+    if (cpu->index == 0 && sleep_head_ && (next == 0 || sleep_head_->sleep_until < next)) {
+        next = sleep_head_->sleep_until;
+    }
+    // Ни готовых, ни спящих: процессор спит в idle до внешнего прерывания
+    // или IPI
+    Timer::set_next_event(next);
+}
+
+// ================= Спящие =================
 
-    if (best_tid == 0 && threads[current_tid].state == ThreadState::Running) {
-        return current_tid;
+void TaskScheduler::sleep_insert(Thread& t) {
+    Thread** pp = &sleep_head_;
+    while (*pp && (*pp)->sleep_until <= t.sleep_until) pp = &(*pp)->run_next;
+    t.run_next = *pp;
+    *pp = &t;
+    if (sleep_head_ == &t) {
+        if (cpu_current()->index == 0) rearm();
+        else Smp::send_resched(0);
     }
+}
 
-    return best_tid;
+void TaskScheduler::sleep_remove(Thread& t) {
+    Thread** pp = &sleep_head_;
+    while (*pp && *pp != &t) pp = &(*pp)->run_next;
+    if (*pp) *pp = t.run_next;
+    t.run_next = nullptr;
 }
 
+// Список отсортирован: на тике без пробуждений проверяется только голова
+void TaskScheduler::wake_sleepers(uint64_t now) {
+    while (sleep_head_ && now >= sleep_head_->sleep_until) {
+        Thread* t = sleep_head_;
+        sleep_head_ = t->run_next;
+        t->run_next = nullptr;
+        t->state = ThreadState::Ready;
+        t->blocked_channel_id = -1;
+        stats_.wakeups++;
+        enqueue(*t);
+    }
+}
+
+// ================= Планирование =================
+
 void TaskScheduler::schedule() {
     if (!scheduling_enabled_) return;
 
     InterruptGuard guard;
 
-    static uint32_t aging_counter = 0;
-    aging_counter++;
-    if (aging_counter >= AGING_INTERVAL) {
-        aging_counter = 0;
-        for (int i = 1; i < MAX_THREADS; i++) {
-            if (threads[i].state == ThreadState::Ready && threads[i].priority > 1) {
-                threads[i].priority -= AGING_BOOST;
-            }
-        }
-    }
+    CpuInfo* cpu = cpu_current();
+    uint64_t now = Timer::now_ns();
+    wake_sleepers(now);
 
     Thread& cur = threads[current_tid];
-    
-    if (cur.state == ThreadState::Running) {
-        cur.quantum_remaining--;
-        cur.total_ticks++;
-        
-        if (cur.quantum_remaining > 0) {
-            return;
-        }
-        
-        cur.state = ThreadState::Ready;
-        cur.quantum_remaining = DEFAULT_QUANTUM;
-    }
 
-    int next_tid = pick_next_thread();
-    
-    if (next_tid == current_tid && cur.state == ThreadState::Ready) {
-        cur.state = ThreadState::Running;
-        cur.quantum_remaining = DEFAULT_QUANTUM;
+    // Поток завершили с другого процессора, пока он здесь исполнялся
+    if (cur.kill_pending) {
+        terminate(current_tid);
         return;
     }
-    
-    if (next_tid == current_tid) return;
 
-    int old_tid = current_tid;
-    current_tid = next_tid;
-    
-    threads[next_tid].state = ThreadState::Running;
-    threads[next_tid].quantum_remaining = DEFAULT_QUANTUM;
+    if (cur.state == ThreadState::Running) {
+        // Простой и поток выше по приоритету не ждут конца кванта
+        int p = highest_ready(queues_[cpu->index]);
+        bool better = p >= 0 && p < cur.priority;
+        if (!better && !cur.idle && now < cpu->quantum_end_ns) {
+            rearm();
+            return;
+        }
 
-    if (threads[next_tid].page_directory_phys != threads[old_tid].page_directory_phys) {
-        VMM::switch_address_space(threads[next_tid].page_directory_phys);
+        // Квант истёк: лучший из остальных готовых, даже если он ниже
+        // по приоритету, текущий - в хвост своей очереди
+        int next_tid = pick_next_thread();
+        if (next_tid == current_tid) {
+            cpu->quantum_end_ns = now + QUANTUM_NS;
+            rearm();
+            return;
+        }
+        cur.state = ThreadState::Ready;
+        enqueue(cur);
+        switch_to(next_tid);
+        return;
     }
 
-    TSS::set_kernel_stack((uint32_t)(threads[next_tid].stack_base + THREAD_STACK_SIZE));
-
-    switch_task(&threads[old_tid].esp, threads[next_tid].esp);
+    switch_to(pick_next_thread());
 }
 
 void TaskScheduler::block_current(int channel_id) {
     InterruptGuard guard;
     threads[current_tid].state = ThreadState::Blocked;
     threads[current_tid].blocked_channel_id = channel_id;
-    
-    int next_tid = pick_next_thread();
-    if (next_tid != current_tid) {
-        int old_tid = current_tid;
-        current_tid = next_tid;
-        threads[next_tid].state = ThreadState::Running;
-        threads[next_tid].quantum_remaining = DEFAULT_QUANTUM;
-        
-        if (threads[next_tid].page_directory_phys != threads[old_tid].page_directory_phys) {
-            VMM::switch_address_space(threads[next_tid].page_directory_phys);
-        }
 
-        TSS::set_kernel_stack((uint32_t)(threads[next_tid].stack_base + THREAD_STACK_SIZE));
-        switch_task(&threads[old_tid].esp, threads[next_tid].esp);
-    }
+    int next_tid = pick_next_thread();
+    if (next_tid != current_tid) switch_to(next_tid);
 }
 
 void TaskScheduler::unblock(int tid) {
@@ -135,50 +293,214 @@ void TaskScheduler::unblock(int tid) {
     if (threads[tid].state == ThreadState::Blocked) {
         threads[tid].state = ThreadState::Ready;
         threads[tid].blocked_channel_id = -1;
+        enqueue(threads[tid]);
     }
 }
 
+void TaskScheduler::make_ready(int tid) {
+    InterruptGuard guard;
+    threads[tid].state = ThreadState::Ready;
+    threads[tid].cpu = (uint8_t)select_cpu();
+    enqueue(threads[tid]);
+}
+
+void TaskScheduler::preempt() {
+    if (!scheduling_enabled_) return;
+
+    InterruptGuard guard;
+    Thread& cur = threads[current_tid];
+    if (cur.state != ThreadState::Running) return;
+
+    int p = highest_ready(queues_[cpu_current()->index]);
+    if (p < 0 || p >= cur.priority) return;
+
+    int next_tid = pick_next_thread();
+    cur.state = ThreadState::Ready;
+    enqueue(cur);
+    switch_to(next_tid);
+}
+
+void TaskScheduler::yield() {
+    if (!scheduling_enabled_) return;
+
+    InterruptGuard guard;
+    Thread& cur = threads[current_tid];
+    if (cur.state != ThreadState::Running) return;
+
+    int p = highest_ready(queues_[cpu_current()->index]);
+    if (p < 0 || p > cur.priority) return;
+
+    int next_tid = pick_next_thread();
+    cur.state = ThreadState::Ready;
+    enqueue(cur);
+    switch_to(next_tid);
+}
+
 void TaskScheduler::sleep_current(uint32_t ms) {
+    sleep_ns((uint64_t)ms * 1000000);
+}
+
+void TaskScheduler::sleep_ns(uint64_t ns) {
     InterruptGuard guard;
-    uint32_t ticks_to_sleep = (ms * 100) / 1000;
-    if (ticks_to_sleep == 0) ticks_to_sleep = 1;
-    
-    threads[current_tid].state = ThreadState::Sleeping;
-    threads[current_tid].sleep_until = Timer::get_ticks() + ticks_to_sleep;
-    
+
+    Thread& cur = threads[current_tid];
+    cur.state = ThreadState::Sleeping;
+    cur.sleep_until = Timer::now_ns() + ns;
+    sleep_insert(cur);
+
     int next_tid = pick_next_thread();
-    if (next_tid != current_tid) {
-        int old_tid = current_tid;
-        current_tid = next_tid;
-        threads[next_tid].state = ThreadState::Running;
-        threads[next_tid].quantum_remaining = DEFAULT_QUANTUM;
-        
-        if (threads[next_tid].page_directory_phys != threads[old_tid].page_directory_phys) {
-            VMM::switch_address_space(threads[next_tid].page_directory_phys);
+    if (next_tid != current_tid) switch_to(next_tid);
+}
+
+// ================= Завершение и уборка =================
+
+void TaskScheduler::terminate_current() {
+    terminate(current_tid);
+}
+
+void TaskScheduler::terminate(int tid) {
+    // Загрузочный поток - запасной для pick_next_thread, reaper убирает остальных
+    if (tid <= 0 || tid >= MAX_THREADS || tid == reaper_tid_) return;
+
+    InterruptGuard guard;
+    Thread& t = threads[tid];
+    if (t.idle) return;
+
+    switch (t.state) {
+    case ThreadState::Unused:
+    case ThreadState::Terminated:
+    case ThreadState::Zombie:
+        return;
+    case ThreadState::Running:
+        if (tid != current_tid) {
+            // Исполняется на другом процессоре: стек из-под него не
+            // убрать, он завершится сам в schedule() по IPI
+            t.kill_pending = true;
+            Smp::send_resched(t.cpu);
+            return;
+        }
+        break;
+    case ThreadState::Ready:
+        dequeue(t);
+        break;
+    case ThreadState::Sleeping:
+        sleep_remove(t);
+        break;
+    case ThreadState::Blocked:
+        if (t.wait_queue) {
+            Thread** pp = &t.wait_queue->head;
+            while (*pp && *pp != &t) pp = &(*pp)->wait_next;
+            if (*pp) *pp = t.wait_next;
+            t.wait_next = nullptr;
+            t.wait_queue = nullptr;
         }
+        break;
+    default:
+        break;
+    }
 
-        TSS::set_kernel_stack((uint32_t)(threads[next_tid].stack_base + THREAD_STACK_SIZE));
-        switch_task(&threads[old_tid].esp, threads[next_tid].esp);
+    t.state = ThreadState::Terminated;
+    t.kill_pending = false;
+    t.run_next = reap_head_;
+    reap_head_ = &t;
+
+    if (reaper_tid_ >= 0) {
+        Thread& r = threads[reaper_tid_];
+        if (r.state == ThreadState::Sleeping) {
+            sleep_remove(r);
+            make_ready(reaper_tid_);
+        }
     }
+
+    if (tid == current_tid) switch_to(pick_next_thread());
 }
 
-void TaskScheduler::terminate_current() {
-    InterruptGuard guard;
-    threads[current_tid].state = ThreadState::Terminated;
-    
-    int next_tid = pick_next_thread();
-    if (next_tid != current_tid) {
-        int old_tid = current_tid;
-        current_tid = next_tid;
-        threads[next_tid].state = ThreadState::Running;
-        threads[next_tid].quantum_remaining = DEFAULT_QUANTUM;
-        
-        if (threads[next_tid].page_directory_phys != threads[old_tid].page_directory_phys) {
-            VMM::switch_address_space(threads[next_tid].page_directory_phys);
+// Приоритет готовых потоков растёт, пока они ждут (против голодания)
+void TaskScheduler::age_ready() {
+    for (int i = 1; i < MAX_THREADS; i++) {
+        Thread& t = threads[i];
+        if (t.state == ThreadState::Ready && t.on_run_queue && t.priority > 1) {
+            dequeue(t);
+            t.priority -= AGING_BOOST;
+            enqueue(t);
         }
+    }
+}
+
+void TaskScheduler::reaper_thread() {
+    uint32_t last_aging = Timer::get_ticks();
+    while (true) {
+        Thread* list;
+        {
+            InterruptGuard guard;
+            uint32_t now = Timer::get_ticks();
+            if (now - last_aging >= AGING_INTERVAL) {
+                last_aging = now;
+                age_ready();
+            }
+            list = reap_head_;
+            reap_head_ = nullptr;
+        }
+
+        while (list) {
+            Thread* next = list->run_next;
+            list->run_next = nullptr;
+            thread_cleanup(list->tid);
+            stats_.reaped++;
+            list = next;
+        }
+
+        InterruptGuard guard;
+        if (!reap_head_) sleep_current(AGING_INTERVAL * 10);
+    }
+}
+
+void TaskScheduler::start_reaper() {
+    reaper_tid_ = thread_create("reaper", reaper_thread, REAPER_PRIORITY);
+}
 
-        TSS::set_kernel_stack((uint32_t)(threads[next_tid].stack_base + THREAD_STACK_SIZE));
-        switch_task(&threads[old_tid].esp, threads[next_tid].esp);
+int TaskScheduler::create_idle(int cpu) {
+    InterruptGuard guard;
+    char name[8] = {'i', 'd', 'l', 'e', 0, 0, 0, 0};
+    if (cpu > 0) name[4] = (char)('0' + cpu);
+
+    int tid = thread_alloc(name, idle_loop, 255);
+    if (tid < 0) return -1;
+    Thread& t = threads[tid];
+    t.idle = true;
+    t.cpu = (uint8_t)cpu;
+    t.state = ThreadState::Ready;
+    cpus[cpu].idle_tid = tid;
+    return tid;
+}
+
+void TaskScheduler::idle_loop() {
+    while (true) Smp::halt();
+}
+
+// ================= Очереди ожидания =================
+
+void TaskScheduler::wait_on(WaitQueue* wq, int channel_id) {
+    InterruptGuard guard;
+    Thread& cur = threads[current_tid];
+    if (!cur.wait_queue) {
+        cur.wait_next = wq->head;
+        wq->head = &cur;
+        cur.wait_queue = wq;
+    }
+    block_current(channel_id);
+}
+
+void TaskScheduler::wake_all(WaitQueue* wq) {
+    InterruptGuard guard;
+    Thread* t = wq->head;
+    wq->head = nullptr;
+    while (t) {
+        Thread* next = t->wait_next;
+        t->wait_next = nullptr;
+        t->wait_queue = nullptr;
+        unblock(t->tid);
+        t = next;
     }
 }
 
@@ -186,27 +508,112 @@ int TaskScheduler::get_current_tid() {
     return current_tid;
 }
 
+bool TaskScheduler::can_block() {
+    return current_tid != 0;
+}
+
+SchedStats TaskScheduler::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
 void TaskScheduler::print_threads() {
     InterruptGuard guard;
-    
+
     const char* state_names[] = {
-        "Unused", "Ready", "Running", "Blocked", "Sleeping", "Dead"
+        "Unused", "Ready", "Running", "Blocked", "Sleeping", "Dead", "Zombie"
     };
-    
-    printf("\n TID | Name              | State    | Pri | Ticks\n");
-    printf("-----+-------------------+----------+-----+------\n");
-    
+
+    printf("\n TID | Name              | State    | Pri | CPU | CPU ms\n");
+    printf("-----+-------------------+----------+-----+-----+------\n");
+
     for (int i = 0; i < MAX_THREADS; i++) {
         if (threads[i].state == ThreadState::Unused) continue;
-        
-        printf(" %d   | %s\t\t| %s\t| %d\t| %d\n",
+
+        printf(" %d   | %s\t\t| %s\t| %d\t| %d   | %d\n",
             threads[i].tid,
             threads[i].name,
             state_names[(int)threads[i].state],
             threads[i].priority,
-            threads[i].total_ticks);
+            threads[i].cpu,
+            Timer::ns_to_ticks(threads[i].cpu_ns) * 10);
     }
     printf("\n");
 }
 
+// ================= Бенчмарк =================
+
+#define BENCH_ROUNDS     2000   // yield() на каждый из двух потоков
+#define BENCH_PRIORITY   2
+#define BENCH_FILLER_MIN 100    // Фоновые потоки - на уровнях 100..249
+
+static volatile uint32_t bench_rounds_left;
+static volatile int bench_finished;
+static volatile uint64_t bench_end_tsc;
+static int bench_waiter;
+static int bench_fillers[MAX_THREADS];
+
+static void bench_pingpong() {
+    while (bench_rounds_left > 0) {
+        bench_rounds_left--;
+        TaskScheduler::yield();
+    }
+    InterruptGuard guard;
+    if (++bench_finished == 2) {
+        bench_end_tsc = Timer::read_tsc();
+        TaskScheduler::unblock(bench_waiter);
+    }
+}
+
+static void bench_filler() {
+    while (true) Smp::halt();
+}
+
+void TaskScheduler::bench() {
+    static const int totals[] = {8, 64, 256};
+
+    uint32_t cycles_per_us = Timer::get_tsc_khz() / 1000;
+    if (cycles_per_us == 0) cycles_per_us = 1;
+
+    printf("Context switch latency (%d yields between 2 threads, pri %d):\n",
+           BENCH_ROUNDS * 2, BENCH_PRIORITY);
+
+    for (int n = 0; n < 3; n++) {
+        int filler_count = 0;
+        int want = totals[n] - thread_count - 2;
+        for (int i = 0; i < want; i++) {
+            uint8_t pri = (uint8_t)(BENCH_FILLER_MIN + i % 150);
+            int tid = thread_create("filler", bench_filler, pri);
+            if (tid < 0) break;
+            bench_fillers[filler_count++] = tid;
+        }
+
+        uint32_t switches0;
+        uint64_t t0;
+        int total;
+        {
+            InterruptGuard guard;
+            bench_rounds_left = BENCH_ROUNDS * 2;
+            bench_finished = 0;
+            bench_waiter = current_tid;
+            total = thread_count + 2;
+            switches0 = stats_.switches;
+            t0 = Timer::read_tsc();
+            thread_create("pingA", bench_pingpong, BENCH_PRIORITY);
+            thread_create("pingB", bench_pingpong, BENCH_PRIORITY);
+            while (bench_finished < 2) block_current(-1);
+        }
+
+        uint32_t switches = stats_.switches - switches0;
+        uint32_t cycles = (uint32_t)(bench_end_tsc - t0);
+        uint32_t per_switch = switches ? cycles / switches : 0;
+        printf("  %d threads: %d switches, %d cycles/switch (%d ns)\n",
+               total, switches, per_switch, per_switch * 1000 / cycles_per_us);
+
+        for (int i = 0; i < filler_count; i++) terminate(bench_fillers[i]);
+        // Дать reaper убрать потоки до следующего прогона
+        sleep_current(20);
+    }
+}
+
 } // namespace re36
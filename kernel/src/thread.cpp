@@ -3,43 +3,73 @@
 #include "kernel/vmm.h"
 #include "kernel/task_scheduler.h"
 #include "kernel/kmalloc.h"
+#include "kernel/pmm.h"
+#include "kernel/mailbox.h"
+#include "kernel/sync_ipc.h"
 #include "libc.h"
 
 namespace re36 {
 
-Thread threads[MAX_THREADS];
-int current_tid = 0;
+Thread* threads = nullptr;
 int thread_count = 0;
 
-static uint8_t thread_stacks[MAX_THREADS][THREAD_STACK_SIZE] __attribute__((aligned(16)));
+KmemCache* vma_cache = nullptr;
+KmemCache* ipc_msg_cache = nullptr;
+KmemCache* ipc_grant_cache = nullptr;
+KmemCache* fpu_cache = nullptr;
+
+#define THREAD_TABLE_FRAMES ((MAX_THREADS * sizeof(Thread) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE)
+#define THREAD_STACK_FRAMES ((THREAD_STACK_SIZE + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE)
+
+// Стеки ядра выделяются вместе со слотом: статический массив на
+// MAX_THREADS потоков не поместился бы в образ ядра
+static uint8_t* alloc_stack() {
+    return (uint8_t*)PhysicalMemoryManager::alloc_blocks(THREAD_STACK_FRAMES);
+}
 
 static void thread_exit_wrapper() {
     printf("\n[Thread %d terminated]\n", current_tid);
-    threads[current_tid].state = ThreadState::Terminated;
-    thread_yield();
+    TaskScheduler::terminate_current();
     while (true) asm volatile("hlt");
 }
 
 void thread_init() {
+    vma_cache = kmem_cache_create("vma", sizeof(VMA));
+    ipc_msg_cache = kmem_cache_create("ipc_msg", sizeof(IpcMessage));
+    ipc_grant_cache = kmem_cache_create("ipc_grant", sizeof(IpcGrant));
+    // Объекты слаба выровнены на 16 байт, как требует FXSAVE
+    fpu_cache = kmem_cache_create("fpu", FPU_STATE_SIZE);
+
+    threads = (Thread*)PhysicalMemoryManager::alloc_blocks(THREAD_TABLE_FRAMES);
+    if (!threads) {
+        printf("[THREAD] No memory for thread table\n");
+        while (true) asm volatile("cli; hlt");
+    }
+    memset(threads, 0, THREAD_TABLE_FRAMES * PMM_FRAME_SIZE);
+
     for (int i = 0; i < MAX_THREADS; i++) {
         threads[i].tid = i;
         threads[i].state = ThreadState::Unused;
         threads[i].priority = 255;
         threads[i].esp = 0;
-        threads[i].stack_base = thread_stacks[i];
+        threads[i].stack_base = nullptr;
         threads[i].sleep_until = 0;
         threads[i].blocked_channel_id = -1;
-        threads[i].quantum_remaining = 5;
-        threads[i].total_ticks = 0;
+        threads[i].cpu_ns = 0;
         threads[i].name[0] = '\0';
         threads[i].name[0] = '\0';
         threads[i].page_directory_phys = (uint32_t*)0; // Инициализируется ниже
-        threads[i].vma_list = nullptr;
+        threads[i].vmas = {nullptr, 0};
+        threads[i].vfork_parent = -1;
+        threads[i].vfork_child = -1;
         for (int f = 0; f < MAX_OPEN_FILES; f++) threads[i].fd_table[f] = nullptr;
         threads[i].is_driver = false;
         threads[i].num_mmio_grants = 0;
+        threads[i].fpu = nullptr;
+        threads[i].fpu_cpu = FPU_NO_CPU;
     }
 
+    threads[0].stack_base = alloc_stack();
     threads[0].state = ThreadState::Running;
     threads[0].priority = 128;
     threads[0].name[0] = 'b'; threads[0].name[1] = 'o';
@@ -47,9 +77,18 @@ void thread_init() {
     threads[0].name[4] = '\0';
     threads[0].page_directory_phys = (uint32_t*)VMM::kernel_directory_phys_;
     threads[0].msg_count = 0;
-    threads[0].msg_head = 0;
-    threads[0].msg_tail = 0;
+    threads[0].msg_head = nullptr;
+    threads[0].msg_tail = nullptr;
+    threads[0].grant_count = 0;
+    threads[0].grant_head = nullptr;
+    threads[0].grant_tail = nullptr;
     threads[0].waiting_for_msg = false;
+    threads[0].ipc_state = IPC_IDLE;
+    threads[0].ipc_partner = -1;
+    threads[0].ipc_result = 0;
+    threads[0].ipc_frame = nullptr;
+    threads[0].ipc_callers = nullptr;
+    threads[0].ipc_next = nullptr;
     // System boot thread is a driver root
     threads[0].is_driver = true;
     threads[0].num_mmio_grants = 0;
@@ -60,6 +99,13 @@ void thread_init() {
 
 int thread_create(const char* name, ThreadEntry entry, uint8_t priority) {
     InterruptGuard guard;
+    int tid = thread_alloc(name, entry, priority);
+    if (tid >= 0) TaskScheduler::make_ready(tid);
+    return tid;
+}
+
+int thread_alloc(const char* name, ThreadEntry entry, uint8_t priority) {
+    InterruptGuard guard;
     
     int tid = -1;
     for (int i = 1; i < MAX_THREADS; i++) {
@@ -71,6 +117,8 @@ int thread_create(const char* name, ThreadEntry entry, uint8_t priority) {
     if (tid == -1) return -1;
 
     Thread& t = threads[tid];
+    t.stack_base = alloc_stack();
+    if (!t.stack_base) return -1;
     
     int j = 0;
     while (name[j] && j < 31) {
@@ -79,21 +127,39 @@ int thread_create(const char* name, ThreadEntry entry, uint8_t priority) {
     }
     t.name[j] = '\0';
     
-    // Add at top of file
-    t.state = ThreadState::Ready;
     t.priority = priority;
     t.sleep_until = 0;
     t.blocked_channel_id = -1;
-    t.quantum_remaining = 5;
-    t.total_ticks = 0;
+    t.run_next = nullptr;
+    t.run_prev = nullptr;
+    t.on_run_queue = false;
+    t.wait_next = nullptr;
+    t.wait_queue = nullptr;
+    t.cpu = 0;
+    t.idle = false;
+    t.kill_pending = false;
+    t.fpu = nullptr;
+    t.fpu_cpu = FPU_NO_CPU;
+    t.cpu_ns = 0;
     t.page_directory_phys = (uint32_t*)VMM::kernel_directory_phys_;
-    t.msg_head = 0;
-    t.msg_tail = 0;
+    t.msg_head = nullptr;
+    t.msg_tail = nullptr;
     t.msg_count = 0;
+    t.grant_head = nullptr;
+    t.grant_tail = nullptr;
+    t.grant_count = 0;
     t.waiting_for_msg = false;
-    t.vma_list = nullptr;
+    t.ipc_state = IPC_IDLE;
+    t.ipc_partner = -1;
+    t.ipc_result = 0;
+    t.ipc_frame = nullptr;
+    t.ipc_callers = nullptr;
+    t.ipc_next = nullptr;
+    t.vmas = {nullptr, 0};
     t.parent_tid = -1;
     t.exit_code = 0;
+    t.vfork_parent = -1;
+    t.vfork_child = -1;
     t.is_driver = false;
     t.num_mmio_grants = 0;
     for (int f = 0; f < MAX_OPEN_FILES; f++) t.fd_table[f] = nullptr;
@@ -110,6 +176,8 @@ int thread_create(const char* name, ThreadEntry entry, uint8_t priority) {
     *(--stack_top) = 0;      // EBP
 
     t.esp = (uint32_t)stack_top;
+    // Слот занят, но до make_ready поток не исполняется
+    t.state = ThreadState::Blocked;
     
     thread_count++;
     return tid;
@@ -118,19 +186,31 @@ int thread_create(const char* name, ThreadEntry entry, uint8_t priority) {
 void thread_cleanup(int tid) {
     if (tid < 0 || tid >= MAX_THREADS) return;
     InterruptGuard guard;
+
+    // Родитель vfork убит, пока потомок занимал его адресное пространство:
+    // каталог и области переходят потомку
+    Thread& t = threads[tid];
+    if (t.vfork_child >= 0) {
+        Thread& child = threads[t.vfork_child];
+        if (child.vfork_parent == tid) {
+            child.vfork_parent = -1;
+            child.vmas = t.vmas;
+            t.vmas = {nullptr, 0};
+            t.page_directory_phys = (uint32_t*)VMM::kernel_directory_phys_;
+        }
+        t.vfork_child = -1;
+    }
+    thread_vfork_done(tid);
     
     if (threads[tid].page_directory_phys != (uint32_t*)VMM::kernel_directory_phys_ && threads[tid].page_directory_phys != nullptr) {
         VMM::destroy_address_space(threads[tid].page_directory_phys);
         threads[tid].page_directory_phys = (uint32_t*)VMM::kernel_directory_phys_;
     }
     
-    VMA* curr = threads[tid].vma_list;
-    while (curr) {
-        VMA* next = curr->next;
-        kfree(curr);
-        curr = next;
-    }
-    threads[tid].vma_list = nullptr;
+    vma_clear(threads[tid].vmas);
+
+    Mailbox::release(tid);
+    SyncIpc::release(tid);
     
     for (int f = 0; f < MAX_OPEN_FILES; f++) {
         if (threads[tid].fd_table[f]) {
@@ -139,22 +219,50 @@ void thread_cleanup(int tid) {
         }
     }
     
-    threads[tid].state = ThreadState::Unused;
+    thread_release(tid);
+}
+
+void thread_vfork_done(int tid) {
+    InterruptGuard guard;
+    Thread& t = threads[tid];
+    int parent = t.vfork_parent;
+    if (parent < 0) return;
+
+    t.vfork_parent = -1;
+    t.page_directory_phys = (uint32_t*)VMM::kernel_directory_phys_;
+    // Каталог родителя не должен оставаться в CR3 после его exit
+    if (tid == current_tid) VMM::switch_address_space(t.page_directory_phys);
+
+    if (threads[parent].vfork_child == tid) {
+        threads[parent].vfork_child = -1;
+        TaskScheduler::unblock(parent);
+    }
+}
+
+void thread_release(int tid) {
+    if (tid <= 0 || tid >= MAX_THREADS) return;
+    InterruptGuard guard;
+
+    Thread& t = threads[tid];
+    if (t.stack_base) {
+        for (uint32_t i = 0; i < THREAD_STACK_FRAMES; i++) {
+            PhysicalMemoryManager::free_frame(t.stack_base + i * PMM_FRAME_SIZE);
+        }
+        t.stack_base = nullptr;
+    }
+    Fpu::release(tid);
+    t.parent_tid = -1;
+    t.state = ThreadState::Unused;
     thread_count--;
 }
 
 void thread_terminate(int tid) {
     if (tid < 0 || tid >= MAX_THREADS) return;
-    InterruptGuard guard;
-    threads[tid].state = ThreadState::Terminated;
-    if (tid == current_tid) {
-        thread_yield();
-        while (1) asm volatile("hlt");
-    }
+    TaskScheduler::terminate(tid);
 }
 
 void thread_yield() {
-    TaskScheduler::schedule();
+    TaskScheduler::yield();
 }
 
 } // namespace re36
@@ -1,35 +1,233 @@
 #include "kernel/timer.h"
 #include "kernel/pic.h"
+#include "kernel/lapic.h"
+#include "kernel/spinlock.h"
 #include "kernel/task_scheduler.h"
+#include "kernel/smp.h"
+#include "libc.h"
 
 namespace re36 {
 
 uint32_t Timer::ticks_ = 0;
 uint32_t Timer::frequency_ = 100;
+ClockEventMode Timer::mode_ = ClockEventMode::PitPeriodic;
+uint64_t Timer::tsc_base_ = 0;
+uint32_t Timer::tsc_per_tick_ = 0;
+uint32_t Timer::ns_mult_ = 0;
+uint32_t Timer::tsc_mult_ = 0;
+uint32_t Timer::lapic_mult_ = 0;
+TimerStats Timer::stats_ = {0, 0};
+
+#define PIT_HZ              1193182
+#define PIT_CALIBRATE_LATCH (PIT_HZ / 100)   // 10 мс
+
+// libgcc не линкуется: 64-битное деление только через divl, когда частное
+// помещается в 32 бита, умножение - через произведения 32x32
+static inline uint32_t div64_32(uint64_t n, uint32_t d) {
+    uint32_t q, r;
+    asm("divl %4" : "=a"(q), "=d"(r) : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+    return q;
+}
+
+// Частное любой величины: старшее слово делится отдельно, тогда остаток
+// меньше d и второе divl не переполняется
+static inline uint64_t div64_32_wide(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t q_hi = hi / d;
+    uint64_t rest = ((uint64_t)(hi % d) << 32) | (uint32_t)n;
+    return ((uint64_t)q_hi << 32) | div64_32(rest, d);
+}
+
+static inline uint64_t mul_shift24(uint64_t v, uint32_t mult) {
+    uint64_t lo = (uint64_t)(uint32_t)v * mult;
+    uint64_t hi = (uint64_t)(uint32_t)(v >> 32) * mult;
+    return (hi << 8) + (lo >> 24);
+}
+
+void Timer::calibrate(uint32_t* tsc_cycles, uint32_t* lapic_counts) {
+    // Канал 2 PIT в режиме 0: OUT2 (бит 5 порта 0x61) поднимается, когда
+    // счёт дойдёт до нуля. Прерывания не нужны.
+    outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+    outb(0x43, 0xB0);
+    outb(0x42, PIT_CALIBRATE_LATCH & 0xFF);
+    outb(0x42, PIT_CALIBRATE_LATCH >> 8);
+
+    uint32_t l0 = LocalApic::is_present() ? LocalApic::read(LAPIC_REG_TIMER_CUR) : 0;
+    uint64_t t0 = read_tsc();
+    while (!(inb(0x61) & 0x20)) {}
+    uint64_t t1 = read_tsc();
+    uint32_t l1 = LocalApic::is_present() ? LocalApic::read(LAPIC_REG_TIMER_CUR) : 0;
+
+    *tsc_cycles = (uint32_t)(t1 - t0);
+    *lapic_counts = l0 - l1;
+}
 
 void Timer::init(uint32_t frequency_hz) {
     frequency_ = frequency_hz;
     ticks_ = 0;
 
+    bool lapic = LocalApic::is_present();
+    if (lapic) {
+        LocalApic::write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV_16);
+        LocalApic::write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+        LocalApic::write(LAPIC_REG_TIMER_INIT, 0xFFFFFFFF);
+    }
+
+    uint32_t tsc10, lapic10;
+    calibrate(&tsc10, &lapic10);
+    if (lapic) LocalApic::write(LAPIC_REG_TIMER_INIT, 0);
+
+    tsc_per_tick_ = tsc10;
+    ns_mult_ = div64_32((uint64_t)NS_PER_TICK << 24, tsc10);
+    tsc_mult_ = div64_32((uint64_t)tsc10 << 24, NS_PER_TICK);
+    tsc_base_ = read_tsc();
+
     uint32_t divisor = 1193180 / frequency_hz;
 
     outb(0x43, 0x36);
     outb(0x40, (uint8_t)(divisor & 0xFF));
     outb(0x40, (uint8_t)((divisor >> 8) & 0xFF));
+
+    if (!lapic || lapic10 == 0) return;
+
+    // Есть LAPIC: PIT молчит, прерывание программируется на ближайшее
+    // событие планировщика
+    if (LocalApic::has_tsc_deadline()) {
+        mode_ = ClockEventMode::TscDeadline;
+        LocalApic::write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_DEADLINE | LAPIC_TIMER_VECTOR);
+    } else {
+        mode_ = ClockEventMode::LapicOneShot;
+        lapic_mult_ = div64_32((uint64_t)lapic10 << 24, NS_PER_TICK);
+        LocalApic::write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+    }
+    pic_mask(0);
+}
+
+void Timer::init_ap() {
+    if (mode_ == ClockEventMode::TscDeadline) {
+        LocalApic::write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_DEADLINE | LAPIC_TIMER_VECTOR);
+    } else if (mode_ == ClockEventMode::LapicOneShot) {
+        LocalApic::write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV_16);
+        LocalApic::write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+    }
 }
 
 void Timer::tick() {
     ticks_++;
+    stats_.interrupts++;
+}
+
+void Timer::handle_event() {
+    stats_.interrupts++;
+    cpu_current()->armed_ns = 0;
+    LocalApic::eoi();
+    TaskScheduler::schedule();
 }
 
 uint32_t Timer::get_ticks() {
-    return ticks_;
+    if (mode_ == ClockEventMode::PitPeriodic) return ticks_;
+    return ns_to_ticks(now_ns());
 }
 
 void Timer::sleep(uint32_t ms) {
-    uint32_t ticks_to_wait = (ms * frequency_) / 1000;
-    if (ticks_to_wait == 0) ticks_to_wait = 1;
     TaskScheduler::sleep_current(ms);
 }
 
+uint64_t Timer::read_tsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+uint64_t Timer::now_ns() {
+    return mul_shift24(read_tsc() - tsc_base_, ns_mult_);
+}
+
+uint32_t Timer::ns_to_ticks(uint64_t ns) {
+    return div64_32(ns, NS_PER_TICK);
+}
+
+void Timer::set_next_event(uint64_t deadline_ns) {
+    if (mode_ == ClockEventMode::PitPeriodic) return;
+
+    InterruptGuard guard;
+    CpuInfo* cpu = cpu_current();
+    if (deadline_ns == cpu->armed_ns) return;
+    cpu->armed_ns = deadline_ns;
+    stats_.programmed++;
+
+    if (deadline_ns == 0) {
+        if (mode_ == ClockEventMode::TscDeadline) wrmsr(MSR_TSC_DEADLINE, 0);
+        else LocalApic::write(LAPIC_REG_TIMER_INIT, 0);
+        return;
+    }
+
+    uint64_t now = now_ns();
+    uint64_t delta = deadline_ns > now ? deadline_ns - now : 0;
+    if (delta < TIMER_MIN_DELTA) delta = TIMER_MIN_DELTA;
+    if (delta > TIMER_MAX_DELTA) delta = TIMER_MAX_DELTA;
+
+    if (mode_ == ClockEventMode::TscDeadline) {
+        wrmsr(MSR_TSC_DEADLINE, read_tsc() + mul_shift24(delta, tsc_mult_));
+    } else {
+        uint32_t count = (uint32_t)mul_shift24(delta, lapic_mult_);
+        LocalApic::write(LAPIC_REG_TIMER_INIT, count ? count : 1);
+    }
+}
+
+bool Timer::is_tickless() {
+    return mode_ != ClockEventMode::PitPeriodic;
+}
+
+ClockEventMode Timer::get_mode() {
+    return mode_;
+}
+
+uint32_t Timer::get_tsc_khz() {
+    return tsc_per_tick_ / 10;
+}
+
+TimerStats Timer::get_stats() {
+    InterruptGuard guard;
+    return stats_;
+}
+
+void Timer::print_info() {
+    const char* modes[] = { "PIT periodic", "LAPIC one-shot", "LAPIC TSC-deadline" };
+    TimerStats st = get_stats();
+    // Миллисекунды с загрузки не помещаются в 32 бита через 49.7 суток
+    uint64_t ns = now_ns();
+    uint32_t uptime_s = (uint32_t)div64_32_wide(ns, 1000000000);
+    uint32_t uptime_ms = div64_32(ns - (uint64_t)uptime_s * 1000000000, 1000000);
+
+    printf("Clock event: %s", modes[(int)mode_]);
+    if (mode_ == ClockEventMode::PitPeriodic) printf(" (%u Hz)", frequency_);
+    printf("\n");
+    printf("TSC: %u kHz, LAPIC: %s (id %u)\n", get_tsc_khz(),
+           LocalApic::is_present() ? "yes" : "no", LocalApic::id());
+    printf("Uptime: %u s %u ms, %u timer interrupts, %u reprogrammed\n",
+           uptime_s, uptime_ms, st.interrupts, st.programmed);
+}
+
+void Timer::bench() {
+    static const uint32_t sleeps_us[] = {100, 500, 1000, 5000};
+    const int rounds = 10;
+
+    print_info();
+    printf("Sleep precision (%d sleeps each):\n", rounds);
+    for (int i = 0; i < 4; i++) {
+        uint64_t total = 0;
+        for (int r = 0; r < rounds; r++) {
+            uint64_t t0 = now_ns();
+            TaskScheduler::sleep_ns((uint64_t)sleeps_us[i] * 1000);
+            total += now_ns() - t0;
+        }
+        printf("  %u us -> %u us average\n", sleeps_us[i], div64_32(total, rounds * 1000));
+    }
+
+    uint32_t irq0 = get_stats().interrupts;
+    TaskScheduler::sleep_current(1000);
+    printf("Timer interrupts during 1 s of shell sleep: %u\n", get_stats().interrupts - irq0);
+}
+
 } // namespace re36
@@ -3,7 +3,7 @@
 
 namespace re36 {
 
-TSSEntry TSS::tss_;
+TSSEntry TSS::tss_[MAX_CPUS];
 GDTEntry TSS::gdt_[GDT_ENTRIES];
 GDTPointer TSS::gdt_ptr_;
 
@@ -18,8 +18,8 @@ void TSS::set_gdt_entry(int index, uint32_t base, uint32_t limit, uint8_t access
     gdt_[index].access      = access;
 }
 
-void TSS::write_tss(int index, uint32_t ss0, uint32_t esp0) {
-    uint32_t base = (uint32_t)&tss_;
+void TSS::write_tss(int index, TSSEntry& tss, uint32_t ss0, uint32_t esp0) {
+    uint32_t base = (uint32_t)&tss;
     uint32_t limit = sizeof(TSSEntry) - 1;
 
     set_gdt_entry(index, base, limit, 0xE9, 0x00);
@@ -27,20 +27,20 @@ void TSS::write_tss(int index, uint32_t ss0, uint32_t esp0) {
     // DPL=3 позволяет переключение из Ring 3
 
     for (uint32_t i = 0; i < sizeof(TSSEntry); i++) {
-        ((uint8_t*)&tss_)[i] = 0;
+        ((uint8_t*)&tss)[i] = 0;
     }
     
-    tss_.ss0  = ss0;
-    tss_.esp0 = esp0;
+    tss.ss0  = ss0;
+    tss.esp0 = esp0;
     
-    tss_.cs = KERNEL_CS;
-    tss_.ss = KERNEL_DS;
-    tss_.ds = KERNEL_DS;
-    tss_.es = KERNEL_DS;
-    tss_.fs = KERNEL_DS;
-    tss_.gs = KERNEL_DS;
+    tss.cs = KERNEL_CS;
+    tss.ss = KERNEL_DS;
+    tss.ds = KERNEL_DS;
+    tss.es = KERNEL_DS;
+    tss.fs = KERNEL_DS;
+    tss.gs = KERNEL_DS;
     
-    tss_.iomap_base = sizeof(TSSEntry);
+    tss.iomap_base = sizeof(TSSEntry);
 }
 
 void TSS::flush_gdt() {
@@ -59,12 +59,8 @@ void TSS::flush_gdt() {
     );
 }
 
-void TSS::flush_tss() {
-    asm volatile(
-        "mov $0x28, %%ax\n\t"   // TSS selector
-        "ltr %%ax\n\t"
-        ::: "eax"
-    );
+void TSS::flush_tss(uint16_t selector) {
+    asm volatile("ltr %0" :: "r"(selector));
 }
 
 void TSS::init(uint32_t kernel_stack) {
@@ -86,19 +82,27 @@ void TSS::init(uint32_t kernel_stack) {
     // 4: User Data (0x20) — Ring 3, Read/Write
     set_gdt_entry(4, 0, 0xFFFFF, 0xF2, 0xCF);
     
-    // 5: TSS (0x28)
-    write_tss(5, KERNEL_DS, kernel_stack);
+    // 5..: TSS процессоров (0x28 - BSP). Занятый TSS нельзя загрузить
+    // вторым процессором, поэтому у каждого свой дескриптор.
+    for (int i = 0; i < MAX_CPUS; i++) {
+        write_tss(5 + i, tss_[i], KERNEL_DS, kernel_stack);
+    }
+
+    flush_gdt();
+    flush_tss(TSS_SEG_CPU(0));
+}
 
+void TSS::init_ap(int cpu) {
     flush_gdt();
-    flush_tss();
+    flush_tss(TSS_SEG_CPU(cpu));
 }
 
 void TSS::set_kernel_stack(uint32_t stack_top) {
-    tss_.esp0 = stack_top;
+    tss_[cpu_current()->index].esp0 = stack_top;
 }
 
 TSSEntry& TSS::get_tss() {
-    return tss_;
+    return tss_[cpu_current()->index];
 }
 
 } // namespace re36
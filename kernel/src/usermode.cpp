@@ -3,6 +3,7 @@
 #include "kernel/pmm.h"
 #include "kernel/tss.h"
 #include "kernel/thread.h"
+#include "kernel/smp.h"
 #include "libc.h"
 
 namespace re36 {
@@ -73,6 +74,10 @@ void enter_usermode() {
 
     TSS::set_kernel_stack((uint32_t)(threads[current_tid].stack_base + THREAD_STACK_SIZE));
 
+    // В Ring 3 процессор уходит без BKL
+    asm volatile("cli");
+    Smp::leave_kernel();
+
     asm volatile(
         "cli\n\t"
         "mov $0x23, %%ax\n\t"   // USER_DS | RPL=3
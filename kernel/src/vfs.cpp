@@ -4,12 +4,15 @@
 
 namespace re36 {
 
+KmemCache* vnode_cache = nullptr;
+KmemCache* file_cache = nullptr;
+
 void vnode_release(vnode* vn) {
     if (!vn) return;
     if (__atomic_sub_fetch(&vn->refcount, 1, __ATOMIC_SEQ_CST) == 0) {
         if (vn->ops && vn->ops->close) vn->ops->close(vn);
         if (vn->fs_data) kfree(vn->fs_data);
-        kfree(vn);
+        kmem_cache_free(vnode_cache, vn);
     }
 }
 
@@ -17,7 +20,7 @@ void file_release(file* f) {
     if (!f) return;
     if (__atomic_sub_fetch(&f->refcount, 1, __ATOMIC_SEQ_CST) == 0) {
         vnode_release(f->vn);
-        kfree(f);
+        kmem_cache_free(file_cache, f);
     }
 }
 
@@ -31,6 +34,8 @@ static superblock* mount_points[MAX_MOUNT_POINTS];
 static int num_mount_points = 0;
 
 void vfs_init() {
+    if (!vnode_cache) vnode_cache = kmem_cache_create("vnode", sizeof(vnode));
+    if (!file_cache) file_cache = kmem_cache_create("file", sizeof(file));
     for (int i = 0; i < MAX_VFS_DRIVERS; i++) fs_drivers[i] = nullptr;
     for (int i = 0; i < MAX_MOUNT_POINTS; i++) mount_points[i] = nullptr;
     num_drivers = 0;
@@ -89,6 +94,13 @@ int vfs_mount(const char* fs_type, const char* target_path, block_device* bdev)
     return 0;
 }
 
+void vfs_sync() {
+    for (int i = 0; i < num_mount_points; i++) {
+        superblock* sb = mount_points[i];
+        if (sb && sb->driver && sb->driver->sync) sb->driver->sync(sb);
+    }
+}
+
 // Helper to extract the next path component. Returns length of component.
 static int extract_path_component(const char* path, int start_idx, char* out_buf, int max_len) {
     int i = start_idx;
@@ -181,6 +193,10 @@ int vfs_open(const char* path, int flags, int mode) {
         if (op_res != 0) return -1;
     }
 
+    if ((flags & O_TRUNC) && vn->type == VnodeType::File && vn->ops && vn->ops->truncate) {
+        if (vn->ops->truncate(vn, 0) != 0) return -1;
+    }
+
     // Вместо возвращения FD тут, мы должны вернуть указатель на абстрактную структуру file*, 
     // но Syscall Gate ждет int FD. 
     // Поэтому мы вернем -2 как ошибку и позволим Syscall Gate выделить FD в `threads[cur].fd_table` 
@@ -385,7 +401,12 @@ int vfs_write_file(const char* path, const uint8_t* data, uint32_t size) {
         return -1;
     }
 
-    int result = vn->ops->write(vn, 0, data, size);
+    // Файл записывается целиком: старое содержимое отбрасываем
+    if (vn->ops->truncate && vn->ops->truncate(vn, 0) != 0) {
+        vnode_release(vn);
+        return -1;
+    }
+    int result = size ? vn->ops->write(vn, 0, data, size) : 0;
     vnode_release(vn);
     return result;
 }
@@ -0,0 +1,369 @@
+#include "kernel/vma.h"
+#include "kernel/thread.h"
+#include "kernel/kmalloc.h"
+#include "libc.h"
+
+namespace re36 {
+
+// AVL-дерево по start. Каждый узел хранит по своему поддереву первый
+// адрес, конец последней области и наибольший промежуток между
+// соседними областями внутри него - поиск свободного места пропускает
+// поддеревья, где промежутка нужного размера нет.
+
+static inline uint8_t height(const VMA* n) {
+    return n ? n->height : 0;
+}
+
+static inline uint32_t max_u32(uint32_t a, uint32_t b) {
+    return a > b ? a : b;
+}
+
+static void update(VMA* n) {
+    VMA* l = n->left;
+    VMA* r = n->right;
+    n->height = (uint8_t)(1 + (height(l) > height(r) ? height(l) : height(r)));
+    n->sub_start = l ? l->sub_start : n->start;
+    n->sub_end = r ? r->sub_end : n->end;
+    uint32_t gap = 0;
+    if (l) gap = max_u32(l->max_gap, n->start - l->sub_end);
+    if (r) gap = max_u32(gap, max_u32(r->max_gap, r->sub_start - n->end));
+    n->max_gap = gap;
+}
+
+static VMA* rotate_right(VMA* n) {
+    VMA* l = n->left;
+    n->left = l->right;
+    l->right = n;
+    update(n);
+    update(l);
+    return l;
+}
+
+static VMA* rotate_left(VMA* n) {
+    VMA* r = n->right;
+    n->right = r->left;
+    r->left = n;
+    update(n);
+    update(r);
+    return r;
+}
+
+static VMA* balance(VMA* n) {
+    update(n);
+    int bf = (int)height(n->left) - (int)height(n->right);
+    if (bf > 1) {
+        if (height(n->left->left) < height(n->left->right)) n->left = rotate_left(n->left);
+        return rotate_right(n);
+    }
+    if (bf < -1) {
+        if (height(n->right->right) < height(n->right->left)) n->right = rotate_right(n->right);
+        return rotate_left(n);
+    }
+    return n;
+}
+
+static VMA* insert_node(VMA* n, VMA* v) {
+    if (!n) {
+        v->left = nullptr;
+        v->right = nullptr;
+        update(v);
+        return v;
+    }
+    if (v->start < n->start) n->left = insert_node(n->left, v);
+    else n->right = insert_node(n->right, v);
+    return balance(n);
+}
+
+static VMA* remove_min(VMA* n, VMA*& min) {
+    if (!n->left) {
+        min = n;
+        return n->right;
+    }
+    n->left = remove_min(n->left, min);
+    return balance(n);
+}
+
+static VMA* remove_node(VMA* n, VMA* v) {
+    if (!n) return nullptr;
+    if (v->start < n->start) {
+        n->left = remove_node(n->left, v);
+    } else if (v->start > n->start) {
+        n->right = remove_node(n->right, v);
+    } else {
+        VMA* l = n->left;
+        VMA* r = n->right;
+        if (!r) return l;
+        VMA* min = nullptr;
+        r = remove_min(r, min);
+        min->left = l;
+        min->right = r;
+        return balance(min);
+    }
+    return balance(n);
+}
+
+static void tree_insert(VmaTree& tree, VMA* v) {
+    tree.root = insert_node(tree.root, v);
+    tree.count++;
+}
+
+static void tree_remove(VmaTree& tree, VMA* v) {
+    tree.root = remove_node(tree.root, v);
+    tree.count--;
+}
+
+// ================= Поиск =================
+
+VMA* vma_find(VmaTree& tree, uint32_t addr) {
+    VMA* n = tree.root;
+    while (n) {
+        if (addr < n->start) n = n->left;
+        else if (addr >= n->end) n = n->right;
+        else return n;
+    }
+    return nullptr;
+}
+
+VMA* vma_first_overlap(VmaTree& tree, uint32_t start, uint32_t end) {
+    VMA* best = nullptr;
+    VMA* n = tree.root;
+    while (n) {
+        if (n->end <= start) {
+            n = n->right;
+        } else {
+            if (n->start < end) best = n;
+            n = n->left;
+        }
+    }
+    return best;
+}
+
+// prev_end - конец последней области левее поддерева (не меньше lo).
+// Сравнения через вычитание: hi >= size проверено в vma_find_free.
+static uint32_t find_gap(VMA* n, uint32_t& prev_end, uint32_t size, uint32_t hi) {
+    if (!n || n->sub_end <= prev_end) return 0;
+    if (prev_end > hi - size) return 0;
+
+    uint32_t before = n->sub_start > prev_end ? n->sub_start - prev_end : 0;
+    if (before < size && n->max_gap < size) {
+        prev_end = n->sub_end;
+        return 0;
+    }
+
+    uint32_t found = find_gap(n->left, prev_end, size, hi);
+    if (found) return found;
+    if (n->start >= prev_end && n->start - prev_end >= size) {
+        return prev_end <= hi - size ? prev_end : 0;
+    }
+    if (n->end > prev_end) prev_end = n->end;
+    return find_gap(n->right, prev_end, size, hi);
+}
+
+uint32_t vma_find_free(VmaTree& tree, uint32_t size, uint32_t lo, uint32_t hi) {
+    if (size == 0 || lo >= hi || size > hi - lo) return 0;
+    uint32_t prev_end = lo;
+    uint32_t found = find_gap(tree.root, prev_end, size, hi);
+    if (found) return found;
+    return prev_end <= hi - size ? prev_end : 0;
+}
+
+// ================= Изменение =================
+
+VMA* vma_alloc(uint32_t start, uint32_t end, uint32_t flags, uint8_t type) {
+    VMA* v = (VMA*)kmem_cache_alloc(vma_cache);
+    if (!v) return nullptr;
+    v->start = start;
+    v->end = end;
+    v->file_offset = 0;
+    v->file_size = 0;
+    v->flags = flags;
+    v->type = type;
+    v->file_vnode = nullptr;
+    v->ra = {};
+    v->left = nullptr;
+    v->right = nullptr;
+    v->height = 1;
+    v->sub_start = start;
+    v->sub_end = end;
+    v->max_gap = 0;
+    return v;
+}
+
+void vma_free(VMA* v) {
+    if (v->type == VMA_TYPE_FILE && v->file_vnode) vnode_release(v->file_vnode);
+    kmem_cache_free(vma_cache, v);
+}
+
+// Отрезать начало области до new_start (файловая часть сдвигается)
+static void cut_head(VMA* v, uint32_t new_start) {
+    uint32_t delta = new_start - v->start;
+    v->file_offset += delta;
+    v->file_size = v->file_size > delta ? v->file_size - delta : 0;
+    v->start = new_start;
+    v->ra = {};
+}
+
+// Вторая половина области с addr; у файловой - своя ссылка на vnode
+static void split_tail(VMA* v, VMA* tail, uint32_t addr) {
+    *tail = *v;
+    cut_head(tail, addr);
+    if (tail->type == VMA_TYPE_FILE && tail->file_vnode) {
+        __atomic_add_fetch(&tail->file_vnode->refcount, 1, __ATOMIC_SEQ_CST);
+    }
+    v->end = addr;
+}
+
+bool vma_remove_range(VmaTree& tree, uint32_t start, uint32_t end) {
+    if (start >= end) return true;
+
+    // Только одна область может выступать с обеих сторон - память под её
+    // вторую половину берётся до изменений
+    VMA* spare = nullptr;
+    VMA* v = vma_first_overlap(tree, start, end);
+    if (v && v->start < start && v->end > end) {
+        spare = (VMA*)kmem_cache_alloc(vma_cache);
+        if (!spare) return false;
+    }
+
+    while ((v = vma_first_overlap(tree, start, end)) != nullptr) {
+        tree_remove(tree, v);
+        if (v->start < start) {
+            if (v->end > end) {
+                split_tail(v, spare, end);
+                tree_insert(tree, spare);
+            }
+            v->end = start;
+            tree_insert(tree, v);
+        } else if (v->end > end) {
+            cut_head(v, end);
+            tree_insert(tree, v);
+        } else {
+            vma_free(v);
+        }
+    }
+    return true;
+}
+
+static bool mergeable(const VMA* a, const VMA* b) {
+    return a->type == VMA_TYPE_ANON && b->type == VMA_TYPE_ANON &&
+           a->file_size == 0 && b->file_size == 0 && a->flags == b->flags;
+}
+
+bool vma_insert(VmaTree& tree, VMA* v) {
+    if (!vma_remove_range(tree, v->start, v->end)) return false;
+
+    // Соседние анонимные области (mmap подряд, полученные страницы IPC)
+    // не множат узлы дерева
+    VMA* prev = v->start ? vma_find(tree, v->start - 1) : nullptr;
+    if (prev && prev->end == v->start && mergeable(prev, v)) {
+        tree_remove(tree, prev);
+        v->start = prev->start;
+        vma_free(prev);
+    }
+    VMA* next = vma_find(tree, v->end);
+    if (next && next->start == v->end && mergeable(next, v)) {
+        tree_remove(tree, next);
+        v->end = next->end;
+        vma_free(next);
+    }
+
+    tree_insert(tree, v);
+    return true;
+}
+
+bool vma_protect(VmaTree& tree, uint32_t start, uint32_t end, uint32_t flags) {
+    if (start >= end) return true;
+
+    // Диапазон должен быть покрыт областями без дыр
+    for (uint32_t addr = start; addr < end;) {
+        VMA* v = vma_find(tree, addr);
+        if (!v) return false;
+        addr = v->end;
+    }
+
+    // Делить придётся не больше двух крайних областей
+    VMA* first = vma_find(tree, start);
+    VMA* last = vma_find(tree, end - 1);
+    VMA* head_spare = nullptr;
+    VMA* tail_spare = nullptr;
+    if (first->start < start) {
+        head_spare = (VMA*)kmem_cache_alloc(vma_cache);
+        if (!head_spare) return false;
+    }
+    if (last->end > end) {
+        tail_spare = (VMA*)kmem_cache_alloc(vma_cache);
+        if (!tail_spare) {
+            if (head_spare) kmem_cache_free(vma_cache, head_spare);
+            return false;
+        }
+    }
+
+    if (head_spare) {
+        tree_remove(tree, first);
+        split_tail(first, head_spare, start);
+        tree_insert(tree, first);
+        tree_insert(tree, head_spare);
+    }
+    if (tail_spare) {
+        last = vma_find(tree, end - 1);
+        tree_remove(tree, last);
+        split_tail(last, tail_spare, end);
+        tree_insert(tree, last);
+        tree_insert(tree, tail_spare);
+    }
+
+    // Области внутри диапазона получают флаги и сливаются с соседями
+    for (uint32_t addr = start; addr < end;) {
+        VMA* v = vma_find(tree, addr);
+        addr = v->end;
+        tree_remove(tree, v);
+        v->flags = flags;
+        vma_insert(tree, v);
+    }
+    return true;
+}
+
+// ================= Целиком =================
+
+static VMA* clone_node(const VMA* n, bool& ok) {
+    if (!n || !ok) return nullptr;
+    VMA* c = (VMA*)kmem_cache_alloc(vma_cache);
+    if (!c) {
+        ok = false;
+        return nullptr;
+    }
+    *c = *n;
+    c->ra = {};
+    if (c->type == VMA_TYPE_FILE && c->file_vnode) {
+        __atomic_add_fetch(&c->file_vnode->refcount, 1, __ATOMIC_SEQ_CST);
+    }
+    c->left = clone_node(n->left, ok);
+    c->right = clone_node(n->right, ok);
+    return c;
+}
+
+bool vma_clone(VmaTree& dst, const VmaTree& src) {
+    bool ok = true;
+    dst.root = clone_node(src.root, ok);
+    dst.count = src.count;
+    if (!ok) {
+        vma_clear(dst);
+        return false;
+    }
+    return true;
+}
+
+static void free_nodes(VMA* n) {
+    if (!n) return;
+    free_nodes(n->left);
+    free_nodes(n->right);
+    vma_free(n);
+}
+
+void vma_clear(VmaTree& tree) {
+    free_nodes(tree.root);
+    tree.root = nullptr;
+    tree.count = 0;
+}
+
+} // namespace re36
@@ -6,12 +6,18 @@
 #include "kernel/cow.h"
 #include "kernel/vfs.h"
 #include "kernel/page_cache.h"
+#include "kernel/zero_pool.h"
+#include "kernel/smp.h"
 #include "libc.h"
 
 namespace re36 {
 
-uint32_t VMM::current_directory_phys_ = 0;
 uint32_t VMM::kernel_directory_phys_ = 0;
+bool VMM::large_pages_ = false;
+bool VMM::global_pages_ = false;
+
+#define CR4_PSE (1u << 4)
+#define CR4_PGE (1u << 7)
 
 static inline void invlpg(uint32_t addr) {
     asm volatile("invlpg (%0)" :: "r"(addr) : "memory");
@@ -60,7 +66,34 @@ void VMM::init() {
         page_dir[i] = 0;
     }
 
-    for (uint32_t addr = 0; addr < KERNEL_SPACE_END; addr += PAGE_SIZE) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    large_pages_ = edx & (1 << 3);
+    global_pages_ = large_pages_ && (edx & (1 << 13));
+    if (large_pages_) {
+        // CR4 до включения страничной адресации; AP берут его у BSP
+        uint32_t cr4;
+        asm volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_PSE;
+        if (global_pages_) cr4 |= CR4_PGE;
+        asm volatile("mov %0, %%cr4" :: "r"(cr4));
+    }
+
+    // Первые 4 МБ (область BIOS и VGA с другими типами памяти в MTRR) -
+    // страницами по 4 КБ, остальное тождественное отображение - страницами
+    // по 4 МБ: ядро не тратит на него таблиц, а глобальные записи TLB не
+    // сбрасываются при переключении адресных пространств.
+    // Вся RAM под PMM, до границы 4 МБ (сверху обычно лежат таблицы ACPI)
+    uint32_t direct_end = (PhysicalMemoryManager::get_memory_size() + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+    if (direct_end > KERNEL_SPACE_END) direct_end = KERNEL_SPACE_END;
+    if (direct_end < LARGE_PAGE_SIZE) direct_end = LARGE_PAGE_SIZE;
+    uint32_t small_end = large_pages_ ? LARGE_PAGE_SIZE : direct_end;
+    for (uint32_t addr = small_end; addr < direct_end; addr += LARGE_PAGE_SIZE) {
+        page_dir[addr >> 22] = addr | PAGE_PRESENT | PAGE_WRITABLE | PAGE_LARGE |
+                               (global_pages_ ? PAGE_GLOBAL : 0);
+    }
+
+    for (uint32_t addr = 0; addr < small_end; addr += PAGE_SIZE) {
         uint32_t pd_index = addr >> 22;
         uint32_t pt_index = (addr >> 12) & 0x3FF;
 
@@ -82,19 +115,72 @@ void VMM::init() {
 
     page_dir[RECURSIVE_PD_INDEX] = (uint32_t)page_dir | PAGE_PRESENT | PAGE_WRITABLE;
 
-    current_directory_phys_ = (uint32_t)page_dir;
-    kernel_directory_phys_ = current_directory_phys_;
+    kernel_directory_phys_ = (uint32_t)page_dir;
 
-    load_cr3(current_directory_phys_);
+    load_cr3(kernel_directory_phys_);
     enable_paging();
 }
 
+bool VMM::map_large_page(uint32_t virt, uint32_t phys, uint32_t flags) {
+    if (!large_pages_ || (flags & PAGE_USER)) return false;
+    if ((virt | phys) & (LARGE_PAGE_SIZE - 1)) return false;
+
+    InterruptGuard guard;
+
+    uint32_t pd_index = virt >> 22;
+    if (pd_index == RECURSIVE_PD_INDEX) return false;
+    uint32_t* pde = get_pde_ptr(pd_index);
+
+    uint32_t old_table = 0;
+    if ((*pde & PAGE_PRESENT) && !(*pde & PAGE_LARGE)) {
+        if (*pde & PAGE_USER) return false;
+        uint32_t* ptes = get_pte_ptr(pd_index << 22);
+        for (int j = 0; j < PT_ENTRIES; j++) {
+            if (ptes[j] & PAGE_PRESENT) return false;
+        }
+        old_table = *pde & 0xFFFFF000;
+    }
+
+    if (!global_pages_) flags &= ~PAGE_GLOBAL;
+    uint32_t entry = phys | (flags & 0xFFF) | PAGE_PRESENT | PAGE_LARGE;
+    *pde = entry;
+    // Каталоги других процессов берут новую PDE ядра при первом сбое на ней
+    uint32_t* kernel_dir = (uint32_t*)kernel_directory_phys_;
+    if (read_cr3() != kernel_directory_phys_) kernel_dir[pd_index] = entry;
+
+    invlpg(virt);
+    if (old_table) PhysicalMemoryManager::free_frame((void*)old_table);
+    return true;
+}
+
+void VMM::unmap_large_page(uint32_t virt) {
+    InterruptGuard guard;
+
+    uint32_t pd_index = virt >> 22;
+    uint32_t* pde = get_pde_ptr(pd_index);
+    if (!(*pde & PAGE_LARGE)) return;
+
+    uint32_t old = *pde;
+    *pde = 0;
+    uint32_t* kernel_dir = (uint32_t*)kernel_directory_phys_;
+    if (kernel_dir[pd_index] == old) kernel_dir[pd_index] = 0;
+
+    invlpg(virt);
+    Smp::tlb_shootdown(virt, false);
+}
+
 void VMM::map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
     InterruptGuard guard;
 
     uint32_t pd_index = virt >> 22;
     uint32_t* pde = get_pde_ptr(pd_index);
 
+    if (*pde & PAGE_LARGE) {
+        printf("[VMM] map_page 0x%x: address lies inside a 4 MB page\n", virt);
+        return;
+    }
+    if ((*pde & PDE_SHARED) && !cow_unshare_table(pd_index)) return;
+
     if (!(*pde & PAGE_PRESENT)) {
         uint32_t* new_table = (uint32_t*)PhysicalMemoryManager::alloc_frame();
         if (!new_table) return;
@@ -106,31 +192,39 @@ void VMM::map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
         invlpg((uint32_t)get_pte_ptr(pd_index << 22));
 
         uint32_t* pt_base = get_pte_ptr(pd_index << 22);
-        for (int i = 0; i < PT_ENTRIES; i++) {
-            pt_base[i] = 0;
-        }
+        zero_page(pt_base);
     } else if ((flags & PAGE_USER) && !(*pde & PAGE_USER)) {
         *pde |= PAGE_USER;
     }
 
     uint32_t* pte = get_pte_ptr(virt);
+    if ((*pte & (PAGE_PRESENT | PAGE_USER)) == (PAGE_PRESENT | PAGE_USER)) {
+        PhysicalMemoryManager::dec_mapcount(*pte & 0xFFFFF000);
+    }
     *pte = (phys & 0xFFFFF000) | (flags & 0xFFF) | PAGE_PRESENT;
+    if (flags & PAGE_USER) PhysicalMemoryManager::inc_mapcount(phys);
 
     invlpg(virt);
 }
 
-void VMM::unmap_page(uint32_t virt) {
+bool VMM::unmap_page(uint32_t virt) {
     InterruptGuard guard;
 
     uint32_t pd_index = virt >> 22;
     uint32_t* pde = get_pde_ptr(pd_index);
 
-    if (!(*pde & PAGE_PRESENT)) return;
+    if (!(*pde & PAGE_PRESENT)) return true;
+    if (*pde & PAGE_LARGE) return false;
+    if ((*pde & PDE_SHARED) && !cow_unshare_table(pd_index)) return false;
 
     uint32_t* pte = get_pte_ptr(virt);
+    bool user = (*pte & PAGE_USER) != 0;
+    if (user && (*pte & PAGE_PRESENT)) PhysicalMemoryManager::dec_mapcount(*pte & 0xFFFFF000);
     *pte = 0;
 
     invlpg(virt);
+    Smp::tlb_shootdown(virt, user);
+    return true;
 }
 
 uint32_t VMM::get_physical(uint32_t virt) {
@@ -138,6 +232,7 @@ uint32_t VMM::get_physical(uint32_t virt) {
     uint32_t* pde = get_pde_ptr(pd_index);
 
     if (!(*pde & PAGE_PRESENT)) return 0;
+    if (*pde & PAGE_LARGE) return (*pde & ~(LARGE_PAGE_SIZE - 1)) | (virt & (LARGE_PAGE_SIZE - 1));
 
     uint32_t* pte = get_pte_ptr(virt);
     if (!(*pte & PAGE_PRESENT)) return 0;
@@ -147,10 +242,17 @@ uint32_t VMM::get_physical(uint32_t virt) {
 
 void VMM::invalidate_page(uint32_t virt) {
     invlpg(virt);
+    Smp::tlb_shootdown(virt, (*get_pde_ptr(virt >> 22) & PAGE_USER) != 0);
 }
 
+// Каталог у каждого процессора свой, текущий берётся из CR3
 void VMM::flush_tlb() {
-    load_cr3(current_directory_phys_);
+    load_cr3(read_cr3());
+}
+
+void VMM::flush_address_space() {
+    load_cr3(read_cr3());
+    Smp::tlb_shootdown(SMP_TLB_FLUSH_ALL, true);
 }
 
 uint32_t* VMM::create_address_space() {
@@ -159,9 +261,7 @@ uint32_t* VMM::create_address_space() {
     uint32_t* new_dir = (uint32_t*)PhysicalMemoryManager::alloc_frame();
     if (!new_dir) return nullptr;
 
-    for (int i = 0; i < PD_ENTRIES; i++) {
-        new_dir[i] = 0;
-    }
+    zero_page(new_dir);
 
     uint32_t* cur_pd = (uint32_t*)PAGE_DIR_VADDR;
     for (uint32_t i = 0; i < PD_ENTRIES; i++) {
@@ -188,9 +288,15 @@ void VMM::destroy_address_space(uint32_t* page_dir_phys) {
         if (!(page_dir_phys[i] & PAGE_USER)) continue;
 
         uint32_t* pt = (uint32_t*)(page_dir_phys[i] & 0xFFFFF000);
+        // Таблица ещё нужна другому каталогу после fork: отдаём только ссылку
+        if (PhysicalMemoryManager::get_refcount((uint32_t)pt) > 1) {
+            PhysicalMemoryManager::dec_ref((uint32_t)pt);
+            continue;
+        }
         for (int j = 0; j < PT_ENTRIES; j++) {
             if (pt[j] & PAGE_PRESENT) {
                 uint32_t phys_frame = pt[j] & 0xFFFFF000;
+                if (pt[j] & PAGE_USER) PhysicalMemoryManager::dec_mapcount(phys_frame);
                 PhysicalMemoryManager::dec_ref(phys_frame);
             }
         }
@@ -201,14 +307,42 @@ void VMM::destroy_address_space(uint32_t* page_dir_phys) {
 }
 
 void VMM::switch_address_space(uint32_t* page_dir_phys) {
-    current_directory_phys_ = (uint32_t)page_dir_phys;
-    load_cr3(current_directory_phys_);
+    load_cr3((uint32_t)page_dir_phys);
 }
 
 uint32_t* VMM::clone_directory() {
     return cow_clone_directory();
 }
 
+// Fault-around: отобразить уже закэшированные страницы файла в выровненном
+// блоке вокруг сбоя, чтобы последовательный старт программы не платил
+// сбоем за каждую страницу
+static void fault_around(VMA* vma, uint32_t page_addr) {
+    uint32_t span = PAGE_CACHE_FAULT_AROUND * PAGE_SIZE;
+    uint32_t from = page_addr & ~(span - 1);
+    uint32_t to = from + span;
+    if (from < vma->start) from = vma->start;
+    uint32_t file_end = vma->start + vma->file_size;
+
+    for (uint32_t addr = from; addr < to && addr + PAGE_SIZE <= file_end; addr += PAGE_SIZE) {
+        if (addr == page_addr || VMM::get_physical(addr)) continue;
+        uint32_t file_offset = vma->file_offset + (addr - vma->start);
+        uint32_t cached = PageCache::lookup(vma->file_vnode, file_offset / PAGE_SIZE);
+        if (cached) VMM::map_page(addr, cached, vma->flags);
+    }
+}
+
+// PDE ядра, появившаяся после создания текущего каталога (страница 4 МБ
+// драйвера, отображённая из другого процесса), копируется из каталога ядра
+static bool sync_kernel_pde(uint32_t pd_index) {
+    if (pd_index == RECURSIVE_PD_INDEX) return false;
+    uint32_t kernel_pde = ((uint32_t*)VMM::kernel_directory_phys_)[pd_index];
+    uint32_t* pde = get_pde_ptr(pd_index);
+    if (!(kernel_pde & PAGE_PRESENT) || (kernel_pde & PAGE_USER) || (*pde & PAGE_PRESENT)) return false;
+    *pde = kernel_pde;
+    return true;
+}
+
 bool VMM::handle_page_fault(uint32_t fault_addr, uint32_t error_code) {
     uint32_t pd_index = fault_addr >> 22;
     uint32_t pt_index = (fault_addr >> 12) & 0x3FF;
@@ -217,6 +351,8 @@ bool VMM::handle_page_fault(uint32_t fault_addr, uint32_t error_code) {
     bool is_write   = (error_code & 0x2) != 0;
     bool is_user    = (error_code & 0x4) != 0;
 
+    if (!is_present && !is_user && sync_kernel_pde(pd_index)) return true;
+
     if (is_present && is_write) {
         if (cow_handle_fault(fault_addr, error_code)) return true;
     } else if (!is_present && is_user) {
@@ -231,7 +367,7 @@ bool VMM::handle_page_fault(uint32_t fault_addr, uint32_t error_code) {
             __atomic_clear(&cur.heap_lock, __ATOMIC_RELEASE);
 
             if (fault_addr >= start && fault_addr < end) {
-                void* new_frame = PhysicalMemoryManager::alloc_frame();
+                void* new_frame = ZeroPool::alloc_frame();
                 if (!new_frame) {
                     printf("\n!!! PAGE FAULT: Out of memory for heap at 0x%x !!!\n", fault_addr);
                     while(1) asm volatile("cli; hlt");
@@ -242,71 +378,70 @@ bool VMM::handle_page_fault(uint32_t fault_addr, uint32_t error_code) {
                 return true;
             }
 
-            VMA* curr_vma = cur.vma_list;
-            while (curr_vma) {
-                if (fault_addr >= curr_vma->start && fault_addr < curr_vma->end) {
-                    uint32_t page_addr = fault_addr & ~0xFFF;
-                    bool is_readonly = !(curr_vma->flags & PAGE_WRITABLE);
-                    bool is_file = (curr_vma->type == VMA_TYPE_FILE && curr_vma->file_vnode);
-
-                    if (is_readonly && is_file) {
-                        uint32_t offset_in_vma = page_addr - curr_vma->start;
-                        uint32_t file_offset = curr_vma->file_offset + offset_in_vma;
-                        uint32_t cache_key = curr_vma->file_vnode->inode_num;
-
-                        uint32_t cached = PageCache::lookup(cache_key, file_offset);
+            // Потомок vfork до exec живёт в областях родителя
+            Thread& owner = cur.vfork_parent >= 0 ? threads[cur.vfork_parent] : cur;
+            VMA* curr_vma = vma_find(owner.vmas, fault_addr);
+            if (curr_vma) {
+                uint32_t page_addr = fault_addr & ~0xFFF;
+                bool is_readonly = !(curr_vma->flags & PAGE_WRITABLE);
+                bool is_file = (curr_vma->type == VMA_TYPE_FILE && curr_vma->file_vnode);
+
+                if (is_readonly && is_file) {
+                    uint32_t offset_in_vma = page_addr - curr_vma->start;
+                    uint32_t file_offset = curr_vma->file_offset + offset_in_vma;
+
+                    // Страница файла целиком лежит в сегменте - отображаем
+                    // фрейм кэша страниц напрямую (ссылка уже взята get_page)
+                    if ((file_offset % PAGE_SIZE) == 0 &&
+                        page_addr + PAGE_SIZE <= curr_vma->start + curr_vma->file_size) {
+                        uint32_t index = file_offset / PAGE_SIZE;
+                        PageCache::readahead(curr_vma->file_vnode, &curr_vma->ra, index, 1);
+                        uint32_t cached = PageCache::get_page(curr_vma->file_vnode, index);
                         if (cached) {
-                            PhysicalMemoryManager::inc_ref(cached);
                             VMM::map_page(page_addr, cached, curr_vma->flags);
+                            if (PageCache::readahead_enabled()) fault_around(curr_vma, page_addr);
                             return true;
                         }
                     }
+                }
 
-                    void* new_frame = PhysicalMemoryManager::alloc_frame();
-                    if (!new_frame) {
-                        printf("\n!!! PAGE FAULT: Out of memory for Demand Paging at 0x%x !!!\n", fault_addr);
-                        while(1) asm volatile("cli; hlt");
-                    }
+                void* new_frame = ZeroPool::alloc_frame();
+                if (!new_frame) {
+                    printf("\n!!! PAGE FAULT: Out of memory for Demand Paging at 0x%x !!!\n", fault_addr);
+                    while(1) asm volatile("cli; hlt");
+                }
 
-                    uint8_t* frame_ptr = (uint8_t*)new_frame;
-                    for (int b = 0; b < 4096; b++) frame_ptr[b] = 0;
+                uint8_t* frame_ptr = (uint8_t*)new_frame;
 
-                    uint32_t file_data_end = curr_vma->start + curr_vma->file_size;
+                uint32_t file_data_end = curr_vma->start + curr_vma->file_size;
 
-                    if (page_addr < file_data_end) {
-                        uint32_t offset_in_vma = page_addr - curr_vma->start;
-                        uint32_t file_offset = curr_vma->file_offset + offset_in_vma;
+                if (page_addr < file_data_end) {
+                    uint32_t offset_in_vma = page_addr - curr_vma->start;
+                    uint32_t file_offset = curr_vma->file_offset + offset_in_vma;
 
-                        uint32_t read_size = 4096;
-                        if (page_addr + 4096 > file_data_end) {
-                            read_size = file_data_end - page_addr;
-                        }
+                    uint32_t read_size = 4096;
+                    if (page_addr + 4096 > file_data_end) {
+                        read_size = file_data_end - page_addr;
+                    }
 
-                        if (read_size > 0) {
-                            if (is_file) {
-                                vnode* fvn = curr_vma->file_vnode;
-                                if (fvn->ops && fvn->ops->read) {
-                                    fvn->ops->read(fvn, file_offset, frame_ptr, read_size);
-                                }
-                            } else {
-                                vnode* vn = nullptr;
-                                if (vfs_resolve_path(cur.name, &vn) == 0 && vn && vn->ops && vn->ops->read) {
-                                    vn->ops->read(vn, file_offset, frame_ptr, read_size);
-                                    vnode_release(vn);
-                                }
+                    if (read_size > 0) {
+                        if (is_file) {
+                            vnode* fvn = curr_vma->file_vnode;
+                            if (fvn->ops && fvn->ops->read) {
+                                fvn->ops->read(fvn, file_offset, frame_ptr, read_size);
                             }
-
-                            if (is_readonly && is_file) {
-                                uint32_t cache_key = curr_vma->file_vnode->inode_num;
-                                PageCache::insert(cache_key, file_offset, (uint32_t)new_frame);
+                        } else {
+                            vnode* vn = nullptr;
+                            if (vfs_resolve_path(cur.name, &vn) == 0 && vn && vn->ops && vn->ops->read) {
+                                vn->ops->read(vn, file_offset, frame_ptr, read_size);
+                                vnode_release(vn);
                             }
                         }
                     }
-
-                    VMM::map_page(page_addr, (uint32_t)new_frame, curr_vma->flags);
-                    return true;
                 }
-                curr_vma = curr_vma->next;
+
+                VMM::map_page(page_addr, (uint32_t)new_frame, curr_vma->flags);
+                return true;
             }
         }
     }
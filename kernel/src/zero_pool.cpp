@@ -0,0 +1,84 @@
+#include "kernel/zero_pool.h"
+#include "kernel/pmm.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "kernel/task_scheduler.h"
+#include "libc.h"
+
+namespace re36 {
+
+uint32_t ZeroPool::frames_[ZERO_POOL_SIZE];
+uint32_t ZeroPool::count_ = 0;
+ZeroPoolStats ZeroPool::stats_ = { 0, 0, 0, 0 };
+
+void ZeroPool::init() {
+    count_ = 0;
+    thread_create("zeroer", worker, ZERO_POOL_PRIORITY);
+}
+
+void* ZeroPool::alloc_frame() {
+    {
+        InterruptGuard guard;
+        if (count_ > 0) {
+            stats_.hits++;
+            uint32_t frame = frames_[--count_];
+            PhysicalMemoryManager::get_page(frame)->flags &= ~PG_ZEROED;
+            return (void*)frame;
+        }
+        stats_.misses++;
+    }
+
+    void* frame = PhysicalMemoryManager::alloc_frame();
+    if (!frame) return nullptr;
+    zero_page(frame);
+    return frame;
+}
+
+void ZeroPool::shrink() {
+    InterruptGuard guard;
+    uint32_t keep = count_ / 2;
+    while (count_ > keep) {
+        PhysicalMemoryManager::free_frame((void*)frames_[--count_]);
+    }
+}
+
+ZeroPoolStats ZeroPool::get_stats() {
+    ZeroPoolStats stats = stats_;
+    stats.cached = count_;
+    return stats;
+}
+
+void ZeroPool::worker() {
+    while (true) {
+        // Памяти мало - отдаём половину пула и не пополняем его
+        if (PhysicalMemoryManager::get_free_memory() < ZERO_POOL_MIN_FREE) {
+            if (count_ > 0) shrink();
+            TaskScheduler::sleep_current(10);
+            continue;
+        }
+
+        while (count_ < ZERO_POOL_SIZE) {
+            if (PhysicalMemoryManager::get_free_memory() < ZERO_POOL_MIN_FREE) break;
+
+            void* frame = PhysicalMemoryManager::alloc_frame();
+            if (!frame) break;
+
+            // Обнуляем вне критической секции - прерывания остаются включены
+            zero_page(frame);
+
+            InterruptGuard guard;
+            if (count_ < ZERO_POOL_SIZE) {
+                PhysicalMemoryManager::get_page((uint32_t)frame)->flags |= PG_ZEROED;
+                frames_[count_++] = (uint32_t)frame;
+                stats_.zeroed++;
+            } else {
+                PhysicalMemoryManager::free_frame(frame);
+                break;
+            }
+        }
+
+        TaskScheduler::sleep_current(10);
+    }
+}
+
+} // namespace re36
@@ -5,6 +5,7 @@
 
 #define FMODE_READ  1
 #define FMODE_WRITE 2
+#define FMODE_APPEND 3
 
 namespace vlsmc {
 
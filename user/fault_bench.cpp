@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <sys/clock.h>
+
+// Fault storm: растим кучу через sbrk, касаемся каждой страницы (каждое
+// касание - page fault с выделением фрейма в ядре), затем отдаём кучу назад.
+// Скорость упирается в путь VMM::handle_page_fault -> PMM::alloc_frame.
+
+#define TICKS_PER_SEC   100            // PIT настроен на 100 Гц
+#define REGION_SIZE     (4 * 1024 * 1024)
+#define PAGE_SIZE       4096
+#define ROUNDS          16
+
+int main() {
+    printf("=== PAGE FAULT STORM BENCHMARK ===\n");
+    printf("Region %d KB x %d rounds\n", REGION_SIZE / 1024, ROUNDS);
+
+    unsigned int pages = REGION_SIZE / PAGE_SIZE;
+    unsigned int total_faults = 0;
+    unsigned int total_cycles_k = 0;
+
+    long t_start = syscall(SYS_TIME);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        char* base = (char*)syscall(SYS_SBRK, REGION_SIZE);
+        if ((long)base == -1) {
+            printf("[FAIL] sbrk(%d) failed\n", REGION_SIZE);
+            return 1;
+        }
+
+        unsigned long long c0 = rdtsc();
+        for (unsigned int p = 0; p < pages; p++) {
+            base[p * PAGE_SIZE] = (char)p;
+        }
+        unsigned long long c1 = rdtsc();
+
+        total_cycles_k += (unsigned int)((c1 - c0) >> 10);
+        total_faults += pages;
+
+        syscall(SYS_SBRK, -REGION_SIZE);
+    }
+
+    long t_end = syscall(SYS_TIME);
+    unsigned int ticks = (unsigned int)(t_end - t_start);
+    if (ticks == 0) ticks = 1;
+
+    printf("Faults:            %u\n", total_faults);
+    printf("Elapsed:           %u ms\n", ticks * (1000 / TICKS_PER_SEC));
+    printf("Faults per second: %u\n", total_faults * TICKS_PER_SEC / ticks);
+    printf("Cycles per fault:  %u\n", total_cycles_k / (total_faults / 1024));
+    printf("=== BENCHMARK COMPLETE ===\n");
+    return 0;
+}
@@ -1,8 +1,131 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/syscall.h>
+#include <sys/clock.h>
+
+// Проверка fork и задержка создания процесса: fork + exit, fork + exec и
+// vfork + exec, каждый раз с ожиданием wait. У родителя отображено
+// RESIDENT_MB МБ, чтобы была видна цена копирования таблиц страниц.
+// exec запускает этот же файл с аргументом CHILD_ARG - он сразу выходит.
+
+#define RESIDENT_MB  8
+#define ROUNDS       32
+#define CHILD_ARG    "-exit"
+#define SELF_PATH    "/FORKTST.ELF"
+#define FANOUT       300           // Больше 255 - прежнего предела счётчика ссылок
+
+static void report(const char* name, unsigned long long ns, unsigned int errors) {
+    printf("  %s: %u us per process", name, ns_to_us(ns) / ROUNDS);
+    if (errors) printf(" [%u ERRORS]", errors);
+    printf("\n");
+}
+
+static char* const child_argv[] = { (char*)SELF_PATH, (char*)CHILD_ARG, nullptr };
+static char* const child_envp[] = { nullptr };
+
+static int wait_code() {
+    int status = -1;
+    wait(&status);
+    return status;
+}
+
+// FANOUT живых потомков одновременно ссылаются на одну страницу: каждый
+// пишет в соседнюю, копируя таблицу страниц, и ждёт сообщения. Затем все
+// проверяют общую страницу и выходят; у родителя она должна уцелеть.
+static void fanout_test() {
+    long shared = syscall(SYS_MMAP, 0, 2 * 4096, 3, 0x22, -1);
+    if (shared == -1) {
+        printf("[FAIL] mmap for fan-out test failed\n");
+        return;
+    }
+    unsigned int* word = (unsigned int*)shared;
+    unsigned int* neighbour = (unsigned int*)(shared + 4096);
+    for (unsigned int i = 0; i < 1024; i++) word[i] = i ^ 0x5A5A5A5A;
+    *neighbour = 0;
+
+    static int pids[FANOUT];
+    int forked = 0;
+    for (; forked < FANOUT; forked++) {
+        int pid = fork();
+        if (pid == 0) {
+            *neighbour = 1;
+            unsigned long msg[4];
+            int sender = -1;
+            syscall(SYS_RECV_MSG, (long)&sender, (long)msg, sizeof(msg));
+            for (unsigned int i = 0; i < 1024; i++) {
+                if (word[i] != (i ^ 0x5A5A5A5A)) exit(1);
+            }
+            exit(0);
+        }
+        if (pid < 0) break;
+        pids[forked] = pid;
+    }
+
+    unsigned long msg[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < forked; i++) syscall(SYS_SEND_MSG, pids[i], (long)msg, sizeof(msg));
+    unsigned int errors = 0;
+    for (int i = 0; i < forked; i++) {
+        if (wait_code() != 0) errors++;
+    }
+    for (unsigned int i = 0; i < 1024; i++) {
+        if (word[i] != (i ^ 0x5A5A5A5A)) errors++;
+    }
+    word[0] = 1;   // Единственный владелец снова пишет без копирования
+
+    if (errors || *neighbour != 0 || word[0] != 1) {
+        printf("[FAIL] page shared by %d processes: %u errors\n", forked, errors);
+    } else if (forked <= 255) {
+        printf("[SKIP] only %d children forked, need more than 255\n", forked);
+    } else {
+        printf("[ OK ] page shared by %d processes\n", forked);
+    }
+    syscall(SYS_MUNMAP, shared, 2 * 4096);
+}
+
+static void bench_fork_exit() {
+    unsigned int errors = 0;
+    unsigned long long t0 = clock_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        int pid = fork();
+        if (pid == 0) exit(7);
+        if (pid < 0 || wait_code() != 7) errors++;
+    }
+    report("fork + exit + wait  ", clock_ns() - t0, errors);
+}
+
+static void bench_fork_exec() {
+    unsigned int errors = 0;
+    unsigned long long t0 = clock_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        int pid = fork();
+        if (pid == 0) {
+            execve(SELF_PATH, child_argv, child_envp);
+            exit(1);
+        }
+        if (pid < 0 || wait_code() != 0) errors++;
+    }
+    report("fork + exec + wait  ", clock_ns() - t0, errors);
+}
+
+static void bench_vfork_exec() {
+    unsigned int errors = 0;
+    unsigned long long t0 = clock_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        // До exec потомок исполняется на стеке родителя: только exec и exit
+        int pid = vfork();
+        if (pid == 0) {
+            execve(SELF_PATH, child_argv, child_envp);
+            exit(1);
+        }
+        if (pid < 0 || wait_code() != 0) errors++;
+    }
+    report("vfork + exec + wait ", clock_ns() - t0, errors);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], CHILD_ARG) == 0) return 0;
 
-int main() {
     printf("=== FORK TEST ===\n");
 
     int pid = fork();
@@ -23,6 +146,38 @@ int main() {
         printf("[PARENT] Child %d exited with code %d\n", child, status);
     }
 
+    fanout_test();
+
+    unsigned int len = RESIDENT_MB * 1024 * 1024;
+    long region = syscall(SYS_MMAP, 0, len, 3, 0x22, -1);   // RW, MAP_PRIVATE | MAP_ANONYMOUS
+    if (region == -1) {
+        printf("[FAIL] mmap of %d MB failed\n", RESIDENT_MB);
+        return 1;
+    }
+    unsigned int* words = (unsigned int*)region;
+    for (unsigned int off = 0; off < len / 4; off += 1024) words[off] = off;
+
+    // Запись потомка не видна родителю и наоборот
+    pid = fork();
+    if (pid == 0) {
+        unsigned int seen = words[1024];
+        words[1024] = 0xDEAD;
+        exit(seen == 1024 ? 0 : 1);
+    }
+    words[2048] = 0xBEEF;
+    int code = wait_code();
+    if (pid < 0 || code != 0 || words[1024] != 1024 || words[2048] != 0xBEEF) {
+        printf("[FAIL] copy-on-write isolation after fork\n");
+    } else {
+        printf("[ OK ] copy-on-write isolation after fork\n");
+    }
+
+    printf("Process creation, %d rounds, %d MB resident in parent:\n", ROUNDS, RESIDENT_MB);
+    bench_fork_exit();
+    bench_fork_exec();
+    bench_vfork_exec();
+
+    syscall(SYS_MUNMAP, region, len);
     printf("=== FORK TEST COMPLETE ===\n");
     return 0;
 }
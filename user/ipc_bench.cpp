@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/clock.h>
+
+// Пропускная способность IPC между двумя процессами: копирование через
+// сообщения по 512 Б против передачи страниц без копирования (MOVE и CoW).
+// Приёмник - IPCSINK.ELF, запускается через fork + exec.
+
+enum { OP_MSGS = 1, OP_GRANTS = 2, OP_QUIT = 3 };
+
+struct Command {
+    unsigned int op;
+    unsigned int count;
+    unsigned int bytes;
+};
+
+struct Report {
+    unsigned int count;
+    unsigned int bytes;
+    unsigned int errors;
+};
+
+#define MSG_SIZE     512
+#define MSG_COUNT    16384        // 8 МБ сообщениями
+#define GRANT_PAGES  16           // 64 КБ за передачу
+#define GRANT_COUNT  512          // 32 МБ передачами
+#define SMALL_COUNT  4096         // Передачи по одной странице
+
+#define SEND_RETRIES 100000
+
+// Очередь приёмника ограничена: при отказе ждём, пока он её разберёт.
+// Если отказы не кончаются, приёмника больше нет.
+static int send_msg(int tid, const void* data, unsigned int size) {
+    for (int i = 0; i < SEND_RETRIES; i++) {
+        if (syscall(SYS_SEND_MSG, tid, (long)data, size) == 0) return 0;
+        syscall(SYS_YIELD);
+    }
+    return -1;
+}
+
+static int send_grant(int tid, long addr, unsigned int pages, int mode, unsigned int tag) {
+    for (int i = 0; i < SEND_RETRIES; i++) {
+        if (syscall(SYS_SEND_GRANT, tid, addr, pages, mode, tag) == 0) return 0;
+        syscall(SYS_YIELD);
+    }
+    return -1;
+}
+
+static int command(int tid, unsigned int op, unsigned int count, unsigned int bytes) {
+    Command cmd = { op, count, bytes };
+    return send_msg(tid, &cmd, sizeof(cmd));
+}
+
+static Report wait_report() {
+    Report rep = {0, 0, 0};
+    int sender = -1;
+    syscall(SYS_RECV_MSG, (long)&sender, (long)&rep, sizeof(rep));
+    return rep;
+}
+
+static void print_result(const char* name, const Report& rep, unsigned int us) {
+    if (us == 0) us = 1;
+    unsigned int ms = us / 1000;
+    if (ms == 0) ms = 1;
+    printf("  %s: %u KB in %u ms, %u MB/s, %u ops/s", name, rep.bytes / 1024, ms,
+           rep.bytes / us, rep.count * 1000 / ms);
+    if (rep.errors) printf(" [%u ERRORS]", rep.errors);
+    printf("\n");
+}
+
+static void bench_msgs(int sink) {
+    static char buf[MSG_SIZE];
+    memset(buf, 0x5A, sizeof(buf));
+
+    if (command(sink, OP_MSGS, MSG_COUNT, MSG_SIZE) != 0) {
+        printf("[FAIL] IPCSINK.ELF is not running\n");
+        return;
+    }
+    unsigned long long t0 = clock_ns();
+    for (unsigned int i = 0; i < MSG_COUNT; i++) {
+        buf[0] = (char)(i & 0xFF);
+        if (send_msg(sink, buf, MSG_SIZE) != 0) return;
+    }
+    Report rep = wait_report();
+    print_result("copy, 512 B messages ", rep, ns_to_us(clock_ns() - t0));
+}
+
+static void bench_grants(int sink, const char* name, int mode, unsigned int pages,
+                         unsigned int count) {
+    unsigned int len = pages * 4096;
+    long region = syscall(SYS_MMAP, 0, len, 3, 0x22, -1);   // RW, MAP_PRIVATE | MAP_ANONYMOUS
+    if (region == -1) {
+        printf("  %s: mmap failed\n", name);
+        return;
+    }
+
+    if (command(sink, OP_GRANTS, count, len) != 0) {
+        syscall(SYS_MUNMAP, region, len);
+        return;
+    }
+    unsigned long long t0 = clock_ns();
+    for (unsigned int i = 0; i < count; i++) {
+        // После MOVE страницы снова выделяются по обращению, после CoW -
+        // копируются при записи, если приёмник ещё держит их
+        volatile unsigned int* page = (volatile unsigned int*)region;
+        unsigned int tag = i * pages;
+        for (unsigned int p = 0; p < pages; p++) page[p * 1024] = tag + p;
+        if (send_grant(sink, region, pages, mode, tag) != 0) {
+            printf("  %s: grant %u rejected\n", name, i);
+            syscall(SYS_MUNMAP, region, len);
+            return;
+        }
+    }
+    Report rep = wait_report();
+    print_result(name, rep, ns_to_us(clock_ns() - t0));
+    syscall(SYS_MUNMAP, region, len);
+}
+
+int main() {
+    printf("=== IPC THROUGHPUT BENCHMARK ===\n");
+
+    int sink = fork();
+    if (sink < 0) {
+        printf("[FAIL] fork() returned %d\n", sink);
+        return 1;
+    }
+    if (sink == 0) {
+        exec("/IPCSINK.ELF");
+        printf("[FAIL] cannot exec IPCSINK.ELF\n");
+        exit(1);
+    }
+
+    bench_msgs(sink);
+    bench_grants(sink, "grant MOVE, 64 KB     ", IPC_GRANT_MOVE, GRANT_PAGES, GRANT_COUNT);
+    bench_grants(sink, "grant CoW, 64 KB      ", IPC_GRANT_COW, GRANT_PAGES, GRANT_COUNT);
+    bench_grants(sink, "grant MOVE, 4 KB      ", IPC_GRANT_MOVE, 1, SMALL_COUNT);
+
+    command(sink, OP_QUIT, 0, 0);
+    int status = 0;
+    wait(&status);
+
+    printf("=== BENCHMARK COMPLETE ===\n");
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/clock.h>
+
+// Задержка запроса-ответа между двумя процессами: пара сообщений через
+// почтовый ящик (SYS_SEND_MSG / SYS_RECV_MSG) против синхронного вызова
+// SYS_IPC_CALL / SYS_IPC_REPLY_WAIT с прямым переключением на получателя.
+
+#define ROUNDS      16384          // Кратно 1024: циклы считаются в 1024-х
+#define OP_PING     1
+#define OP_SWITCH   2              // Сервер переходит к синхронным вызовам
+#define OP_QUIT     3
+
+static void server() {
+    // Фаза 1: сообщения, ответ - тем же сообщением с увеличенным словом
+    unsigned long msg[4];
+    for (;;) {
+        int sender = -1;
+        if (syscall(SYS_RECV_MSG, (long)&sender, (long)msg, sizeof(msg)) != sizeof(msg)) exit(1);
+        if (msg[0] == OP_SWITCH) break;
+        msg[1]++;
+        syscall(SYS_SEND_MSG, sender, (long)msg, sizeof(msg));
+    }
+
+    // Фаза 2: синхронные вызовы; завершение без ответа вернёт вызвавшему -1
+    long reply_to = -1;
+    for (;;) {
+        long caller = ipc_reply_wait(reply_to, msg);
+        if (caller < 0 || msg[0] == OP_QUIT) exit(0);
+        msg[1]++;
+        reply_to = caller;
+    }
+}
+
+static void report(const char* name, unsigned long long cycles, unsigned int errors) {
+    unsigned int total_k = (unsigned int)(cycles >> 10);
+    printf("  %s: %u cycles per round trip", name, total_k / (ROUNDS / 1024));
+    if (errors) printf(" [%u ERRORS]", errors);
+    printf("\n");
+}
+
+int main() {
+    printf("=== IPC ROUND-TRIP BENCHMARK ===\n");
+    printf("%d round trips, server in a separate process\n", ROUNDS);
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("[FAIL] fork() returned %d\n", pid);
+        return 1;
+    }
+    if (pid == 0) server();
+
+    unsigned long msg[4] = { OP_PING, 0, 0, 0 };
+    unsigned int errors = 0;
+
+    unsigned long long c0 = rdtsc();
+    for (unsigned int i = 0; i < ROUNDS; i++) {
+        msg[0] = OP_PING;
+        msg[1] = i;
+        syscall(SYS_SEND_MSG, pid, (long)msg, sizeof(msg));
+        int sender = -1;
+        syscall(SYS_RECV_MSG, (long)&sender, (long)msg, sizeof(msg));
+        if (msg[1] != i + 1) errors++;
+    }
+    report("mailbox send + recv   ", rdtsc() - c0, errors);
+
+    msg[0] = OP_SWITCH;
+    syscall(SYS_SEND_MSG, pid, (long)msg, sizeof(msg));
+
+    errors = 0;
+    c0 = rdtsc();
+    for (unsigned int i = 0; i < ROUNDS; i++) {
+        msg[0] = OP_PING;
+        msg[1] = i;
+        if (ipc_call(pid, msg) != 0 || msg[1] != i + 1) errors++;
+    }
+    report("ipc_call/reply_wait   ", rdtsc() - c0, errors);
+
+    msg[0] = OP_QUIT;
+    if (ipc_call(pid, msg) != -1) printf("[FAIL] call to exited server succeeded\n");
+    int status = 0;
+    wait(&status);
+
+    printf("=== BENCHMARK COMPLETE ===\n");
+    return 0;
+}
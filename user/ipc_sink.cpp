@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+
+// Приёмная сторона IPCBENCH.ELF: получает команды и данные от процесса,
+// который её запустил, и отвечает итогом каждой фазы.
+
+enum { OP_MSGS = 1, OP_GRANTS = 2, OP_QUIT = 3 };
+
+struct Command {
+    unsigned int op;
+    unsigned int count;
+    unsigned int bytes;     // Размер одного сообщения или передачи
+};
+
+struct Report {
+    unsigned int count;
+    unsigned int bytes;
+    unsigned int errors;
+};
+
+static char msg_buf[512];
+
+static void recv_msgs(const Command& cmd, Report& rep) {
+    for (unsigned int i = 0; i < cmd.count; i++) {
+        int sender = -1;
+        int n = (int)syscall(SYS_RECV_MSG, (long)&sender, (long)msg_buf, sizeof(msg_buf));
+        if (n != (int)cmd.bytes || (unsigned char)msg_buf[0] != (i & 0xFF)) rep.errors++;
+        rep.count++;
+        rep.bytes += n > 0 ? n : 0;
+    }
+}
+
+static void recv_grants(const Command& cmd, Report& rep) {
+    for (unsigned int i = 0; i < cmd.count; i++) {
+        int sender = -1;
+        unsigned int tag = 0, pages = 0;
+        long addr = syscall(SYS_RECV_GRANT, (long)&sender, (long)&tag, (long)&pages);
+        if (addr == -1) {
+            rep.errors++;
+            continue;
+        }
+        // Отправитель помечает каждую страницу номером передачи
+        volatile unsigned int* page = (volatile unsigned int*)addr;
+        for (unsigned int p = 0; p < pages; p++) {
+            if (page[p * 1024] != tag + p) rep.errors++;
+        }
+        syscall(SYS_MUNMAP, addr, (long)(pages * 4096));
+        rep.count++;
+        rep.bytes += pages * 4096;
+    }
+}
+
+int main() {
+    for (;;) {
+        Command cmd;
+        int sender = -1;
+        int n = (int)syscall(SYS_RECV_MSG, (long)&sender, (long)&cmd, sizeof(cmd));
+        if (n != (int)sizeof(cmd) || cmd.op == OP_QUIT) break;
+
+        Report rep = {0, 0, 0};
+        if (cmd.op == OP_MSGS) recv_msgs(cmd, rep);
+        else if (cmd.op == OP_GRANTS) recv_grants(cmd, rep);
+        else rep.errors = 1;
+
+        syscall(SYS_SEND_MSG, sender, (long)&rep, sizeof(rep));
+    }
+    return 0;
+}
@@ -40,6 +40,7 @@ typedef struct {
 
 #define FMODE_READ 1
 #define FMODE_WRITE 2
+#define FMODE_APPEND 3
 
 FILE* fopen(const char* filename, const char* mode);
 int fclose(FILE* stream);
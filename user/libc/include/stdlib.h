@@ -43,6 +43,7 @@ int fork(void);
 int exec(const char* path);
 int execve(const char* path, char* const argv[], char* const envp[]);
 int wait(int* status);
+void sync(void);
 
 #ifdef __cplusplus
 }
@@ -11,6 +11,7 @@ void* memmove(void* dest, const void* src, size_t n);
 void* memset(void* s, int c, size_t n);
 int memcmp(const void* s1, const void* s2, size_t n);
 int memcmp_s(const void* s1, size_t s1max, const void* s2, size_t s2max);
+void* memchr(const void* s, int c, size_t n);
 
 size_t strlen(const char* s);
 size_t strnlen(const char* s, size_t maxlen);
@@ -26,6 +27,13 @@ char* strchr(const char* s, int c);
 char* strrchr(const char* s, int c);
 char* strstr(const char* haystack, const char* needle);
 
+// Выбор реализации memcpy/memset/strlen/memchr: SSE2, если процессор его
+// поддерживает, иначе SWAR. Вызывается из __libc_start_main.
+void __libc_init_string(void);
+// Включить (1) или выключить (0) SSE2-вариант, вернуть прежний режим.
+// Для сравнения вариантов в бенчмарках.
+int __libc_string_sse2(int enable);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <sys/syscall.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Монотонные наносекунды с загрузки (TSC)
+static inline unsigned long long clock_ns(void) {
+    volatile unsigned long long ns = 0;
+    syscall(SYS_CLOCK_NS, (long)&ns);
+    return ns;
+}
+
+// Счётчик тактов процессора
+static inline unsigned long long rdtsc(void) {
+    unsigned int lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+// libgcc не линкуется: нс -> мкс умножением на 2^32/1000
+static inline unsigned int ns_to_us(unsigned long long ns) {
+    return (unsigned int)((ns * 4294967ull) >> 32);
+}
+
+#ifdef __cplusplus
+}
+#endif
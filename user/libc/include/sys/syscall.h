@@ -35,6 +35,20 @@
 #define SYS_WAIT        36
 #define SYS_GRANT_MMIO  37
 #define SYS_SET_DRIVER  38
+#define SYS_SYNC        39
+#define SYS_USLEEP      40
+#define SYS_CLOCK_NS    41
+#define SYS_CPU_COUNT   42
+#define SYS_SEND_GRANT  43
+#define SYS_RECV_GRANT  44
+#define SYS_IPC_CALL    45
+#define SYS_IPC_REPLY_WAIT 46
+#define SYS_MPROTECT    47
+#define SYS_VFORK       48
+
+// Режим SYS_SEND_GRANT
+#define IPC_GRANT_MOVE  0   // Страницы уходят из адресного пространства отправителя
+#define IPC_GRANT_COW   1   // Общие до первой записи
 
 #ifdef __cplusplus
 extern "C" {
@@ -78,6 +92,35 @@ static inline long __syscall5(long n, long a1, long a2, long a3, long a4, long a
     return ret;
 }
 
+// Синхронный вызов SYS_IPC_CALL: msg[0..3] уходят в ECX/EDX/ESI/EDI и
+// заменяются ответом. 0 или -1.
+static inline long ipc_call(long tid, unsigned long msg[4]) {
+    long ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret), "+c"(msg[0]), "+d"(msg[1]), "+S"(msg[2]), "+D"(msg[3])
+                 : "a"(SYS_IPC_CALL), "b"(tid) : "memory");
+    return ret;
+}
+
+// Ответить reply_tid (-1 - некому) и ждать следующего вызова; его слова -
+// в msg. Возвращает TID вызвавшего.
+static inline long ipc_reply_wait(long reply_tid, unsigned long msg[4]) {
+    long ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret), "+c"(msg[0]), "+d"(msg[1]), "+S"(msg[2]), "+D"(msg[3])
+                 : "a"(SYS_IPC_REPLY_WAIT), "b"(reply_tid) : "memory");
+    return ret;
+}
+
+// Потомок исполняется в памяти и на стеке родителя, пока не вызовет exec
+// или exit, родитель до тех пор ждёт. Встраивается в вызывающего: кадра
+// функции, который потомок затёр бы на общем стеке, нет.
+static inline __attribute__((always_inline)) int vfork(void) {
+    long ret;
+    asm volatile("int $0x80" : "=a"(ret) : "a"(SYS_VFORK) : "memory");
+    return (int)ret;
+}
+
 #ifdef __cplusplus
 }
 #endif
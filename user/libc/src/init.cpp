@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 extern "C" {
     extern void (*__init_array_start[])(void) __attribute__((weak));
@@ -26,6 +27,8 @@ extern "C" {
         void (*rtld_fini)(void),
         void* stack_end
     ) {
+        __libc_init_string();
+
         if (argv && argv[0]) {
             __progname = argv[0];
         } else {
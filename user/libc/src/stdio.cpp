@@ -337,10 +337,13 @@ FILE* fopen(const char* filename, const char* mode) {
     int mode_flag = 0;
     if (mode[0] == 'r') mode_flag = FMODE_READ;
     else if (mode[0] == 'w') mode_flag = FMODE_WRITE;
+    else if (mode[0] == 'a') mode_flag = FMODE_APPEND;
     else return nullptr;
 
     long fd = syscall(SYS_FOPEN, (long)filename, (long)mode_flag);
     if (fd == -1) return nullptr;
+    // Дозапись - тот же поток записи, смещение ставит ядро
+    if (mode_flag == FMODE_APPEND) mode_flag = FMODE_WRITE;
 
     FILE* f = (FILE*)malloc(sizeof(FILE));
     if (!f) {
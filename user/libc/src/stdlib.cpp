@@ -141,3 +141,7 @@ int exec(const char* path) {
 int wait(int* status) {
     return (int)syscall(SYS_WAIT, (long)status);
 }
+
+void sync(void) {
+    syscall(SYS_SYNC);
+}
@@ -6,9 +6,14 @@
 #define HAS_ZERO_BYTE(v) (((v) - SWAR_MASK_01) & ~(v) & SWAR_MASK_80)
 #define ALIGN_4(p) (((uint32_t)(p) & 3) == 0)
 
-extern "C" void* memcpy(void* dest, const void* src, size_t n) {
-    if (!dest || !src || n == 0) return dest;
+// Строковые функции в двух вариантах: 32-битный SWAR и SSE2 (по 16 байт).
+// Вариант выбирается при старте (__libc_init_string) по CPUID; ядро
+// сохраняет регистры XMM при переключении потоков.
+#define SSE2_MIN_SIZE 64   // Короче - SWAR: выравнивание дороже выигрыша
 
+static bool use_sse2 = false;
+
+static void* memcpy_swar(void* dest, const void* src, size_t n) {
     uint8_t* d8 = (uint8_t*)dest;
     const uint8_t* s8 = (const uint8_t*)src;
 
@@ -49,8 +54,7 @@ extern "C" void* memmove(void* dest, const void* src, size_t n) {
     return dest;
 }
 
-extern "C" void* memset(void* s, int c, size_t n) {
-    if (!s || n == 0) return s;
+static void* memset_swar(void* s, int c, size_t n) {
 
     uint8_t* p = (uint8_t*)s;
     uint8_t val8 = (uint8_t)c;
@@ -113,8 +117,7 @@ extern "C" int memcmp_s(const void* s1, size_t s1max, const void* s2, size_t s2m
     return memcmp(s1, s2, n);
 }
 
-extern "C" size_t strlen(const char* s) {
-    if (!s) return 0;
+static size_t strlen_swar(const char* s) {
     const char* p = s;
 
     while (!ALIGN_4(p)) {
@@ -136,6 +139,210 @@ extern "C" size_t strlen(const char* s) {
     }
 }
 
+static void* memchr_swar(const void* s, int c, size_t n) {
+    const uint8_t* p = (const uint8_t*)s;
+    uint8_t ch = (uint8_t)c;
+
+    while (n > 0 && !ALIGN_4(p)) {
+        if (*p == ch) return (void*)p;
+        p++;
+        n--;
+    }
+
+    uint32_t pattern = ch * SWAR_MASK_01;
+    const uint32_t* p32 = (const uint32_t*)p;
+    while (n >= 4) {
+        uint32_t v = *p32 ^ pattern;
+        if (HAS_ZERO_BYTE(v)) break;
+        p32++;
+        n -= 4;
+    }
+
+    p = (const uint8_t*)p32;
+    while (n--) {
+        if (*p == ch) return (void*)p;
+        p++;
+    }
+    return nullptr;
+}
+
+// --- SSE2 ---
+// libc собрана без -msse, поэтому компилятор сам XMM-регистры не
+// использует, и ассемблерные вставки берут их без сохранения. Выровненное
+// чтение 16 байт не пересекает границу страницы, поэтому strlen и memchr
+// могут читать блок, начинающийся до s или заканчивающийся за концом строки.
+
+static void* memcpy_sse2(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    // Запись выровнена, чтение - movdqu
+    size_t head = (0u - (uint32_t)d) & 15;
+    n -= head;
+    while (head--) *d++ = *s++;
+
+    size_t blocks = n / 64;
+    if (blocks) {
+        asm volatile(
+            "1:\n\t"
+            "movdqu 0(%1), %%xmm0\n\t"
+            "movdqu 16(%1), %%xmm1\n\t"
+            "movdqu 32(%1), %%xmm2\n\t"
+            "movdqu 48(%1), %%xmm3\n\t"
+            "movdqa %%xmm0, 0(%0)\n\t"
+            "movdqa %%xmm1, 16(%0)\n\t"
+            "movdqa %%xmm2, 32(%0)\n\t"
+            "movdqa %%xmm3, 48(%0)\n\t"
+            "add $64, %1\n\t"
+            "add $64, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(s), "+r"(blocks)
+            :
+            : "memory", "cc");
+    }
+
+    memcpy_swar(d, s, n & 63);
+    return dest;
+}
+
+static void* memset_sse2(void* dest, int c, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    uint8_t val8 = (uint8_t)c;
+
+    size_t head = (0u - (uint32_t)d) & 15;
+    n -= head;
+    while (head--) *d++ = val8;
+
+    uint32_t pattern = val8 * SWAR_MASK_01;
+    size_t blocks = n / 64;
+    if (blocks) {
+        asm volatile(
+            "movd %2, %%xmm0\n\t"
+            "pshufd $0, %%xmm0, %%xmm0\n\t"
+            "1:\n\t"
+            "movdqa %%xmm0, 0(%0)\n\t"
+            "movdqa %%xmm0, 16(%0)\n\t"
+            "movdqa %%xmm0, 32(%0)\n\t"
+            "movdqa %%xmm0, 48(%0)\n\t"
+            "add $64, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(blocks)
+            : "m"(pattern)
+            : "memory", "cc");
+    }
+
+    memset_swar(d, c, n & 63);
+    return dest;
+}
+
+static size_t strlen_sse2(const char* s) {
+    uint32_t off = (uint32_t)s & 15;
+    const char* p = s - off;
+    uint32_t first = 0xFFFFu << off;   // Байты до s не считаются
+    uint32_t mask;
+
+    asm volatile(
+        "pxor %%xmm1, %%xmm1\n\t"
+        "movdqa (%1), %%xmm0\n\t"
+        "pcmpeqb %%xmm1, %%xmm0\n\t"
+        "pmovmskb %%xmm0, %0\n\t"
+        "and %2, %0\n\t"
+        "jnz 2f\n\t"
+        "1:\n\t"
+        "add $16, %1\n\t"
+        "movdqa (%1), %%xmm0\n\t"
+        "pcmpeqb %%xmm1, %%xmm0\n\t"
+        "pmovmskb %%xmm0, %0\n\t"
+        "test %0, %0\n\t"
+        "jz 1b\n\t"
+        "2:"
+        : "=&r"(mask), "+r"(p)
+        : "m"(first)
+        : "memory", "cc");
+
+    return p + __builtin_ctz(mask) - s;
+}
+
+static void* memchr_sse2(const void* s, int c, size_t n) {
+    uint32_t off = (uint32_t)s & 15;
+    const uint8_t* p = (const uint8_t*)s - off;
+    uint32_t first = 0xFFFFu << off;
+    uint32_t pattern = (uint8_t)c * SWAR_MASK_01;
+    // Байт от p, среди которых ищем
+    size_t rem = n + off;
+    if (rem < n) rem = (size_t)-1;
+    uint32_t mask;
+
+    asm volatile(
+        "movd %3, %%xmm1\n\t"
+        "pshufd $0, %%xmm1, %%xmm1\n\t"
+        "movdqa (%1), %%xmm0\n\t"
+        "pcmpeqb %%xmm1, %%xmm0\n\t"
+        "pmovmskb %%xmm0, %0\n\t"
+        "and %4, %0\n\t"
+        "jnz 2f\n\t"
+        "1:\n\t"
+        "cmp $16, %2\n\t"
+        "jbe 2f\n\t"
+        "sub $16, %2\n\t"
+        "add $16, %1\n\t"
+        "movdqa (%1), %%xmm0\n\t"
+        "pcmpeqb %%xmm1, %%xmm0\n\t"
+        "pmovmskb %%xmm0, %0\n\t"
+        "test %0, %0\n\t"
+        "jz 1b\n\t"
+        "2:"
+        : "=&r"(mask), "+r"(p), "+r"(rem)
+        : "m"(pattern), "m"(first)
+        : "memory", "cc");
+
+    if (!mask) return nullptr;
+    uint32_t idx = __builtin_ctz(mask);
+    return idx < rem ? (void*)(p + idx) : nullptr;
+}
+
+static bool cpu_has_sse2() {
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return edx & (1u << 26);
+}
+
+extern "C" void __libc_init_string() {
+    use_sse2 = cpu_has_sse2();
+}
+
+extern "C" int __libc_string_sse2(int enable) {
+    int prev = use_sse2;
+    use_sse2 = enable && cpu_has_sse2();
+    return prev;
+}
+
+extern "C" void* memcpy(void* dest, const void* src, size_t n) {
+    if (!dest || !src || n == 0) return dest;
+    if (use_sse2 && n >= SSE2_MIN_SIZE) return memcpy_sse2(dest, src, n);
+    return memcpy_swar(dest, src, n);
+}
+
+extern "C" void* memset(void* s, int c, size_t n) {
+    if (!s || n == 0) return s;
+    if (use_sse2 && n >= SSE2_MIN_SIZE) return memset_sse2(s, c, n);
+    return memset_swar(s, c, n);
+}
+
+extern "C" size_t strlen(const char* s) {
+    if (!s) return 0;
+    if (use_sse2) return strlen_sse2(s);
+    return strlen_swar(s);
+}
+
+extern "C" void* memchr(const void* s, int c, size_t n) {
+    if (!s || n == 0) return nullptr;
+    if (use_sse2) return memchr_sse2(s, c, n);
+    return memchr_swar(s, c, n);
+}
+
 extern "C" size_t strnlen(const char* s, size_t maxlen) {
     if (!s) return 0;
     size_t len = 0;
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/clock.h>
+
+// Параллельная счётная нагрузка: 1, 2, 4, ... процессов (fork) делают по
+// одинаковому куску работы без системных вызовов. На SMP пользовательский
+// код исполняется параллельно, и время прогона почти не растёт, пока
+// процессов не больше, чем процессоров.
+
+#define WORK_ITERS  20000000u      // Итераций на процесс
+#define MAX_WORKERS 16
+
+static unsigned int burn(unsigned int seed) {
+    unsigned int x = seed;
+    for (unsigned int i = 0; i < WORK_ITERS; i++) {
+        x = x * 1664525u + 1013904223u;
+        x ^= x >> 13;
+    }
+    return x;
+}
+
+// Время прогона n процессов, мкс
+static unsigned int run(int n) {
+    unsigned long long t0 = clock_ns();
+    for (int i = 0; i < n; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("[FAIL] fork() returned %d\n", pid);
+            break;
+        }
+        if (pid == 0) exit((int)(burn((unsigned int)i + 1) & 0x7F));
+    }
+    for (int i = 0; i < n; i++) {
+        int status = 0;
+        if (wait(&status) < 0) break;
+    }
+    return ns_to_us(clock_ns() - t0);
+}
+
+int main() {
+    int cpus = (int)syscall(SYS_CPU_COUNT);
+    if (cpus < 1) cpus = 1;
+    int max_workers = cpus * 2;
+    if (max_workers > MAX_WORKERS) max_workers = MAX_WORKERS;
+
+    printf("=== SMP SCALING BENCHMARK ===\n");
+    printf("CPUs online: %d, %u iterations per worker\n", cpus, WORK_ITERS);
+
+    unsigned int base_ms = 0;
+    for (int n = 1; n <= max_workers; n *= 2) {
+        unsigned int ms = run(n) / 1000;
+        if (ms == 0) ms = 1;
+        if (n == 1) base_ms = ms;
+        // Ускорение = работа n процессов за время одного, x100
+        unsigned int speedup = base_ms * n * 100 / ms;
+        printf("  %d workers: %u ms, speedup %u.%u%u\n", n, ms,
+               speedup / 100, (speedup / 10) % 10, speedup % 10);
+    }
+
+    printf("=== BENCHMARK COMPLETE ===\n");
+    return 0;
+}
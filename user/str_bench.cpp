@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/clock.h>
+
+// Сравнение SWAR- и SSE2-вариантов memcpy/memset/strlen/memchr на блоках
+// 64 Б .. 64 КБ и проверка, что ядро не смешивает состояние FPU/SSE
+// процессов при переключении.
+
+#define BUF_SIZE    65536
+#define TOTAL_BYTES (16u * 1024 * 1024)   // Объём одного замера
+
+static char src_buf[BUF_SIZE + 64] __attribute__((aligned(16)));
+static char dst_buf[BUF_SIZE + 64] __attribute__((aligned(16)));
+
+enum { OP_MEMCPY, OP_MEMSET, OP_STRLEN, OP_MEMCHR, OP_COUNT };
+static const char* op_names[OP_COUNT] = { "memcpy", "memset", "strlen", "memchr" };
+
+// Пропускная способность, МБ/с (байт за мкс)
+static unsigned int measure(int op, unsigned int size) {
+    unsigned int iters = TOTAL_BYTES / size;
+    volatile unsigned int sink = 0;
+
+    // Строка длины size для strlen, искомый байт в конце для memchr
+    memset(src_buf, 'a', size);
+    src_buf[size] = '\0';
+    src_buf[size - 1] = 'z';
+
+    unsigned long long t0 = clock_ns();
+    for (unsigned int i = 0; i < iters; i++) {
+        switch (op) {
+        case OP_MEMCPY: memcpy(dst_buf, src_buf, size); break;
+        case OP_MEMSET: memset(dst_buf, (int)i, size); break;
+        case OP_STRLEN: sink += strlen(src_buf); break;
+        case OP_MEMCHR: sink += (unsigned int)memchr(src_buf, 'z', size); break;
+        }
+    }
+    unsigned int us = ns_to_us(clock_ns() - t0);
+    if (us == 0) us = 1;
+    return iters * size / us;
+}
+
+// x87 и SSE в нескольких процессах одновременно: при переключении без
+// сохранения состояния результат разошёлся бы с посчитанным заранее
+static double fpu_work(int seed) {
+    double x = 1.0 + seed;
+    for (int i = 0; i < 200000; i++) {
+        x = x * 1.0000001 + 0.5 / (x + i);
+        if ((i & 0x3FFF) == 0) syscall(SYS_YIELD);
+    }
+    return x;
+}
+
+static void fpu_isolation_test() {
+    const int workers = 4;
+    double expected[workers];
+    for (int i = 0; i < workers; i++) expected[i] = fpu_work(i);
+
+    for (int i = 0; i < workers; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("[FAIL] fork() returned %d\n", pid);
+            return;
+        }
+        if (pid == 0) {
+            double r = fpu_work(i);
+            // SSE-копия в каждом процессе тоже ходит через XMM-регистры
+            char local[256];
+            memset(local, 'a' + i, sizeof(local));
+            int ok = r == expected[i] && memchr(local, 'a' + i, sizeof(local)) == local;
+            exit(ok ? 0 : 1);
+        }
+    }
+
+    int failed = 0;
+    for (int i = 0; i < workers; i++) {
+        int status = 0;
+        if (wait(&status) < 0) break;
+        if (status != 0) failed++;
+    }
+    if (failed) printf("[FAIL] FPU state corrupted in %d of %d processes\n", failed, workers);
+    else printf("[OK] FPU state preserved across %d concurrent processes\n", workers);
+}
+
+int main() {
+    static const unsigned int sizes[] = { 64, 1024, 16384, 65536 };
+
+    printf("=== LIBC STRING BENCHMARK ===\n");
+    int sse2 = __libc_string_sse2(1);
+    printf("SSE2 by default: %s\n", sse2 ? "yes" : "no (SWAR only)");
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        printf("%s:\n", op_names[op]);
+        for (int s = 0; s < 4; s++) {
+            __libc_string_sse2(0);
+            unsigned int swar = measure(op, sizes[s]);
+            if (swar == 0) swar = 1;
+            printf("  %u B: SWAR %u MB/s", sizes[s], swar);
+            if (sse2) {
+                __libc_string_sse2(1);
+                unsigned int vec = measure(op, sizes[s]);
+                printf(", SSE2 %u MB/s (x%u.%u)", vec, vec / swar,
+                       (vec * 10 / swar) % 10);
+            }
+            printf("\n");
+        }
+    }
+    __libc_string_sse2(sse2);
+
+    fpu_isolation_test();
+
+    printf("=== BENCHMARK COMPLETE ===\n");
+    return 0;
+}
@@ -38,6 +38,19 @@ typedef uint32_t size_t;
 #define SYS_WAIT        36
 #define SYS_GRANT_MMIO  37
 #define SYS_SET_DRIVER  38
+#define SYS_SYNC        39
+#define SYS_USLEEP      40
+#define SYS_CLOCK_NS    41
+#define SYS_CPU_COUNT   42
+#define SYS_SEND_GRANT  43
+#define SYS_RECV_GRANT  44
+#define SYS_IPC_CALL    45
+#define SYS_IPC_REPLY_WAIT 46
+#define SYS_MPROTECT    47
+#define SYS_VFORK       48
+
+#define IPC_GRANT_MOVE  0   // Страницы уходят из адресного пространства отправителя
+#define IPC_GRANT_COW   1   // Общие до первой записи
 
 static inline uint32_t syscall0(uint32_t num) {
     uint32_t ret;
@@ -63,6 +76,14 @@ static inline uint32_t syscall3(uint32_t num, uint32_t arg1, uint32_t arg2, uint
     return ret;
 }
 
+static inline uint32_t syscall5(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                                uint32_t arg4, uint32_t arg5) {
+    uint32_t ret;
+    asm volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(arg1), "c"(arg2), "d"(arg3),
+                 "S"(arg4), "D"(arg5) : "memory");
+    return ret;
+}
+
 static inline void sys_exit(void) {
     syscall0(SYS_EXIT);
 }
@@ -91,6 +112,22 @@ static inline uint32_t sys_time(void) {
     return syscall0(SYS_TIME);
 }
 
+// Сон с точностью до события таймера (LAPIC one-shot), а не тика 10 мс
+static inline void sys_usleep(uint32_t us) {
+    syscall1(SYS_USLEEP, us);
+}
+
+// Монотонные наносекунды с загрузки (TSC)
+static inline uint64_t sys_clock_ns(void) {
+    volatile uint64_t ns = 0;   // Пишет ядро: у syscall1 нет clobber "memory"
+    syscall1(SYS_CLOCK_NS, (uint32_t)&ns);
+    return ns;
+}
+
+static inline uint32_t sys_cpu_count(void) {
+    return syscall0(SYS_CPU_COUNT);
+}
+
 static inline uint8_t sys_inb(uint16_t port) {
     return (uint8_t)syscall1(SYS_INB, (uint32_t)port);
 }
@@ -119,6 +156,39 @@ static inline int sys_recv_msg(int* sender_tid_out, void* buffer, uint32_t max_s
     return (int)syscall3(SYS_RECV_MSG, (uint32_t)sender_tid_out, (uint32_t)buffer, max_size);
 }
 
+// Передать pages страниц с адреса addr (выровнен на 4 КБ) без копирования
+static inline int sys_send_grant(int target_tid, void* addr, uint32_t pages,
+                                 uint32_t mode, uint32_t tag) {
+    return (int)syscall5(SYS_SEND_GRANT, (uint32_t)target_tid, (uint32_t)addr, pages, mode, tag);
+}
+
+// Дождаться передачи; страницы освобождаются munmap. nullptr - ошибка.
+static inline void* sys_recv_grant(int* sender_tid_out, uint32_t* tag_out, uint32_t* pages_out) {
+    uint32_t addr = syscall3(SYS_RECV_GRANT, (uint32_t)sender_tid_out, (uint32_t)tag_out,
+                             (uint32_t)pages_out);
+    return addr == (uint32_t)-1 ? nullptr : (void*)addr;
+}
+
+// Синхронный вызов: четыре слова msg уходят потоку target_tid в регистрах
+// и заменяются его ответом. 0 или -1.
+static inline int sys_ipc_call(int target_tid, uint32_t msg[4]) {
+    uint32_t ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret), "+c"(msg[0]), "+d"(msg[1]), "+S"(msg[2]), "+D"(msg[3])
+                 : "a"(SYS_IPC_CALL), "b"((uint32_t)target_tid) : "memory");
+    return (int)ret;
+}
+
+// Ответить reply_tid (-1 - некому) словами msg и ждать следующего вызова:
+// его слова - в msg, возвращается TID вызвавшего
+static inline int sys_ipc_reply_wait(int reply_tid, uint32_t msg[4]) {
+    uint32_t ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret), "+c"(msg[0]), "+d"(msg[1]), "+S"(msg[2]), "+D"(msg[3])
+                 : "a"(SYS_IPC_REPLY_WAIT), "b"((uint32_t)reply_tid) : "memory");
+    return (int)ret;
+}
+
 static inline bool sys_read_sector(uint32_t lba, void* buffer) {
     return syscall2(SYS_READ_SECTOR, lba, (uint32_t)buffer) != 0;
 }
@@ -159,6 +229,13 @@ static inline int sys_fork(void) {
     return (int)syscall0(SYS_FORK);
 }
 
+// Только exec или exit в потомке: до них он на стеке родителя
+static inline __attribute__((always_inline)) int sys_vfork(void) {
+    uint32_t ret;
+    asm volatile("int $0x80" : "=a"(ret) : "a"(SYS_VFORK) : "memory");
+    return (int)ret;
+}
+
 static inline int sys_exec(const char* path, char* const* argv, char* const* envp) {
     return (int)syscall3(SYS_EXEC, (uint32_t)path, (uint32_t)argv, (uint32_t)envp);
 }
@@ -175,6 +252,10 @@ static inline int sys_set_driver(int target_tid) {
     return (int)syscall1(SYS_SET_DRIVER, (uint32_t)target_tid);
 }
 
+static inline int sys_sync() {
+    return (int)syscall0(SYS_SYNC);
+}
+
 static inline void print(const char* s) {
     uint32_t len = 0;
     while (s[len]) len++;
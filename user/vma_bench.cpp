@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/clock.h>
+
+// Дерево VMA под нагрузкой: mprotect через страницу делит одну область
+// на PAGES областей, mmap без адреса ищет свободное место среди них,
+// mprotect всего диапазона сливает области обратно, munmap середины
+// делит надвое. Время - в тактах на вызов; содержимое страниц проверяется.
+
+#define PAGES       1024
+#define HOLES       256            // Двухстраничных mmap среди областей
+#define PROT_R      1
+#define PROT_RW     3
+#define MAP_ANON    0x22           // MAP_PRIVATE | MAP_ANONYMOUS
+
+static void report(const char* name, unsigned long long cycles, unsigned int calls) {
+    printf("  %s: %u cycles per call\n", name, (unsigned int)cycles / calls);
+}
+
+static unsigned int fail_count = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("  [FAIL] %s\n", what);
+        fail_count++;
+    }
+}
+
+static unsigned int* page_word(long base, unsigned int page) {
+    return (unsigned int*)(base + page * 4096);
+}
+
+int main() {
+    printf("=== VMA TREE BENCHMARK ===\n");
+    printf("%d pages split into %d areas, %d two-page mmaps among them\n", PAGES, PAGES, HOLES);
+
+    long base = syscall(SYS_MMAP, 0, PAGES * 4096, PROT_RW, MAP_ANON, -1);
+    if (base == -1) {
+        printf("[FAIL] mmap of %d pages failed\n", PAGES);
+        return 1;
+    }
+    for (unsigned int i = 0; i < PAGES; i++) *page_word(base, i) = i * 7 + 1;
+
+    // Каждая нечётная страница - только чтение: каждый вызов делит область
+    unsigned long long c0 = rdtsc();
+    for (unsigned int i = 1; i < PAGES; i += 2) {
+        check(syscall(SYS_MPROTECT, base + i * 4096, 4096, PROT_R) == 0, "mprotect split");
+    }
+    report("mprotect, split area  ", rdtsc() - c0, PAGES / 2);
+
+    // Промежутков в две страницы внутри диапазона нет - поиск должен
+    // пропустить все его области
+    static long extra[HOLES];
+    c0 = rdtsc();
+    for (unsigned int i = 0; i < HOLES; i++) {
+        extra[i] = syscall(SYS_MMAP, 0, 2 * 4096, PROT_RW, MAP_ANON, -1);
+    }
+    report("mmap, free-range search", rdtsc() - c0, HOLES);
+    for (unsigned int i = 0; i < HOLES; i++) {
+        check(extra[i] != -1, "mmap among areas");
+        check(extra[i] + 2 * 4096 <= base || extra[i] >= base + PAGES * 4096,
+              "mmap overlaps existing area");
+    }
+    c0 = rdtsc();
+    for (unsigned int i = 0; i < HOLES; i++) {
+        if (extra[i] != -1) syscall(SYS_MUNMAP, extra[i], 2 * 4096);
+    }
+    report("munmap, whole area    ", rdtsc() - c0, HOLES);
+
+    // Весь диапазон снова на запись: области сливаются в одну
+    c0 = rdtsc();
+    check(syscall(SYS_MPROTECT, base, PAGES * 4096, PROT_RW) == 0, "mprotect merge");
+    report("mprotect, merge areas ", rdtsc() - c0, 1);
+    for (unsigned int i = 0; i < PAGES; i++) {
+        check(*page_word(base, i) == i * 7 + 1, "page contents after mprotect");
+        *page_word(base, i) += 1;
+    }
+
+    // Середина уходит: область делится на две, края сохраняют данные
+    check(syscall(SYS_MUNMAP, base + (PAGES / 4) * 4096, (PAGES / 2) * 4096) == 0, "munmap split");
+    check(syscall(SYS_MPROTECT, base, PAGES * 4096, PROT_RW) == -1,
+          "mprotect over unmapped hole succeeded");
+    for (unsigned int i = 0; i < PAGES; i++) {
+        if (i >= PAGES / 4 && i < PAGES / 4 * 3) continue;
+        check(*page_word(base, i) == i * 7 + 2, "page contents after munmap");
+    }
+    syscall(SYS_MUNMAP, base, PAGES * 4096);
+
+    if (fail_count) printf("[FAIL] %u checks failed\n", fail_count);
+    else printf("[ OK ] contents and layout checks passed\n");
+    printf("=== BENCHMARK COMPLETE ===\n");
+    return 0;
+}